@@ -500,9 +500,10 @@ void ods_obj_iter_pos_init(ods_obj_iter_pos_t pos);
  * If the the <tt>pos</tt> argument is not NULL, it should be
  * initialized with the ods_obj_iter_pos_init() funuction. The
  * <tt>pos</tt> argument will updated with the location of the next
- * object in the store when ods_obj_iter() returns. This facilitates
- * walking through a portion of the objects at a time, continuing
- * later where the function left off.
+ * object in the store when ods_obj_iter() returns. If the callback
+ * stopped the iteration, this is the object for which it returned
+ * !0. This facilitates walking through a portion of the objects at a
+ * time, continuing later where the function left off.
  *
  * The ods_obj_iter_fn_t() function indicates that the iteration
  * should stop by returning !0. Otherwise, the ods_obj_iter() function
@@ -518,6 +519,53 @@ void ods_obj_iter_pos_init(ods_obj_iter_pos_t pos);
  */
 int ods_obj_iter(ods_t ods, ods_obj_iter_pos_t pos, ods_obj_iter_fn_t iter_fn, void *arg);
 
+/**
+ * \brief Iterate over the objects in a range of the ODS
+ *
+ * Like ods_obj_iter(), but stops at the page given by <tt>end</tt>
+ * instead of at the end of the store. If <tt>end</tt> is NULL, the
+ * iteration continues to the end of the store. The <tt>pos</tt> and
+ * <tt>end</tt> values are normally obtained from
+ * ods_obj_iter_split().
+ *
+ * Iterators over disjoint ranges may run concurrently in different
+ * threads as long as no objects are allocated or deleted in the ODS
+ * while they run.
+ *
+ * \param ods		The ODS handle
+ * \param pos		The object iterator position
+ * \param end		The position at which to stop or NULL
+ * \param iter_fn	Pointer to the function to call
+ * \param arg		A void* argument passed to the callback function
+ * \retval 0		All objects in the range were iterated through
+ * \retval !0		A callback returned !0
+ */
+int ods_obj_iter_range(ods_t ods, ods_obj_iter_pos_t pos, ods_obj_iter_pos_t end,
+		       ods_obj_iter_fn_t iter_fn, void *arg);
+
+/**
+ * \brief Divide the ODS into ranges for ods_obj_iter_range()
+ *
+ * Splits the allocated pages of the ODS into at most <tt>count</tt>
+ * ranges of about the same number of pages. Range <tt>i</tt> begins at
+ * <tt>pos[i]</tt> and ends at <tt>pos[i+1]</tt>, so the <tt>pos</tt>
+ * array must have room for <tt>count + 1</tt> entries. Range
+ * boundaries always fall on the start of an allocation.
+ *
+ * \param ods	The ODS handle
+ * \param pos	Array of at least count + 1 positions
+ * \param count	The maximum number of ranges
+ * \returns The number of ranges
+ */
+int ods_obj_iter_split(ods_t ods, ods_obj_iter_pos_t pos, int count);
+
+/**
+ * \brief Return the number of objects in use
+ *
+ * \param ods	The ODS handle
+ * \returns The number of objects obtained from the ODS that have not
+ *          been released with ods_obj_put()
+ */
 ods_atomic_t ods_obj_count(ods_t ods);
 
 /*
@@ -372,6 +372,38 @@ typedef struct ods_comp_key_s {	/* overloads the ods_key_value_t */
 } *ods_comp_key_t;
 #pragma pack()
 
+/**
+ * \brief Encode a compound key in an order preserving form
+ *
+ * Converts a key in the ods_comp_key_t layout to a byte string whose
+ * memcmp() order is the same as the order of the compound key.
+ * Integers are stored big-endian with the sign bit flipped for signed
+ * types, floating point values have their bits adjusted so that the
+ * ordering of the bit pattern matches the ordering of the value, and
+ * strings and arrays are escaped and terminated so that a prefix
+ * sorts before any longer value.
+ *
+ * The encoded key may be up to twice the length of \c src.
+ *
+ * \param dst	The destination key
+ * \param src	The compound key
+ * \retval 0	The key was encoded
+ * \retval E2BIG	\c dst is too small
+ * \retval EINVAL	\c src contains a component type that cannot be encoded
+ */
+int ods_comp_key_encode(ods_key_t dst, ods_key_t src);
+
+/**
+ * \brief Decode a key encoded with ods_comp_key_encode()
+ *
+ * \param dst	The destination key in the ods_comp_key_t layout
+ * \param src	The encoded key
+ * \retval 0	The key was decoded
+ * \retval E2BIG	\c dst is too small
+ * \retval EINVAL	\c src is not a valid encoded key
+ */
+int ods_comp_key_decode(ods_key_t dst, ods_key_t src);
+
 /**
  * \brief Create an key in the ODS store
  *
@@ -498,6 +530,9 @@ const char *ods_key_to_str(ods_idx_t idx, ods_key_t key, char *buf, size_t len);
 /**
  * \brief Compare two keys using the index's compare function
  *
+ * If a key cannot be converted to the form stored in the index,
+ * errno is set and that key compares less than the other.
+ *
  * \param idx	The index handle
  * \param a	The first key
  * \param b	The second key
@@ -666,6 +701,25 @@ int ods_idx_min(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *idx_data);
  */
 int ods_idx_max(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *idx_data);
 
+/**
+ * \brief Return keys that split the index into ranges
+ *
+ * Fills <tt>keys</tt> with up to <tt>*count</tt> keys in ascending
+ * order that partition the key space into ranges holding roughly
+ * the same number of entries. The first range is all keys less
+ * than keys[0], the last is all keys greater than or equal to the
+ * last key returned. The keys are taken from the index structure,
+ * so no entries are visited. The caller must ods_obj_put() each key.
+ *
+ * \param idx The index handle
+ * \param keys Array of at least <tt>*count</tt> keys
+ * \param count On entry the number of keys requested, on exit the
+ *	number of keys returned, which may be fewer or 0
+ * \retval 0 Success
+ * \retval ENOSYS The index type does not support splitting
+ */
+int ods_idx_split(ods_idx_t idx, ods_key_t *keys, int *count);
+
 /**
  * \brief Update the data value associated with a key in the index
  *
@@ -704,6 +758,42 @@ int ods_idx_update(ods_idx_t idx, ods_key_t key, ods_idx_data_t data);
  */
 int ods_idx_delete(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data);
 
+/**
+ * \brief Callback for ods_idx_delete_range()
+ *
+ * Return 0 to accept the value for deletion, any other value to stop
+ * the deletion before the value's key.
+ */
+typedef int (*ods_range_cb_fn_t)(ods_idx_t idx, ods_idx_data_t *data, void *arg);
+
+/**
+ * \brief Delete all keys in a range from the index
+ *
+ * Deletes every key <tt>k</tt> where lo <= k <= hi together with all
+ * of its values. Subtrees that fall entirely inside the range are
+ * freed in bulk rather than a key at a time.
+ *
+ * If <tt>cb_fn</tt> is not NULL, it is called for the values in the
+ * range in key order before anything is deleted and with the index
+ * locked. Deletion stops before the first key that has a value for
+ * which <tt>cb_fn</tt> returns !0; the keys before it are deleted
+ * and ECANCELED is returned. This lets the caller check that it
+ * owns the entries it removes, or bound the work done per call.
+ *
+ * \param idx	The index handle
+ * \param lo	The smallest key to delete
+ * \param hi	The largest key to delete
+ * \param cb_fn	Optional callback to accept each value
+ * \param arg	Passed to cb_fn
+ * \param count	If not NULL, set to the number of values deleted
+ * \retval 0	All keys in the range were deleted
+ * \retval ECANCELED	cb_fn stopped the deletion
+ * \retval EPERM	The index is not open for write
+ * \retval ENOSYS	The index type does not support range deletes
+ */
+int ods_idx_delete_range(ods_idx_t idx, ods_key_t lo, ods_key_t hi,
+			 ods_range_cb_fn_t cb_fn, void *arg, uint64_t *count);
+
 /**
  * \brief Find the specified key
  *
@@ -754,13 +844,17 @@ typedef struct ods_idx_stat_s {
 	uint64_t cardinality;
 	uint64_t duplicates;
 	uint64_t size;
+	uint64_t depth;		/* Levels in the tree, 0 if not a tree */
+	uint64_t node_size;	/* Bytes per tree node */
+	double fill_factor;	/* Fraction of the node capacity in use */
 } *ods_idx_stat_t;
 
 /**
  * \brief Get index statistics
  *
  * Queries index statistics and returns them in the provided
- * statistics buffer.
+ * statistics buffer. The depth, node_size and fill_factor fields
+ * are zero for index types that do not report them.
  *
  * \param idx The index handle
  * \param sb Pointer to the idx_stat buffer
@@ -1008,6 +1102,36 @@ int ods_iter_prev(ods_iter_t iter);
  */
 ods_key_t ods_iter_key(ods_iter_t iter);
 
+/**
+ * \brief Compare the key at the cursor position with a key
+ *
+ * The comparison is made against the key as stored in the index, so
+ * the key at the cursor is not converted to the application form.
+ *
+ * \param iter	The iterator handle
+ * \param key	The key
+ * \return <0	The cursor key < key, the cursor is not positioned, or
+ *		the key cannot be converted to the stored form (errno is set)
+ * \return 0	The cursor key == key
+ * \return >0	The cursor key > key
+ */
+int64_t ods_iter_key_cmp(ods_iter_t iter, ods_key_t key);
+
+/**
+ * \brief Compare the keys at the cursor positions of two iterators
+ *
+ * The iterators must be on indices of the same type and key
+ * class. An iterator that is not positioned compares less than one
+ * that is.
+ *
+ * \param a	The first iterator handle
+ * \param b	The second iterator handle
+ * \return <0	a < b
+ * \return 0	a == b
+ * \return >0	a > b
+ */
+int64_t ods_iter_cmp(ods_iter_t a, ods_iter_t b);
+
 /**
  * \brief Returns the data associated with current cursor position
  *
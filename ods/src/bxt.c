@@ -126,6 +126,9 @@ void dump_leaf(bxt_t t, ods_idx_t idx, ods_obj_t n, int ent, int indent, FILE *f
 				(void *)*(unsigned long *)&REC(rec)->value.bytes[8],
 				(void *)(unsigned long)REC(rec)->prev_ref,
 				(void *)(unsigned long)REC(rec)->next_ref);
+			if (fp && BXT_POSTING(t) && REC(rec)->dup_ref)
+				fprintf(fp, "%*sdup_ref %p\n", indent+16, "",
+					(void *)(unsigned long)REC(rec)->dup_ref);
 			free(keystr);
 			if (head == tail)
 				break;
@@ -178,10 +181,13 @@ static void print_info(ods_idx_t idx, FILE *fp)
 {
 	bxt_t t = idx->priv;
 	fprintf(fp, "%*s : %d\n", 12, "Order", t->udata->order);
+	fprintf(fp, "%*s : %zu\n", 12, "Node Size", BXT_NODE_SIZE(t->udata->order));
 	fprintf(fp, "%*s : %lx\n", 12, "Root Ref", t->udata->root_ref);
 	fprintf(fp, "%*s : %d\n", 12, "Depth", t->udata->depth);
 	fprintf(fp, "%*s : %d\n", 12, "Cardinality", t->udata->card);
 	fprintf(fp, "%*s : %d\n", 12, "Duplicates", t->udata->dups);
+	fprintf(fp, "%*s : %s\n", 12, "Dup Format",
+		BXT_POSTING(t) ? "posting list" : "record chain");
 	fflush(fp);
 }
 
@@ -231,6 +237,47 @@ static int verify_record(bxt_t t, ods_obj_t rec, FILE *fp)
 	return rc;
 }
 
+static int verify_dups(bxt_t t, ods_obj_t rec, FILE *fp)
+{
+	ods_ref_t prev_ref, last_ref, ref = REC(rec)->dup_ref;
+	ods_obj_t page;
+	int rc = 0;
+
+	if (!ref)
+		return 0;
+	page = ods_ref_as_obj(t->ods, ref);
+	if (!page) {
+		fprintf(fp, "The record %p's posting list %p is invalid.\n",
+			(void *)rec->ref, (void *)ref);
+		return 1;
+	}
+	last_ref = DUPS(page)->prev_ref;
+	prev_ref = 0;
+	while (page) {
+		if (!DUPS(page)->count || DUPS(page)->count > DUPS(page)->size) {
+			fprintf(fp, "The posting page %p has a bad count %d/%d.\n",
+				(void *)page->ref, DUPS(page)->count, DUPS(page)->size);
+			rc = 1;
+		}
+		if (prev_ref && DUPS(page)->prev_ref != prev_ref) {
+			fprintf(fp, "The posting page %p's prev pointer %p should be %p.\n",
+				(void *)page->ref, (void *)DUPS(page)->prev_ref,
+				(void *)prev_ref);
+			rc = 1;
+		}
+		prev_ref = page->ref;
+		ref = DUPS(page)->next_ref;
+		ods_obj_put(page);
+		page = ods_ref_as_obj(t->ods, ref);
+	}
+	if (prev_ref != last_ref) {
+		fprintf(fp, "The record %p's last posting page %p should be %p.\n",
+			(void *)rec->ref, (void *)last_ref, (void *)prev_ref);
+		rc = 1;
+	}
+	return rc;
+}
+
 static int verify_leaf(bxt_t t, ods_obj_t l, int is_root, FILE *fp)
 {
 	int i, j, rc = 0;
@@ -280,6 +327,15 @@ static int verify_leaf(bxt_t t, ods_obj_t l, int is_root, FILE *fp)
 			continue;
 		}
 		rc |= verify_record(t, rec, fp);
+		if (BXT_POSTING(t)) {
+			if (L_ENT(l, i).tail_ref != rec_ref) {
+				fprintf(fp, "Leaf %p entry %d tail_ref %p should equal head_ref %p\n",
+					(void *)l->ref, i, (void *)L_ENT(l, i).tail_ref,
+					(void *)rec_ref);
+				rc = 1;
+			}
+			rc |= verify_dups(t, rec, fp);
+		}
 		ods_obj_put(rec);
 	}
 	return rc;
@@ -394,6 +450,7 @@ static int bxt_open(ods_idx_t idx)
 	t->udata = UDATA(udata);
 	t->ods = idx->ods;
 	t->comparator = idx->idx_class->cmp->compare_fn;
+	t->key_class = ods_key_class(idx->idx_class->cmp);
 	idx->priv = t;
 	return 0;
 }
@@ -423,31 +480,40 @@ static void __int_unlock(bxt_t t)
 		return ods_unlock(t->ods, 0);
 }
 
+/*
+ * The ORDER=<n> argument sets the number of entries in a node. The
+ * NODE_SIZE=<bytes> argument sets the order to the number of entries
+ * that fit in a node of that size. Nodes are page sized by default.
+ * POSTING=0 keeps duplicates in record chains, the format of indices
+ * created by earlier versions.
+ */
 static int bxt_init(ods_t ods, const char *idx_type, const char *key_type, const char *argp)
 {
-	char order_arg[ODS_IDX_ARGS_LEN];
 	ods_obj_t udata;
-	char *name;
-	int order = 0;
+	size_t node_size;
+	int order;
+
+	order = ods_idx_arg_int(argp, "ORDER", 0);
+	if (!order) {
+		node_size = ods_idx_arg_int(argp, "NODE_SIZE", 0);
+		if (!node_size)
+			node_size = BXT_DEF_NODE_SIZE;
+		if (node_size < BXT_MIN_NODE_SIZE || node_size > BXT_MAX_NODE_SIZE)
+			return EINVAL;
+		order = BXT_NODE_ORDER(node_size);
+	}
 
 	udata = ods_get_user_data(ods);
 	if (!udata)
 		return EINVAL;
 
-	if (argp) {
-		strcpy(order_arg, argp);
-		name = strtok(order_arg, "=");
-		if (name && (0 == strcasecmp(name, "ORDER")))
-			order = strtoul(strtok(NULL, "="), NULL, 0);
-	}
-	if (order <= 0)
-		order = 5;
-
 	UDATA(udata)->order = order;
 	UDATA(udata)->root_ref = 0;
 	UDATA(udata)->depth = 0;
 	UDATA(udata)->card = 0;
 	UDATA(udata)->dups = 0;
+	UDATA(udata)->flags =
+		(ods_idx_arg_int(argp, "POSTING", 1) ? BXT_F_POSTING : 0);
 	ods_obj_put(udata);
 	return 0;
 }
@@ -500,16 +566,20 @@ ods_obj_t leaf_find(bxt_t t, ods_key_t key)
 	n = ods_ref_as_obj(t->ods, t->udata->root_ref);
 	while (!NODE(n)->is_leaf) {
 		int64_t rc;
+		int hi = NODE(n)->count;
 		depth += 1;
-		for (i = 1; i < NODE(n)->count; i++) {
+		/* Find the first entry whose key is greater than key */
+		i = 1;
+		while (i < hi) {
+			int mid = (i + hi) >> 1;
 			ods_obj_t entry_key =
-				ods_ref_as_obj(t->ods, N_ENT(n,i).key_ref);
-			rc = t->comparator(key, entry_key);
+				ods_ref_as_obj(t->ods, N_ENT(n,mid).key_ref);
+			rc = BXT_KEY_CMP(t, key, entry_key);
 			ods_obj_put(entry_key);
 			if (rc >= 0)
-				continue;
+				i = mid + 1;
 			else
-				break;
+				hi = mid;
 		}
 		ref = N_ENT(n,i-1).node_ref;
 		ods_obj_put(n);
@@ -536,7 +606,7 @@ static ods_obj_t rec_find(bxt_t t, ods_key_t key, int first)
 			ref = L_ENT(leaf,i).tail_ref;
 		rec = ods_ref_as_obj(t->ods, ref);
 		entry_key = ods_ref_as_obj(t->ods, REC(rec)->key_ref);
-		rc = t->comparator(key, entry_key);
+		rc = BXT_KEY_CMP(t, key, entry_key);
 		ods_obj_put(entry_key);
 		if (!rc)
 			goto found;
@@ -663,41 +733,26 @@ static ods_obj_t __find_lub(ods_idx_t idx, ods_key_t key,
 			    ods_iter_flags_t flags,
 			    uint32_t *ent)
 {
-	int i;
-	ods_ref_t head_ref = 0;
-	ods_ref_t tail_ref = 0;
+	int i, found;
 	ods_ref_t next_ref;
+	ods_ref_t tail_ref;
 	bxt_t t = idx->priv;
 	ods_obj_t leaf = leaf_find(t, key);
 	ods_obj_t rec = NULL;
 	if (!leaf)
 		return NULL;
-	for (i = 0; i < NODE(leaf)->count; i++) {
-		tail_ref = L_ENT(leaf,i).tail_ref;
-		head_ref = L_ENT(leaf,i).head_ref;
-		if (rec)
-			ods_obj_put(rec);
-		rec = ods_ref_as_obj(t->ods, head_ref);
-		ods_key_t entry_key =
-			ods_ref_as_obj(t->ods, REC(rec)->key_ref);
-		int64_t rc = t->comparator(key, entry_key);
-		ods_obj_put(entry_key);
-		if (rc <= 0) {
-			if ((flags & ODS_ITER_F_LUB_LAST_DUP)
-			    && (tail_ref != head_ref)) {
-				/* user wants last-dup,  swap head for tail */
-				ods_obj_put(rec);
-				rec = ods_ref_as_obj(t->ods, tail_ref);
-			}
-			goto found;
-		}
+	i = find_key_idx(t, leaf, key, &found);
+	if (i < NODE(leaf)->count) {
+		if (flags & ODS_ITER_F_LUB_LAST_DUP)
+			/* user wants last-dup, use the tail */
+			rec = ods_ref_as_obj(t->ods, L_ENT(leaf,i).tail_ref);
+		else
+			rec = ods_ref_as_obj(t->ods, L_ENT(leaf,i).head_ref);
+		goto found;
 	}
 	/* Our LUB is the first record in the right sibling */
-	if (tail_ref != head_ref) {
-		ods_obj_put(rec);
-		rec = ods_ref_as_obj(t->ods, tail_ref);
-		assert(rec);
-	}
+	rec = ods_ref_as_obj(t->ods, L_ENT(leaf,i-1).tail_ref);
+	assert(rec);
 
 	next_ref = REC(rec)->next_ref;
 	ods_obj_put(rec);
@@ -753,7 +808,7 @@ static ods_obj_t __find_glb(ods_idx_t idx, ods_key_t key,
 			    ods_iter_flags_t flags,
 			    uint32_t *ent)
 {
-	int i = 0;
+	int i = 0, found;
 	bxt_t t = idx->priv;
 	ods_obj_t leaf = leaf_find(t, key);
 	ods_obj_t rec = NULL;
@@ -761,23 +816,18 @@ static ods_obj_t __find_glb(ods_idx_t idx, ods_key_t key,
 	if (!leaf)
 		goto out;
 
-	for (i = NODE(leaf)->count - 1; i >= 0; i--) {
-		if (flags & ODS_ITER_F_GLB_LAST_DUP)
-			rec = ods_ref_as_obj(t->ods, L_ENT(leaf,i).tail_ref);
-		else
-			rec = ods_ref_as_obj(t->ods, L_ENT(leaf,i).head_ref);
-		ods_key_t entry_key =
-			ods_ref_as_obj(t->ods, REC(rec)->key_ref);
-		int64_t rc = t->comparator(key, entry_key);
-		ods_obj_put(entry_key);
-		if (rc < 0) {
-			ods_obj_put(rec);
-			continue;
-		}
-		goto out;
+	/* The GLB is the last entry whose key is <= key */
+	i = find_key_idx(t, leaf, key, &found);
+	if (!found)
+		i--;
+	if (i < 0) {
+		ods_obj_put(leaf);
+		return NULL;
 	}
-	ods_obj_put(leaf);
-	return NULL;
+	if (flags & ODS_ITER_F_GLB_LAST_DUP)
+		rec = ods_ref_as_obj(t->ods, L_ENT(leaf,i).tail_ref);
+	else
+		rec = ods_ref_as_obj(t->ods, L_ENT(leaf,i).head_ref);
  out:
 	if (ent)
 		*ent = i;
@@ -844,8 +894,7 @@ static void free_el(bxt_t t, struct bxt_obj_el *el)
 static struct bxt_obj_el *node_alloc(bxt_t t)
 {
 	struct bxt_obj_el *el = alloc_el(t);
-	size_t sz = sizeof(struct bxt_node) +
-		(t->udata->order * sizeof(struct bxn_entry));
+	size_t sz = BXT_NODE_SIZE(t->udata->order);
 	if (!el)
 		return NULL;
 	el->obj = ods_obj_alloc_extend(t->ods, sz, BXT_EXTEND_SIZE);
@@ -898,15 +947,16 @@ static ods_obj_t node_new(ods_idx_t idx, bxt_t t, bxt_udata_t udata, int cache)
 
 static ods_obj_t rec_new(ods_idx_t idx, ods_key_t key, ods_idx_data_t data, int is_dup)
 {
+	bxt_t t = idx->priv;
 	ods_obj_t obj;
 	bxn_record_t rec;
 
-	obj = ods_obj_alloc_extend(idx->ods, sizeof(struct bxn_record), BXT_EXTEND_SIZE);
+	obj = ods_obj_alloc_extend(idx->ods, BXT_REC_SIZE(t), BXT_EXTEND_SIZE);
 	if (!obj)
 		goto err_0;
 
 	rec = obj->as.ptr;
-	memset(rec, 0, sizeof(struct bxn_record));
+	memset(rec, 0, BXT_REC_SIZE(t));
 	if (is_dup == 0) {
 		/* Allocate space for the key */
 		ods_key_t akey = key_new(idx, key);
@@ -933,6 +983,168 @@ static void rec_del(ods_obj_t obj, int is_dup)
 	ods_obj_delete(obj);
 }
 
+/*
+ * Allocate a posting list page twice the size of the previous page,
+ * bounded by BXT_DUPS_MIN_SZ and BXT_DUPS_MAX_SZ.
+ */
+static ods_obj_t dups_new(bxt_t t, size_t prev_sz)
+{
+	size_t sz = BXT_DUPS_MIN_SZ;
+	ods_obj_t obj;
+
+	while (sz <= prev_sz && sz < BXT_DUPS_MAX_SZ)
+		sz <<= 1;
+	obj = ods_obj_alloc_extend(t->ods, sz, BXT_EXTEND_SIZE);
+	if (!obj)
+		return NULL;
+	DUPS(obj)->next_ref = 0;
+	DUPS(obj)->prev_ref = ods_obj_ref(obj);
+	DUPS(obj)->count = 0;
+	DUPS(obj)->size = (sz - sizeof(struct bxn_dups)) / sizeof(ods_idx_data_t);
+	return obj;
+}
+
+/*
+ * Append a value to the end of the record's posting list
+ */
+static int dups_append(bxt_t t, ods_obj_t rec, ods_idx_data_t data)
+{
+	ods_obj_t first, last, page;
+	size_t sz;
+
+	first = ods_ref_as_obj(t->ods, REC(rec)->dup_ref);
+	if (!first) {
+		first = dups_new(t, 0);
+		if (!first)
+			return ENOMEM;
+		REC(rec)->dup_ref = ods_obj_ref(first);
+	}
+	last = ods_ref_as_obj(t->ods, DUPS(first)->prev_ref);
+	if (DUPS(last)->count == DUPS(last)->size) {
+		sz = sizeof(struct bxn_dups)
+			+ (DUPS(last)->size * sizeof(ods_idx_data_t));
+		page = dups_new(t, sz);
+		if (!page) {
+			ods_obj_put(last);
+			ods_obj_put(first);
+			return ENOMEM;
+		}
+		DUPS(page)->prev_ref = ods_obj_ref(last);
+		DUPS(last)->next_ref = ods_obj_ref(page);
+		DUPS(first)->prev_ref = ods_obj_ref(page);
+		ods_obj_put(last);
+		last = page;
+	}
+	DUPS(last)->data[DUPS(last)->count++] = data;
+	ods_obj_put(last);
+	ods_obj_put(first);
+	return 0;
+}
+
+/*
+ * Remove the value at index ent in a posting list page. The page is
+ * unlinked and deleted if it becomes empty; the caller still owns
+ * the reference on page.
+ */
+static void dups_remove(bxt_t t, ods_obj_t rec, ods_obj_t page, uint32_t ent)
+{
+	ods_obj_t first, prev, next;
+
+	DUPS(page)->count--;
+	memmove(&DUPS(page)->data[ent], &DUPS(page)->data[ent+1],
+		(DUPS(page)->count - ent) * sizeof(ods_idx_data_t));
+	if (DUPS(page)->count)
+		return;
+
+	next = ods_ref_as_obj(t->ods, DUPS(page)->next_ref);
+	if (ods_obj_ref(page) == REC(rec)->dup_ref) {
+		REC(rec)->dup_ref = DUPS(page)->next_ref;
+		if (next)
+			DUPS(next)->prev_ref = DUPS(page)->prev_ref;
+	} else {
+		first = ods_ref_as_obj(t->ods, REC(rec)->dup_ref);
+		prev = ods_ref_as_obj(t->ods, DUPS(page)->prev_ref);
+		DUPS(prev)->next_ref = DUPS(page)->next_ref;
+		if (next)
+			DUPS(next)->prev_ref = DUPS(page)->prev_ref;
+		else
+			DUPS(first)->prev_ref = DUPS(page)->prev_ref;
+		ods_obj_put(prev);
+		ods_obj_put(first);
+	}
+	ods_obj_put(next);
+	ods_obj_delete(page);
+}
+
+/*
+ * Find the posting list page and index that contain data
+ */
+static ods_obj_t dups_find(bxt_t t, ods_obj_t rec, ods_idx_data_t *data,
+			   uint32_t *ent)
+{
+	ods_obj_t page = ods_ref_as_obj(t->ods, REC(rec)->dup_ref);
+	ods_ref_t next_ref;
+	uint32_t i;
+
+	while (page) {
+		for (i = 0; i < DUPS(page)->count; i++) {
+			if (ods_idx_data_equal(&DUPS(page)->data[i], data)) {
+				*ent = i;
+				return page;
+			}
+		}
+		next_ref = DUPS(page)->next_ref;
+		ods_obj_put(page);
+		page = ods_ref_as_obj(t->ods, next_ref);
+	}
+	return NULL;
+}
+
+/*
+ * Delete one value of a key that has duplicates. If data is null,
+ * the first value is deleted and returned in data. The first
+ * duplicate is promoted to the record value when the record value is
+ * deleted.
+ */
+static int dups_delete(bxt_t t, ods_obj_t rec, ods_idx_data_t *data)
+{
+	ods_obj_t page;
+	uint32_t ent;
+
+	if (ods_idx_data_null(data)
+	    || ods_idx_data_equal(&REC(rec)->value, data)) {
+		*data = REC(rec)->value;
+		page = ods_ref_as_obj(t->ods, REC(rec)->dup_ref);
+		REC(rec)->value = DUPS(page)->data[0];
+		ent = 0;
+	} else {
+		page = dups_find(t, rec, data, &ent);
+		if (!page)
+			return ENOENT;
+	}
+	dups_remove(t, rec, page, ent);
+	ods_obj_put(page);
+	return 0;
+}
+
+/*
+ * Return the value of the last duplicate of the record's key
+ */
+static ods_idx_data_t rec_last_value(bxt_t t, ods_obj_t rec)
+{
+	ods_idx_data_t data = REC(rec)->value;
+	ods_obj_t first, last;
+
+	if (!BXT_POSTING(t) || !REC(rec)->dup_ref)
+		return data;
+	first = ods_ref_as_obj(t->ods, REC(rec)->dup_ref);
+	last = ods_ref_as_obj(t->ods, DUPS(first)->prev_ref);
+	data = DUPS(last)->data[DUPS(last)->count - 1];
+	ods_obj_put(last);
+	ods_obj_put(first);
+	return data;
+}
+
 static struct bxn_entry ENTRY_INITIALIZER = {
 	.u.leaf = { 0, 0 }
 };
@@ -948,23 +1160,33 @@ static int find_ref_idx(ods_obj_t node, ods_ref_t ref)
 	return i;
 }
 
+/*
+ * Return the index of the first leaf entry whose key is greater than
+ * or equal to key. The leaf keys are unique.
+ */
 static int find_key_idx(bxt_t t, ods_obj_t leaf, ods_key_t key, int *found)
 {
-	int64_t rc = ENOENT;
-	int i;
+	int64_t rc;
+	int i = 0, hi = NODE(leaf)->count;
 	assert(NODE(leaf)->is_leaf);
-	for (i = 0; i < NODE(leaf)->count; i++) {
+	*found = 0;
+	while (i < hi) {
+		int mid = (i + hi) >> 1;
 		ods_obj_t rec =
-			ods_ref_as_obj(t->ods, L_ENT(leaf,i).head_ref);
+			ods_ref_as_obj(t->ods, L_ENT(leaf,mid).head_ref);
 		ods_key_t entry_key =
 			ods_ref_as_obj(t->ods, REC(rec)->key_ref);
-		rc = t->comparator(key, entry_key);
+		rc = BXT_KEY_CMP(t, key, entry_key);
 		ods_obj_put(entry_key);
 		ods_obj_put(rec);
-		if (rc <= 0)
-			break;
+		if (rc > 0) {
+			i = mid + 1;
+		} else {
+			hi = mid;
+			if (!rc)
+				*found = 1;
+		}
 	}
-	*found = (rc == 0);
 	return i;
 }
 
@@ -1047,9 +1269,9 @@ int leaf_insert(bxt_t t, ods_obj_t leaf, ods_obj_t new_rec, int ent, int dup)
 		if (next)
 			next_key = ods_ref_as_obj(t->ods, REC(next)->key_ref);
 		if (prev_key)
-			assert(t->comparator(prev_key, rec_key) <= 0);
+			assert(BXT_KEY_CMP(t, prev_key, rec_key) <= 0);
 		if (next_key)
-			assert(t->comparator(next_key, rec_key) >= 0);
+			assert(BXT_KEY_CMP(t, next_key, rec_key) >= 0);
 		ods_obj_put(prev_key);
 		ods_obj_put(next_key);
 		ods_obj_put(next);
@@ -1372,6 +1594,18 @@ static int bxt_insert_with_leaf(ods_idx_t idx, ods_key_t new_key, ods_idx_data_t
 		ods_obj_put(new_rec);
 		return 0;
 	}
+	if (is_dup && BXT_POSTING(t)) {
+		/* Append the value to the key's posting list */
+		ods_obj_t rec = ods_ref_as_obj(t->ods, L_ENT(leaf,ent).head_ref);
+		int rc = dups_append(t, rec, data);
+		ods_obj_put(rec);
+		ods_obj_put(leaf);
+		if (rc)
+			return rc;
+		ods_atomic_inc(&t->udata->dups);
+		ods_atomic_inc(&t->udata->card);
+		return 0;
+	}
 	/* Allocate a record object */
 	new_rec = rec_new(idx, new_key, data, is_dup);
 	if (!new_rec)
@@ -1547,7 +1781,7 @@ static int bxt_max(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data)
 		rec = ods_ref_as_obj(t->ods, L_ENT(node, NODE(node)->count-1).tail_ref);
 		if (rec) {
 			if (data)
-				*data = REC(rec)->value;
+				*data = rec_last_value(t, rec);
 			if (key)
 				*key = ods_ref_as_obj(t->ods, REC(rec)->key_ref);
 		} else
@@ -1587,6 +1821,97 @@ static int bxt_min(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data)
 	return rc;
 }
 
+/*
+ * Return up to *count keys that split the index into ranges holding
+ * roughly the same number of leaves. The tree is expanded a level at
+ * a time until a level has more nodes than keys requested; the lower
+ * bound of each node at that level is the separator stored in its
+ * parent, and evenly spaced ones are returned in ascending order.
+ */
+static int bxt_split(ods_idx_t idx, ods_key_t *keys, int *count)
+{
+	bxt_t t = idx->priv;
+	ods_ref_t *level, *bound, *next, *next_bound;
+	int want = *count;
+	int level_cnt, next_cnt, i, j, k, n;
+	ods_obj_t node;
+	ods_key_t key;
+	int rc;
+
+	*count = 0;
+	if (want <= 0)
+		return 0;
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	rc = ENOMEM;
+	level = malloc(2 * sizeof(ods_ref_t));
+	if (!level)
+		goto out;
+	bound = &level[1];
+	level[0] = t->udata->root_ref;
+	bound[0] = 0;
+	level_cnt = level[0] ? 1 : 0;
+	while (level_cnt && level_cnt <= want) {
+		node = ods_ref_as_obj(t->ods, level[0]);
+		if (!node)
+			goto err;
+		n = NODE(node)->is_leaf;
+		ods_obj_put(node);
+		if (n)
+			break;
+		next = malloc(2 * sizeof(ods_ref_t) * level_cnt * t->udata->order);
+		if (!next)
+			goto err;
+		next_bound = &next[level_cnt * t->udata->order];
+		next_cnt = 0;
+		for (i = 0; i < level_cnt; i++) {
+			node = ods_ref_as_obj(t->ods, level[i]);
+			if (!node) {
+				free(next);
+				goto err;
+			}
+			for (j = 0; j < NODE(node)->count; j++) {
+				next[next_cnt] = N_ENT(node,j).node_ref;
+				next_bound[next_cnt] = j ? N_ENT(node,j).key_ref : bound[i];
+				next_cnt++;
+			}
+			ods_obj_put(node);
+		}
+		free(level);
+		level = next;
+		bound = next_bound;
+		level_cnt = next_cnt;
+	}
+	if (want > level_cnt - 1)
+		want = level_cnt - 1;
+	for (i = n = 0; i < want; i++) {
+		k = ((i + 1) * level_cnt) / (want + 1);
+		key = ods_ref_as_obj(t->ods, bound[k]);
+		if (!key)
+			break;
+		if (n && BXT_KEY_CMP(t, keys[n-1], key) >= 0) {
+			ods_obj_put(key);
+			continue;
+		}
+		/* The separator may be freed once the tree is unlocked */
+		keys[n] = ods_key_malloc(ods_key_len(key));
+		if (keys[n])
+			ods_key_copy(keys[n], key);
+		ods_obj_put(key);
+		if (!keys[n])
+			break;
+		n++;
+	}
+	*count = n;
+	rc = 0;
+ err:
+	free(level);
+ out:
+	__int_unlock(t);
+	return rc;
+}
+
 static ods_obj_t left_sibling(bxt_t t, ods_obj_t node)
 {
 	int idx = 0;
@@ -1860,7 +2185,11 @@ static void merge_from_right(bxt_t t, ods_obj_t right, ods_obj_t node, int midpo
 	fixup_parents(t, parent, right);
 }
 
-static ods_ref_t entry_delete(bxt_t t, ods_obj_t node, ods_obj_t rec, int ent)
+/*
+ * Remove entry ent from node and rebalance the tree. Drops the
+ * reference on node and returns the new root.
+ */
+static ods_ref_t node_entry_delete(bxt_t t, ods_obj_t node, int ent)
 {
 	int i, midpoint;
 	ods_obj_t left, right;
@@ -1868,18 +2197,6 @@ static ods_ref_t entry_delete(bxt_t t, ods_obj_t node, ods_obj_t rec, int ent)
 	int node_idx;
 	int count;
 
-	assert(NODE(node)->is_leaf);
-	/* Fix up next and prev pointers in record list */
-	ods_obj_t next_rec = ods_ref_as_obj(t->ods, REC(rec)->next_ref);
-	ods_obj_t prev_rec = ods_ref_as_obj(t->ods, REC(rec)->prev_ref);
-	if (prev_rec)
-		REC(prev_rec)->next_ref = REC(rec)->next_ref;
-	if (next_rec)
-		REC(next_rec)->prev_ref = REC(rec)->prev_ref;
-	ods_obj_put(next_rec);
-	ods_obj_put(prev_rec);
-	rec_del(rec, 0);
-
  next_level:
 	parent = ods_ref_as_obj(t->ods, NODE(node)->parent);
 #ifdef ODS_DEBUG
@@ -2010,6 +2327,23 @@ static ods_ref_t entry_delete(bxt_t t, ods_obj_t node, ods_obj_t rec, int ent)
 	goto next_level;
 }
 
+static ods_ref_t entry_delete(bxt_t t, ods_obj_t node, ods_obj_t rec, int ent)
+{
+	assert(NODE(node)->is_leaf);
+	/* Fix up next and prev pointers in record list */
+	ods_obj_t next_rec = ods_ref_as_obj(t->ods, REC(rec)->next_ref);
+	ods_obj_t prev_rec = ods_ref_as_obj(t->ods, REC(rec)->prev_ref);
+	if (prev_rec)
+		REC(prev_rec)->next_ref = REC(rec)->next_ref;
+	if (next_rec)
+		REC(next_rec)->prev_ref = REC(rec)->prev_ref;
+	ods_obj_put(next_rec);
+	ods_obj_put(prev_rec);
+	rec_del(rec, 0);
+
+	return node_entry_delete(t, node, ent);
+}
+
 static void delete_head(bxt_t t, ods_obj_t leaf, int ent)
 {
 	ods_obj_t rec = ods_ref_as_obj(t->ods, L_ENT(leaf,ent).head_ref);
@@ -2080,6 +2414,20 @@ static int bxt_delete_with_leaf(ods_idx_t idx,
 {
 	bxt_t t = idx->priv;
 	ods_obj_t rec;
+	if (BXT_POSTING(t)) {
+		rec = ods_ref_as_obj(t->ods, L_ENT(leaf, ent).head_ref);
+		if (REC(rec)->dup_ref) {
+			int rc = dups_delete(t, rec, data);
+			if (!rc) {
+				ods_atomic_dec(&t->udata->dups);
+				ods_atomic_dec(&t->udata->card);
+			}
+			ods_obj_put(rec);
+			ods_obj_put(leaf);
+			return rc;
+		}
+		ods_obj_put(rec);
+	}
 	/*
 	 * Trivial case is that this is a dup key. In this case,
 	 * delete the first entry on the list and return
@@ -2108,7 +2456,6 @@ static int bxt_delete_with_leaf(ods_idx_t idx,
 	assert(rec);
 	*data = REC(rec)->value;
 	t->udata->root_ref = entry_delete(t, leaf, rec, ent);
-	ods_obj_delete(key);
 	ods_obj_put(rec);
 	ods_atomic_dec(&t->udata->card);
 	return 0;
@@ -2141,15 +2488,486 @@ static int bxt_delete(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data)
 	return ENOENT;
 }
 
+/*
+ * Return the smallest (max == 0) or largest key in a subtree. The
+ * caller must put the key.
+ */
+static ods_key_t subtree_key(bxt_t t, ods_ref_t root, int max)
+{
+	ods_obj_t leaf, rec;
+	ods_key_t key;
+	int ent = 0;
+
+	if (max) {
+		leaf = max_in_subtree(t, root);
+		ent = NODE(leaf)->count - 1;
+	} else {
+		leaf = min_in_subtree(t, root);
+	}
+	rec = ods_ref_as_obj(t->ods, L_ENT(leaf,ent).head_ref);
+	key = ods_ref_as_obj(t->ods, REC(rec)->key_ref);
+	ods_obj_put(rec);
+	ods_obj_put(leaf);
+	return key;
+}
+
+/* Return !0 if every key in the subtree is in [lo, hi] */
+static int subtree_in_range(bxt_t t, ods_ref_t root, ods_key_t lo, ods_key_t hi)
+{
+	ods_key_t key;
+	int64_t rc;
+
+	key = subtree_key(t, root, 0);
+	rc = BXT_KEY_CMP(t, key, lo);
+	ods_obj_put(key);
+	if (rc < 0)
+		return 0;
+	key = subtree_key(t, root, 1);
+	rc = BXT_KEY_CMP(t, key, hi);
+	ods_obj_put(key);
+	return rc <= 0;
+}
+
+/* Return the entry of the internal node n whose subtree would hold key */
+static int child_idx(bxt_t t, ods_obj_t n, ods_key_t key)
+{
+	int64_t rc;
+	int i = 1, hi = NODE(n)->count;
+
+	while (i < hi) {
+		int mid = (i + hi) >> 1;
+		ods_obj_t entry_key =
+			ods_ref_as_obj(t->ods, N_ENT(n,mid).key_ref);
+		rc = BXT_KEY_CMP(t, key, entry_key);
+		ods_obj_put(entry_key);
+		if (rc >= 0)
+			i = mid + 1;
+		else
+			hi = mid;
+	}
+	return i - 1;
+}
+
+/*
+ * Search below the internal node for a subtree whose keys are all
+ * in [lo, hi]. Returns the subtree's parent and sets *ent to its
+ * entry, or returns NULL if every subtree that intersects the range
+ * also holds keys outside it. Drops the reference on node.
+ */
+static ods_obj_t range_subtree_find(bxt_t t, ods_obj_t node,
+				    ods_key_t lo, ods_key_t hi, int *ent)
+{
+	ods_obj_t child, parent;
+	int i, i_lo, i_hi;
+
+	i_lo = child_idx(t, node, lo);
+	i_hi = child_idx(t, node, hi);
+	if (i_hi - i_lo > 1) {
+		/* The subtrees between the two bounds are in range */
+		*ent = i_lo + 1;
+		return node;
+	}
+	for (i = i_lo; i <= i_hi; i++) {
+		if (subtree_in_range(t, N_ENT(node,i).node_ref, lo, hi)) {
+			*ent = i;
+			return node;
+		}
+	}
+	for (i = i_lo; i <= i_hi; i++) {
+		child = ods_ref_as_obj(t->ods, N_ENT(node,i).node_ref);
+		if (NODE(child)->is_leaf) {
+			ods_obj_put(child);
+			break;
+		}
+		parent = range_subtree_find(t, child, lo, hi, ent);
+		if (parent) {
+			ods_obj_put(node);
+			return parent;
+		}
+	}
+	ods_obj_put(node);
+	return NULL;
+}
+
+/*
+ * Free the records and posting list of the key whose records run
+ * from head_ref to tail_ref. Returns the number of values freed.
+ */
+static uint64_t key_free(bxt_t t, ods_ref_t head_ref, ods_ref_t tail_ref)
+{
+	ods_ref_t rec_ref, next_ref, page_ref;
+	ods_obj_t rec, page;
+	uint64_t count = 0;
+
+	for (rec_ref = head_ref; ; rec_ref = next_ref) {
+		rec = ods_ref_as_obj(t->ods, rec_ref);
+		/* Records of trees without posting lists have no dup_ref */
+		page_ref = BXT_POSTING(t) ? REC(rec)->dup_ref : 0;
+		while (page_ref) {
+			page = ods_ref_as_obj(t->ods, page_ref);
+			count += DUPS(page)->count;
+			page_ref = DUPS(page)->next_ref;
+			ods_obj_delete(page);
+			ods_obj_put(page);
+		}
+		next_ref = REC(rec)->next_ref;
+		/* The duplicates share the head record's key */
+		rec_del(rec, rec_ref != head_ref);
+		ods_obj_put(rec);
+		count++;
+		if (rec_ref == tail_ref)
+			break;
+	}
+	return count;
+}
+
+/*
+ * Free the nodes, records and keys of a subtree that is no longer
+ * linked into the tree. Returns the number of values freed and adds
+ * the number of keys to *keys.
+ */
+static uint64_t subtree_free(bxt_t t, ods_ref_t root, uint64_t *keys)
+{
+	ods_obj_t node = ods_ref_as_obj(t->ods, root);
+	uint64_t count = 0;
+	int i;
+
+	for (i = 0; i < NODE(node)->count; i++) {
+		if (NODE(node)->is_leaf)
+			count += key_free(t, L_ENT(node,i).head_ref,
+					  L_ENT(node,i).tail_ref);
+		else
+			count += subtree_free(t, N_ENT(node,i).node_ref, keys);
+	}
+	if (NODE(node)->is_leaf)
+		*keys += NODE(node)->count;
+	ods_obj_delete(node);
+	ods_obj_put(node);
+	return count;
+}
+
+/*
+ * Delete the subtree at entry ent of parent, or the whole tree if
+ * parent is NULL. The subtree's records are contiguous in the record
+ * list, so they are spliced out in one step and the subtree is
+ * removed from its parent with a single rebalance. Drops the
+ * reference on parent.
+ */
+static void range_subtree_delete(bxt_t t, ods_obj_t parent, int ent,
+				 uint64_t *count)
+{
+	ods_ref_t root = t->udata->root_ref;
+	ods_obj_t leaf, first, last, rec;
+	uint64_t values, keys = 0;
+
+	if (parent)
+		root = N_ENT(parent,ent).node_ref;
+	leaf = min_in_subtree(t, root);
+	first = ods_ref_as_obj(t->ods, L_ENT(leaf,0).head_ref);
+	ods_obj_put(leaf);
+	leaf = max_in_subtree(t, root);
+	last = ods_ref_as_obj(t->ods, L_ENT(leaf,NODE(leaf)->count-1).tail_ref);
+	ods_obj_put(leaf);
+	rec = ods_ref_as_obj(t->ods, REC(first)->prev_ref);
+	if (rec) {
+		REC(rec)->next_ref = REC(last)->next_ref;
+		ods_obj_put(rec);
+	}
+	rec = ods_ref_as_obj(t->ods, REC(last)->next_ref);
+	if (rec) {
+		REC(rec)->prev_ref = REC(first)->prev_ref;
+		ods_obj_put(rec);
+	}
+	ods_obj_put(first);
+	ods_obj_put(last);
+
+	values = subtree_free(t, root, &keys);
+	ods_atomic_sub(&t->udata->card, values);
+	ods_atomic_sub(&t->udata->dups, values - keys);
+	*count += values;
+	if (parent)
+		t->udata->root_ref = node_entry_delete(t, parent, ent);
+	else
+		t->udata->root_ref = 0;
+}
+
+/*
+ * Delete the first key in [lo, hi] and all of its values. Returns
+ * ENOENT if there is no such key.
+ */
+static int range_key_delete(bxt_t t, ods_key_t lo, ods_key_t hi,
+			    uint64_t *count)
+{
+	ods_obj_t leaf, right, rec, page;
+	ods_ref_t page_ref;
+	ods_key_t key;
+	uint64_t values = 1;
+	int ent, found;
+	int64_t rc;
+
+	leaf = leaf_find(t, lo);
+	if (!leaf)
+		return ENOENT;
+	ent = find_key_idx(t, leaf, lo, &found);
+	if (ent == NODE(leaf)->count) {
+		/* The key is the first in the right sibling */
+		right = right_sibling(t, leaf);
+		ods_obj_put(leaf);
+		if (!right)
+			return ENOENT;
+		leaf = right;
+		ent = 0;
+	}
+	rec = ods_ref_as_obj(t->ods, L_ENT(leaf,ent).head_ref);
+	key = ods_ref_as_obj(t->ods, REC(rec)->key_ref);
+	rc = BXT_KEY_CMP(t, key, hi);
+	ods_obj_put(key);
+	if (rc > 0) {
+		ods_obj_put(rec);
+		ods_obj_put(leaf);
+		return ENOENT;
+	}
+	if (BXT_POSTING(t)) {
+		page_ref = REC(rec)->dup_ref;
+		while (page_ref) {
+			page = ods_ref_as_obj(t->ods, page_ref);
+			values += DUPS(page)->count;
+			page_ref = DUPS(page)->next_ref;
+			ods_obj_delete(page);
+			ods_obj_put(page);
+		}
+		REC(rec)->dup_ref = 0;
+	}
+	ods_obj_put(rec);
+	while (L_ENT(leaf,ent).head_ref != L_ENT(leaf,ent).tail_ref) {
+		delete_head(t, leaf, ent);
+		values++;
+	}
+	rec = ods_ref_as_obj(t->ods, L_ENT(leaf,ent).head_ref);
+	t->udata->root_ref = entry_delete(t, leaf, rec, ent);
+	ods_obj_put(rec);
+	ods_atomic_sub(&t->udata->card, values);
+	ods_atomic_sub(&t->udata->dups, values - 1);
+	*count += values;
+	return 0;
+}
+
+/*
+ * Offer the values of the keys in [lo, hi] to cb_fn in order. On
+ * return *last is a copy of the last key all of whose values were
+ * accepted, or NULL if there is none.
+ */
+static int range_check(ods_idx_t idx, ods_key_t lo, ods_key_t hi,
+		       ods_range_cb_fn_t cb_fn, void *arg, ods_key_t *last)
+{
+	bxt_t t = idx->priv;
+	ods_ref_t key_ref = 0, next_ref, page_ref;
+	ods_obj_t rec, page;
+	ods_idx_data_t data;
+	ods_key_t key;
+	uint32_t i;
+	int rc = 0;
+
+	*last = NULL;
+	rec = __find_lub(idx, lo, 0, NULL);
+	while (rec) {
+		if (REC(rec)->key_ref != key_ref) {
+			key = ods_ref_as_obj(t->ods, REC(rec)->key_ref);
+			if (BXT_KEY_CMP(t, key, hi) > 0) {
+				ods_obj_put(key);
+				break;
+			}
+			ods_obj_put(key);
+			/* All of the previous key's values were accepted */
+			ods_obj_put(*last);
+			*last = NULL;
+			if (key_ref) {
+				key = ods_ref_as_obj(t->ods, key_ref);
+				*last = ods_key_malloc(ods_key_len(key));
+				if (*last)
+					ods_key_copy(*last, key);
+				ods_obj_put(key);
+				if (!*last) {
+					rc = ENOMEM;
+					goto out;
+				}
+			}
+			key_ref = REC(rec)->key_ref;
+		}
+		data = REC(rec)->value;
+		if (cb_fn(idx, &data, arg))
+			goto cancel;
+		page_ref = BXT_POSTING(t) ? REC(rec)->dup_ref : 0;
+		while (page_ref) {
+			page = ods_ref_as_obj(t->ods, page_ref);
+			for (i = 0; i < DUPS(page)->count; i++) {
+				data = DUPS(page)->data[i];
+				if (cb_fn(idx, &data, arg)) {
+					ods_obj_put(page);
+					goto cancel;
+				}
+			}
+			page_ref = DUPS(page)->next_ref;
+			ods_obj_put(page);
+		}
+		next_ref = REC(rec)->next_ref;
+		ods_obj_put(rec);
+		rec = ods_ref_as_obj(t->ods, next_ref);
+	}
+	/* The current key was accepted in full */
+	ods_obj_put(rec);
+	if (key_ref) {
+		ods_obj_put(*last);
+		key = ods_ref_as_obj(t->ods, key_ref);
+		*last = ods_key_malloc(ods_key_len(key));
+		if (*last)
+			ods_key_copy(*last, key);
+		else
+			rc = ENOMEM;
+		ods_obj_put(key);
+	}
+	return rc;
+ cancel:
+	rc = ECANCELED;
+ out:
+	ods_obj_put(rec);
+	return rc;
+}
+
+static int bxt_delete_range(ods_idx_t idx, ods_key_t lo, ods_key_t hi,
+			    ods_range_cb_fn_t cb_fn, void *arg, uint64_t *count)
+{
+	bxt_t t = idx->priv;
+	ods_key_t last = NULL;
+	ods_obj_t root, parent;
+	int ent, rc;
+
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	if (!t->udata->root_ref || BXT_KEY_CMP(t, lo, hi) > 0)
+		goto out;
+	if (cb_fn) {
+		rc = range_check(idx, lo, hi, cb_fn, arg, &last);
+		if (!last)
+			goto out;
+		hi = last;
+	}
+	while (t->udata->root_ref) {
+		if (subtree_in_range(t, t->udata->root_ref, lo, hi)) {
+			range_subtree_delete(t, NULL, 0, count);
+			break;
+		}
+		root = ods_ref_as_obj(t->ods, t->udata->root_ref);
+		if (!NODE(root)->is_leaf) {
+			parent = range_subtree_find(t, root, lo, hi, &ent);
+			if (parent) {
+				range_subtree_delete(t, parent, ent, count);
+				continue;
+			}
+		} else {
+			ods_obj_put(root);
+		}
+		/* What remains in range shares leaves with keys outside it */
+		if (range_key_delete(t, lo, hi, count))
+			break;
+	}
+	ods_obj_put(last);
+ out:
+	__int_unlock(t);
+	return rc;
+}
+
 static ods_iter_t bxt_iter_new(ods_idx_t idx)
 {
 	bxt_iter_t iter = calloc(1, sizeof *iter);
 	return (struct ods_iter *)iter;
 }
 
+static void iter_dups_reset(bxt_iter_t i)
+{
+	if (i->dups)
+		ods_obj_put(i->dups);
+	i->dups = NULL;
+	i->dup = 0;
+}
+
+/*
+ * Position the iterator at the last duplicate of its record
+ */
+static void iter_dups_last(bxt_iter_t i)
+{
+	bxt_t t = i->iter.idx->priv;
+	ods_obj_t first;
+
+	iter_dups_reset(i);
+	if (!i->rec || !BXT_POSTING(t) || !REC(i->rec)->dup_ref)
+		return;
+	first = ods_ref_as_obj(t->ods, REC(i->rec)->dup_ref);
+	i->dups = ods_ref_as_obj(t->ods, DUPS(first)->prev_ref);
+	i->dup = DUPS(i->dups)->count - 1;
+	ods_obj_put(first);
+}
+
+/*
+ * Advance the iterator in its record's posting list. Returns ENOENT
+ * if the iterator is at the last duplicate of the key.
+ */
+static int iter_dups_next(bxt_iter_t i)
+{
+	bxt_t t = i->iter.idx->priv;
+	ods_obj_t page;
+
+	if (!BXT_POSTING(t))
+		return ENOENT;
+	if (!i->dups) {
+		i->dups = ods_ref_as_obj(t->ods, REC(i->rec)->dup_ref);
+		i->dup = 0;
+		return i->dups ? 0 : ENOENT;
+	}
+	if (i->dup + 1 < DUPS(i->dups)->count) {
+		i->dup++;
+		return 0;
+	}
+	page = ods_ref_as_obj(t->ods, DUPS(i->dups)->next_ref);
+	if (!page)
+		return ENOENT;
+	ods_obj_put(i->dups);
+	i->dups = page;
+	i->dup = 0;
+	return 0;
+}
+
+/*
+ * Move the iterator back in its record's posting list. Returns
+ * ENOENT if the iterator is at the record value.
+ */
+static int iter_dups_prev(bxt_iter_t i)
+{
+	bxt_t t = i->iter.idx->priv;
+	ods_obj_t page;
+
+	if (!i->dups)
+		return ENOENT;
+	if (i->dup > 0) {
+		i->dup--;
+		return 0;
+	}
+	if (ods_obj_ref(i->dups) == REC(i->rec)->dup_ref) {
+		iter_dups_reset(i);
+		return 0;
+	}
+	page = ods_ref_as_obj(t->ods, DUPS(i->dups)->prev_ref);
+	ods_obj_put(i->dups);
+	i->dups = page;
+	i->dup = DUPS(page)->count - 1;
+	return 0;
+}
+
 static void bxt_iter_delete(ods_iter_t i)
 {
 	bxt_iter_t bxi = (bxt_iter_t)i;
+	iter_dups_reset(bxi);
 	if (bxi->rec)
 		ods_obj_put(bxi->rec);
 	if (bxi->node)
@@ -2172,6 +2990,7 @@ static int _iter_begin(bxt_iter_t i)
 {
 	ods_obj_t node;
 	bxt_t t = i->iter.idx->priv;
+	iter_dups_reset(i);
 	if (i->rec)
 		ods_obj_put(i->rec);
 	node = bxt_min_node(t);
@@ -2230,6 +3049,7 @@ static int _iter_end(bxt_iter_t i)
 		ods_obj_put(node);
 	} else
 		i->rec = NULL;
+	iter_dups_last(i);
 	return i->rec ? 0 : ENOENT;
 }
 
@@ -2306,6 +3126,8 @@ static ods_idx_data_t _iter_data(bxt_iter_t i)
 	assert(0 == (i->iter.flags & ODS_ITER_F_UNIQUE));
 	if (!i->rec)
 		return NULL_DATA;
+	if (i->dups)
+		return DUPS(i->dups)->data[i->dup];
 	return REC(i->rec)->value;
 }
 
@@ -2328,6 +3150,7 @@ static int _iter_find_dup(ods_iter_t oi, ods_key_t key, int first)
 
 	assert(0 == (iter->iter.flags & ODS_ITER_F_UNIQUE));
 
+	iter_dups_reset(iter);
 	if (iter->rec) {
 		ods_obj_put(iter->rec);
 		iter->rec = NULL;
@@ -2351,6 +3174,8 @@ static int _iter_find_dup(ods_iter_t oi, ods_key_t key, int first)
 	iter->rec = ods_ref_as_obj(t->ods, ref);
 	ods_obj_put(leaf);
 	iter->ent = i;
+	if (!first)
+		iter_dups_last(iter);
 	return 0;
 }
 
@@ -2372,6 +3197,7 @@ static int bxt_iter_find(ods_iter_t oi, ods_key_t key)
 	int found;
 	int i;
 
+	iter_dups_reset(iter);
 	if (iter->rec) {
 		ods_obj_put(iter->rec);
 		iter->rec = NULL;
@@ -2408,9 +3234,12 @@ static int _iter_find_lub_unique(bxt_iter_t iter, ods_key_t key)
 static int _iter_find_lub(bxt_iter_t iter, ods_key_t key)
 {
 	assert(0 == (iter->iter.flags & ODS_ITER_F_UNIQUE));
+	iter_dups_reset(iter);
 	if (iter->rec)
 		ods_obj_put(iter->rec);
 	iter->rec = __find_lub(iter->iter.idx, key, iter->iter.flags, NULL);
+	if (iter->iter.flags & ODS_ITER_F_LUB_LAST_DUP)
+		iter_dups_last(iter);
 	return iter->rec ? 0 : ENOENT;
 }
 
@@ -2425,9 +3254,12 @@ static int bxt_iter_find_lub(ods_iter_t oi, ods_key_t key)
 static int _iter_find_glb(bxt_iter_t iter, ods_key_t key)
 {
 	assert(0 == (iter->iter.flags & ODS_ITER_F_UNIQUE));
+	iter_dups_reset(iter);
 	if (iter->rec)
 		ods_obj_put(iter->rec);
 	iter->rec = __find_glb(iter->iter.idx, key, iter->iter.flags, NULL);
+	if (iter->iter.flags & ODS_ITER_F_GLB_LAST_DUP)
+		iter_dups_last(iter);
 	return iter->rec ? 0 : ENOENT;
 }
 
@@ -2481,6 +3313,9 @@ static int _iter_next(bxt_iter_t i)
 	assert(0 == (i->iter.flags & ODS_ITER_F_UNIQUE));
 
 	if (i->rec) {
+		if (0 == iter_dups_next(i))
+			return 0;
+		iter_dups_reset(i);
 		ods_ref_t next_ref = REC(i->rec)->next_ref;
 #ifdef ODS_DEBUG
 		ods_ref_t rec_ref = ods_obj_ref(i->rec);
@@ -2550,9 +3385,12 @@ static int _iter_prev(bxt_iter_t i)
 	ods_obj_t prev_rec;
 
 	if (i->rec) {
+		if (0 == iter_dups_prev(i))
+			return 0;
 		prev_rec = ods_ref_as_obj(t->ods, REC(i->rec)->prev_ref);
 		ods_obj_put(i->rec);
 		i->rec = prev_rec;
+		iter_dups_last(i);
 #ifdef ODS_DEBUG
 		if (i->rec)
 			assert(REC(i->rec)->next_ref != 0xFFFFFFFFFFFFFFFF);
@@ -2603,6 +3441,11 @@ static int bxt_iter_pos_set(ods_iter_t oi, const ods_pos_t pos)
 		goto err_0;
 
 	i->ent = POS(obj)->ent;
+	iter_dups_reset(i);
+	if (POS(obj)->dups_ref) {
+		i->dups = ods_ref_as_obj(t->ods, POS(obj)->dups_ref);
+		i->dup = POS(obj)->dup;
+	}
 #ifdef ODS_DEBUG
 	if (i->rec)
 		assert(REC(i->rec)->next_ref != 0xFFFFFFFFFFFFFFFF);
@@ -2637,6 +3480,8 @@ static int bxt_iter_pos_get(ods_iter_t oi, ods_pos_t pos)
 	pos->ref = ods_obj_ref(obj);
 	POS(obj)->rec_ref = ods_obj_ref(i->rec);
 	POS(obj)->ent = i->ent;
+	POS(obj)->dups_ref = (i->dups ? ods_obj_ref(i->dups) : 0);
+	POS(obj)->dup = i->dup;
 	ods_obj_put(obj);
 	return 0;
 }
@@ -2657,6 +3502,37 @@ static int bxt_iter_pos_put(ods_iter_t oi, ods_pos_t pos)
 	return 0;
 }
 
+/*
+ * Delete the value at the iterator position from its record's
+ * posting list and leave the iterator at the next value.
+ */
+static int iter_dups_delete(bxt_iter_t i, ods_idx_data_t *data)
+{
+	bxt_t t = i->iter.idx->priv;
+	ods_obj_t rec, page;
+	uint32_t ent;
+
+	*data = _iter_data(i);
+	rec = ods_obj_get(i->rec);
+	if (!i->dups) {
+		/* The first duplicate becomes the record value */
+		page = ods_ref_as_obj(t->ods, REC(rec)->dup_ref);
+		REC(rec)->value = DUPS(page)->data[0];
+		ent = 0;
+	} else {
+		page = ods_obj_get(i->dups);
+		ent = i->dup;
+		if (ent + 1 == DUPS(page)->count)
+			(void)_iter_next(i);
+	}
+	dups_remove(t, rec, page, ent);
+	ods_obj_put(page);
+	ods_obj_put(rec);
+	ods_atomic_dec(&t->udata->dups);
+	ods_atomic_dec(&t->udata->card);
+	return 0;
+}
+
 static int bxt_iter_entry_delete(ods_iter_t oi, ods_idx_data_t *data)
 {
 	bxt_iter_t i = (bxt_iter_t)oi;
@@ -2674,6 +3550,12 @@ static int bxt_iter_entry_delete(ods_iter_t oi, ods_idx_data_t *data)
 	if (!i->rec)
 		goto out_0;
 
+	if (BXT_POSTING(t) && 0 == (oi->flags & ODS_ITER_F_UNIQUE)
+	    && REC(i->rec)->dup_ref) {
+		rc = iter_dups_delete(i, data);
+		goto out_0;
+	}
+
 	key = __iter_key(i);
 	if (!key)
 		goto out_0;
@@ -2707,14 +3589,90 @@ static void bxt_commit(ods_idx_t idx)
 	ods_commit(idx->ods, ODS_COMMIT_SYNC);
 }
 
+/*
+ * Count the levels, nodes and entries of the subtree rooted at
+ * node. Only internal nodes are visited; the caller accounts for
+ * the leaf entries, which are the distinct keys.
+ */
+static void tree_census(bxt_t t, ods_obj_t node, uint64_t level, uint64_t *depth,
+			uint64_t *nodes, uint64_t *entries)
+{
+	ods_obj_t child;
+	int i;
+
+	*nodes += 1;
+	if (level > *depth)
+		*depth = level;
+	if (NODE(node)->is_leaf)
+		return;
+	*entries += NODE(node)->count;
+	child = ods_ref_as_obj(t->ods, N_ENT(node,0).node_ref);
+	if (!child)
+		return;
+	if (NODE(child)->is_leaf) {
+		*nodes += NODE(node)->count;
+		if (level + 1 > *depth)
+			*depth = level + 1;
+		ods_obj_put(child);
+		return;
+	}
+	ods_obj_put(child);
+	for (i = 0; i < NODE(node)->count; i++) {
+		child = ods_ref_as_obj(t->ods, N_ENT(node,i).node_ref);
+		if (!child)
+			continue;
+		tree_census(t, child, level + 1, depth, nodes, entries);
+		ods_obj_put(child);
+	}
+}
+
+/*
+ * The census visits every internal node, so it is only repeated when
+ * the number of distinct keys has changed by more than 1/8 since the
+ * last one. In between, the node and entry counts are scaled by the
+ * number of keys.
+ */
+#define CENSUS_STALE(_t_, _keys_) \
+	(!(_t_)->census_nodes \
+	 || (_keys_) > (_t_)->census_keys + (_t_)->census_keys / 8 \
+	 || (_keys_) + (_keys_) / 8 < (_t_)->census_keys)
+
 int bxt_stat(ods_idx_t idx, ods_idx_stat_t idx_sb)
 {
 	struct stat sb;
 	bxt_t t = idx->priv;
+	uint64_t depth = 0, nodes = 0, entries = 0, keys;
+	ods_obj_t root;
+	int rc;
+
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
 	idx_sb->cardinality = t->udata->card;
 	idx_sb->duplicates = t->udata->dups;
 	ods_stat(idx->ods, &sb);
 	idx_sb->size = sb.st_size;
+	idx_sb->node_size = BXT_NODE_SIZE(t->udata->order);
+	keys = t->udata->card - t->udata->dups;
+	if (CENSUS_STALE(t, keys)) {
+		root = ods_ref_as_obj(t->ods, t->udata->root_ref);
+		if (root) {
+			tree_census(t, root, 1, &depth, &nodes, &entries);
+			ods_obj_put(root);
+		}
+		t->census_keys = keys;
+		t->census_depth = depth;
+		t->census_nodes = nodes;
+		t->census_entries = entries;
+	}
+	if (t->census_nodes && t->census_keys) {
+		double scale = (double)keys / (double)t->census_keys;
+		idx_sb->depth = t->census_depth;
+		idx_sb->fill_factor =
+			((double)t->census_entries * scale + (double)keys)
+			/ ((double)t->census_nodes * scale * t->udata->order);
+	}
+	__int_unlock(t);
 	return 0;
 }
 
@@ -2751,8 +3709,10 @@ static struct ods_idx_provider bxt_provider = {
 	.visit = bxt_visit,
 	.update = bxt_update,
 	.delete = bxt_delete,
+	.delete_range = bxt_delete_range,
 	.max = bxt_max,
 	.min = bxt_min,
+	.split = bxt_split,
 	.find = bxt_find,
 	.find_lub = bxt_find_lub,
 	.find_glb = bxt_find_glb,
@@ -46,6 +46,7 @@
 #ifndef _BXT_H_
 #define _BXT_H_
 
+#include <stddef.h>
 #include <ods/ods_idx.h>
 #include <ods/ods.h>
 #include "ods_idx_priv.h"
@@ -78,8 +79,28 @@ typedef struct bxn_record {
 	ods_idx_data_t value;	/* The value */
 	ods_ref_t next_ref;	/* The next record */
 	ods_ref_t prev_ref;	/* The previous record */
+	ods_ref_t dup_ref;	/* The posting list (BXT_F_POSTING only) */
 } *bxn_record_t;
 
+/*
+ * Posting list page
+ *
+ * When the tree has the BXT_F_POSTING flag, a key has exactly one
+ * record. The record value is the first value inserted for the key;
+ * the values of the duplicates are appended, in insertion order, to
+ * a list of pages that hangs off the record's dup_ref. The first
+ * page's prev_ref refers to the last page so that appends do not
+ * walk the list. Page capacity doubles from BXT_DUPS_MIN_SZ to
+ * BXT_DUPS_MAX_SZ bytes as the list grows.
+ */
+typedef struct bxn_dups {
+	ods_ref_t next_ref;	/* The next page, 0 if last */
+	ods_ref_t prev_ref;	/* The previous page, the last if first */
+	uint32_t count;		/* Values in the page */
+	uint32_t size;		/* Capacity of the page */
+	ods_idx_data_t data[];
+} *bxn_dups_t;
+
 typedef struct bxt_node {
 	ods_ref_t parent;	/* NULL if root */
 	uint32_t count:16;
@@ -94,8 +115,12 @@ typedef struct bxt_udata {
 	ods_atomic_t depth;	/* The current tree depth */
 	ods_atomic_t card;	/* Cardinality */
 	ods_atomic_t dups;	/* Duplicate keys */
+	uint32_t flags;		/* BXT_F_xxx format flags */
 } *bxt_udata_t;
 
+/* Duplicates are kept in posting lists rather than record chains */
+#define BXT_F_POSTING	1
+
 /* Structure to hang on to cached node allocations */
 struct bxt_obj_el {
 	ods_obj_t obj;
@@ -111,6 +136,7 @@ typedef struct bxt_s {
 	ods_obj_t udata_obj;
 	bxt_udata_t udata;
 	ods_idx_compare_fn_t comparator;
+	ods_key_class_t key_class;	/* Selects an in-line key compare */
 	ods_idx_rt_opts_t rt_opts;	/* Run-time flags */
 	/*
 	 * The node_q keeps a Q of nodes for allocation.
@@ -118,11 +144,20 @@ typedef struct bxt_s {
 	ods_atomic_t node_q_depth;
 	LIST_HEAD(node_node_q_head, bxt_obj_el) node_q;
 	LIST_HEAD(node_el_q_head, bxt_obj_el) el_q;
+	/*
+	 * The result of the last tree census, see bxt_stat()
+	 */
+	uint64_t census_keys;	/* Distinct keys at the census */
+	uint64_t census_depth;
+	uint64_t census_nodes;
+	uint64_t census_entries;	/* Internal node entries */
 } *bxt_t;
 
 typedef struct bxt_pos_s {
 	ods_ref_t rec_ref;
 	uint32_t ent;
+	ods_ref_t dups_ref;
+	uint32_t dup;
 } *bxt_pos_t;
 
 typedef struct bxt_iter_s {
@@ -130,9 +165,21 @@ typedef struct bxt_iter_s {
 	ods_obj_t rec;
 	ods_obj_t node;
 	uint32_t ent;
+	ods_obj_t dups;		/* Posting page, NULL if at the record value */
+	uint32_t dup;		/* Index in the posting page */
 } *bxt_iter_t;
 
 #define BXT_EXTEND_SIZE	(1024 * 1024)
+#define BXT_DUPS_MIN_SZ	64
+#define BXT_DUPS_MAX_SZ	4096
+#define BXT_DEF_NODE_SIZE	4096
+#define BXT_MIN_NODE_SIZE	128
+#define BXT_MAX_NODE_SIZE	(1024 * 1024)
+/* The number of entries in a node of _sz_ bytes and its inverse */
+#define BXT_NODE_ORDER(_sz_) \
+	(((_sz_) - sizeof(struct bxt_node)) / sizeof(struct bxn_entry))
+#define BXT_NODE_SIZE(_order_) \
+	(sizeof(struct bxt_node) + ((_order_) * sizeof(struct bxn_entry)))
 #define BXT_SIGNATURE "BXTREE01"
 #pragma pack()
 
@@ -144,4 +191,11 @@ typedef struct bxt_iter_s {
 #define NODE(_o_) ODS_PTR(bxt_node_t, _o_)
 #define REC(_o_) ODS_PTR(bxn_record_t, _o_)
 #define POS(_o_) ODS_PTR(bxt_pos_t, _o_)
+#define DUPS(_o_) ODS_PTR(bxn_dups_t, (_o_))
+#define BXT_POSTING(_t_) ((_t_)->udata->flags & BXT_F_POSTING)
+/* Records of trees without posting lists end before dup_ref */
+#define BXT_REC_SIZE(_t_) (BXT_POSTING(_t_) ? sizeof(struct bxn_record) \
+			   : offsetof(struct bxn_record, dup_ref))
+#define BXT_KEY_CMP(_t_, _a_, _b_) \
+	ods_key_class_cmp((_t_)->key_class, (_t_)->comparator, _a_, _b_)
 #endif
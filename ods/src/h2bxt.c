@@ -244,29 +244,6 @@ static int h2bxt_open(ods_idx_t idx)
 	return ENOMEM;
 }
 
-static unsigned long arg_int_value(const char *arg_str, const char *name_str)
-{
-	extern char *strcasestr(const char *haystack, const char *needle);
-	char order_arg[ODS_IDX_ARGS_LEN];
-	char *name, *value, *arg;
-
-	if (!arg_str)
-		return 0;
-
-	arg = strcasestr(arg_str, name_str);
-	if (!arg)
-		return 0;
-
-	strcpy(order_arg, arg);
-	name = strtok(order_arg, "=");
-	if (name) {
-		value = strtok(NULL, "=");
-		if (value)
-			return strtoul(value, NULL, 0);
-	}
-	return 0;
-}
-
 static int h2bxt_init(ods_t ods, const char *type, const char *key, const char *argp)
 {
 	char path_buf[PATH_MAX];
@@ -279,11 +256,22 @@ static int h2bxt_init(ods_t ods, const char *type, const char *key, const char *
 	int i, rc;
 	struct stat sb;
 	mode_t dir_mode;
+	struct ods_idx_class *idx_class;
+	const char *child_key;
 
 	rc = ods_stat(ods, &sb);
 	if (rc)
 		return rc;
 
+	/*
+	 * If the keys are stored encoded, the top level index encodes
+	 * them and the children only need to compare the result.
+	 */
+	idx_class = get_idx_class(type, key);
+	if (!idx_class)
+		return errno;
+	child_key = (idx_class->cmp->encode ? "MEMCMP" : key);
+
 	dir_mode = sb.st_mode;
 	if (dir_mode | S_IRUSR)
 		dir_mode |= S_IXUSR;
@@ -299,16 +287,16 @@ static int h2bxt_init(ods_t ods, const char *type, const char *key, const char *
 	if (!udata)
 		return EINVAL;
 
-	order = arg_int_value(argp, "ORDER");
+	order = ods_idx_arg_int(argp, "ORDER", 0);
 	if (!order)
 		order = H2BXT_DEFAULT_ORDER;
 
 	srandom(time(NULL));
-	seed = arg_int_value(argp, "SEED");
+	seed = ods_idx_arg_int(argp, "SEED", 0);
 	if (!seed)
 		seed = (uint32_t)random();
 
-	htlen = arg_int_value(argp, "SIZE");
+	htlen = ods_idx_arg_int(argp, "SIZE", 0);
 	if (!htlen)
 		htlen = H2BXT_DEFAULT_TABLE_SIZE;
 
@@ -328,7 +316,7 @@ static int h2bxt_init(ods_t ods, const char *type, const char *key, const char *
 		if (rc)
 			goto out;
 		sprintf(path_buf, "%s/bkt_%d/%s", path, i, base);
-		rc = ods_idx_create(path_buf, sb.st_mode, "BXTREE", key, argp);
+		rc = ods_idx_create(path_buf, sb.st_mode, "BXTREE", child_key, argp);
 		if (rc)
 			goto out;
 	}
@@ -490,32 +478,30 @@ static int h2bxt_max(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data)
 	h2bxt_t t = idx->priv;
 	ods_key_t max_key = NULL;
 	ods_key_t idx_key;
-	struct ods_idx_data_s idx_data;
-	int rc = ENOENT;
+	struct ods_idx_data_s max_data, idx_data;
 
 	for (bkt = 0; bkt < t->udata->table_size; bkt++) {
-		rc = ods_idx_max(t->idx_table[bkt].idx, &idx_key, &idx_data);
-		if (rc)
+		if (ods_idx_max(t->idx_table[bkt].idx, &idx_key, &idx_data))
 			continue;
-		rc = 0;
-		if (max_key) {
-			if (ods_key_cmp(t->idx_table[bkt].idx, idx_key, max_key) > 0) {
+		if (!max_key
+		    || ods_key_cmp(t->idx_table[bkt].idx, idx_key, max_key) > 0) {
+			if (max_key)
 				ods_obj_put(max_key);
-				max_key = idx_key;
-			} else {
-				ods_obj_put(idx_key);
-			}
-		} else {
 			max_key = idx_key;
+			max_data = idx_data;
+		} else {
+			ods_obj_put(idx_key);
 		}
 	}
-	if (!rc) {
-		if (key)
-			*key = idx_key;
-		if (data)
-			*data = idx_data;
-	}
-	return rc;
+	if (!max_key)
+		return ENOENT;
+	if (key)
+		*key = max_key;
+	else
+		ods_obj_put(max_key);
+	if (data)
+		*data = max_data;
+	return 0;
 }
 
 static int h2bxt_min(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data)
@@ -524,32 +510,30 @@ static int h2bxt_min(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data)
 	h2bxt_t t = idx->priv;
 	ods_key_t min_key = NULL;
 	ods_key_t idx_key;
-	struct ods_idx_data_s idx_data;
-	int rc = ENOENT;
+	struct ods_idx_data_s min_data, idx_data;
 
 	for (bkt = 0; bkt < t->udata->table_size; bkt++) {
-		rc = ods_idx_min(t->idx_table[bkt].idx, &idx_key, &idx_data);
-		if (rc)
+		if (ods_idx_min(t->idx_table[bkt].idx, &idx_key, &idx_data))
 			continue;
-		rc = 0;
-		if (min_key) {
-			if (ods_key_cmp(t->idx_table[bkt].idx, idx_key, min_key) > 0) {
+		if (!min_key
+		    || ods_key_cmp(t->idx_table[bkt].idx, idx_key, min_key) < 0) {
+			if (min_key)
 				ods_obj_put(min_key);
-				min_key = idx_key;
-			} else {
-				ods_obj_put(idx_key);
-			}
-		} else {
 			min_key = idx_key;
+			min_data = idx_data;
+		} else {
+			ods_obj_put(idx_key);
 		}
 	}
-	if (!rc) {
-		if (key)
-			*key = idx_key;
-		if (data)
-			*data = idx_data;
-	}
-	return rc;
+	if (!min_key)
+		return ENOENT;
+	if (key)
+		*key = min_key;
+	else
+		ods_obj_put(min_key);
+	if (data)
+		*data = min_data;
+	return 0;
 }
 
 static int h2bxt_delete(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data)
@@ -572,7 +556,8 @@ static int entry_cmp(void *tree_key, void *key)
 	iter_entry_t a = tree_key;
 	iter_entry_t b = key;
 	ods_iter_t oi = (ods_iter_t)a->iter;
-	return ods_key_cmp(oi->idx, a->key, b->key);
+	/* The keys come from the children and are already encoded */
+	return oi->idx->idx_class->cmp->compare_fn(a->key, b->key);
 }
 
 static void iter_cleanup(h2bxt_t t, h2bxt_iter_t iter)
@@ -1201,13 +1186,21 @@ int h2bxt_stat(ods_idx_t idx, ods_idx_stat_t idx_sb)
 	struct ods_idx_stat_s bkt_sb;
 	h2bxt_t t = idx->priv;
 	int bkt;
+	double fill = 0.0;
 	memset(idx_sb, 0, sizeof(*idx_sb));
 	for (bkt = 0; bkt < t->udata->table_size; bkt++) {
 		ods_idx_stat(t->idx_table[bkt].idx, &bkt_sb);
 		idx_sb->cardinality += bkt_sb.cardinality;
 		idx_sb->duplicates += bkt_sb.duplicates;
 		idx_sb->size += bkt_sb.size;
+		if (bkt_sb.depth > idx_sb->depth)
+			idx_sb->depth = bkt_sb.depth;
+		idx_sb->node_size = bkt_sb.node_size;
+		/* Weight each bucket's fill by its entries */
+		fill += bkt_sb.fill_factor * bkt_sb.cardinality;
 	}
+	if (idx_sb->cardinality)
+		idx_sb->fill_factor = fill / idx_sb->cardinality;
 	return 0;
 }
 
@@ -136,29 +136,6 @@ static int h2htbl_open(ods_idx_t idx)
 	return ENOMEM;
 }
 
-static unsigned long arg_int_value(const char *arg_str, const char *name_str)
-{
-	extern char *strcasestr(const char *haystack, const char *needle);
-	char order_arg[ODS_IDX_ARGS_LEN];
-	char *name, *value, *arg;
-
-	if (!arg_str)
-		return 0;
-
-	arg = strcasestr(arg_str, name_str);
-	if (!arg)
-		return 0;
-
-	strcpy(order_arg, arg);
-	name = strtok(order_arg, "=");
-	if (name) {
-		value = strtok(NULL, "=");
-		if (value)
-			return strtoul(value, NULL, 0);
-	}
-	return 0;
-}
-
 static int h2htbl_init(ods_t ods, const char *type, const char *key, const char *argp)
 {
 	char path_buf[PATH_MAX];
@@ -170,11 +147,22 @@ static int h2htbl_init(ods_t ods, const char *type, const char *key, const char
 	int i, rc;
 	struct stat sb;
 	mode_t dir_mode;
+	struct ods_idx_class *idx_class;
+	const char *child_key;
 
 	rc = ods_stat(ods, &sb);
 	if (rc)
 		return rc;
 
+	/*
+	 * If the keys are stored encoded, the top level index encodes
+	 * them and the children only need to compare the result.
+	 */
+	idx_class = get_idx_class(type, key);
+	if (!idx_class)
+		return errno;
+	child_key = (idx_class->cmp->encode ? "MEMCMP" : key);
+
 	dir_mode = sb.st_mode;
 	if (dir_mode | S_IRUSR)
 		dir_mode |= S_IXUSR;
@@ -191,11 +179,11 @@ static int h2htbl_init(ods_t ods, const char *type, const char *key, const char
 		return EINVAL;
 
 	srandom(time(NULL));
-	seed = arg_int_value(argp, "SEED");
+	seed = ods_idx_arg_int(argp, "SEED", 0);
 	if (!seed)
 		seed = (uint32_t)random();
 
-	htlen = arg_int_value(argp, "SIZE");
+	htlen = ods_idx_arg_int(argp, "SIZE", 0);
 	if (!htlen)
 		htlen = H2HTBL_DEFAULT_TABLE_SIZE;
 
@@ -214,7 +202,7 @@ static int h2htbl_init(ods_t ods, const char *type, const char *key, const char
 		if (rc)
 			goto out;
 		sprintf(path_buf, "%s/bkt_%d/%s", path, i, base);
-		rc = ods_idx_create(path_buf, sb.st_mode, "HTBL", key, argp);
+		rc = ods_idx_create(path_buf, sb.st_mode, "HTBL", child_key, argp);
 		if (rc)
 			goto out;
 	}
@@ -458,7 +446,8 @@ static int entry_cmp(void *tree_key, void *key)
 	iter_entry_t a = tree_key;
 	iter_entry_t b = key;
 	ods_iter_t oi = (ods_iter_t)a->iter;
-	return ods_key_cmp(oi->idx, a->key, b->key);
+	/* The keys come from the children and are already encoded */
+	return oi->idx->idx_class->cmp->compare_fn(a->key, b->key);
 }
 
 static void iter_cleanup(h2htbl_t t, h2htbl_iter_t iter)
@@ -174,6 +174,7 @@ static int ht_open(ods_idx_t idx)
 	t->htable = HTBL(t->htable_obj);
 	t->ods = idx->ods;
 	t->comparator = idx->idx_class->cmp->compare_fn;
+	t->key_class = ods_key_class(idx->idx_class->cmp);
 	switch (t->udata->hash_type) {
 	case HT_HASH_FNV_32:
 		t->hash_fn = fnv_hash_a1_32;
@@ -285,7 +286,7 @@ static ods_obj_t find_entry(ht_t t, ods_key_t key, int64_t *p_bkt)
 	for (ref = ht->table[bkt].head_ref; ref; ) {
 		ent = ods_ref_as_obj(t->ods, ref);
 		entry_key = ods_ref_as_obj(t->ods, HENT(ent)->key_ref);
-		c = t->comparator(entry_key, key);
+		c = ods_key_class_cmp(t->key_class, t->comparator, entry_key, key);
 		ods_obj_put(entry_key);
 		if (0 == c)
 			return ent;
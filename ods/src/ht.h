@@ -107,6 +107,7 @@ typedef struct ht_s {
 	ht_tbl_t htable;
 	ht_hash_fn_t hash_fn;
 	ods_idx_compare_fn_t comparator;
+	ods_key_class_t key_class;	/* Selects an in-line key compare */
 } *ht_t;
 
 typedef struct ht_pos_s {
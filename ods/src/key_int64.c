@@ -68,7 +68,12 @@ static int64_t int64_comparator(ods_key_t a, ods_key_t b)
 {
 	int64_t av = *((int64_t *)ods_key_value(a)->value);
 	int64_t bv = *((int64_t *)ods_key_value(b)->value);
-	return av - bv;
+	/* av - bv overflows when the keys are far apart */
+	if (av < bv)
+		return -1;
+	if (av > bv)
+		return 1;
+	return 0;
 }
 
 static const char *to_str(ods_key_t key, char *buf, size_t len)
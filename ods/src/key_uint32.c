@@ -66,9 +66,13 @@ static const char *get_doc(void)
 
 static int64_t uint32_comparator(ods_key_t a, ods_key_t b)
 {
-	int64_t av = *((uint32_t *)ods_key_value(a)->value);
-	int64_t bv = *((uint32_t *)ods_key_value(b)->value);
-	return av - bv;
+	uint32_t av = *((uint32_t *)ods_key_value(a)->value);
+	uint32_t bv = *((uint32_t *)ods_key_value(b)->value);
+	if (av < bv)
+		return -1;
+	if (av > bv)
+		return 1;
+	return 0;
 }
 
 static const char *to_str(ods_key_t key, char *sbuf, size_t len)
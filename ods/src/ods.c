@@ -942,6 +942,7 @@ void __ods_obj_put(ods_obj_t obj, int lock)
 			return;
 		}
 		assert(obj->refcount == 0);
+		ods_atomic_dec(&obj->ods->obj_count);
 		if (__ods_debug) {
 			if (lock)
 				__ods_lock(obj->ods);
@@ -2206,19 +2207,100 @@ void ods_obj_iter_pos_init(ods_obj_iter_pos_t pos)
 	pos->blk = 0;
 }
 
+/*
+ * Advance pg_no past the allocation at pg_no the way ods_obj_iter()
+ * does: bucket pages and free pages one page at a time, extents by
+ * their page count. Returns the number of allocated pages skipped.
+ */
+static uint64_t __pg_next(ods_pgt_t pgt, uint64_t *pg_no)
+{
+	ods_pg_t pg = &pgt->pg_pages[*pg_no];
+	if (0 == pg->pg_flags) {
+		*pg_no += 1;
+		return 0;
+	}
+	if (pg->pg_flags & ODS_F_IDX_VALID) {
+		*pg_no += 1;
+		return 1;
+	}
+	*pg_no += pg->pg_count;
+	return pg->pg_count;
+}
+
 /*
  * This function is _not_ thread safe
  */
+int ods_obj_iter_split(ods_t ods, ods_obj_iter_pos_t pos, int count)
+{
+	ods_pgt_t pgt;
+	uint64_t pg_no, used, target, seen;
+	int range;
+
+	if (count <= 0)
+		return 0;
+	/* Pick up the page table in case another handle resized the store */
+	__ods_lock(ods);
+	pgt = pgt_get(ods);
+	__ods_unlock(ods);
+	if (!pgt)
+		return 0;
+	used = 0;
+	for (pg_no = 1; pg_no < pgt->pg_count; )
+		used += __pg_next(pgt, &pg_no);
+	target = used / count;
+	if (!target)
+		target = 1;
+
+	range = 0;
+	pos[range].page_no = 1;
+	pos[range].blk = 0;
+	seen = 0;
+	for (pg_no = 1; pg_no < pgt->pg_count && range < count - 1; ) {
+		seen += __pg_next(pgt, &pg_no);
+		if (seen >= target && pg_no < pgt->pg_count) {
+			range ++;
+			pos[range].page_no = pg_no;
+			pos[range].blk = 0;
+			seen = 0;
+		}
+	}
+	range ++;
+	pos[range].page_no = pgt->pg_count;
+	pos[range].blk = 0;
+	return range;
+}
+
 int ods_obj_iter(ods_t ods, ods_obj_iter_pos_t pos,
 		 ods_obj_iter_fn_t iter_fn, void *arg)
 {
-	ods_pgt_t pgt = ods->pg_table;
+	return ods_obj_iter_range(ods, pos, NULL, iter_fn, arg);
+}
+
+/*
+ * This function is thread safe with respect to other iterators on
+ * the same ODS provided that no objects are being allocated or
+ * deleted.
+ */
+int ods_obj_iter_range(ods_t ods, ods_obj_iter_pos_t pos, ods_obj_iter_pos_t end,
+		       ods_obj_iter_fn_t iter_fn, void *arg)
+{
+	ods_pgt_t pgt;
 	ods_pg_t pg;
-	uint64_t pg_no, blk;
+	uint64_t pg_no, blk, pg_end;
 	int bkt, rc = 0;
 	size_t sz;
 	ods_obj_t obj;
 
+	/*
+	 * Refresh the page table before walking it, otherwise
+	 * the first ods_ref_as_obj() may remap it underneath us.
+	 */
+	__ods_lock(ods);
+	pgt = pgt_get(ods);
+	__ods_unlock(ods);
+	if (!pgt)
+		return ENOMEM;
+
 	if (pos) {
 		pg_no = pos->page_no;
 		if (!pg_no)
@@ -2228,8 +2310,11 @@ int ods_obj_iter(ods_t ods, ods_obj_iter_pos_t pos,
 		pg_no = 1;
 		blk = 0;
 	}
+	pg_end = pgt->pg_count;
+	if (end && end->page_no < pg_end)
+		pg_end = end->page_no;
 
-	for(; pg_no < pgt->pg_count; ) {
+	for(; pg_no < pg_end; ) {
 		pg = &pgt->pg_pages[pg_no];
 		if (0 == pg->pg_flags) {
 			pg_no++;
@@ -2254,9 +2339,10 @@ int ods_obj_iter(ods_t ods, ods_obj_iter_pos_t pos,
 			obj = ods_ref_as_obj(ods, pg_no << ODS_PAGE_SHIFT);
 			rc = iter_fn(ods, obj, arg);
 			ods_obj_put(obj);
-			pg_no += pg->pg_count;
 			if (rc)
+				/* Resume at this object, as for a block */
 				goto out;
+			pg_no += pg->pg_count;
 		}
 		blk = 0;
 	}
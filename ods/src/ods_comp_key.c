@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Converters between the ods_comp_key_t layout used by the COMPOUND
+ * key type and an order-preserving byte encoding that can be compared
+ * with memcmp().
+ *
+ * Each component is encoded as a one byte type tag followed by the
+ * component value:
+ *
+ * - Unsigned integers are stored big-endian.
+ * - Signed integers have the sign bit flipped and are stored big-endian.
+ * - Floats and doubles have the sign bit flipped if positive, or all
+ *   bits inverted if negative, and are stored big-endian.
+ * - Timestamps are stored as big-endian seconds followed by
+ *   big-endian micro-seconds.
+ * - Strings, byte arrays and structs are stored with each 0x00 byte
+ *   escaped as 0x00 0xFF and are terminated with 0x00 0x01, so that a
+ *   string sorts before any longer string it prefixes.
+ * - Numeric arrays store each element as 0x01 followed by the element
+ *   encoded as above, and are terminated with 0x00, so that an array
+ *   sorts before any longer array it prefixes.
+ *
+ * Long double and object arrays have no order-preserving encoding and
+ * are rejected with EINVAL.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <ods/ods_idx.h>
+#include "../../sos/include/sos/sos.h"
+#include "ods_idx_priv.h"
+
+#define COMP_HDR_SZ		sizeof(uint16_t)
+#define COMP_STR_HDR_SZ		(sizeof(uint16_t) + sizeof(uint16_t))
+#define NORM_STR_ESC		0xFF
+#define NORM_STR_END		0x01
+#define NORM_ARRAY_EL		0x01
+#define NORM_ARRAY_END		0x00
+
+static inline uint32_t float_to_ordered(float f)
+{
+	union { float f; uint32_t u; } v;
+	v.f = (f == 0.0f ? 0.0f : f);	/* -0.0 == 0.0 */
+	if (v.u & 0x80000000)
+		return ~v.u;
+	return v.u | 0x80000000;
+}
+
+static inline float ordered_to_float(uint32_t u)
+{
+	union { float f; uint32_t u; } v;
+	if (u & 0x80000000)
+		v.u = u & ~0x80000000;
+	else
+		v.u = ~u;
+	return v.f;
+}
+
+static inline uint64_t double_to_ordered(double d)
+{
+	union { double d; uint64_t u; } v;
+	v.d = (d == 0.0 ? 0.0 : d);
+	if (v.u & 0x8000000000000000UL)
+		return ~v.u;
+	return v.u | 0x8000000000000000UL;
+}
+
+static inline double ordered_to_double(uint64_t u)
+{
+	union { double d; uint64_t u; } v;
+	if (u & 0x8000000000000000UL)
+		v.u = u & ~0x8000000000000000UL;
+	else
+		v.u = ~u;
+	return v.d;
+}
+
+static int is_str_type(int type)
+{
+	return (type == SOS_TYPE_STRUCT
+		|| type == SOS_TYPE_BYTE_ARRAY
+		|| type == SOS_TYPE_CHAR_ARRAY);
+}
+
+/*
+ * Return the element type of a numeric array, or -1 if the type is
+ * not a numeric array.
+ */
+static int array_el_type(int type)
+{
+	switch (type) {
+	case SOS_TYPE_INT16_ARRAY:
+		return SOS_TYPE_INT16;
+	case SOS_TYPE_INT32_ARRAY:
+		return SOS_TYPE_INT32;
+	case SOS_TYPE_INT64_ARRAY:
+		return SOS_TYPE_INT64;
+	case SOS_TYPE_UINT16_ARRAY:
+		return SOS_TYPE_UINT16;
+	case SOS_TYPE_UINT32_ARRAY:
+		return SOS_TYPE_UINT32;
+	case SOS_TYPE_UINT64_ARRAY:
+		return SOS_TYPE_UINT64;
+	case SOS_TYPE_FLOAT_ARRAY:
+		return SOS_TYPE_FLOAT;
+	case SOS_TYPE_DOUBLE_ARRAY:
+		return SOS_TYPE_DOUBLE;
+	}
+	return -1;
+}
+
+/*
+ * Return the size of a numeric value, or 0 if the type is not a
+ * numeric scalar. The value has the same size encoded and decoded.
+ */
+static size_t num_size(int type)
+{
+	switch (type) {
+	case SOS_TYPE_UINT16:
+	case SOS_TYPE_INT16:
+		return sizeof(uint16_t);
+	case SOS_TYPE_UINT32:
+	case SOS_TYPE_INT32:
+	case SOS_TYPE_FLOAT:
+		return sizeof(uint32_t);
+	case SOS_TYPE_UINT64:
+	case SOS_TYPE_INT64:
+	case SOS_TYPE_DOUBLE:
+		return sizeof(uint64_t);
+	}
+	return 0;
+}
+
+/* Encode the num_size(type) bytes at src to p */
+static void num_encode(int type, const void *src, unsigned char *p)
+{
+	uint64_t u64;
+	uint32_t u32;
+	uint16_t u16;
+	float f;
+	double d;
+
+	switch (type) {
+	case SOS_TYPE_UINT16:
+	case SOS_TYPE_INT16:
+		memcpy(&u16, src, sizeof(u16));
+		if (type == SOS_TYPE_INT16)
+			u16 ^= 0x8000;
+		u16 = htobe16(u16);
+		memcpy(p, &u16, sizeof(u16));
+		break;
+	case SOS_TYPE_UINT32:
+	case SOS_TYPE_INT32:
+	case SOS_TYPE_FLOAT:
+		if (type == SOS_TYPE_FLOAT) {
+			memcpy(&f, src, sizeof(f));
+			u32 = float_to_ordered(f);
+		} else {
+			memcpy(&u32, src, sizeof(u32));
+		}
+		if (type == SOS_TYPE_INT32)
+			u32 ^= 0x80000000;
+		u32 = htobe32(u32);
+		memcpy(p, &u32, sizeof(u32));
+		break;
+	case SOS_TYPE_UINT64:
+	case SOS_TYPE_INT64:
+	case SOS_TYPE_DOUBLE:
+		if (type == SOS_TYPE_DOUBLE) {
+			memcpy(&d, src, sizeof(d));
+			u64 = double_to_ordered(d);
+		} else {
+			memcpy(&u64, src, sizeof(u64));
+		}
+		if (type == SOS_TYPE_INT64)
+			u64 ^= 0x8000000000000000UL;
+		u64 = htobe64(u64);
+		memcpy(p, &u64, sizeof(u64));
+		break;
+	}
+}
+
+/* Decode the num_size(type) bytes at p to dst */
+static void num_decode(int type, const unsigned char *p, void *dst)
+{
+	uint64_t u64;
+	uint32_t u32;
+	uint16_t u16;
+	float f;
+	double d;
+
+	switch (type) {
+	case SOS_TYPE_UINT16:
+	case SOS_TYPE_INT16:
+		memcpy(&u16, p, sizeof(u16));
+		u16 = be16toh(u16);
+		if (type == SOS_TYPE_INT16)
+			u16 ^= 0x8000;
+		memcpy(dst, &u16, sizeof(u16));
+		break;
+	case SOS_TYPE_UINT32:
+	case SOS_TYPE_INT32:
+	case SOS_TYPE_FLOAT:
+		memcpy(&u32, p, sizeof(u32));
+		u32 = be32toh(u32);
+		if (type == SOS_TYPE_FLOAT) {
+			f = ordered_to_float(u32);
+			memcpy(dst, &f, sizeof(f));
+			break;
+		}
+		if (type == SOS_TYPE_INT32)
+			u32 ^= 0x80000000;
+		memcpy(dst, &u32, sizeof(u32));
+		break;
+	case SOS_TYPE_UINT64:
+	case SOS_TYPE_INT64:
+	case SOS_TYPE_DOUBLE:
+		memcpy(&u64, p, sizeof(u64));
+		u64 = be64toh(u64);
+		if (type == SOS_TYPE_DOUBLE) {
+			d = ordered_to_double(u64);
+			memcpy(dst, &d, sizeof(d));
+			break;
+		}
+		if (type == SOS_TYPE_INT64)
+			u64 ^= 0x8000000000000000UL;
+		memcpy(dst, &u64, sizeof(u64));
+		break;
+	}
+}
+
+int ods_comp_key_encode(ods_key_t dst, ods_key_t src)
+{
+	ods_comp_key_t ck = (ods_comp_key_t)ods_key_value(src);
+	ods_key_value_t nk = ods_key_value(dst);
+	size_t max = ods_key_size(dst);
+	unsigned char *p = nk->value;
+	unsigned char *end = p + max;
+	off_t koff;
+	uint32_t u32;
+	size_t sz;
+	int i, el_type;
+
+	for (koff = 0; koff < ck->len;) {
+		ods_key_comp_t comp = (ods_key_comp_t)&((char *)ck->value)[koff];
+		if (p + 1 > end)
+			return E2BIG;
+		*p++ = (unsigned char)comp->type;
+		if (is_str_type(comp->type)) {
+			for (i = 0; i < comp->value.str.len; i++) {
+				unsigned char c = comp->value.str.str[i];
+				if (p + 2 > end)
+					return E2BIG;
+				*p++ = c;
+				if (!c)
+					*p++ = NORM_STR_ESC;
+			}
+			if (p + 2 > end)
+				return E2BIG;
+			*p++ = 0;
+			*p++ = NORM_STR_END;
+			koff += COMP_STR_HDR_SZ + comp->value.str.len;
+			continue;
+		}
+		el_type = array_el_type(comp->type);
+		if (el_type >= 0) {
+			sz = num_size(el_type);
+			if (comp->value.str.len % sz)
+				return EINVAL;
+			for (i = 0; i < comp->value.str.len; i += sz) {
+				if (p + 1 + sz > end)
+					return E2BIG;
+				*p++ = NORM_ARRAY_EL;
+				num_encode(el_type, &comp->value.str.str[i], p);
+				p += sz;
+			}
+			if (p + 1 > end)
+				return E2BIG;
+			*p++ = NORM_ARRAY_END;
+			koff += COMP_STR_HDR_SZ + comp->value.str.len;
+			continue;
+		}
+		sz = num_size(comp->type);
+		if (sz) {
+			if (p + sz > end)
+				return E2BIG;
+			num_encode(comp->type, &comp->value, p);
+			p += sz;
+			koff += COMP_HDR_SZ + sz;
+			continue;
+		}
+		switch (comp->type) {
+		case SOS_TYPE_TIMESTAMP:
+			if (p + 2 * sizeof(u32) > end)
+				return E2BIG;
+			u32 = htobe32(comp->value.tv_.tv_sec);
+			memcpy(p, &u32, sizeof(u32));
+			p += sizeof(u32);
+			u32 = htobe32(comp->value.tv_.tv_usec);
+			memcpy(p, &u32, sizeof(u32));
+			p += sizeof(u32);
+			koff += COMP_HDR_SZ + sizeof(comp->value.tv_);
+			break;
+		default:
+			return EINVAL;
+		}
+	}
+	nk->len = p - nk->value;
+	return 0;
+}
+
+int ods_comp_key_decode(ods_key_t dst, ods_key_t src)
+{
+	ods_key_value_t nk = ods_key_value(src);
+	ods_comp_key_t ck = (ods_comp_key_t)ods_key_value(dst);
+	size_t max = ods_key_size(dst);
+	unsigned char *p = nk->value;
+	unsigned char *p_end = p + nk->len;
+	off_t koff = 0;
+	uint32_t u32;
+	size_t sz;
+	int type, el_type;
+
+	while (p < p_end) {
+		ods_key_comp_t comp = (ods_key_comp_t)&((char *)ck->value)[koff];
+		type = *p++;
+		if (is_str_type(type)) {
+			if (koff + COMP_STR_HDR_SZ > max)
+				return E2BIG;
+			comp->type = type;
+			comp->value.str.len = 0;
+			while (p + 1 < p_end) {
+				if (p[0] == 0 && p[1] == NORM_STR_END)
+					break;
+				if (koff + COMP_STR_HDR_SZ + comp->value.str.len + 1 > max)
+					return E2BIG;
+				comp->value.str.str[comp->value.str.len++] = *p;
+				if (p[0] == 0)
+					p++;	/* skip the escape */
+				p++;
+			}
+			if (p + 2 > p_end)
+				return EINVAL;
+			p += 2;
+			koff += COMP_STR_HDR_SZ + comp->value.str.len;
+			continue;
+		}
+		el_type = array_el_type(type);
+		if (el_type >= 0) {
+			if (koff + COMP_STR_HDR_SZ > max)
+				return E2BIG;
+			sz = num_size(el_type);
+			comp->type = type;
+			comp->value.str.len = 0;
+			while (p < p_end && *p == NORM_ARRAY_EL) {
+				if (p + 1 + sz > p_end)
+					return EINVAL;
+				if (koff + COMP_STR_HDR_SZ + comp->value.str.len + sz > max)
+					return E2BIG;
+				num_decode(el_type, p + 1,
+					   &comp->value.str.str[comp->value.str.len]);
+				comp->value.str.len += sz;
+				p += 1 + sz;
+			}
+			if (p >= p_end || *p != NORM_ARRAY_END)
+				return EINVAL;
+			p++;
+			koff += COMP_STR_HDR_SZ + comp->value.str.len;
+			continue;
+		}
+		sz = num_size(type);
+		if (sz) {
+			if (koff + COMP_HDR_SZ + sz > max)
+				return E2BIG;
+			if (p + sz > p_end)
+				return EINVAL;
+			comp->type = type;
+			num_decode(type, p, &comp->value);
+			p += sz;
+			koff += COMP_HDR_SZ + sz;
+			continue;
+		}
+		switch (type) {
+		case SOS_TYPE_TIMESTAMP:
+			if (koff + COMP_HDR_SZ + sizeof(comp->value.tv_) > max)
+				return E2BIG;
+			if (p + 2 * sizeof(u32) > p_end)
+				return EINVAL;
+			comp->type = type;
+			memcpy(&u32, p, sizeof(u32));
+			comp->value.tv_.tv_sec = be32toh(u32);
+			p += sizeof(u32);
+			memcpy(&u32, p, sizeof(u32));
+			comp->value.tv_.tv_usec = be32toh(u32);
+			p += sizeof(u32);
+			koff += COMP_HDR_SZ + sizeof(comp->value.tv_);
+			break;
+		default:
+			return EINVAL;
+		}
+	}
+	ck->len = koff;
+	return 0;
+}
@@ -150,6 +150,51 @@ struct ods_idx_class *get_idx_class(const char *type, const char *key)
 	return idx_class;
 }
 
+/*
+ * Return the value of the NAME=value argument in the index creation
+ * arguments, or def if it is not present. A K or M suffix scales the
+ * value by 1024 or 1024*1024.
+ */
+unsigned long ods_idx_arg_int(const char *args, const char *name, unsigned long def)
+{
+	extern char *strcasestr(const char *haystack, const char *needle);
+	char arg_buf[ODS_IDX_ARGS_LEN];
+	char *value, *arg, *end;
+	unsigned long v;
+
+	if (!args)
+		return def;
+
+	/* Skip matches inside another name, e.g. SIZE in NODE_SIZE */
+	for (arg = strcasestr(args, name); arg;
+	     arg = strcasestr(arg + 1, name)) {
+		if (arg == args || arg[-1] == ' ' || arg[-1] == ',')
+			break;
+	}
+	if (!arg)
+		return def;
+
+	strncpy(arg_buf, arg, sizeof(arg_buf) - 1);
+	arg_buf[sizeof(arg_buf) - 1] = '\0';
+	if (!strtok(arg_buf, "="))
+		return def;
+	value = strtok(NULL, "=");
+	if (!value)
+		return def;
+	v = strtoul(value, &end, 0);
+	switch (*end) {
+	case 'k':
+	case 'K':
+		v *= 1024;
+		break;
+	case 'm':
+	case 'M':
+		v *= 1024 * 1024;
+		break;
+	}
+	return v;
+}
+
 int ods_idx_create(const char *path, int mode,
 		   const char *type, const char *key,
 		   const char *args)
@@ -252,6 +297,7 @@ ods_idx_t ods_idx_open(const char *path, ods_perm_t o_perm)
 
 int ods_idx_stat(ods_idx_t idx, ods_idx_stat_t stat)
 {
+	memset(stat, 0, sizeof(*stat));
 	return idx->idx_class->prv->stat(idx, stat);
 }
 
@@ -308,55 +354,250 @@ void ods_idx_commit(ods_idx_t idx, int flags)
 	ods_commit(idx->ods, flags);
 }
 
+/*
+ * If the index key class stores keys in an encoded form, convert the
+ * application key before handing it to the provider. The stack key
+ * is used if it is large enough, otherwise a memory key is
+ * allocated. Release the result with __key_put().
+ */
+static ods_key_t __key_encode(ods_idx_t idx, ods_key_t key, ods_key_t stack_key)
+{
+	struct ods_idx_comparator *cmp = idx->idx_class->cmp;
+	size_t sz = 2 * ods_key_len(key) + 2;
+	ods_key_t ek;
+	int rc;
+
+	if (!cmp->encode || !key)
+		return key;
+	if (sz <= ods_key_size(stack_key)) {
+		ek = stack_key;
+	} else {
+		ek = ods_key_malloc(sz);
+		if (!ek)
+			return NULL;
+	}
+	rc = cmp->encode(ek, key);
+	if (rc) {
+		if (ek != stack_key)
+			ods_obj_put(ek);
+		errno = rc;
+		return NULL;
+	}
+	return ek;
+}
+
+static void __key_put(ods_key_t ek, ods_key_t key, ods_key_t stack_key)
+{
+	if (ek && ek != key && ek != stack_key)
+		ods_obj_put(ek);
+}
+
+/*
+ * Convert a key returned by the provider back to the application
+ * form. The stored key reference is dropped.
+ */
+static ods_key_t __key_decode(ods_idx_t idx, ods_key_t key)
+{
+	struct ods_idx_comparator *cmp = idx->idx_class->cmp;
+	ods_key_t dk;
+	int rc;
+
+	if (!cmp->decode || !key)
+		return key;
+	dk = ods_key_malloc(2 * ods_key_len(key) + 2);
+	if (!dk)
+		goto out;
+	rc = cmp->decode(dk, key);
+	if (rc) {
+		ods_obj_put(dk);
+		dk = NULL;
+		errno = rc;
+	}
+ out:
+	ods_obj_put(key);
+	return dk;
+}
+
 int ods_idx_visit(ods_idx_t idx, ods_key_t key, ods_visit_cb_fn_t cb_fn, void *arg)
 {
-	return idx->idx_class->prv->visit(idx, key, cb_fn, arg);
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
+	ek = __key_encode(idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = idx->idx_class->prv->visit(idx, ek, cb_fn, arg);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 int ods_idx_insert(ods_idx_t idx, ods_key_t key, ods_idx_data_t data)
 {
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
 	if (!idx->o_perm)
 		return EPERM;
-	return idx->idx_class->prv->insert(idx, key, data);
+	ek = __key_encode(idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = idx->idx_class->prv->insert(idx, ek, data);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 int ods_idx_update(ods_idx_t idx, ods_key_t key, ods_idx_data_t data)
 {
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
 	if (!idx->o_perm)
 		return EPERM;
-	return idx->idx_class->prv->update(idx, key, data);
+	ek = __key_encode(idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = idx->idx_class->prv->update(idx, ek, data);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 int ods_idx_delete(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data)
 {
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
 	if (!idx->o_perm)
 		return EPERM;
-	return idx->idx_class->prv->delete(idx, key, data);
+	ek = __key_encode(idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = idx->idx_class->prv->delete(idx, ek, data);
+	__key_put(ek, key, &stack_key);
+	return rc;
+}
+
+int ods_idx_delete_range(ods_idx_t idx, ods_key_t lo, ods_key_t hi,
+			 ods_range_cb_fn_t cb_fn, void *arg, uint64_t *count)
+{
+	ODS_KEY(lo_stack_key);
+	ODS_KEY(hi_stack_key);
+	ods_key_t elo, ehi;
+	uint64_t dummy;
+	int rc;
+
+	if (!count)
+		count = &dummy;
+	*count = 0;
+	if (!idx->idx_class->prv->delete_range)
+		return ENOSYS;
+	if (!idx->o_perm)
+		return EPERM;
+	elo = __key_encode(idx, lo, &lo_stack_key);
+	if (!elo)
+		return errno;
+	ehi = __key_encode(idx, hi, &hi_stack_key);
+	if (!ehi) {
+		rc = errno;
+		goto out;
+	}
+	rc = idx->idx_class->prv->delete_range(idx, elo, ehi, cb_fn, arg, count);
+	__key_put(ehi, hi, &hi_stack_key);
+ out:
+	__key_put(elo, lo, &lo_stack_key);
+	return rc;
 }
 
 int ods_idx_min(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data)
 {
-	return idx->idx_class->prv->min(idx, key, data);
+	int rc = idx->idx_class->prv->min(idx, key, data);
+	if (!rc && key) {
+		*key = __key_decode(idx, *key);
+		if (!*key)
+			rc = errno;
+	}
+	return rc;
 }
 
 int ods_idx_max(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data)
 {
-	return idx->idx_class->prv->max(idx, key, data);
+	int rc = idx->idx_class->prv->max(idx, key, data);
+	if (!rc && key) {
+		*key = __key_decode(idx, *key);
+		if (!*key)
+			rc = errno;
+	}
+	return rc;
+}
+
+int ods_idx_split(ods_idx_t idx, ods_key_t *keys, int *count)
+{
+	int i, j, rc;
+
+	if (!idx->idx_class->prv->split)
+		return ENOSYS;
+	rc = idx->idx_class->prv->split(idx, keys, count);
+	if (rc)
+		return rc;
+	for (i = 0; i < *count; i++) {
+		keys[i] = __key_decode(idx, keys[i]);
+		if (!keys[i])
+			goto err;
+	}
+	return 0;
+ err:
+	rc = errno;
+	for (j = 0; j < *count; j++) {
+		if (j != i)
+			ods_obj_put(keys[j]);
+	}
+	*count = 0;
+	return rc;
 }
 
 int ods_idx_find(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data)
 {
-	return idx->idx_class->prv->find(idx, key, data);
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
+	ek = __key_encode(idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = idx->idx_class->prv->find(idx, ek, data);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 int ods_idx_find_lub(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data)
 {
-	return idx->idx_class->prv->find_lub(idx, key, data);
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
+	ek = __key_encode(idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = idx->idx_class->prv->find_lub(idx, ek, data);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 int ods_idx_find_glb(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data)
 {
-	return idx->idx_class->prv->find_glb(idx, key, data);
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
+	ek = __key_encode(idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = idx->idx_class->prv->find_glb(idx, ek, data);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 ods_iter_t ods_iter_new(ods_idx_t idx)
@@ -397,27 +638,72 @@ void ods_iter_delete(ods_iter_t iter)
 
 int ods_iter_find(ods_iter_t iter, ods_key_t key)
 {
-	return iter->idx->idx_class->prv->iter_find(iter, key);
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
+	ek = __key_encode(iter->idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = iter->idx->idx_class->prv->iter_find(iter, ek);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 int ods_iter_find_first(ods_iter_t iter, ods_key_t key)
 {
-	return iter->idx->idx_class->prv->iter_find_first(iter, key);
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
+	ek = __key_encode(iter->idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = iter->idx->idx_class->prv->iter_find_first(iter, ek);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 int ods_iter_find_last(ods_iter_t iter, ods_key_t key)
 {
-	return iter->idx->idx_class->prv->iter_find_last(iter, key);
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
+	ek = __key_encode(iter->idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = iter->idx->idx_class->prv->iter_find_last(iter, ek);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 int ods_iter_find_lub(ods_iter_t iter, ods_key_t key)
 {
-	return iter->idx->idx_class->prv->iter_find_lub(iter, key);
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
+	ek = __key_encode(iter->idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = iter->idx->idx_class->prv->iter_find_lub(iter, ek);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 int ods_iter_find_glb(ods_iter_t iter, ods_key_t key)
 {
-	return iter->idx->idx_class->prv->iter_find_glb(iter, key);
+	ODS_KEY(stack_key);
+	ods_key_t ek;
+	int rc;
+
+	ek = __key_encode(iter->idx, key, &stack_key);
+	if (!ek)
+		return errno;
+	rc = iter->idx->idx_class->prv->iter_find_glb(iter, ek);
+	__key_put(ek, key, &stack_key);
+	return rc;
 }
 
 int ods_iter_begin(ods_iter_t iter)
@@ -452,7 +738,47 @@ int ods_iter_pos_set(ods_iter_t iter, const ods_pos_t pos)
 
 ods_key_t ods_iter_key(ods_iter_t iter)
 {
-	return iter->idx->idx_class->prv->iter_key(iter);
+	return __key_decode(iter->idx, iter->idx->idx_class->prv->iter_key(iter));
+}
+
+int64_t ods_iter_key_cmp(ods_iter_t iter, ods_key_t key)
+{
+	ODS_KEY(stack_key);
+	ods_key_t ik, ek;
+	int64_t res;
+
+	ik = iter->idx->idx_class->prv->iter_key(iter);
+	if (!ik)
+		return -1;
+	ek = __key_encode(iter->idx, key, &stack_key);
+	if (!ek) {
+		/* errno is set by the encoder */
+		ods_obj_put(ik);
+		return -1;
+	}
+	res = iter->idx->idx_class->cmp->compare_fn(ik, ek);
+	__key_put(ek, key, &stack_key);
+	ods_obj_put(ik);
+	return res;
+}
+
+int64_t ods_iter_cmp(ods_iter_t a, ods_iter_t b)
+{
+	ods_key_t ak, bk;
+	int64_t res;
+
+	assert(a->idx->idx_class == b->idx->idx_class);
+	ak = a->idx->idx_class->prv->iter_key(a);
+	bk = b->idx->idx_class->prv->iter_key(b);
+	if (ak && bk)
+		res = a->idx->idx_class->cmp->compare_fn(ak, bk);
+	else
+		res = (ak != NULL) - (bk != NULL);
+	if (ak)
+		ods_obj_put(ak);
+	if (bk)
+		ods_obj_put(bk);
+	return res;
 }
 
 ods_idx_data_t ods_iter_data(ods_iter_t iter)
@@ -523,7 +849,23 @@ int ods_key_from_str(ods_idx_t idx, ods_key_t key, const char *str)
 
 int64_t ods_key_cmp(ods_idx_t idx, ods_key_t a, ods_key_t b)
 {
-	return idx->idx_class->cmp->compare_fn(a, b);
+	ODS_KEY(stack_a);
+	ODS_KEY(stack_b);
+	ods_key_t ea, eb;
+	int64_t res;
+
+	if (!idx->idx_class->cmp->encode)
+		return idx->idx_class->cmp->compare_fn(a, b);
+	ea = __key_encode(idx, a, &stack_a);
+	eb = __key_encode(idx, b, &stack_b);
+	if (ea && eb)
+		res = idx->idx_class->cmp->compare_fn(ea, eb);
+	else
+		/* errno is set by the encoder */
+		res = (ea != NULL) - (eb != NULL);
+	__key_put(ea, a, &stack_a);
+	__key_put(eb, b, &stack_b);
+	return res;
 }
 
 size_t ods_idx_key_size(ods_idx_t idx)
@@ -47,6 +47,7 @@
 #define _ODS_IDX_PRIV_H_
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ods/rbt.h>
 #include <ods/ods.h>
 #include "ods_priv.h"
@@ -71,6 +72,11 @@ struct ods_idx_provider {
 	int (*stat)(ods_idx_t idx, ods_idx_stat_t sb);
 	int (*max)(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data);
 	int (*min)(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data);
+	/* Optional, return keys that partition the index into ranges */
+	int (*split)(ods_idx_t idx, ods_key_t *keys, int *count);
+	/* Optional, delete all keys in [lo, hi] */
+	int (*delete_range)(ods_idx_t idx, ods_key_t lo, ods_key_t hi,
+			    ods_range_cb_fn_t cb_fn, void *arg, uint64_t *count);
 	ods_iter_t (*iter_new)(ods_idx_t idx);
 	void (*iter_delete)(ods_iter_t i);
 	int (*iter_find)(ods_iter_t iter, ods_key_t key);
@@ -108,8 +114,82 @@ struct ods_idx_comparator {
 	size_t (*str_size)(ods_key_t);
 	/** Compare two keys */
 	ods_idx_compare_fn_t compare_fn;
+	/**
+	 * Optional. Convert an application key to the form stored in
+	 * the index. If present, ods_idx.c encodes keys before passing
+	 * them to the provider and the compare_fn is called with
+	 * encoded keys only.
+	 */
+	int (*encode)(ods_key_t dst, ods_key_t src);
+	/** Optional. Convert a stored key back to the application form */
+	int (*decode)(ods_key_t dst, ods_key_t src);
 };
 
+/*
+ * Key classes for which the index providers compare keys in line
+ * rather than calling through the comparator's compare_fn.
+ */
+typedef enum ods_key_class_e {
+	ODS_KEY_CLASS_GENERIC = 0,	/* Use the comparator compare_fn */
+	ODS_KEY_CLASS_UINT32,
+	ODS_KEY_CLASS_UINT64,		/* UINT64 and TIMESTAMP */
+	ODS_KEY_CLASS_INT64,
+	ODS_KEY_CLASS_UINT128,
+	ODS_KEY_CLASS_MEMCMP,		/* memcmp() then length order */
+} ods_key_class_t;
+
+static inline ods_key_class_t ods_key_class(struct ods_idx_comparator *cmp)
+{
+	const char *type = cmp->get_type();
+	if (0 == strcmp(type, "UINT64") || 0 == strcmp(type, "TIMESTAMP"))
+		return ODS_KEY_CLASS_UINT64;
+	if (0 == strcmp(type, "INT64"))
+		return ODS_KEY_CLASS_INT64;
+	if (0 == strcmp(type, "UINT32"))
+		return ODS_KEY_CLASS_UINT32;
+	if (0 == strcmp(type, "UINT128"))
+		return ODS_KEY_CLASS_UINT128;
+	if (0 == strcmp(type, "MEMCMP") || 0 == strcmp(type, "NCOMPOUND"))
+		return ODS_KEY_CLASS_MEMCMP;
+	return ODS_KEY_CLASS_GENERIC;
+}
+
+/*
+ * Compare two keys. The result is the same as the class
+ * comparator's compare_fn would return; the fixed-width
+ * comparators are three-way compares.
+ */
+static inline int64_t ods_key_class_cmp(ods_key_class_t kc,
+					ods_idx_compare_fn_t compare_fn,
+					ods_key_t a, ods_key_t b)
+{
+	void *av = ods_key_value(a)->value;
+	void *bv = ods_key_value(b)->value;
+	switch (kc) {
+	case ODS_KEY_CLASS_UINT64:
+		return (*(uint64_t *)av > *(uint64_t *)bv)
+			- (*(uint64_t *)av < *(uint64_t *)bv);
+	case ODS_KEY_CLASS_INT64:
+		return (*(int64_t *)av > *(int64_t *)bv)
+			- (*(int64_t *)av < *(int64_t *)bv);
+	case ODS_KEY_CLASS_UINT32:
+		return (*(uint32_t *)av > *(uint32_t *)bv)
+			- (*(uint32_t *)av < *(uint32_t *)bv);
+	case ODS_KEY_CLASS_UINT128:
+		return memcmp(av, bv, 16);
+	case ODS_KEY_CLASS_MEMCMP: {
+		ods_key_value_t ak = ods_key_value(a);
+		ods_key_value_t bk = ods_key_value(b);
+		int64_t res = memcmp(av, bv, ak->len < bk->len ? ak->len : bk->len);
+		if (res)
+			return res;
+		return (int64_t)ak->len - (int64_t)bk->len;
+	}
+	default:
+		return compare_fn(a, b);
+	}
+}
+
 #pragma pack(1)
 #define ODS_IDX_NAME_MAX	31
 struct ods_idx_meta_data {
@@ -125,6 +205,9 @@ struct ods_idx_class {
 	struct rbn rb_node;
 };
 
+struct ods_idx_class *get_idx_class(const char *type, const char *key);
+unsigned long ods_idx_arg_int(const char *args, const char *name, unsigned long def);
+
 struct ods_idx {
 	/** open and iterator references */
 	ods_atomic_t ref_count;
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Rebuild an index, for example with a different node size:
+ *
+ *    ods_idx_rebuild -p <path> -a NODE_SIZE=16K
+ *
+ * The entries are copied to a new index of the same key type that is
+ * created in a temporary directory beside the original. The new
+ * index then replaces the original.
+ */
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <libgen.h>
+#include <ftw.h>
+#include <ods/ods.h>
+#include <ods/ods_idx.h>
+#include "ods_idx_priv.h"
+
+/* The files and directories that make up an index */
+static const char *suffixes[] = { ".OBJ", ".PG", "" };
+#define SUFFIX_COUNT (sizeof(suffixes) / sizeof(suffixes[0]))
+
+void usage(int argc, char *argv[])
+{
+	printf("usage: %s -p <path> [-t <type>] [-a <args>] [-k]\n"
+	       "    -p <path>   The path to the index.\n"
+	       "    -t <type>   The new index type, the default is the current type.\n"
+	       "    -a <args>   The new index arguments, e.g. \"NODE_SIZE=16K\".\n"
+	       "    -k          Keep the original index as <path>.bak\n",
+	       argv[0]);
+	exit(1);
+}
+
+static int remove_fn(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static int remove_tree(const char *path)
+{
+	return nftw(path, remove_fn, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/*
+ * Move each file of the index at from to the same file of the index at to
+ */
+static int move_index(const char *from, const char *to)
+{
+	char from_path[PATH_MAX];
+	char to_path[PATH_MAX];
+	struct stat sb;
+	int i;
+
+	for (i = 0; i < SUFFIX_COUNT; i++) {
+		snprintf(from_path, sizeof(from_path), "%s%s", from, suffixes[i]);
+		snprintf(to_path, sizeof(to_path), "%s%s", to, suffixes[i]);
+		if (stat(from_path, &sb))
+			continue;
+		if (rename(from_path, to_path))
+			return errno;
+	}
+	return 0;
+}
+
+static void remove_index(const char *path)
+{
+	char file_path[PATH_MAX];
+	struct stat sb;
+	int i;
+
+	for (i = 0; i < SUFFIX_COUNT; i++) {
+		snprintf(file_path, sizeof(file_path), "%s%s", path, suffixes[i]);
+		if (!stat(file_path, &sb))
+			remove_tree(file_path);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	char tmp_dir[PATH_MAX];
+	char new_path[PATH_MAX];
+	char bak_path[PATH_MAX];
+	char dir_buf[PATH_MAX];
+	char base_buf[PATH_MAX];
+	char *path = NULL, *type = NULL, *args = NULL;
+	char *key_type;
+	int c, rc, keep = 0;
+	ods_idx_t idx, new_idx;
+	ods_iter_t iter;
+	struct stat sb;
+	uint64_t count = 0;
+
+	while ((c = getopt(argc, argv, "p:t:a:k")) > 0) {
+		switch (c) {
+		case 'p':
+			path = optarg;
+			break;
+		case 't':
+			type = optarg;
+			break;
+		case 'a':
+			args = optarg;
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		default:
+			usage(argc, argv);
+		}
+	}
+	if (!path)
+		usage(argc, argv);
+	/* Leave room for the longest name derived from the path */
+	if (strlen(path) + sizeof(".bak.OBJ") > sizeof(bak_path)) {
+		printf("The path %s is too long.\n", path);
+		exit(1);
+	}
+
+	idx = ods_idx_open(path, ODS_PERM_RO);
+	if (!idx) {
+		printf("Error %d opening the index %s.\n", errno, path);
+		exit(1);
+	}
+	if (!type)
+		type = strdup(idx->idx_class->prv->get_type());
+	key_type = strdup(idx->idx_class->cmp->get_type());
+	ods_stat(ods_idx_ods(idx), &sb);
+
+	/* The new index has the same base name so that H2 indices
+	 * can find their buckets once moved */
+	strcpy(dir_buf, path);
+	strcpy(base_buf, path);
+	if (snprintf(tmp_dir, sizeof(tmp_dir), "%s/.%s.rebuild",
+		     dirname(dir_buf), basename(base_buf)) >= sizeof(tmp_dir)) {
+		printf("The path %s is too long.\n", path);
+		exit(1);
+	}
+	strcpy(base_buf, path);
+	if (snprintf(new_path, sizeof(new_path), "%s/%s",
+		     tmp_dir, basename(base_buf)) >= sizeof(new_path)) {
+		printf("The path %s is too long.\n", path);
+		exit(1);
+	}
+	remove_tree(tmp_dir);
+	if (mkdir(tmp_dir, 0700)) {
+		printf("Error %d creating the directory %s.\n", errno, tmp_dir);
+		exit(1);
+	}
+	rc = ods_idx_create(new_path, sb.st_mode, type, key_type, args);
+	if (rc) {
+		printf("Error %d creating the %s index with arguments \"%s\".\n",
+		       rc, type, args ? args : "");
+		goto err;
+	}
+	new_idx = ods_idx_open(new_path, ODS_PERM_RW);
+	if (!new_idx) {
+		rc = errno;
+		printf("Error %d opening the new index.\n", rc);
+		goto err;
+	}
+	ods_idx_rt_opts_set(new_idx, ODS_IDX_OPT_MP_UNSAFE);
+
+	iter = ods_iter_new(idx);
+	if (!iter) {
+		rc = ENOMEM;
+		printf("Error %d creating an iterator.\n", rc);
+		goto err;
+	}
+	for (rc = ods_iter_begin(iter); !rc; rc = ods_iter_next(iter)) {
+		ods_key_t key = ods_iter_key(iter);
+		rc = ods_idx_insert(new_idx, key, ods_iter_data(iter));
+		ods_obj_put(key);
+		if (rc) {
+			printf("Error %d inserting entry %ld.\n", rc, count);
+			goto err;
+		}
+		count++;
+	}
+	ods_iter_delete(iter);
+	ods_idx_close(new_idx, ODS_COMMIT_SYNC);
+	ods_idx_close(idx, ODS_COMMIT_SYNC);
+
+	snprintf(bak_path, sizeof(bak_path), "%s.bak", path);
+	remove_index(bak_path);
+	rc = move_index(path, bak_path);
+	if (rc) {
+		printf("Error %d moving the original index to %s.\n", rc, bak_path);
+		goto err;
+	}
+	rc = move_index(new_path, path);
+	if (rc) {
+		printf("Error %d moving the new index to %s, the original "
+		       "index is at %s.\n", rc, path, bak_path);
+		goto err;
+	}
+	if (!keep)
+		remove_index(bak_path);
+	remove_tree(tmp_dir);
+	printf("%ld entries were copied to the new %s index.\n", count, type);
+	return 0;
+ err:
+	remove_tree(tmp_dir);
+	exit(1);
+}
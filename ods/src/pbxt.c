@@ -0,0 +1,1857 @@
+/*
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <sys/fcntl.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <ods/ods.h>
+#include <ods/ods_idx.h>
+#include "pbxt.h"
+
+#pragma GCC diagnostic ignored "-Wstrict-aliasing"
+
+#define ROUNDUP2(_sz_) (((_sz_) + 1) & ~1)
+
+/* A key and payload gathered from a node when it is split */
+struct pbxt_tmp {
+	unsigned char *key;
+	uint16_t len;
+	int dummy;		/* Entry 0 of an internal node */
+	union {
+		ods_idx_data_t data;
+		ods_ref_t ref;
+	} payload;
+};
+
+static inline size_t slot_base(pbxt_node_t n)
+{
+	return ROUNDUP2(n->ref_len);
+}
+
+static inline uint16_t *node_slots(pbxt_node_t n)
+{
+	return (uint16_t *)&n->data[slot_base(n)];
+}
+
+static inline pbxt_entry_t node_entry(pbxt_node_t n, int i)
+{
+	return (pbxt_entry_t)&n->data[node_slots(n)[i]];
+}
+
+static inline size_t payload_len(int is_leaf)
+{
+	return is_leaf ? sizeof(ods_idx_data_t) : sizeof(ods_ref_t);
+}
+
+static inline size_t entry_size(size_t slen, int is_leaf)
+{
+	return ROUNDUP2(sizeof(struct pbxt_entry) + slen + payload_len(is_leaf));
+}
+
+static inline size_t node_free(pbxt_t t, pbxt_node_t n)
+{
+	return n->heap - slot_base(n) - (n->count * sizeof(uint16_t));
+}
+
+static inline ods_idx_data_t leaf_data(pbxt_node_t n, int i)
+{
+	ods_idx_data_t data;
+	pbxt_entry_t e = node_entry(n, i);
+	memcpy(&data, &e->sfx[e->slen], sizeof(data));
+	return data;
+}
+
+static inline void leaf_data_set(pbxt_node_t n, int i, ods_idx_data_t *data)
+{
+	pbxt_entry_t e = node_entry(n, i);
+	memcpy(&e->sfx[e->slen], data, sizeof(*data));
+}
+
+static inline ods_ref_t child_ref(pbxt_node_t n, int i)
+{
+	ods_ref_t ref;
+	pbxt_entry_t e = node_entry(n, i);
+	memcpy(&ref, &e->sfx[e->slen], sizeof(ref));
+	return ref;
+}
+
+static inline void child_ref_set(pbxt_node_t n, int i, ods_ref_t ref)
+{
+	pbxt_entry_t e = node_entry(n, i);
+	memcpy(&e->sfx[e->slen], &ref, sizeof(ref));
+}
+
+/* Expand the key of entry i into key */
+static inline void entry_key(pbxt_node_t n, int i, ods_key_t key)
+{
+	pbxt_entry_t e = node_entry(n, i);
+	ods_key_value_t kv = ods_key_value(key);
+	memcpy(kv->value, n->data, e->plen);
+	memcpy(&kv->value[e->plen], e->sfx, e->slen);
+	kv->len = e->plen + e->slen;
+}
+
+static inline size_t common_prefix(const unsigned char *a, size_t a_len,
+				   const unsigned char *b, size_t b_len)
+{
+	size_t i, len = (a_len < b_len ? a_len : b_len);
+	for (i = 0; i < len && a[i] == b[i]; i++)
+		;
+	return i;
+}
+
+/*
+ * Return the index of the first entry at or after \c start whose key
+ * is >= key, or > key if \c upper is set.
+ */
+static int node_search(pbxt_t t, pbxt_node_t n, int start,
+		       ods_key_t key, int upper, ods_key_t ek)
+{
+	int lo = start, hi = n->count;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		int64_t rc;
+		entry_key(n, mid, ek);
+		rc = PBXT_KEY_CMP(t, ek, key);
+		if (rc < 0 || (upper && rc == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int64_t entry_cmp(pbxt_t t, pbxt_node_t n, int i, ods_key_t key, ods_key_t ek)
+{
+	entry_key(n, i, ek);
+	return PBXT_KEY_CMP(t, ek, key);
+}
+
+static void path_put(struct pbxt_path *p)
+{
+	int i;
+	for (i = 0; i < p->depth; i++) {
+		if (p->node[i])
+			ods_obj_put(p->node[i]);
+		p->node[i] = NULL;
+	}
+	p->depth = 0;
+}
+
+/*
+ * Descend from the root to the leaf that would contain the key. If
+ * \c upper is zero, the path leads to the leaf containing the first
+ * entry >= key and the leaf position is that entry; otherwise the
+ * path leads to the leaf containing the last entry <= key and the
+ * leaf position is the entry following it.
+ */
+static int descend(pbxt_t t, ods_key_t key, int upper,
+		   struct pbxt_path *p, ods_key_t ek)
+{
+	ods_ref_t ref = t->udata->root_ref;
+	ods_obj_t n;
+	int i;
+
+	p->depth = 0;
+	while (ref) {
+		if (p->depth >= PBXT_MAX_DEPTH)
+			goto err;
+		n = ods_ref_as_obj(t->ods, ref);
+		if (!n)
+			goto err;
+		p->node[p->depth] = n;
+		if (PNODE(n)->is_leaf) {
+			p->ent[p->depth] = node_search(t, PNODE(n), 0, key, upper, ek);
+			p->depth++;
+			return 0;
+		}
+		i = node_search(t, PNODE(n), 1, key, upper, ek) - 1;
+		p->ent[p->depth] = i;
+		p->depth++;
+		ref = child_ref(PNODE(n), i);
+	}
+	return ENOENT;
+ err:
+	path_put(p);
+	return EINVAL;
+}
+
+/*
+ * Find the path to a specific leaf. The key must be in the key range
+ * of the leaf.
+ */
+static int path_to(pbxt_t t, ods_ref_t ref, ods_key_t key, ods_ref_t leaf_ref,
+		   struct pbxt_path *p, ods_key_t ek)
+{
+	ods_obj_t n;
+	int i, lo, hi;
+
+	if (p->depth >= PBXT_MAX_DEPTH)
+		return EINVAL;
+	n = ods_ref_as_obj(t->ods, ref);
+	if (!n)
+		return EINVAL;
+	if (ref == leaf_ref) {
+		p->node[p->depth++] = n;
+		return 0;
+	}
+	if (PNODE(n)->is_leaf) {
+		ods_obj_put(n);
+		return ENOENT;
+	}
+	lo = node_search(t, PNODE(n), 1, key, 0, ek) - 1;
+	hi = node_search(t, PNODE(n), 1, key, 1, ek) - 1;
+	p->node[p->depth++] = n;
+	for (i = lo; i <= hi; i++) {
+		p->ent[p->depth - 1] = i;
+		if (0 == path_to(t, child_ref(PNODE(n), i), key, leaf_ref, p, ek))
+			return 0;
+	}
+	p->node[--p->depth] = NULL;
+	ods_obj_put(n);
+	return ENOENT;
+}
+
+/* Return the sibling of a leaf and drop the reference on the leaf */
+static ods_obj_t leaf_sibling(pbxt_t t, ods_obj_t leaf, int right)
+{
+	ods_ref_t ref = (right ? PNODE(leaf)->next : PNODE(leaf)->prev);
+	ods_obj_put(leaf);
+	if (!ref)
+		return NULL;
+	return ods_ref_as_obj(t->ods, ref);
+}
+
+/* Move a (leaf, entry) position forward one entry */
+static int pos_next(pbxt_t t, ods_obj_t *leaf, int *ent)
+{
+	if (*ent + 1 < PNODE(*leaf)->count) {
+		*ent += 1;
+		return 0;
+	}
+	*leaf = leaf_sibling(t, *leaf, 1);
+	*ent = 0;
+	return *leaf ? 0 : ENOENT;
+}
+
+/* Move a (leaf, entry) position back one entry */
+static int pos_prev(pbxt_t t, ods_obj_t *leaf, int *ent)
+{
+	if (*ent > 0) {
+		*ent -= 1;
+		return 0;
+	}
+	*leaf = leaf_sibling(t, *leaf, 0);
+	if (!*leaf)
+		return ENOENT;
+	*ent = PNODE(*leaf)->count - 1;
+	return 0;
+}
+
+/* Move a position to the first duplicate of its key */
+static void pos_first_dup(pbxt_t t, ods_obj_t *leaf, int *ent)
+{
+	PBXT_KEY(key);
+	PBXT_KEY(ek);
+	ods_obj_t n;
+	int i;
+
+	entry_key(PNODE(*leaf), *ent, key);
+	for (;;) {
+		n = ods_obj_get(*leaf);
+		i = *ent;
+		if (pos_prev(t, &n, &i))
+			break;
+		if (entry_cmp(t, PNODE(n), i, key, ek)) {
+			ods_obj_put(n);
+			break;
+		}
+		ods_obj_put(*leaf);
+		*leaf = n;
+		*ent = i;
+	}
+}
+
+/* Move a position to the last duplicate of its key */
+static void pos_last_dup(pbxt_t t, ods_obj_t *leaf, int *ent)
+{
+	PBXT_KEY(key);
+	PBXT_KEY(ek);
+	ods_obj_t n;
+	int i;
+
+	entry_key(PNODE(*leaf), *ent, key);
+	for (;;) {
+		n = ods_obj_get(*leaf);
+		i = *ent;
+		if (pos_next(t, &n, &i))
+			break;
+		if (entry_cmp(t, PNODE(n), i, key, ek)) {
+			ods_obj_put(n);
+			break;
+		}
+		ods_obj_put(*leaf);
+		*leaf = n;
+		*ent = i;
+	}
+}
+
+/* Return !0 if the key at the position has a duplicate */
+static int pos_is_dup(pbxt_t t, ods_obj_t leaf, int ent)
+{
+	PBXT_KEY(key);
+	PBXT_KEY(ek);
+	ods_obj_t n;
+	int i, dup = 0;
+
+	entry_key(PNODE(leaf), ent, key);
+	n = ods_obj_get(leaf);
+	i = ent;
+	if (0 == pos_prev(t, &n, &i)) {
+		dup = (0 == entry_cmp(t, PNODE(n), i, key, ek));
+		ods_obj_put(n);
+	}
+	if (dup)
+		return 1;
+	n = ods_obj_get(leaf);
+	i = ent;
+	if (0 == pos_next(t, &n, &i)) {
+		dup = (0 == entry_cmp(t, PNODE(n), i, key, ek));
+		ods_obj_put(n);
+	}
+	return dup;
+}
+
+/*
+ * Find the first entry >= key. Returns the leaf and sets *ent, or
+ * NULL if there is no such entry.
+ */
+static ods_obj_t find_ge(pbxt_t t, ods_key_t key, int *ent)
+{
+	struct pbxt_path p;
+	ods_obj_t leaf;
+	PBXT_KEY(ek);
+
+	if (descend(t, key, 0, &p, ek))
+		return NULL;
+	leaf = p.node[p.depth - 1];
+	*ent = p.ent[p.depth - 1];
+	p.node[p.depth - 1] = NULL;
+	path_put(&p);
+	if (*ent >= PNODE(leaf)->count) {
+		leaf = leaf_sibling(t, leaf, 1);
+		*ent = 0;
+	}
+	return leaf;
+}
+
+/*
+ * Find the last entry <= key. Returns the leaf and sets *ent, or
+ * NULL if there is no such entry.
+ */
+static ods_obj_t find_le(pbxt_t t, ods_key_t key, int *ent)
+{
+	struct pbxt_path p;
+	ods_obj_t leaf;
+	PBXT_KEY(ek);
+
+	if (descend(t, key, 1, &p, ek))
+		return NULL;
+	leaf = p.node[p.depth - 1];
+	*ent = p.ent[p.depth - 1] - 1;
+	p.node[p.depth - 1] = NULL;
+	path_put(&p);
+	if (*ent < 0) {
+		leaf = leaf_sibling(t, leaf, 0);
+		if (leaf)
+			*ent = PNODE(leaf)->count - 1;
+	}
+	return leaf;
+}
+
+/* Find the first entry whose key is equal to key */
+static ods_obj_t find_eq(pbxt_t t, ods_key_t key, int *ent)
+{
+	PBXT_KEY(ek);
+	ods_obj_t leaf = find_ge(t, key, ent);
+	if (!leaf)
+		return NULL;
+	if (entry_cmp(t, PNODE(leaf), *ent, key, ek)) {
+		ods_obj_put(leaf);
+		return NULL;
+	}
+	return leaf;
+}
+
+static ods_obj_t node_alloc(pbxt_t t, int is_leaf)
+{
+	ods_obj_t obj;
+	pbxt_node_t n;
+
+	obj = ods_obj_alloc_extend(t->ods, t->udata->node_size, PBXT_EXTEND_SIZE);
+	if (!obj)
+		return NULL;
+	n = PNODE(obj);
+	n->next = n->prev = 0;
+	n->count = 0;
+	n->is_leaf = is_leaf;
+	n->ref_len = 0;
+	n->heap = t->data_size;
+	return obj;
+}
+
+static void node_delete(ods_obj_t node)
+{
+	ods_obj_delete(node);
+	ods_obj_put(node);
+}
+
+/* Remove the holes left in the entry heap by deleted entries */
+static int node_compact(pbxt_t t, pbxt_node_t n)
+{
+	unsigned char *buf;
+	uint16_t *slots = node_slots(n);
+	size_t off = t->data_size;
+	int i;
+
+	buf = malloc(t->data_size);
+	if (!buf)
+		return ENOMEM;
+	for (i = 0; i < n->count; i++) {
+		pbxt_entry_t e = node_entry(n, i);
+		size_t sz = entry_size(e->slen, n->is_leaf);
+		off -= sz;
+		memcpy(&buf[off], e, sz);
+		slots[i] = off;
+	}
+	memcpy(&n->data[off], &buf[off], t->data_size - off);
+	n->heap = off;
+	free(buf);
+	return 0;
+}
+
+static size_t node_live_size(pbxt_t t, pbxt_node_t n)
+{
+	size_t sz = slot_base(n) + (n->count * sizeof(uint16_t));
+	int i;
+	for (i = 0; i < n->count; i++)
+		sz += entry_size(node_entry(n, i)->slen, n->is_leaf);
+	return sz;
+}
+
+/*
+ * Insert an entry at position \c ent in the node. Returns ENOSPC if
+ * the entry does not fit.
+ */
+static int node_insert(pbxt_t t, pbxt_node_t n, int ent,
+		       ods_key_t key, void *payload)
+{
+	ods_key_value_t kv = ods_key_value(key);
+	size_t plen = common_prefix(n->data, n->ref_len, kv->value, kv->len);
+	size_t slen = kv->len - plen;
+	size_t sz = entry_size(slen, n->is_leaf);
+	uint16_t *slots;
+	pbxt_entry_t e;
+
+	if (node_free(t, n) < sz + sizeof(uint16_t)) {
+		if (node_live_size(t, n) + sz + sizeof(uint16_t) > t->data_size)
+			return ENOSPC;
+		if (node_compact(t, n))
+			return ENOMEM;
+	}
+	n->heap -= sz;
+	e = (pbxt_entry_t)&n->data[n->heap];
+	e->plen = plen;
+	e->slen = slen;
+	memcpy(e->sfx, &kv->value[plen], slen);
+	memcpy(&e->sfx[slen], payload, payload_len(n->is_leaf));
+	slots = node_slots(n);
+	memmove(&slots[ent + 1], &slots[ent], (n->count - ent) * sizeof(uint16_t));
+	slots[ent] = n->heap;
+	n->count++;
+	return 0;
+}
+
+static void node_remove(pbxt_node_t n, int ent)
+{
+	uint16_t *slots = node_slots(n);
+	memmove(&slots[ent], &slots[ent + 1], (n->count - ent - 1) * sizeof(uint16_t));
+	n->count--;
+}
+
+/* Expand every entry of a node plus a new entry into tmp */
+static struct pbxt_tmp *node_gather(pbxt_t t, pbxt_node_t n, int ent,
+				    ods_key_t key, void *payload,
+				    unsigned char **kbuf)
+{
+	struct pbxt_tmp *tmp;
+	size_t klen = ods_key_len(key) + n->ref_len;
+	unsigned char *p;
+	int i, j;
+
+	for (i = 0; i < n->count; i++) {
+		pbxt_entry_t e = node_entry(n, i);
+		klen += e->plen + e->slen;
+	}
+	tmp = calloc(n->count + 1, sizeof(*tmp));
+	*kbuf = malloc(klen);
+	if (!tmp || !*kbuf) {
+		free(tmp);
+		free(*kbuf);
+		return NULL;
+	}
+	/* The node's reference key is saved at the start of kbuf */
+	p = *kbuf;
+	memcpy(p, n->data, n->ref_len);
+	p += n->ref_len;
+	for (i = j = 0; j <= n->count; j++) {
+		struct pbxt_tmp *tp = &tmp[j];
+		if (j == ent) {
+			tp->key = p;
+			tp->len = ods_key_len(key);
+			memcpy(p, ods_key_value(key)->value, tp->len);
+			memcpy(&tp->payload, payload, payload_len(n->is_leaf));
+		} else {
+			pbxt_entry_t e = node_entry(n, i);
+			tp->key = p;
+			tp->len = e->plen + e->slen;
+			memcpy(p, n->data, e->plen);
+			memcpy(&p[e->plen], e->sfx, e->slen);
+			memcpy(&tp->payload, &e->sfx[e->slen], payload_len(n->is_leaf));
+			if (!n->is_leaf && i == 0)
+				tp->dummy = 1;
+			i++;
+		}
+		p += tp->len;
+	}
+	return tmp;
+}
+
+/* The bytes required for an entry and its slot given a reference key */
+static size_t tmp_entry_size(struct pbxt_tmp *tp, int is_leaf,
+			     unsigned char *ref, size_t ref_len)
+{
+	size_t slen = 0;
+	if (!tp->dummy)
+		slen = tp->len - common_prefix(ref, ref_len, tp->key, tp->len);
+	return entry_size(slen, is_leaf) + sizeof(uint16_t);
+}
+
+/* The bytes required for the entries [lo, hi) given a reference key */
+static size_t tmp_size(struct pbxt_tmp *tmp, int lo, int hi, int is_leaf,
+		       unsigned char *ref, size_t ref_len)
+{
+	size_t sz = ROUNDUP2(ref_len);
+	int i;
+	for (i = lo; i < hi; i++)
+		sz += tmp_entry_size(&tmp[i], is_leaf, ref, ref_len);
+	return sz;
+}
+
+/*
+ * Rebuild a node from the entries [lo, hi). The first key becomes the
+ * node's reference key if the entries fit, otherwise the reference key
+ * \c ref is kept.
+ */
+static void node_build(pbxt_t t, pbxt_node_t n, struct pbxt_tmp *tmp, int lo, int hi,
+		       unsigned char *ref, size_t ref_len)
+{
+	int i, first = lo;
+	uint16_t *slots;
+
+	while (first < hi && tmp[first].dummy)
+		first++;
+	if (first < hi
+	    && tmp_size(tmp, lo, hi, n->is_leaf, tmp[first].key, tmp[first].len)
+	    <= t->data_size) {
+		ref = tmp[first].key;
+		ref_len = tmp[first].len;
+	}
+	memmove(n->data, ref, ref_len);
+	n->ref_len = ref_len;
+	n->heap = t->data_size;
+	n->count = 0;
+	slots = node_slots(n);
+	for (i = lo; i < hi; i++) {
+		size_t plen = 0, slen;
+		pbxt_entry_t e;
+		if (!tmp[i].dummy)
+			plen = common_prefix(n->data, n->ref_len, tmp[i].key, tmp[i].len);
+		slen = tmp[i].len - plen;
+		if (tmp[i].dummy)
+			slen = 0;
+		n->heap -= entry_size(slen, n->is_leaf);
+		e = (pbxt_entry_t)&n->data[n->heap];
+		e->plen = plen;
+		e->slen = slen;
+		memcpy(e->sfx, &tmp[i].key[plen], slen);
+		memcpy(&e->sfx[slen], &tmp[i].payload, payload_len(n->is_leaf));
+		slots[n->count++] = n->heap;
+	}
+}
+
+/*
+ * Compute the separator between the last key of a left leaf and the
+ * first key of its right sibling.
+ */
+static void leaf_separator(pbxt_t t, struct pbxt_tmp *left, struct pbxt_tmp *right,
+			   ods_key_t sep)
+{
+	ods_key_value_t kv = ods_key_value(sep);
+	size_t len = right->len;
+
+	if (t->key_class == ODS_KEY_CLASS_MEMCMP) {
+		/* The shortest prefix of right that is > left */
+		len = common_prefix(left->key, left->len, right->key, right->len) + 1;
+		if (len > right->len)
+			len = right->len;
+	}
+	memcpy(kv->value, right->key, len);
+	kv->len = len;
+}
+
+static int insert_at(pbxt_t t, struct pbxt_path *p, int level, int ent,
+		     ods_key_t key, void *payload);
+
+/* Split the node at path level and insert the entry */
+static int node_split_insert(pbxt_t t, struct pbxt_path *p, int level, int ent,
+			     ods_key_t key, void *payload)
+{
+	ods_obj_t left = p->node[level];
+	ods_obj_t right;
+	pbxt_node_t ln = PNODE(left);
+	pbxt_node_t rn;
+	struct pbxt_tmp *tmp;
+	unsigned char *kbuf;
+	size_t ref_len = ln->ref_len;
+	size_t total, sum;
+	int is_leaf = ln->is_leaf;
+	int m, cnt = ln->count + 1;
+	ods_ref_t right_ref;
+	PBXT_KEY(sep);
+	int rc;
+
+	tmp = node_gather(t, ln, ent, key, payload, &kbuf);
+	if (!tmp)
+		return ENOMEM;
+	right = node_alloc(t, is_leaf);
+	if (!right) {
+		rc = ENOMEM;
+		goto out;
+	}
+	rn = PNODE(right);
+	right_ref = ods_obj_ref(right);
+
+	/* Split in the middle of the bytes used with the current reference key */
+	total = tmp_size(tmp, 0, cnt, is_leaf, kbuf, ref_len);
+	for (m = 0, sum = 0; m < cnt - 1; m++) {
+		sum += tmp_entry_size(&tmp[m], is_leaf, kbuf, ref_len);
+		if (sum >= total / 2)
+			break;
+	}
+	m = m + 1;
+	if (m >= cnt)
+		m = cnt - 1;
+
+	if (is_leaf) {
+		leaf_separator(t, &tmp[m - 1], &tmp[m], sep);
+	} else {
+		memcpy(ods_key_value(sep)->value, tmp[m].key, tmp[m].len);
+		ods_key_value(sep)->len = tmp[m].len;
+		tmp[m].dummy = 1;
+	}
+	node_build(t, ln, tmp, 0, m, kbuf, ref_len);
+	node_build(t, rn, tmp, m, cnt, kbuf, ref_len);
+
+	if (is_leaf) {
+		rn->prev = ods_obj_ref(left);
+		rn->next = ln->next;
+		ln->next = right_ref;
+		if (rn->next) {
+			ods_obj_t next = ods_ref_as_obj(t->ods, rn->next);
+			PNODE(next)->prev = right_ref;
+			ods_obj_put(next);
+		}
+	}
+	ods_obj_put(right);
+
+	if (level == 0) {
+		/* Split the root */
+		ods_obj_t root = node_alloc(t, 0);
+		ods_ref_t left_ref = ods_obj_ref(left);
+		PBXT_KEY(nokey);
+		if (!root) {
+			rc = ENOMEM;
+			goto out;
+		}
+		ods_key_value(nokey)->len = 0;
+		memcpy(PNODE(root)->data, ods_key_value(sep)->value, ods_key_len(sep));
+		PNODE(root)->ref_len = ods_key_len(sep);
+		node_insert(t, PNODE(root), 0, nokey, &left_ref);
+		node_insert(t, PNODE(root), 1, sep, &right_ref);
+		t->udata->root_ref = ods_obj_ref(root);
+		t->udata->depth++;
+		ods_obj_put(root);
+		rc = 0;
+		goto out;
+	}
+	rc = insert_at(t, p, level - 1, p->ent[level - 1] + 1, sep, &right_ref);
+ out:
+	free(tmp);
+	free(kbuf);
+	return rc;
+}
+
+static int insert_at(pbxt_t t, struct pbxt_path *p, int level, int ent,
+		     ods_key_t key, void *payload)
+{
+	int rc = node_insert(t, PNODE(p->node[level]), ent, key, payload);
+	if (rc != ENOSPC)
+		return rc;
+	return node_split_insert(t, p, level, ent, key, payload);
+}
+
+static int pbxt_insert_no_lock(pbxt_t t, ods_key_t key, ods_idx_data_t data)
+{
+	struct pbxt_path p;
+	ods_obj_t leaf;
+	int rc, ent, dup = 0;
+	PBXT_KEY(ek);
+
+	if (ods_key_len(key) > t->key_max)
+		return EINVAL;
+
+	if (!t->udata->root_ref) {
+		leaf = node_alloc(t, 1);
+		if (!leaf)
+			return ENOMEM;
+		memcpy(PNODE(leaf)->data, ods_key_value(key)->value, ods_key_len(key));
+		PNODE(leaf)->ref_len = ods_key_len(key);
+		rc = node_insert(t, PNODE(leaf), 0, key, &data);
+		assert(rc == 0);
+		t->udata->root_ref = ods_obj_ref(leaf);
+		t->udata->depth = 1;
+		ods_obj_put(leaf);
+		goto out;
+	}
+
+	rc = descend(t, key, 1, &p, ek);
+	if (rc)
+		return rc;
+	leaf = p.node[p.depth - 1];
+	ent = p.ent[p.depth - 1];
+	if (ent > 0) {
+		dup = (0 == entry_cmp(t, PNODE(leaf), ent - 1, key, ek));
+	} else if (PNODE(leaf)->prev) {
+		ods_obj_t prev = ods_ref_as_obj(t->ods, PNODE(leaf)->prev);
+		dup = (0 == entry_cmp(t, PNODE(prev), PNODE(prev)->count - 1, key, ek));
+		ods_obj_put(prev);
+	}
+	rc = insert_at(t, &p, p.depth - 1, ent, key, &data);
+	path_put(&p);
+	if (rc)
+		return rc;
+	if (dup)
+		ods_atomic_inc(&t->udata->dups);
+ out:
+	ods_atomic_inc(&t->udata->card);
+	return 0;
+}
+
+/* Expand the entries of a node into tmp and their keys into p */
+static unsigned char *node_expand(pbxt_node_t n, struct pbxt_tmp *tmp,
+				  unsigned char *p)
+{
+	int i;
+	for (i = 0; i < n->count; i++) {
+		pbxt_entry_t e = node_entry(n, i);
+		tmp[i].key = p;
+		tmp[i].len = e->plen + e->slen;
+		tmp[i].dummy = (!n->is_leaf && i == 0);
+		memcpy(p, n->data, e->plen);
+		memcpy(&p[e->plen], e->sfx, e->slen);
+		memcpy(&tmp[i].payload, &e->sfx[e->slen], payload_len(n->is_leaf));
+		p += tmp[i].len;
+	}
+	return p;
+}
+
+/*
+ * Merge the node at path level with a sibling that has the same
+ * parent. The entries of the right node are moved to the left node and
+ * the right node is removed from the tree. The nodes are only merged
+ * if the result is no more than 3/4 full so that an insert does not
+ * immediately split them again. If the entry \c succ is in the right
+ * node it is updated to its new position. Returns !0 if the nodes were
+ * merged.
+ */
+static int node_merge(pbxt_t t, struct pbxt_path *p, int level,
+		      struct pbxt_succ *succ)
+{
+	pbxt_node_t pn = PNODE(p->node[level - 1]);
+	int pe = p->ent[level - 1];
+	ods_obj_t left, right;
+	pbxt_node_t ln, rn;
+	struct pbxt_tmp *tmp = NULL;
+	unsigned char *kbuf = NULL, *kp;
+	size_t klen, ref_len;
+	int i, sep_ent, first, cnt, lcnt, merged = 0;
+	PBXT_KEY(sep);
+
+	if (pe + 1 < pn->count) {
+		left = ods_obj_get(p->node[level]);
+		right = ods_ref_as_obj(t->ods, child_ref(pn, pe + 1));
+		sep_ent = pe + 1;
+	} else if (pe > 0) {
+		left = ods_ref_as_obj(t->ods, child_ref(pn, pe - 1));
+		right = ods_obj_get(p->node[level]);
+		sep_ent = pe;
+	} else {
+		return 0;
+	}
+	if (!left || !right)
+		goto out;
+	ln = PNODE(left);
+	rn = PNODE(right);
+	lcnt = ln->count;
+	cnt = ln->count + rn->count;
+	entry_key(pn, sep_ent, sep);
+	ref_len = ln->ref_len;
+	klen = ref_len + ods_key_len(sep);
+	for (i = 0; i < ln->count; i++)
+		klen += node_entry(ln, i)->plen + node_entry(ln, i)->slen;
+	for (i = 0; i < rn->count; i++)
+		klen += node_entry(rn, i)->plen + node_entry(rn, i)->slen;
+	tmp = calloc(cnt, sizeof(*tmp));
+	kbuf = malloc(klen);
+	if (!tmp || !kbuf)
+		goto out;
+	memcpy(kbuf, ln->data, ref_len);
+	kp = node_expand(ln, tmp, kbuf + ref_len);
+	kp = node_expand(rn, &tmp[lcnt], kp);
+	if (!ln->is_leaf) {
+		/* The separator is the key of the right node's first child */
+		tmp[lcnt].key = kp;
+		tmp[lcnt].len = ods_key_len(sep);
+		tmp[lcnt].dummy = 0;
+		memcpy(kp, ods_key_value(sep)->value, ods_key_len(sep));
+	}
+	for (first = 0; first < cnt && tmp[first].dummy; first++)
+		;
+	if (first >= cnt
+	    || tmp_size(tmp, 0, cnt, ln->is_leaf, tmp[first].key, tmp[first].len)
+	    > t->data_size * 3 / 4)
+		goto out;
+
+	node_build(t, ln, tmp, 0, cnt, kbuf, ref_len);
+	if (ln->is_leaf) {
+		ln->next = rn->next;
+		if (rn->next) {
+			ods_obj_t next = ods_ref_as_obj(t->ods, rn->next);
+			PNODE(next)->prev = ods_obj_ref(left);
+			ods_obj_put(next);
+		}
+	}
+	if (succ && succ->ref == ods_obj_ref(right)) {
+		succ->ref = ods_obj_ref(left);
+		succ->ent += lcnt;
+	}
+	node_remove(pn, sep_ent);
+	if (ods_obj_ref(p->node[level]) == ods_obj_ref(right)) {
+		ods_obj_put(p->node[level]);
+		p->node[level] = NULL;
+	}
+	node_delete(right);
+	right = NULL;
+	merged = 1;
+ out:
+	free(tmp);
+	free(kbuf);
+	if (left)
+		ods_obj_put(left);
+	if (right)
+		ods_obj_put(right);
+	return merged;
+}
+
+/*
+ * Delete the entry at the leaf position in the path. Empty nodes are
+ * removed from the tree, and a node that is less than 1/4 full is
+ * merged with a sibling if they fit in one node. If \c succ is not
+ * NULL it is set to the position of the entry that followed the
+ * deleted entry; succ->ref is 0 if it was the last entry.
+ */
+static void delete_at(pbxt_t t, struct pbxt_path *p, struct pbxt_succ *succ)
+{
+	int level = p->depth - 1;
+	struct pbxt_succ next;
+	ods_obj_t root;
+
+	node_remove(PNODE(p->node[level]), p->ent[level]);
+	if (p->ent[level] < PNODE(p->node[level])->count) {
+		next.ref = ods_obj_ref(p->node[level]);
+		next.ent = p->ent[level];
+	} else {
+		next.ref = PNODE(p->node[level])->next;
+		next.ent = 0;
+	}
+	while (PNODE(p->node[level])->count == 0) {
+		ods_obj_t node = p->node[level];
+		if (PNODE(node)->is_leaf) {
+			if (PNODE(node)->prev) {
+				ods_obj_t prev = ods_ref_as_obj(t->ods, PNODE(node)->prev);
+				PNODE(prev)->next = PNODE(node)->next;
+				ods_obj_put(prev);
+			}
+			if (PNODE(node)->next) {
+				ods_obj_t next = ods_ref_as_obj(t->ods, PNODE(node)->next);
+				PNODE(next)->prev = PNODE(node)->prev;
+				ods_obj_put(next);
+			}
+		}
+		p->node[level] = NULL;
+		node_delete(node);
+		if (level == 0) {
+			t->udata->root_ref = 0;
+			t->udata->depth = 0;
+			goto out;
+		}
+		level--;
+		node_remove(PNODE(p->node[level]), p->ent[level]);
+	}
+	/* Merge under-full nodes up the path */
+	for (; level > 0; level--) {
+		if (node_live_size(t, PNODE(p->node[level])) > t->data_size / 4)
+			break;
+		if (!node_merge(t, p, level, &next))
+			break;
+	}
+	/* Collapse internal roots with a single child */
+	root = ods_ref_as_obj(t->ods, t->udata->root_ref);
+	while (root && !PNODE(root)->is_leaf && PNODE(root)->count == 1) {
+		ods_ref_t child = child_ref(PNODE(root), 0);
+		int i;
+		for (i = 0; i < p->depth; i++) {
+			if (p->node[i] && ods_obj_ref(p->node[i]) == ods_obj_ref(root)) {
+				ods_obj_put(p->node[i]);
+				p->node[i] = NULL;
+			}
+		}
+		node_delete(root);
+		t->udata->root_ref = child;
+		t->udata->depth--;
+		root = ods_ref_as_obj(t->ods, child);
+	}
+	if (root)
+		ods_obj_put(root);
+ out:
+	if (succ)
+		*succ = next;
+}
+
+/*
+ * Delete the entry at (leaf, ent). If \c succ is not NULL it is set
+ * to the position of the following entry, see delete_at().
+ */
+static int delete_entry(pbxt_t t, ods_obj_t leaf, int ent, struct pbxt_succ *succ)
+{
+	struct pbxt_path p;
+	PBXT_KEY(key);
+	PBXT_KEY(ek);
+	int dup, rc;
+
+	dup = pos_is_dup(t, leaf, ent);
+	entry_key(PNODE(leaf), ent, key);
+	p.depth = 0;
+	rc = path_to(t, t->udata->root_ref, key, ods_obj_ref(leaf), &p, ek);
+	if (rc)
+		return rc;
+	p.ent[p.depth - 1] = ent;
+	delete_at(t, &p, succ);
+	path_put(&p);
+	ods_atomic_dec(&t->udata->card);
+	if (dup)
+		ods_atomic_dec(&t->udata->dups);
+	return 0;
+}
+
+static void print_node(ods_idx_t idx, ods_obj_t n, int ent, int indent, FILE *fp)
+{
+	pbxt_t t = idx->priv;
+	PBXT_KEY(key);
+	char *keystr;
+	size_t keylen;
+	int i;
+
+	fprintf(fp, "%*s%s[%d] | %p : count %d free %zu\n", indent, "",
+		PNODE(n)->is_leaf ? "LEAF" : "NODE", ent,
+		(void *)(unsigned long)ods_obj_ref(n), PNODE(n)->count,
+		node_free(t, PNODE(n)));
+	for (i = 0; i < PNODE(n)->count; i++) {
+		entry_key(PNODE(n), i, key);
+		keylen = ods_idx_key_str_size(idx, key);
+		keystr = malloc(keylen);
+		if (!keystr)
+			return;
+		if (!PNODE(n)->is_leaf && i == 0)
+			strcpy(keystr, "-");
+		else
+			ods_key_to_str(idx, key, keystr, keylen);
+		if (PNODE(n)->is_leaf) {
+			ods_idx_data_t data = leaf_data(PNODE(n), i);
+			fprintf(fp, "%*s%s : %lx:%lx\n", indent + 4, "", keystr,
+				data.uint64_[0], data.uint64_[1]);
+		} else {
+			ods_obj_t child = ods_ref_as_obj(t->ods, child_ref(PNODE(n), i));
+			fprintf(fp, "%*s%s :\n", indent + 4, "", keystr);
+			if (child) {
+				print_node(idx, child, i, indent + 4, fp);
+				ods_obj_put(child);
+			}
+		}
+		free(keystr);
+	}
+}
+
+static void print_idx(ods_idx_t idx, FILE *fp)
+{
+	pbxt_t t = idx->priv;
+	ods_obj_t node = ods_ref_as_obj(t->ods, t->udata->root_ref);
+	if (!node) {
+		fprintf(fp, "<nil>\n");
+		return;
+	}
+	print_node(idx, node, 0, 0, fp);
+	ods_obj_put(node);
+}
+
+static void print_info(ods_idx_t idx, FILE *fp)
+{
+	pbxt_t t = idx->priv;
+	fprintf(fp, "%*s : %d\n", 12, "Node Size", t->udata->node_size);
+	fprintf(fp, "%*s : %lx\n", 12, "Root Ref", t->udata->root_ref);
+	fprintf(fp, "%*s : %d\n", 12, "Depth", t->udata->depth);
+	fprintf(fp, "%*s : %d\n", 12, "Cardinality", t->udata->card);
+	fprintf(fp, "%*s : %d\n", 12, "Duplicates", t->udata->dups);
+	fflush(fp);
+}
+
+static int verify_node(ods_idx_t idx, ods_obj_t n, ods_key_t lo, ods_key_t hi,
+		       int depth, uint64_t *count, FILE *fp)
+{
+	pbxt_t t = idx->priv;
+	PBXT_KEY(key);
+	PBXT_KEY(prev);
+	int i, rc = 0;
+
+	if (!PNODE(n)->count) {
+		fprintf(fp, "Node %p is empty\n", (void *)(unsigned long)ods_obj_ref(n));
+		return 1;
+	}
+	if (node_live_size(t, PNODE(n)) > t->data_size) {
+		fprintf(fp, "Node %p is overfull\n", (void *)(unsigned long)ods_obj_ref(n));
+		return 1;
+	}
+	for (i = 0; i < PNODE(n)->count; i++) {
+		if (!PNODE(n)->is_leaf && i == 0)
+			goto child;
+		entry_key(PNODE(n), i, key);
+		if ((lo && PBXT_KEY_CMP(t, key, lo) < 0)
+		    || (hi && PBXT_KEY_CMP(t, key, hi) > 0)) {
+			fprintf(fp, "Node %p entry %d is out of range\n",
+				(void *)(unsigned long)ods_obj_ref(n), i);
+			rc = 1;
+		}
+		if (i > (PNODE(n)->is_leaf ? 0 : 1) && PBXT_KEY_CMP(t, prev, key) > 0) {
+			fprintf(fp, "Node %p entry %d is out of order\n",
+				(void *)(unsigned long)ods_obj_ref(n), i);
+			rc = 1;
+		}
+		ods_key_copy(prev, key);
+	child:
+		if (PNODE(n)->is_leaf) {
+			*count += 1;
+			continue;
+		}
+		{
+			PBXT_KEY(clo);
+			PBXT_KEY(chi);
+			ods_key_t cl = lo, ch = hi;
+			ods_obj_t child;
+			if (i > 0) {
+				entry_key(PNODE(n), i, clo);
+				cl = clo;
+			}
+			if (i + 1 < PNODE(n)->count) {
+				entry_key(PNODE(n), i + 1, chi);
+				ch = chi;
+			}
+			child = ods_ref_as_obj(t->ods, child_ref(PNODE(n), i));
+			if (!child) {
+				fprintf(fp, "Node %p entry %d has a bad child\n",
+					(void *)(unsigned long)ods_obj_ref(n), i);
+				return 1;
+			}
+			rc |= verify_node(idx, child, cl, ch, depth + 1, count, fp);
+			ods_obj_put(child);
+		}
+	}
+	return rc;
+}
+
+static int verify_idx(ods_idx_t idx, FILE *fp)
+{
+	pbxt_t t = idx->priv;
+	uint64_t count = 0;
+	ods_obj_t root;
+	int rc;
+
+	if (!fp)
+		fp = stdout;
+	root = ods_ref_as_obj(t->ods, t->udata->root_ref);
+	if (!root)
+		return t->udata->card ? 1 : 0;
+	rc = verify_node(idx, root, NULL, NULL, 1, &count, fp);
+	ods_obj_put(root);
+	if (count != t->udata->card) {
+		fprintf(fp, "The tree has %ld entries but the cardinality is %d\n",
+			count, t->udata->card);
+		rc = 1;
+	}
+	return rc;
+}
+
+static int pbxt_open(ods_idx_t idx)
+{
+	ods_obj_t udata;
+	pbxt_t t;
+	udata = ods_get_user_data(idx->ods);
+	if (!udata)
+		return EINVAL;
+	t = calloc(1, sizeof *t);
+	if (!t) {
+		ods_obj_put(udata);
+		return ENOMEM;
+	}
+	t->udata_obj = udata;
+	t->udata = PUDATA(udata);
+	t->ods = idx->ods;
+	t->comparator = idx->idx_class->cmp->compare_fn;
+	t->key_class = ods_key_class(idx->idx_class->cmp);
+	t->data_size = t->udata->node_size - sizeof(struct pbxt_node);
+	t->key_max = t->data_size / 5;
+	if (t->key_max > PBXT_KEY_MAX)
+		t->key_max = PBXT_KEY_MAX;
+	idx->priv = t;
+	return 0;
+}
+
+static int pbxt_lock(ods_idx_t idx, struct timespec *wait)
+{
+	if (ods_lock(idx->ods, 0, wait))
+		return EBUSY;
+	return 0;
+}
+
+static void pbxt_unlock(ods_idx_t idx)
+{
+	ods_unlock(idx->ods, 0);
+}
+
+static int __int_lock(pbxt_t t, struct timespec *wait)
+{
+	if (0 == (t->rt_opts & ODS_IDX_OPT_MP_UNSAFE))
+		return ods_lock(t->ods, 0, wait);
+	return 0;
+}
+
+static void __int_unlock(pbxt_t t)
+{
+	if (0 == (t->rt_opts & ODS_IDX_OPT_MP_UNSAFE))
+		return ods_unlock(t->ods, 0);
+}
+
+static int pbxt_init(ods_t ods, const char *idx_type, const char *key_type, const char *argp)
+{
+	char size_arg[ODS_IDX_ARGS_LEN];
+	ods_obj_t udata;
+	char *name, *value;
+	long node_size = 0;
+
+	udata = ods_get_user_data(ods);
+	if (!udata)
+		return EINVAL;
+
+	if (argp) {
+		strncpy(size_arg, argp, sizeof(size_arg) - 1);
+		size_arg[sizeof(size_arg) - 1] = '\0';
+		name = strtok(size_arg, "=");
+		value = strtok(NULL, "=");
+		if (name && value && (0 == strcasecmp(name, "NODE_SIZE")))
+			node_size = strtol(value, NULL, 0);
+	}
+	if (node_size <= 0)
+		node_size = PBXT_DEF_NODE_SIZE;
+	if (node_size < PBXT_MIN_NODE_SIZE || node_size > PBXT_MAX_NODE_SIZE) {
+		ods_obj_put(udata);
+		return EINVAL;
+	}
+
+	PUDATA(udata)->node_size = node_size;
+	PUDATA(udata)->root_ref = 0;
+	PUDATA(udata)->depth = 0;
+	PUDATA(udata)->card = 0;
+	PUDATA(udata)->dups = 0;
+	ods_obj_put(udata);
+	return 0;
+}
+
+static void pbxt_close(ods_idx_t idx)
+{
+	pbxt_t t = idx->priv;
+	assert(t);
+	idx->priv = NULL;
+	ods_obj_put(t->udata_obj);
+	free(t);
+}
+
+static void pbxt_commit(ods_idx_t idx)
+{
+	ods_commit(idx->ods, ODS_COMMIT_SYNC);
+}
+
+static int pbxt_insert(ods_idx_t idx, ods_key_t key, ods_idx_data_t data)
+{
+	pbxt_t t = idx->priv;
+	int rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	rc = pbxt_insert_no_lock(t, key, data);
+	__int_unlock(t);
+	return rc;
+}
+
+static int pbxt_visit(ods_idx_t idx, ods_key_t key, ods_visit_cb_fn_t cb_fn, void *ctxt)
+{
+	pbxt_t t = idx->priv;
+	ods_visit_action_t act;
+	ods_idx_data_t data;
+	ods_obj_t leaf;
+	int ent, found;
+	int rc;
+
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	leaf = find_eq(t, key, &ent);
+	found = (leaf != NULL);
+	if (found)
+		data = leaf_data(PNODE(leaf), ent);
+	else
+		memset(&data, 0, sizeof(data));
+	act = cb_fn(idx, key, &data, found, ctxt);
+	switch (act) {
+	case ODS_VISIT_ADD:
+		rc = pbxt_insert_no_lock(t, key, data);
+		break;
+	case ODS_VISIT_DEL:
+		if (!found) {
+			rc = ENOENT;
+			break;
+		}
+		rc = delete_entry(t, leaf, ent, NULL);
+		break;
+	case ODS_VISIT_UPD:
+		if (!found) {
+			rc = ENOENT;
+			break;
+		}
+		leaf_data_set(PNODE(leaf), ent, &data);
+		break;
+	case ODS_VISIT_NOP:
+		rc = 0;
+		break;
+	default:
+		rc = EINVAL;
+	}
+	if (leaf)
+		ods_obj_put(leaf);
+	__int_unlock(t);
+	return rc;
+}
+
+static int pbxt_update(ods_idx_t idx, ods_key_t key, ods_idx_data_t data)
+{
+	pbxt_t t = idx->priv;
+	ods_obj_t leaf;
+	int ent, rc;
+
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	leaf = find_eq(t, key, &ent);
+	if (leaf) {
+		leaf_data_set(PNODE(leaf), ent, &data);
+		ods_obj_put(leaf);
+	} else {
+		rc = ENOENT;
+	}
+	__int_unlock(t);
+	return rc;
+}
+
+/*
+ * Delete the first entry matching key. If data is not null, the entry
+ * data must also match.
+ */
+static int pbxt_delete(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data)
+{
+	pbxt_t t = idx->priv;
+	ods_obj_t leaf;
+	int ent, rc;
+	PBXT_KEY(ek);
+
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	leaf = find_eq(t, key, &ent);
+	if (!leaf)
+		goto noent;
+	if (!ods_idx_data_null(data)) {
+		do {
+			ods_idx_data_t ent_data = leaf_data(PNODE(leaf), ent);
+			if (ods_idx_data_equal(&ent_data, data))
+				break;
+			if (pos_next(t, &leaf, &ent))
+				goto noent;
+		} while (0 == entry_cmp(t, PNODE(leaf), ent, key, ek));
+		if (entry_cmp(t, PNODE(leaf), ent, key, ek))
+			goto noent;
+	}
+	*data = leaf_data(PNODE(leaf), ent);
+	rc = delete_entry(t, leaf, ent, NULL);
+	ods_obj_put(leaf);
+	__int_unlock(t);
+	return rc;
+ noent:
+	if (leaf)
+		ods_obj_put(leaf);
+	__int_unlock(t);
+	return ENOENT;
+}
+
+static int pbxt_find(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data)
+{
+	pbxt_t t = idx->priv;
+	ods_obj_t leaf;
+	int ent, rc;
+
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	leaf = find_eq(t, key, &ent);
+	if (leaf) {
+		*data = leaf_data(PNODE(leaf), ent);
+		ods_obj_put(leaf);
+	} else {
+		rc = ENOENT;
+	}
+	__int_unlock(t);
+	return rc;
+}
+
+static int pbxt_find_lub(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data)
+{
+	pbxt_t t = idx->priv;
+	ods_obj_t leaf;
+	int ent, rc;
+
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	leaf = find_ge(t, key, &ent);
+	if (leaf) {
+		*data = leaf_data(PNODE(leaf), ent);
+		ods_obj_put(leaf);
+	} else {
+		rc = ENOENT;
+	}
+	__int_unlock(t);
+	return rc;
+}
+
+static int pbxt_find_glb(ods_idx_t idx, ods_key_t key, ods_idx_data_t *data)
+{
+	pbxt_t t = idx->priv;
+	ods_obj_t leaf;
+	int ent, rc;
+
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	leaf = find_le(t, key, &ent);
+	if (leaf) {
+		pos_first_dup(t, &leaf, &ent);
+		*data = leaf_data(PNODE(leaf), ent);
+		ods_obj_put(leaf);
+	} else {
+		rc = ENOENT;
+	}
+	__int_unlock(t);
+	return rc;
+}
+
+/* Return the leftmost or rightmost leaf */
+static ods_obj_t edge_leaf(pbxt_t t, int right)
+{
+	ods_obj_t n, child;
+
+	n = ods_ref_as_obj(t->ods, t->udata->root_ref);
+	while (n && !PNODE(n)->is_leaf) {
+		int i = (right ? PNODE(n)->count - 1 : 0);
+		child = ods_ref_as_obj(t->ods, child_ref(PNODE(n), i));
+		ods_obj_put(n);
+		n = child;
+	}
+	return n;
+}
+
+static ods_key_t leaf_key_new(ods_obj_t leaf, int ent)
+{
+	pbxt_entry_t e = node_entry(PNODE(leaf), ent);
+	ods_key_t key = ods_key_malloc(e->plen + e->slen);
+	if (key)
+		entry_key(PNODE(leaf), ent, key);
+	return key;
+}
+
+static int edge_entry(ods_idx_t idx, int right, ods_key_t *key, ods_idx_data_t *data)
+{
+	pbxt_t t = idx->priv;
+	ods_obj_t leaf;
+	int ent, rc;
+
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	leaf = edge_leaf(t, right);
+	if (!leaf) {
+		rc = ENOENT;
+		goto out;
+	}
+	ent = (right ? PNODE(leaf)->count - 1 : 0);
+	if (key) {
+		*key = leaf_key_new(leaf, ent);
+		if (!*key)
+			rc = ENOMEM;
+	}
+	if (data)
+		*data = leaf_data(PNODE(leaf), ent);
+	ods_obj_put(leaf);
+ out:
+	__int_unlock(t);
+	return rc;
+}
+
+static int pbxt_min(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data)
+{
+	return edge_entry(idx, 0, key, data);
+}
+
+static int pbxt_max(ods_idx_t idx, ods_key_t *key, ods_idx_data_t *data)
+{
+	return edge_entry(idx, 1, key, data);
+}
+
+static ods_iter_t pbxt_iter_new(ods_idx_t idx)
+{
+	pbxt_iter_t iter = calloc(1, sizeof *iter);
+	return (struct ods_iter *)iter;
+}
+
+static void iter_reset(pbxt_iter_t i)
+{
+	if (i->node)
+		ods_obj_put(i->node);
+	i->node = NULL;
+	i->ent = 0;
+}
+
+static void pbxt_iter_delete(ods_iter_t oi)
+{
+	iter_reset((pbxt_iter_t)oi);
+	free(oi);
+}
+
+static int pbxt_iter_begin(ods_iter_t oi)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	pbxt_t t = oi->idx->priv;
+	int rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	iter_reset(i);
+	i->node = edge_leaf(t, 0);
+	__int_unlock(t);
+	return i->node ? 0 : ENOENT;
+}
+
+static int pbxt_iter_end(ods_iter_t oi)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	pbxt_t t = oi->idx->priv;
+	int rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	iter_reset(i);
+	i->node = edge_leaf(t, 1);
+	if (i->node) {
+		i->ent = PNODE(i->node)->count - 1;
+		if (oi->flags & ODS_ITER_F_UNIQUE)
+			pos_first_dup(t, &i->node, &i->ent);
+	}
+	__int_unlock(t);
+	return i->node ? 0 : ENOENT;
+}
+
+static int pbxt_iter_next(ods_iter_t oi)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	pbxt_t t = oi->idx->priv;
+	PBXT_KEY(key);
+	PBXT_KEY(ek);
+	int rc;
+
+	if (!i->node)
+		return ENOENT;
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	if (oi->flags & ODS_ITER_F_UNIQUE) {
+		entry_key(PNODE(i->node), i->ent, key);
+		do {
+			rc = pos_next(t, &i->node, &i->ent);
+		} while (!rc && 0 == entry_cmp(t, PNODE(i->node), i->ent, key, ek));
+	} else {
+		rc = pos_next(t, &i->node, &i->ent);
+	}
+	__int_unlock(t);
+	return rc;
+}
+
+static int pbxt_iter_prev(ods_iter_t oi)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	pbxt_t t = oi->idx->priv;
+	int rc;
+
+	if (!i->node)
+		return ENOENT;
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	rc = pos_prev(t, &i->node, &i->ent);
+	if (!rc && (oi->flags & ODS_ITER_F_UNIQUE))
+		pos_first_dup(t, &i->node, &i->ent);
+	__int_unlock(t);
+	return rc;
+}
+
+static int iter_find_eq(ods_iter_t oi, ods_key_t key, int last)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	pbxt_t t = oi->idx->priv;
+	int rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	iter_reset(i);
+	i->node = find_eq(t, key, &i->ent);
+	if (i->node && last)
+		pos_last_dup(t, &i->node, &i->ent);
+	__int_unlock(t);
+	return i->node ? 0 : ENOENT;
+}
+
+static int pbxt_iter_find(ods_iter_t oi, ods_key_t key)
+{
+	return iter_find_eq(oi, key, 0);
+}
+
+static int pbxt_iter_find_first(ods_iter_t oi, ods_key_t key)
+{
+	return iter_find_eq(oi, key, 0);
+}
+
+static int pbxt_iter_find_last(ods_iter_t oi, ods_key_t key)
+{
+	return iter_find_eq(oi, key, 1);
+}
+
+static int pbxt_iter_find_lub(ods_iter_t oi, ods_key_t key)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	pbxt_t t = oi->idx->priv;
+	int rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	iter_reset(i);
+	i->node = find_ge(t, key, &i->ent);
+	if (i->node && (oi->flags & ODS_ITER_F_LUB_LAST_DUP)
+	    && 0 == (oi->flags & ODS_ITER_F_UNIQUE))
+		pos_last_dup(t, &i->node, &i->ent);
+	__int_unlock(t);
+	return i->node ? 0 : ENOENT;
+}
+
+static int pbxt_iter_find_glb(ods_iter_t oi, ods_key_t key)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	pbxt_t t = oi->idx->priv;
+	int rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	iter_reset(i);
+	i->node = find_le(t, key, &i->ent);
+	if (i->node && (0 == (oi->flags & ODS_ITER_F_GLB_LAST_DUP)
+			|| (oi->flags & ODS_ITER_F_UNIQUE)))
+		pos_first_dup(t, &i->node, &i->ent);
+	__int_unlock(t);
+	return i->node ? 0 : ENOENT;
+}
+
+static ods_key_t pbxt_iter_key(ods_iter_t oi)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	if (!i->node)
+		return NULL;
+	return leaf_key_new(i->node, i->ent);
+}
+
+static ods_idx_data_t NULL_DATA;
+
+static ods_idx_data_t pbxt_iter_data(ods_iter_t oi)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	if (!i->node)
+		return NULL_DATA;
+	return leaf_data(PNODE(i->node), i->ent);
+}
+
+static int pbxt_iter_pos_set(ods_iter_t oi, const ods_pos_t pos)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	pbxt_t t = oi->idx->priv;
+	ods_obj_t obj, node;
+
+	obj = ods_ref_as_obj(t->ods, pos->ref);
+	if (!obj)
+		return EINVAL;
+	node = ods_ref_as_obj(t->ods, PPOS(obj)->node_ref);
+	if (!node)
+		goto err_0;
+	if (!PNODE(node)->is_leaf || PPOS(obj)->ent >= PNODE(node)->count) {
+		ods_obj_put(node);
+		goto err_0;
+	}
+	iter_reset(i);
+	i->node = node;
+	i->ent = PPOS(obj)->ent;
+	ods_obj_delete(obj);	/* POS are 1-time use */
+	ods_obj_put(obj);
+	return 0;
+ err_0:
+	ods_obj_put(obj);
+	return EINVAL;
+}
+
+static int pbxt_iter_pos_get(ods_iter_t oi, ods_pos_t pos)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	pbxt_t t = oi->idx->priv;
+	ods_obj_t obj;
+
+	if (!i->node)
+		return ENOENT;
+	obj = ods_obj_alloc_extend(t->ods, sizeof(struct pbxt_pos_s), PBXT_EXTEND_SIZE);
+	if (!obj)
+		return ENOMEM;
+	pos->ref = ods_obj_ref(obj);
+	PPOS(obj)->node_ref = ods_obj_ref(i->node);
+	PPOS(obj)->ent = i->ent;
+	ods_obj_put(obj);
+	return 0;
+}
+
+static int pbxt_iter_pos_put(ods_iter_t oi, ods_pos_t pos)
+{
+	void __ods_obj_delete(ods_obj_t obj);
+	pbxt_t t = oi->idx->priv;
+	ods_obj_t obj;
+
+	obj = ods_ref_as_obj(t->ods, pos->ref);
+	if (!obj)
+		return EINVAL;
+	__ods_obj_delete(obj);
+	ods_obj_put(obj);
+	return 0;
+}
+
+/* Delete the entry at the iterator position and advance to the next entry */
+static int pbxt_iter_entry_delete(ods_iter_t oi, ods_idx_data_t *data)
+{
+	pbxt_iter_t i = (pbxt_iter_t)oi;
+	pbxt_t t = oi->idx->priv;
+	struct pbxt_succ succ;
+	ods_obj_t leaf;
+	int ent, rc;
+
+	rc = __int_lock(t, NULL);
+	if (rc)
+		return rc;
+	if (!i->node) {
+		rc = ENOENT;
+		goto out;
+	}
+	leaf = i->node;
+	ent = i->ent;
+	i->node = NULL;
+	*data = leaf_data(PNODE(leaf), ent);
+	rc = delete_entry(t, leaf, ent, &succ);
+	/* The leaf may have been freed */
+	ods_obj_put(leaf);
+	if (!rc && succ.ref) {
+		i->node = ods_ref_as_obj(t->ods, succ.ref);
+		i->ent = succ.ent;
+	}
+ out:
+	__int_unlock(t);
+	return rc;
+}
+
+static const char *pbxt_get_type(void)
+{
+	return "PBXTREE";
+}
+
+static int pbxt_stat(ods_idx_t idx, ods_idx_stat_t idx_sb)
+{
+	struct stat sb;
+	pbxt_t t = idx->priv;
+	idx_sb->cardinality = t->udata->card;
+	idx_sb->duplicates = t->udata->dups;
+	ods_stat(idx->ods, &sb);
+	idx_sb->size = sb.st_size;
+	idx_sb->depth = t->udata->depth;
+	idx_sb->node_size = t->udata->node_size;
+	return 0;
+}
+
+static int pbxt_rt_opts_set(ods_idx_t idx, ods_idx_rt_opts_t opt, va_list ap)
+{
+	pbxt_t t = idx->priv;
+	switch (opt) {
+	case ODS_IDX_OPT_MP_UNSAFE:
+		t->rt_opts |= ODS_IDX_OPT_MP_UNSAFE;
+		break;
+	default:
+		return EINVAL;
+	}
+	return 0;
+}
+
+static ods_idx_rt_opts_t pbxt_rt_opts_get(ods_idx_t idx)
+{
+	pbxt_t t = idx->priv;
+	return t->rt_opts;
+}
+
+static struct ods_idx_provider pbxt_provider = {
+	.get_type = pbxt_get_type,
+	.init = pbxt_init,
+	.open = pbxt_open,
+	.close = pbxt_close,
+	.lock = pbxt_lock,
+	.unlock = pbxt_unlock,
+	.rt_opts_set = pbxt_rt_opts_set,
+	.rt_opts_get = pbxt_rt_opts_get,
+	.commit = pbxt_commit,
+	.insert = pbxt_insert,
+	.visit = pbxt_visit,
+	.update = pbxt_update,
+	.delete = pbxt_delete,
+	.max = pbxt_max,
+	.min = pbxt_min,
+	.find = pbxt_find,
+	.find_lub = pbxt_find_lub,
+	.find_glb = pbxt_find_glb,
+	.stat = pbxt_stat,
+	.iter_new = pbxt_iter_new,
+	.iter_delete = pbxt_iter_delete,
+	.iter_find = pbxt_iter_find,
+	.iter_find_lub = pbxt_iter_find_lub,
+	.iter_find_glb = pbxt_iter_find_glb,
+	.iter_find_first = pbxt_iter_find_first,
+	.iter_find_last = pbxt_iter_find_last,
+	.iter_begin = pbxt_iter_begin,
+	.iter_end = pbxt_iter_end,
+	.iter_next = pbxt_iter_next,
+	.iter_prev = pbxt_iter_prev,
+	.iter_pos_set = pbxt_iter_pos_set,
+	.iter_pos_get = pbxt_iter_pos_get,
+	.iter_pos_put = pbxt_iter_pos_put,
+	.iter_entry_delete = pbxt_iter_entry_delete,
+	.iter_key = pbxt_iter_key,
+	.iter_data = pbxt_iter_data,
+	.print_idx = print_idx,
+	.print_info = print_info,
+	.verify_idx = verify_idx
+};
+
+struct ods_idx_provider *get(void)
+{
+	return &pbxt_provider;
+}
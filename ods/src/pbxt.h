@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The PBXTREE is a B+Tree whose nodes are fixed size byte arrays
+ * that contain the keys in-line. Each node has a reference key, and
+ * every key in the node is stored as the number of leading bytes it
+ * shares with the reference key followed by the remaining suffix.
+ * Keys that share long prefixes, for example host names, metric
+ * paths or compound keys, therefore cost little more than their
+ * distinct suffix.
+ *
+ *  +--------+---------+----------------+------------+---------------+
+ *  | header | ref key | slot[0..count) | free space | entries       |
+ *  +--------+---------+----------------+------------+---------------+
+ *
+ * The slot array contains the offset of each entry in key order. The
+ * entries are allocated from the end of the node toward the slot
+ * array. A leaf entry's payload is the ods_idx_data_t for the key,
+ * an internal entry's payload is the reference of the child node. The
+ * key of entry 0 in an internal node is not used; the key of entry i
+ * is the separator between the children i-1 and i such that:
+ *
+ *     keys(child i-1) <= separator(i) <= keys(child i)
+ *
+ * When the key type is ordered by memcmp(), separators are truncated
+ * to the shortest prefix that satisfies this relation.
+ *
+ * Duplicate keys are stored as separate entries and may span leaves.
+ * Leaves are linked to their siblings for iteration.
+ *
+ * When a delete leaves a node less than 1/4 full, it is merged with a
+ * sibling that has the same parent if their entries fit in 3/4 of a
+ * node. Nodes are not otherwise rebalanced.
+ */
+#ifndef _PBXT_H_
+#define _PBXT_H_
+
+#include <ods/ods_idx.h>
+#include <ods/ods.h>
+#include "ods_idx_priv.h"
+
+#pragma pack(4)
+
+typedef struct pbxt_node {
+	ods_ref_t next;		/* Right sibling, leaf only */
+	ods_ref_t prev;		/* Left sibling, leaf only */
+	uint16_t count;		/* Number of entries */
+	uint16_t is_leaf;
+	uint16_t heap;		/* Offset in data[] of the lowest entry */
+	uint16_t ref_len;	/* Length of the reference key */
+	unsigned char data[];	/* ref key, slots, free space, entries */
+} *pbxt_node_t;
+
+typedef struct pbxt_udata {
+	struct ods_idx_meta_data idx_udata;
+	uint32_t node_size;	/* The size of each node in bytes */
+	ods_ref_t root_ref;	/* The root of the tree */
+	ods_atomic_t depth;	/* The current tree depth */
+	ods_atomic_t card;	/* Cardinality */
+	ods_atomic_t dups;	/* Duplicate keys */
+} *pbxt_udata_t;
+
+typedef struct pbxt_pos_s {
+	ods_ref_t node_ref;
+	uint32_t ent;
+} *pbxt_pos_t;
+
+#pragma pack(1)
+typedef struct pbxt_entry {
+	uint16_t plen;		/* Bytes shared with the reference key */
+	uint16_t slen;		/* Bytes in the suffix */
+	unsigned char sfx[];	/* The suffix followed by the payload */
+} *pbxt_entry_t;
+#pragma pack()
+
+typedef struct pbxt_s {
+	ods_t ods;		/* The ods that contains the tree */
+	ods_obj_t udata_obj;
+	pbxt_udata_t udata;
+	ods_idx_compare_fn_t comparator;
+	ods_key_class_t key_class;	/* Selects an in-line key compare */
+	size_t data_size;	/* Bytes in a node's data[] */
+	size_t key_max;		/* The longest key the tree accepts */
+	ods_idx_rt_opts_t rt_opts;	/* Run-time flags */
+} *pbxt_t;
+
+typedef struct pbxt_iter_s {
+	struct ods_iter iter;
+	ods_obj_t node;
+	int ent;
+} *pbxt_iter_t;
+
+/* The position of an entry after a delete */
+struct pbxt_succ {
+	ods_ref_t ref;
+	int ent;
+};
+
+/* The path from the root to a leaf */
+#define PBXT_MAX_DEPTH	32
+struct pbxt_path {
+	int depth;
+	ods_obj_t node[PBXT_MAX_DEPTH];
+	int ent[PBXT_MAX_DEPTH];
+};
+
+#define PBXT_DEF_NODE_SIZE	4096
+#define PBXT_MIN_NODE_SIZE	512
+#define PBXT_MAX_NODE_SIZE	65535	/* Offsets in data[] are uint16_t */
+#define PBXT_KEY_MAX		2048
+#define PBXT_EXTEND_SIZE	(1024 * 1024)
+
+#define PUDATA(_o_) ODS_PTR(struct pbxt_udata *, _o_)
+#define PNODE(_o_) ODS_PTR(pbxt_node_t, (_o_))
+#define PPOS(_o_) ODS_PTR(pbxt_pos_t, _o_)
+#define PBXT_KEY_CMP(_t_, _a_, _b_) \
+	ods_key_class_cmp((_t_)->key_class, (_t_)->comparator, _a_, _b_)
+
+/* A key on the stack large enough for any key in the tree */
+#define PBXT_KEY(_name_)					\
+	struct {						\
+		uint16_t len;					\
+		unsigned char value[PBXT_KEY_MAX];		\
+	} _name_ ## _ ## data;					\
+	ODS_OBJ(_name_ ## _ ## obj, &_name_ ## _ ## data,	\
+		sizeof(_name_ ## _ ## data));			\
+	ods_key_t _name_ = &_name_ ## _ ## obj
+#endif
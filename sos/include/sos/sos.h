@@ -76,6 +76,12 @@ typedef enum sos_perm_e {
 } sos_perm_t;
 
 #define SOS_POS_KEEP_TIME			"POS_KEEP_TIME"
+#define SOS_PART_ROLL_TIME			"PART_ROLL_TIME"
+#define SOS_PART_ROLL_SIZE			"PART_ROLL_SIZE"
+#define SOS_PART_ROLL_EXTEND			"PART_ROLL_EXTEND"
+#define SOS_PART_ROLL_STANDBY			"PART_ROLL_STANDBY"
+#define SOS_PART_OPEN_MAX			"PART_OPEN_MAX"
+#define SOS_PART_RETENTION			"PART_RETENTION"
 
 #define SOS_CONTAINER_NAME_LEN  64
 #define SOS_CONFIG_NAME_LEN	64
@@ -346,6 +352,15 @@ int sos_attr_id(sos_attr_t attr);
 const char *sos_attr_name(sos_attr_t attr);
 sos_type_t sos_attr_type(sos_attr_t attr);
 sos_index_t sos_attr_index(sos_attr_t attr);
+typedef struct sos_index_build_stat_s {
+	int building;		/* !0 until the index can be used */
+	uint32_t part_count;	/* Partitions to scan, 0 if not started */
+	uint32_t part_done;	/* Partitions scanned */
+	uint64_t part_size;	/* Size of the partition being scanned */
+	uint64_t part_pos;	/* Bytes of it scanned */
+	uint64_t obj_count;	/* Objects added to the index by the build */
+} *sos_index_build_stat_t;
+int sos_attr_index_build_stat(sos_attr_t attr, sos_index_build_stat_t sb);
 size_t sos_attr_size(sos_attr_t attr);
 sos_schema_t sos_attr_schema(sos_attr_t attr);
 sos_array_t sos_attr_join_list(sos_attr_t attr);
@@ -388,14 +403,23 @@ typedef struct sos_part_stat_s {
 	uint64_t changed;	/*! Status change time as a Unix timestamp */
 } *sos_part_stat_t;
 
+typedef struct sos_part_retain_stat_s {
+	uint64_t part_count;	/*! Partitions deleted */
+	uint64_t bytes;		/*! Bytes of storage reclaimed */
+} *sos_part_retain_stat_t;
+
 typedef struct sos_part_iter_s *sos_part_iter_t;
 typedef struct sos_part_s *sos_part_t;
+
+/** The partition keeps the keys of its objects in its own indices */
+#define SOS_PART_F_LOCAL_INDEX	1
 /** @} */
 /**
  * \defgroup part_funcs Partition Functions
  * @{
  */
 int sos_part_create(sos_t sos, const char *name, const char *path);
+int sos_part_create_ex(sos_t sos, const char *name, const char *path, int flags);
 int sos_part_delete(sos_part_t part);
 int sos_part_move(sos_part_t part, const char *part_path);
 sos_part_t sos_part_find(sos_t sos, const char *name);
@@ -412,7 +436,11 @@ uint32_t sos_part_refcount(sos_part_t part);
 void sos_part_put(sos_part_t part);
 int sos_part_stat(sos_part_t part, sos_part_stat_t stat);
 int64_t sos_part_export(sos_part_t src_part, sos_t dst_sos, int reindex);
+int sos_part_attach(sos_part_t src_part, sos_t dst_sos, const char *part_path,
+		    int reindex);
 int64_t sos_part_index(sos_part_t src_part);
+int sos_part_retain(sos_t sos, time_t keep, sos_part_retain_stat_t stat);
+void sos_part_retain_stat(sos_t sos, sos_part_retain_stat_t stat);
 
 /**
  * \brief The callback function called by the sos_part_obj_iter() function
@@ -533,6 +561,9 @@ typedef struct sos_index_stat_s {
 	uint64_t cardinality;
 	uint64_t duplicates;
 	uint64_t size;
+	uint64_t depth;		/* Levels in the tree, 0 if not a tree */
+	uint64_t node_size;	/* Bytes per tree node */
+	double fill_factor;	/* Fraction of the node capacity in use */
 } *sos_index_stat_t;
 /** @} */
 /** \defgroup index_funcs Index Functions
@@ -646,6 +677,8 @@ int sos_key_join_va(sos_key_t key, sos_attr_t join_attr, va_list ap);
 int sos_key_join_size(sos_attr_t join_attr, ...);
 int sos_key_join_size_va(sos_attr_t join_attr, va_list ap);
 int sos_key_split(sos_key_t key, sos_attr_t join_attr, ...);
+sos_value_t sos_key_join_value(sos_value_t v, sos_attr_t join_attr,
+			       sos_key_t key, int join_idx);
 int sos_comp_key_set(sos_key_t key, size_t len, sos_comp_key_spec_t key_spec);
 int sos_comp_key_get(sos_key_t key, size_t *len, sos_comp_key_spec_t key_spec);
 size_t sos_comp_key_size(size_t len, sos_comp_key_spec_t key_spec);
@@ -693,6 +726,7 @@ int64_t sos_iter_key_cmp(sos_iter_t iter, sos_key_t other);
 int sos_iter_find(sos_iter_t iter, sos_key_t key);
 int sos_iter_find_first(sos_iter_t iter, sos_key_t key);
 int sos_iter_find_last(sos_iter_t iter, sos_key_t key);
+int sos_iter_key_range_set(sos_iter_t iter, sos_key_t lo, sos_key_t hi);
 int sos_iter_inf(sos_iter_t i, sos_key_t key);
 int sos_iter_sup(sos_iter_t i, sos_key_t key);
 sos_attr_t sos_iter_attr(sos_iter_t i);
@@ -724,7 +758,20 @@ sos_obj_t sos_filter_begin(sos_filter_t filt);
 sos_obj_t sos_filter_next(sos_filter_t filt);
 sos_obj_t sos_filter_prev(sos_filter_t filt);
 sos_obj_t sos_filter_end(sos_filter_t filt);
+sos_key_t sos_filter_key_begin(sos_filter_t filt);
+sos_key_t sos_filter_key_next(sos_filter_t filt);
+sos_key_t sos_filter_key_prev(sos_filter_t filt);
+sos_key_t sos_filter_key_end(sos_filter_t filt);
+int sos_filter_is_covered(sos_filter_t filt);
 int sos_filter_miss_count(sos_filter_t filt);
+int sos_filter_range_add(sos_filter_t filt, sos_attr_t attr,
+			 sos_value_t lo, sos_value_t hi);
+int sos_filter_in_add(sos_filter_t filt, sos_attr_t attr,
+		      sos_value_t *values, int count);
+void sos_filter_limit_set(sos_filter_t filt, size_t limit);
+size_t sos_filter_limit_get(sos_filter_t filt);
+int sos_filter_batch_begin(sos_filter_t filt, sos_obj_t *objs, int count);
+int sos_filter_batch_next(sos_filter_t filt, sos_obj_t *objs, int count);
 int sos_filter_pos_set(sos_filter_t filt, const sos_pos_t pos);
 int sos_filter_pos_get(sos_filter_t filt, sos_pos_t *pos);
 int sos_filter_pos_put(sos_filter_t filt, const sos_pos_t pos);
@@ -732,6 +779,60 @@ sos_obj_t sos_filter_obj(sos_filter_t filt);
 int sos_filter_flags_set(sos_filter_t filt, sos_iter_flags_t flags);
 sos_iter_flags_t sos_filter_flags_get(sos_filter_t filt);
 
+typedef struct sos_plan_cond_s {
+	sos_attr_t attr;
+	enum sos_cond_e cond;
+	sos_value_t value;
+} *sos_plan_cond_t;
+int sos_attr_analyze(sos_attr_t attr);
+sos_attr_t sos_plan_attr(sos_schema_t schema, sos_plan_cond_t conds, int count,
+			 uint64_t *est_count);
+
+typedef struct sos_isect_s *sos_isect_t;
+sos_isect_t sos_isect_new(sos_filter_t filt, sos_attr_t *attrs, int count);
+void sos_isect_free(sos_isect_t isect);
+size_t sos_isect_card(sos_isect_t isect);
+sos_obj_t sos_isect_begin(sos_isect_t isect);
+sos_obj_t sos_isect_next(sos_isect_t isect);
+
+typedef struct sos_agg_s {
+	uint64_t count;
+	double sum;
+	double min;		/* Undefined if count is 0 */
+	double max;		/* Undefined if count is 0 */
+} *sos_agg_t;
+typedef int (*sos_agg_fn_t)(sos_value_t group, sos_agg_t agg, void *arg);
+int sos_filter_aggregate(sos_filter_t filt, sos_attr_t attr, sos_attr_t group_attr,
+			 sos_agg_fn_t fn, void *arg);
+
+enum sos_resample_op_e {
+	SOS_RESAMPLE_FIRST,
+	SOS_RESAMPLE_LAST,
+	SOS_RESAMPLE_MIN,
+	SOS_RESAMPLE_MAX,
+	SOS_RESAMPLE_MEAN,
+	SOS_RESAMPLE_RATE,
+};
+typedef struct sos_resample_col_s {
+	sos_attr_t attr;
+	enum sos_resample_op_e op;
+} *sos_resample_col_t;
+typedef struct sos_resample_s *sos_resample_t;
+sos_resample_t sos_resample_new(sos_filter_t filt, sos_attr_t ts_attr,
+				uint64_t interval, sos_resample_col_t cols,
+				int col_count);
+void sos_resample_free(sos_resample_t rs);
+size_t sos_resample_next(sos_resample_t rs, uint64_t *times, double **data,
+			 size_t count);
+
+int sos_filter_top_k(sos_filter_t filt, sos_attr_t attr, int desc,
+		     sos_obj_t *objs, int k);
+
+#define SOS_FILTER_PARALLEL_UNORDERED	1
+typedef int (*sos_filter_obj_fn_t)(sos_obj_t obj, void *arg);
+int sos_filter_parallel(sos_filter_t filt, int thread_count, int flags,
+			sos_filter_obj_fn_t fn, void *arg);
+
 /** @} */
 /** @} */
 
@@ -468,6 +468,15 @@ cdef extern from "sos/sos.h":
     const char *sos_attr_name(sos_attr_t attr)
     sos_type_t sos_attr_type(sos_attr_t attr)
     sos_index_t sos_attr_index(sos_attr_t attr)
+    cdef struct sos_index_build_stat_s:
+        int building
+        uint32_t part_count
+        uint32_t part_done
+        uint64_t part_size
+        uint64_t part_pos
+        uint64_t obj_count
+    ctypedef sos_index_build_stat_s *sos_index_build_stat_t
+    int sos_attr_index_build_stat(sos_attr_t attr, sos_index_build_stat_t sb)
     size_t sos_attr_size(sos_attr_t attr)
     sos_schema_t sos_attr_schema(sos_attr_t attr)
     int sos_attr_join(sos_obj_t obj, sos_attr_t attr)
@@ -497,6 +506,11 @@ cdef extern from "sos/sos.h":
         uint64_t changed
     ctypedef sos_part_stat_s *sos_part_stat_t
 
+    cdef struct sos_part_retain_stat_s:
+        uint64_t part_count
+        uint64_t bytes
+    ctypedef sos_part_retain_stat_s *sos_part_retain_stat_t
+
     cdef struct sos_part_iter_s:
         pass
     ctypedef sos_part_iter_s *sos_part_iter_t
@@ -504,7 +518,10 @@ cdef extern from "sos/sos.h":
         pass
     ctypedef sos_part_s *sos_part_t
 
+    cdef enum:
+        SOS_PART_F_LOCAL_INDEX
     int sos_part_create(sos_t sos, const char *name, const char *path)
+    int sos_part_create_ex(sos_t sos, const char *name, const char *path, int flags)
     int sos_part_delete(sos_part_t part)
     int sos_part_move(sos_part_t part, const char *part_path)
     sos_part_t sos_part_find(sos_t sos, const char *name)
@@ -521,7 +538,10 @@ cdef extern from "sos/sos.h":
     void sos_part_put(sos_part_t part)
     int sos_part_stat(sos_part_t part, sos_part_stat_t stat)
     uint64_t sos_part_export(sos_part_t src_part, sos_t dst_sos, int reindex)
+    int sos_part_attach(sos_part_t src_part, sos_t dst_sos, const char *part_path, int reindex)
     uint64_t sos_part_index(sos_part_t part)
+    int sos_part_retain(sos_t sos, time_t keep, sos_part_retain_stat_t stat)
+    void sos_part_retain_stat(sos_t sos, sos_part_retain_stat_t stat)
     ctypedef int (*sos_part_obj_iter_fn_t)(sos_part_t part, sos_obj_t obj, void *arg)
     cdef struct sos_part_obj_iter_pos_s:
         pass
@@ -590,6 +610,9 @@ cdef extern from "sos/sos.h":
         uint64_t cardinality
         uint64_t duplicates
         uint64_t size
+        uint64_t depth
+        uint64_t node_size
+        double fill_factor
     ctypedef sos_index_stat_s *sos_index_stat_t
 
     ctypedef int (*sos_ins_cb_fn_t)(sos_index_t index, sos_key_t key,
@@ -687,6 +710,7 @@ cdef extern from "sos/sos.h":
     int sos_iter_find_last(sos_iter_t iter, sos_key_t key)
     int sos_iter_inf(sos_iter_t i, sos_key_t key)
     int sos_iter_sup(sos_iter_t i, sos_key_t key)
+    int sos_iter_key_range_set(sos_iter_t iter, sos_key_t lo, sos_key_t hi)
 
     int sos_iter_flags_set(sos_iter_t i, sos_iter_flags_t flags)
     sos_iter_flags_t sos_iter_flags_get(sos_iter_t i)
@@ -715,10 +739,72 @@ cdef extern from "sos/sos.h":
     sos_obj_t sos_filter_next(sos_filter_t filt)
     sos_obj_t sos_filter_prev(sos_filter_t filt)
     sos_obj_t sos_filter_end(sos_filter_t filt)
+    int sos_filter_batch_begin(sos_filter_t filt, sos_obj_t *objs, int count)
+    int sos_filter_batch_next(sos_filter_t filt, sos_obj_t *objs, int count)
     int sos_filter_miss_count(sos_filter_t filt)
+    int sos_filter_range_add(sos_filter_t filt, sos_attr_t attr,
+                             sos_value_t lo, sos_value_t hi)
+    int sos_filter_in_add(sos_filter_t filt, sos_attr_t attr,
+                          sos_value_t *values, int count)
+    void sos_filter_limit_set(sos_filter_t filt, size_t limit)
+    size_t sos_filter_limit_get(sos_filter_t filt)
     int sos_filter_pos_set(sos_filter_t filt, const sos_pos_t pos)
     int sos_filter_pos_put(sos_filter_t filt, const sos_pos_t pos)
     int sos_filter_pos_get(sos_filter_t filt, sos_pos_t *pos)
     sos_obj_t sos_filter_obj(sos_filter_t filt)
     int sos_filter_flags_set(sos_filter_t filt, sos_iter_flags_t flags)
     sos_iter_flags_t sos_filter_flags_get(sos_filter_t filt)
+
+    cdef struct sos_isect_s
+    ctypedef sos_isect_s *sos_isect_t
+    sos_isect_t sos_isect_new(sos_filter_t filt, sos_attr_t *attrs, int count)
+    void sos_isect_free(sos_isect_t isect)
+    size_t sos_isect_card(sos_isect_t isect)
+    sos_obj_t sos_isect_begin(sos_isect_t isect)
+    sos_obj_t sos_isect_next(sos_isect_t isect)
+
+    cdef struct sos_plan_cond_s:
+        sos_attr_t attr
+        sos_cond_e cond
+        sos_value_t value
+    ctypedef sos_plan_cond_s *sos_plan_cond_t
+    int sos_attr_analyze(sos_attr_t attr)
+    sos_attr_t sos_plan_attr(sos_schema_t schema, sos_plan_cond_t conds, int count,
+                             uint64_t *est_count)
+
+    cdef struct sos_agg_s:
+        uint64_t count
+        double sum
+        double min
+        double max
+    ctypedef sos_agg_s *sos_agg_t
+    ctypedef int (*sos_agg_fn_t)(sos_value_t group, sos_agg_t agg, void *arg)
+    int sos_filter_aggregate(sos_filter_t filt, sos_attr_t attr, sos_attr_t group_attr,
+                             sos_agg_fn_t fn, void *arg)
+
+    cdef enum sos_resample_op_e:
+        SOS_RESAMPLE_FIRST,
+        SOS_RESAMPLE_LAST,
+        SOS_RESAMPLE_MIN,
+        SOS_RESAMPLE_MAX,
+        SOS_RESAMPLE_MEAN,
+        SOS_RESAMPLE_RATE
+    cdef struct sos_resample_col_s:
+        sos_attr_t attr
+        sos_resample_op_e op
+    ctypedef sos_resample_col_s *sos_resample_col_t
+    cdef struct sos_resample_s:
+        pass
+    ctypedef sos_resample_s *sos_resample_t
+    sos_resample_t sos_resample_new(sos_filter_t filt, sos_attr_t ts_attr,
+                                    uint64_t interval, sos_resample_col_t cols,
+                                    int col_count)
+    void sos_resample_free(sos_resample_t rs)
+    size_t sos_resample_next(sos_resample_t rs, uint64_t *times, double **data,
+                             size_t count)
+    int sos_filter_top_k(sos_filter_t filt, sos_attr_t attr, int desc,
+                         sos_obj_t *objs, int k)
+    cdef int SOS_FILTER_PARALLEL_UNORDERED
+    ctypedef int (*sos_filter_obj_fn_t)(sos_obj_t obj, void *arg)
+    int sos_filter_parallel(sos_filter_t filt, int thread_count, int flags,
+                            sos_filter_obj_fn_t fn, void *arg)
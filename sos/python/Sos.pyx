@@ -307,16 +307,52 @@ cdef class Container(SosObject):
         if rc != 0:
             self.abort(rc)
 
-    def part_create(self, name, path=None):
+    def part_create(self, name, path=None, local_index=False):
+        """Create a new partition
+
+        Positional Parameters:
+        -- The partition name
+
+        Keyword Parameters:
+        path        -- The partition path, the container path by default
+        local_index -- If True, the partition keeps the keys of its
+                       objects in its own indices
+        """
         cdef int rc
+        cdef int flags = 0
         if self.c_cont == NULL:
             raise ValueError("The container is not open.")
+        if local_index:
+            flags = SOS_PART_F_LOCAL_INDEX
         if path:
-            rc = sos_part_create(self.c_cont, name.encode(), path.encode())
+            rc = sos_part_create_ex(self.c_cont, name.encode(), path.encode(), flags)
         else:
-            rc = sos_part_create(self.c_cont, name.encode(), NULL)
+            rc = sos_part_create_ex(self.c_cont, name.encode(), NULL, flags)
+        if rc != 0:
+            self.abort(rc)
+
+    def part_retain(self, keep=0):
+        """Delete the partitions older than a retention period
+
+        Deletes the ACTIVE partitions whose objects have not been
+        modified for keep seconds and frees their storage.
+
+        Keyword Parameters:
+        keep -- The retention period in seconds, by default the
+                container's PART_RETENTION option
+
+        Returns:
+        A dictionary with the number of partitions deleted and the
+        bytes of storage reclaimed
+        """
+        cdef int rc
+        cdef sos_part_retain_stat_s sb
+        if self.c_cont == NULL:
+            raise ValueError("The container is not open.")
+        rc = sos_part_retain(self.c_cont, keep, &sb)
         if rc != 0:
             self.abort(rc)
+        return { "part_count" : sb.part_count, "bytes" : sb.bytes }
 
     def part_by_name(self, name):
         cdef sos_part_t c_part = sos_part_find(self.c_cont, name.encode())
@@ -351,6 +387,21 @@ cdef class Container(SosObject):
     def schema_iter(self):
         return SchemaIter(self)
 
+def container_config_set(path, option, value):
+    """Set a container configuration option
+
+    The option takes effect the next time the container is opened.
+
+    Positional Parameters:
+    -- The container path
+    -- The option name, e.g. "PART_ROLL_TIME"
+    -- The option value, e.g. "1d"
+    """
+    cdef int rc = sos_container_config_set(path.encode(), option.encode(),
+                                           str(value).encode())
+    if rc != 0:
+        raise errno_exception(rc, "Error setting the option {0}".format(option))
+
 PART_STATE_OFFLINE = SOS_PART_STATE_OFFLINE
 PART_STATE_PRIMARY = SOS_PART_STATE_PRIMARY
 PART_STATE_ACTIVE = SOS_PART_STATE_ACTIVE
@@ -466,6 +517,24 @@ cdef class Partition(SosObject):
         """Export the contents of this partition to another container"""
         return sos_part_export(self.c_part, dst_cont.c_cont, reindex)
 
+    def attach(self, Container dst_cont, part_path=None, reindex=False):
+        """Move this partition to another container without copying it
+
+        The partition must be OFFLINE. If part_path is given, the
+        partition directory is renamed to part_path. If reindex is
+        True, the objects are added to the destination indices and the
+        partition is made ACTIVE. This partition handle cannot be used
+        after the call.
+        """
+        cdef int rc
+        if part_path is None:
+            rc = sos_part_attach(self.c_part, dst_cont.c_cont, NULL, reindex)
+        else:
+            rc = sos_part_attach(self.c_part, dst_cont.c_cont, part_path.encode(), reindex)
+        self.c_part = NULL
+        if rc != 0:
+            self.abort(rc)
+
     def index(self):
         """Index the contents of this partition"""
         return sos_part_index(self.c_part)
@@ -735,6 +804,42 @@ cdef class Schema(SosObject):
         """Returns the number of attributes in the schema"""
         return sos_schema_attr_count(self.c_schema)
 
+    def plan(self, where):
+        """Choose the index to search for a set of conditions
+
+        Returns a tuple of the Attr whose index a Filter with the
+        conditions should iterate, and the estimated number of objects
+        that match all of the conditions. See Attr.analyze() to improve
+        the estimates for range conditions.
+
+        Positional Arguments:
+        -- An array of condition tuples, ( attribute_name, condition, value )
+        """
+        cdef int i
+        cdef int count = len(where)
+        cdef uint64_t est_count
+        cdef sos_attr_t c_attr
+        cdef sos_plan_cond_t conds = <sos_plan_cond_t>calloc(count + 1, sizeof(sos_plan_cond_s))
+        if conds == NULL:
+            raise MemoryError()
+        try:
+            for i in range(count):
+                attr = self.attr_by_name(where[i][0])
+                conds[i].attr = (<Attr>attr).c_attr
+                conds[i].cond = <sos_cond_e>where[i][1]
+                conds[i].value = cond_value_new(attr, where[i][2])
+            c_attr = sos_plan_attr(self.c_schema, conds, count, &est_count)
+        finally:
+            for i in range(count):
+                if conds[i].value != NULL:
+                    sos_value_put(conds[i].value)
+                    sos_value_free(conds[i].value)
+            free(conds)
+        if c_attr == NULL:
+            raise ValueError("The schema {0} has no indexed attributes."
+                             .format(self.name()))
+        return ( self.attr_by_id(sos_attr_id(c_attr)), est_count )
+
     def schema_id(self):
         """Returns the unique schema id"""
         return sos_schema_id(self.c_schema)
@@ -755,7 +860,7 @@ cdef class Schema(SosObject):
         if type(attr_id) == int:
             return Attr(self, attr_id=attr_id)
         elif type(attr_id) == str:
-            return Attr(self, attr_name=attr_id.encode())
+            return Attr(self, attr_name=attr_id)
         raise ValueError("The index must be a string or an integer.")
 
     def __str__(self):
@@ -1349,6 +1454,27 @@ cdef class AttrIter(SosObject):
             return True
         return False
 
+    def key_range_set(self, Key lo=None, Key hi=None):
+        """Skip the partitions that cannot contain keys in [lo, hi]
+
+        The range is a hint that takes effect when the iterator is
+        next positioned. Keys outside the range may still be returned.
+
+        Keyword arguments:
+        lo -- The lowest key of interest or None for no lower bound
+        hi -- The highest key of interest or None for no upper bound
+        """
+        cdef sos_key_t c_lo = NULL
+        cdef sos_key_t c_hi = NULL
+        cdef int rc
+        if lo is not None:
+            c_lo = lo.c_key
+        if hi is not None:
+            c_hi = hi.c_key
+        rc = sos_iter_key_range_set(self.c_iter, c_lo, c_hi)
+        if rc != 0:
+            raise MemoryError()
+
     def get_pos(self):
         """Returns the currrent iterator position as a string
 
@@ -1538,6 +1664,73 @@ cdef class Attr(SosObject):
             return True
         return False
 
+    def index_add(self, idx_type=None, key_type=None, idx_args=None):
+        """Add an index to the attribute of a schema in a container
+
+        The objects already in the container are added to the index
+        in the background. Iterators and queries do not use the index
+        until index_build_stat() reports that it is complete.
+
+        Keyword Parameters:
+        idx_type -- The index type, the default is "BXTREE"
+        key_type -- The key type, the default depends on the attribute type
+        idx_args -- The index type specific arguments
+        """
+        cdef int rc
+        cdef const char *c_key_type = NULL
+        cdef const char *c_idx_args = NULL
+        name = sos_attr_name(self.c_attr)
+        if idx_type or key_type or idx_args:
+            if idx_type is None:
+                idx_type = "BXTREE"
+            idx_type = idx_type.encode()
+            if key_type is not None:
+                key_type = key_type.encode()
+                c_key_type = key_type
+            if idx_args is not None:
+                idx_args = idx_args.encode()
+                c_idx_args = idx_args
+            rc = sos_schema_index_modify(self.c_schema, name, idx_type,
+                                         c_key_type, c_idx_args)
+            if rc != 0:
+                self.abort(rc)
+        rc = sos_schema_index_add(self.c_schema, name)
+        if rc != 0:
+            self.abort(rc)
+
+    def index_build_stat(self):
+        """Returns the progress of the attribute's index build
+
+        The progress is returned as a dictionary. 'building' is True
+        until the index can be used. The partitions are scanned one at
+        a time, 'part_pos' and 'part_size' are the progress through
+        the partition being scanned.
+        """
+        cdef sos_index_build_stat_s sb
+        cdef int rc = sos_attr_index_build_stat(self.c_attr, &sb)
+        if rc != 0:
+            self.abort(rc)
+        return { 'building' : sb.building != 0,
+                 'part_count' : sb.part_count,
+                 'part_done' : sb.part_done,
+                 'part_size' : sb.part_size,
+                 'part_pos' : sb.part_pos,
+                 'obj_count' : sb.obj_count }
+
+    def analyze(self):
+        """Build the key distribution statistics for the attribute's index
+
+        The statistics are used by Schema.plan() and Query.select() to
+        estimate the number of objects matching range conditions on
+        this attribute. Only numeric and timestamp attributes can be
+        analyzed. The statistics are not saved in the container and
+        are discarded when it is closed; call analyze() again after
+        reopening the container.
+        """
+        cdef int rc = sos_attr_analyze(self.c_attr)
+        if rc != 0:
+            self.abort(rc)
+
     def size(self):
         """Returns the size of the attribute data in bytes"""
         return sos_attr_size(self.c_attr)
@@ -2265,6 +2458,102 @@ cdef int array_op_to_offset(name):
         return PICK_ARRAY
     raise ValueError("{0} is an invalid 'op' value.".format(name))
 
+cdef sos_value_t cond_value_new(Attr cond_attr, value) except NULL:
+    """Return a new sos_value_t for a filter condition on cond_attr
+
+    See Filter.add_condition() for the accepted value types. The
+    caller must release the value with sos_value_put() and
+    sos_value_free().
+    """
+    cdef int rc
+    cdef int typ
+    cdef int typ_is_array
+    cdef int count
+    cdef sos_value_t cond_v
+
+    typ = <int>sos_attr_type(cond_attr.c_attr)
+    typ_is_array = sos_attr_is_array(cond_attr.c_attr)
+
+    if type(value) == str:
+        # strip embedded '"' from value if present
+        value = value.replace('"', '')
+        if typ_is_array:
+            count = value.count(',') + 1
+    else:
+        if typ_is_array:
+            count = len(value)
+
+    cond_v = sos_value_new()
+    if typ_is_array != 0:
+        cond_v = sos_array_new(cond_v, cond_attr.c_attr, NULL, count)
+    else:
+        cond_v = sos_value_init(cond_v, NULL, cond_attr.c_attr)
+
+    if not cond_v:
+        raise ValueError("The attribute value for {0} "
+                         "could not be created.".format(cond_attr.name()))
+
+    if typ == SOS_TYPE_STRUCT:
+        # truncate the value to avoid overflowing the struct
+        value = value[:sos_attr_size(cond_attr.c_attr)]
+
+    if type(value) != str:
+        type_setters[typ](cond_attr.c_attr, cond_v.data, value)
+    else:
+        rc = sos_value_from_str(cond_v, value, NULL)
+        if rc != 0:
+            sos_value_put(cond_v)
+            sos_value_free(cond_v)
+            raise ValueError("The value {0} is invalid for the {1} attribute."
+                             .format(value, cond_attr.name()))
+    return cond_v
+
+cdef int filter_agg_cb(sos_value_t c_group, sos_agg_t c_agg, void *arg):
+    # arg is [ result, exception ]; an exception stops the aggregation
+    # and is raised by Filter.aggregate()
+    ctx = <object>arg
+    try:
+        if c_agg.count:
+            stats = { 'count' : c_agg.count, 'sum' : c_agg.sum,
+                      'min' : c_agg.min, 'max' : c_agg.max,
+                      'avg' : c_agg.sum / c_agg.count }
+        else:
+            stats = { 'count' : 0, 'sum' : 0.0,
+                      'min' : None, 'max' : None, 'avg' : None }
+        if c_group == NULL:
+            ctx[0][None] = stats
+            return 0
+        typ = <int>sos_attr_type(c_group.attr)
+        group = <object>type_getters[typ](NULL, c_group.data, c_group.attr)
+        if type(group) == np.ndarray:
+            group = tuple(group)
+        ctx[0][group] = stats
+    except BaseException as e:
+        ctx[1] = e
+        return -1
+    return 0
+
+cdef int filter_parallel_cb(sos_obj_t c_obj, void *arg):
+    # arg is [ result, exception ]; an exception stops the search and
+    # is raised by Filter.parallel()
+    ctx = <object>arg
+    try:
+        o = Object()
+        o.assign(sos_obj_get(c_obj))
+        ctx[0].append(o)
+    except BaseException as e:
+        ctx[1] = e
+        return -1
+    return 0
+
+cdef object errno_exception(int rc, msg):
+    """Return the exception for an errno value returned by the library"""
+    if rc == ENOMEM:
+        return MemoryError(msg)
+    if rc == EINVAL:
+        return ValueError(msg)
+    return OSError(rc, "{0}: {1}".format(msg, libc_errno_str.get(rc, rc)))
+
 cdef class Filter(object):
     """Implements a non-Python iterator on a Schema object
 
@@ -2308,6 +2597,9 @@ cdef class Filter(object):
     cdef sos_obj_t c_obj
     cdef double start_us
     cdef double end_us
+    cdef sos_resample_t c_rs
+    cdef rs_names
+    cdef rs_time
 
     def __init__(self, Attr attr):
         """Positional Parameters:
@@ -2406,43 +2698,10 @@ cdef class Filter(object):
         """
         cdef int rc
         cdef int typ
-        cdef int typ_is_array
-        cdef int count
         cdef sos_value_t cond_v
 
         typ = <int>sos_attr_type(cond_attr.c_attr)
-        typ_is_array = sos_attr_is_array(cond_attr.c_attr)
-
-        if type(value) == str:
-            # strip embedded '"' from value if present
-            value = value.replace('"', '')
-            if typ_is_array:
-                count = value.count(',') + 1
-        else:
-            if typ_is_array:
-                count = len(value)
-
-        cond_v = sos_value_new()
-        if typ_is_array != 0:
-            cond_v = sos_array_new(cond_v, cond_attr.c_attr, NULL, count)
-        else:
-            cond_v = sos_value_init(cond_v, NULL, cond_attr.c_attr)
-
-        if not cond_v:
-            raise ValueError("The attribute value for {0} "
-                             "could not be created.".format(cond_attr.name()))
-
-        if typ == SOS_TYPE_STRUCT:
-            # truncate the value to avoid overflowing the struct
-            value = value[:sos_attr_size(cond_attr.c_attr)]
-
-        if type(value) != str:
-            type_setters[typ](cond_attr.c_attr, cond_v.data, value)
-        else:
-            rc = sos_value_from_str(cond_v, value, NULL)
-            if rc != 0:
-                raise ValueError("The value {0} is invalid for the {1} attribute."
-                                 .format(value, cond_attr.name()))
+        cond_v = cond_value_new(cond_attr, value)
 
         if typ == SOS_TYPE_TIMESTAMP:
             # this is to support as_timeseries
@@ -2460,6 +2719,58 @@ cdef class Filter(object):
         if rc != 0:
             raise ValueError("Invalid filter condition, error {0}".format(rc))
 
+    def add_in(self, Attr cond_attr, values):
+        """Match objects whose attribute value is any one of the values
+
+        The values are OR'd together and AND'd with the other
+        conditions. If the filter iterates over cond_attr, or over a
+        join in which cond_attr follows components with COND_EQ
+        conditions, only the index entries for the values are
+        visited. Each matching object is returned once.
+
+        Positional parameters:
+        -- The attribute whose value is being compared
+        -- A list of values, see add_condition() for the value types
+        """
+        cdef int rc
+        cdef sos_value_t cond_v
+        for value in values:
+            cond_v = cond_value_new(cond_attr, value)
+            rc = sos_filter_in_add(self.c_filt, cond_attr.c_attr, &cond_v, 1)
+            sos_value_put(cond_v)
+            sos_value_free(cond_v)
+            if rc != 0:
+                raise ValueError("Invalid filter value, error {0}".format(rc))
+
+    def add_range(self, Attr cond_attr, lo, hi):
+        """Match objects whose attribute value is within [lo, hi]
+
+        Ranges, and the values added with add_in(), are OR'd together
+        and must all be on the same attribute. See add_in().
+
+        Positional parameters:
+        -- The attribute whose value is being compared
+        -- The low value, inclusive
+        -- The high value, inclusive
+        """
+        cdef int rc
+        cdef sos_value_t lo_v
+        cdef sos_value_t hi_v
+        lo_v = cond_value_new(cond_attr, lo)
+        try:
+            hi_v = cond_value_new(cond_attr, hi)
+        except:
+            sos_value_put(lo_v)
+            sos_value_free(lo_v)
+            raise
+        rc = sos_filter_range_add(self.c_filt, cond_attr.c_attr, lo_v, hi_v)
+        sos_value_put(lo_v)
+        sos_value_free(lo_v)
+        sos_value_put(hi_v)
+        sos_value_free(hi_v)
+        if rc != 0:
+            raise ValueError("Invalid filter range, error {0}".format(rc))
+
     def unique(self):
         """Return unique values
 
@@ -2515,15 +2826,339 @@ cdef class Filter(object):
     def count(self):
         """Return the number of objects matching all conditions"""
         cdef size_t count = 0
-        cdef sos_obj_t c_o = sos_filter_begin(self.c_filt)
-        if c_o == NULL:
-            return count
-        while c_o != NULL:
-            count += 1
-            sos_obj_put(c_o)
-            c_o = sos_filter_next(self.c_filt)
+        cdef sos_obj_t c_objs[256]
+        cdef int i
+        cdef int n = sos_filter_batch_begin(self.c_filt, c_objs, 256)
+        while n > 0:
+            count += n
+            for i in range(0, n):
+                sos_obj_put(c_objs[i])
+            n = sos_filter_batch_next(self.c_filt, c_objs, 256)
         return count
 
+    cdef batch_objs(self, int first, int count):
+        cdef sos_obj_t *c_objs
+        cdef int i, n
+        if count <= 0:
+            return []
+        c_objs = <sos_obj_t *>calloc(count, sizeof(sos_obj_t))
+        if c_objs == NULL:
+            raise MemoryError("Insufficient memory to allocate the result")
+        if first:
+            n = sos_filter_batch_begin(self.c_filt, c_objs, count)
+        else:
+            n = sos_filter_batch_next(self.c_filt, c_objs, count)
+        res = []
+        for i in range(0, n):
+            o = Object()
+            o.assign(c_objs[i])
+            res.append(o)
+        free(c_objs)
+        return res
+
+    def batch_begin(self, int count):
+        """Return the first matching objects
+
+        This is equivalent to begin() followed by next() until count
+        objects have been returned, but the conditions are evaluated
+        over a batch of index entries at a time. next() and
+        batch_next() continue after the last object returned.
+
+        Positional Parameters:
+        -- The maximum number of objects to return
+
+        Returns a list of at most count Objects.
+        """
+        return self.batch_objs(1, count)
+
+    def batch_next(self, int count):
+        """Return the matching objects following the last one returned
+
+        Positional Parameters:
+        -- The maximum number of objects to return
+
+        Returns a list of at most count Objects, empty if there are
+        no more matches.
+        """
+        return self.batch_objs(0, count)
+
+    def aggregate(self, attr=None, group_by=None):
+        """Aggregate an attribute over the objects matching all conditions
+
+        The values are accumulated while the filter iterates; the
+        objects are not converted to Python.
+
+        Keyword Parameters:
+        attr     -- The name of a numeric or timestamp attribute. If
+                    None, only the count is computed.
+        group_by -- The name of an attribute whose values group the
+                    objects, or None
+
+        Returns a dictionary with the keys 'count', 'sum', 'min',
+        'max' and 'avg'. If group_by is specified, a dictionary mapping
+        each group value to such a dictionary is returned.
+        """
+        cdef sos_attr_t c_attr = NULL
+        cdef sos_attr_t c_group = NULL
+        cdef int rc
+        schema = self.attr.schema()
+        if attr is not None:
+            c_attr = (<Attr>schema.attr_by_name(attr)).c_attr
+        if group_by is not None:
+            c_group = (<Attr>schema.attr_by_name(group_by)).c_attr
+        ctx = [ {}, None ]
+        rc = sos_filter_aggregate(self.c_filt, c_attr, c_group,
+                                  filter_agg_cb, <void *>ctx)
+        if ctx[1] is not None:
+            raise ctx[1]
+        if rc == ENOMEM:
+            raise MemoryError("Insufficient memory to group the objects")
+        if rc != 0:
+            raise ValueError("The attribute {0} cannot be aggregated, error {1}"
+                             .format(attr, rc))
+        res = ctx[0]
+        if group_by is None:
+            return res[None]
+        return res
+
+    def limit(self, size_t count):
+        """Limit the number of objects returned by the filter
+
+        After 'count' objects have been returned since begin(), end()
+        or the first batch, next() and prev() return None without
+        searching the index any further. A count of 0 removes the
+        limit.
+
+        Positional Parameters:
+        -- The maximum number of objects
+        """
+        sos_filter_limit_set(self.c_filt, count)
+
+    def top_k(self, int k, attr=None, desc=False):
+        """Return the k matching objects with the smallest attribute values
+
+        If the filter iterates over 'attr' the first k matches are
+        returned without visiting the rest of the index. Otherwise the
+        best k objects are kept in a bounded heap in the container
+        library as the filter iterates.
+
+        Positional Parameters:
+        -- The number of objects to return
+
+        Keyword Parameters:
+        attr -- The name of the attribute to order by. The default
+                is the filter attribute.
+        desc -- If True, return the objects with the largest values
+                first
+
+        Returns a list of at most k Objects.
+        """
+        cdef sos_attr_t c_attr = NULL
+        cdef sos_obj_t *c_objs
+        cdef int i, n
+        if attr is not None:
+            c_attr = (<Attr>self.attr.schema()[attr]).c_attr
+        c_objs = <sos_obj_t *>calloc(k, sizeof(sos_obj_t))
+        if c_objs == NULL:
+            raise MemoryError("Insufficient memory to allocate the result")
+        n = sos_filter_top_k(self.c_filt, c_attr, int(desc), c_objs, k)
+        if n < 0:
+            free(c_objs)
+            raise MemoryError("Insufficient memory to order the result")
+        res = []
+        for i in range(0, n):
+            o = Object()
+            o.assign(c_objs[i])
+            res.append(o)
+        free(c_objs)
+        return res
+
+    def intersect(self, attrs=None):
+        """Return the matching objects found by intersecting indices
+
+        The key range of each attribute's index is scanned and only
+        the objects referenced by every index are tested against the
+        filter's conditions. The objects are returned in storage
+        order, not in index order. The filter itself is not
+        positioned.
+
+        Keyword Parameters:
+        attrs -- A list of the names of the attributes whose indices
+                 are intersected. The default is every indexed
+                 attribute with a range condition.
+
+        Returns a list of Objects.
+        """
+        cdef sos_attr_t *c_attrs = NULL
+        cdef sos_isect_t c_isect
+        cdef sos_obj_t c_obj
+        cdef int i, count = 0
+        schema = self.attr.schema()
+        if attrs is not None:
+            count = len(attrs)
+            c_attrs = <sos_attr_t *>calloc(count + 1, sizeof(sos_attr_t))
+            if c_attrs == NULL:
+                raise MemoryError("Insufficient memory to allocate the attributes")
+            for i in range(0, count):
+                c_attrs[i] = (<Attr>schema.attr_by_name(attrs[i])).c_attr
+        c_isect = sos_isect_new(self.c_filt, c_attrs, count)
+        free(c_attrs)
+        if c_isect == NULL:
+            raise ValueError("The filter conditions cannot be intersected")
+        res = []
+        c_obj = sos_isect_begin(c_isect)
+        while c_obj != NULL:
+            o = Object()
+            o.assign(c_obj)
+            res.append(o)
+            c_obj = sos_isect_next(c_isect)
+        sos_isect_free(c_isect)
+        return res
+
+    def parallel(self, int threads, ordered=True):
+        """Return the matching objects, searching on several threads
+
+        The index is split into key ranges and the ranges are scanned
+        by copies of this filter on 'threads' threads. The filter's
+        limit, see limit(), caps the number of objects returned. The
+        filter itself is not positioned.
+
+        Positional Parameters:
+        -- The number of threads
+
+        Keyword Parameters:
+        ordered -- If True (the default) the objects are returned in
+                   index order, otherwise in the order they are found
+
+        Returns a list of Objects.
+        """
+        cdef int flags = 0
+        if not ordered:
+            flags = SOS_FILTER_PARALLEL_UNORDERED
+        ctx = [ [], None ]
+        rc = sos_filter_parallel(self.c_filt, threads, flags,
+                                 filter_parallel_cb, <void *>ctx)
+        if ctx[1] is not None:
+            raise ctx[1]
+        if rc != 0:
+            raise errno_exception(rc, "The parallel search failed")
+        return ctx[0]
+
+    def resample(self, interval_ms, columns, timestamp='timestamp',
+                 size_t count=4096, cont=False):
+        """Downsample the matching objects into fixed width time buckets
+
+        The filter must iterate over the timestamp attribute, or over
+        a join index whose first component is the timestamp, so that
+        the objects are visited in time order. One row is returned for
+        each bucket that contains at least one object. The buckets are
+        reduced while the filter iterates and are written directly
+        into the result arrays; the objects are not converted to
+        Python.
+
+        Each element of 'columns' is either the name of an attribute,
+        which is reduced with 'mean', or a tuple (name, op[, series])
+        where op is one of 'first', 'last', 'min', 'max', 'mean' or
+        'rate' and series names the result series. The
+        'rate' of a bucket is the change per second from the last
+        value of the previous bucket to the last value in the bucket.
+
+        Positional Parameters:
+        -- The bucket width in milliseconds
+        -- The list of column specifications
+
+        Keyword Parameters:
+        timestamp -- The name of the SOS_TYPE_TIMESTAMP attribute.
+                     The default is 'timestamp'
+        count     -- The maximum number of rows to return
+        cont      -- If True, continue with the row following the
+                     last row returned by the previous call
+
+        Returns a DataSet with a series named after the timestamp
+        attribute containing the start time of each bucket followed
+        by a series for each column, or None if there are no more
+        rows. If a tuple column does not name its series, the series
+        is named '<name>_<op>'.
+        """
+        cdef sos_resample_col_s *c_cols
+        cdef double **c_data
+        cdef uint64_t *c_times
+        cdef np.ndarray nda
+        cdef sos_attr_t t_attr
+        cdef Attr attr
+        cdef size_t rows
+        cdef int ncol, i
+
+        ops = { 'first' : SOS_RESAMPLE_FIRST, 'last' : SOS_RESAMPLE_LAST,
+                'min' : SOS_RESAMPLE_MIN, 'max' : SOS_RESAMPLE_MAX,
+                'mean' : SOS_RESAMPLE_MEAN, 'avg' : SOS_RESAMPLE_MEAN,
+                'rate' : SOS_RESAMPLE_RATE }
+        schema = self.attr.schema()
+        if not cont or self.c_rs == NULL:
+            if self.c_rs:
+                sos_resample_free(self.c_rs)
+                self.c_rs = NULL
+            ncol = len(columns)
+            c_cols = <sos_resample_col_s *>calloc(ncol, sizeof(sos_resample_col_s))
+            if c_cols == NULL:
+                raise MemoryError("Insufficient memory to allocate the columns")
+            names = []
+            try:
+                t_attr = (<Attr>schema[timestamp]).c_attr
+                for i in range(0, ncol):
+                    col = columns[i]
+                    if type(col) == str:
+                        name = col
+                        op = 'mean'
+                        names.append(name)
+                    else:
+                        name = col[0]
+                        op = col[1]
+                        if len(col) > 2:
+                            names.append(col[2])
+                        else:
+                            names.append('{0}_{1}'.format(name, op))
+                    attr = schema[name]
+                    c_cols[i].attr = attr.c_attr
+                    c_cols[i].op = <sos_resample_op_e><int>ops[op]
+            except Exception as e:
+                free(c_cols)
+                raise ValueError("Error '{0}' processing the columns parameter"
+                                 .format(str(e)))
+            self.c_rs = sos_resample_new(self.c_filt, t_attr,
+                                         <uint64_t>(interval_ms * 1000),
+                                         c_cols, ncol)
+            free(c_cols)
+            if self.c_rs == NULL:
+                raise ValueError("The filter cannot be resampled on {0}. "
+                                 "The filter must be ordered by the timestamp and "
+                                 "the columns must be numeric.".format(timestamp))
+            self.rs_names = names
+            self.rs_time = timestamp
+
+        ncol = len(self.rs_names)
+        c_data = <double **>calloc(ncol, sizeof(double *))
+        if c_data == NULL:
+            raise MemoryError("Insufficient memory to allocate the columns")
+        times = np.zeros([ count ], dtype=np.dtype('uint64'))
+        nda = times
+        c_times = <uint64_t *>np.PyArray_DATA(nda)
+        result = []
+        for i in range(0, ncol):
+            nda = np.zeros([ count ], dtype=np.float64)
+            c_data[i] = <double *>np.PyArray_DATA(nda)
+            result.append(nda)
+        rows = sos_resample_next(self.c_rs, c_times, c_data, count)
+        free(c_data)
+        if rows == 0:
+            return None
+        res = DataSet()
+        res.append_array(rows, self.rs_time, times.view('datetime64[us]'))
+        for i in range(0, ncol):
+            res.append_array(rows, self.rs_names[i], result[i])
+        res.set_series_size(rows)
+        return res
+
     def obj(self):
         """Return the object at the currrent filter position"""
         cdef sos_obj_t c_obj = sos_filter_obj(self.c_filt)
@@ -3218,6 +3853,9 @@ cdef class Filter(object):
         if self.c_obj:
             sos_obj_put(self.c_obj)
             self.c_obj = NULL
+        if self.c_rs:
+            sos_resample_free(self.c_rs)
+            self.c_rs = NULL
         if self.c_filt:
             sos_filter_free(self.c_filt)
             self.c_filt = NULL
@@ -3410,6 +4048,9 @@ cdef class Index(object):
             cardinality - Number of index entries
             duplicates  - Number of duplicate keys
             size        - The storage size consumed by the index in bytes
+            depth       - The number of levels in a tree index
+            node_size   - The size of a tree node in bytes
+            fill_factor - The fraction of the tree node capacity in use
         """
         cdef int rc = sos_index_stat(self.c_index, &self.c_stats)
         return self.c_stats
@@ -4742,6 +5383,19 @@ cdef nda_resample_fn_t *nda_resamplers = [
     NULL,                       # obj array
 ]
 
+cdef struct query_parallel_s:
+    sos_obj_t *objects
+    int count
+    int limit
+
+cdef int query_parallel_cb(sos_obj_t c_obj, void *arg):
+    cdef query_parallel_s *qp = <query_parallel_s *>arg
+    qp.objects[qp.count] = sos_obj_get(c_obj)
+    qp.count += 1
+    if qp.count == qp.limit:
+        return ENOSPC
+    return 0
+
 cdef class QueryInputer:
     DEFAULT_ARRAY_LIMIT = 256
     cdef int start
@@ -4849,6 +5503,9 @@ cdef class QueryInputer:
         else:
             start = self.row_count
 
+        if query.parallel:
+            return self.__input_parallel(query, reset_)
+
         for filt_no in range(start, filt_count):
             f = query.filters[filt_no]
             if reset_:
@@ -4875,6 +5532,27 @@ cdef class QueryInputer:
             return False
         return True
 
+    cdef __input_parallel(self, Query query, int reset_):
+        cdef query_parallel_s qp
+        cdef Filter f
+        cdef int flags = 0
+        if len(query.filters) != 1:
+            raise ValueError("A parallel query must select from a single schema")
+        if not reset_:
+            raise ValueError("A parallel query cannot be continued")
+        f = query.filters[0]
+        if not query.parallel_ordered:
+            flags = SOS_FILTER_PARALLEL_UNORDERED
+        qp.objects = self.objects
+        qp.count = 0
+        qp.limit = self.row_limit
+        rc = sos_filter_parallel(f.c_filt, query.parallel, flags,
+                                 query_parallel_cb, <void *>&qp)
+        self.row_count = qp.count
+        if rc != 0 and rc != ENOSPC:
+            raise errno_exception(rc, "The parallel query failed")
+        return False
+
     def to_timeseries(self, Query query, timestamp='timestamp', interval_ms=None,
                       max_array=DEFAULT_ARRAY_LIMIT,
                       max_string=DEFAULT_ARRAY_LIMIT):
@@ -5137,6 +5815,8 @@ cdef class Query:
     cdef last_row               # indeed...
     cdef unique                 # Boolean indicating if queries are unique
     cdef inputer                # Maintains query results
+    cdef int parallel           # Threads used to search, 0 if not parallel
+    cdef int parallel_ordered   # Parallel results are in index order
 
     def __init__(self, container):
         """Implements a Query interface to the SOS container.
@@ -5315,6 +5995,12 @@ cdef class Query:
     def _order_by(self, name):
         self.primary = name
 
+    def _plan_order_by(self, where):
+        if len(self.schema) == 0:
+            raise ValueError("from_ is required with order_by='*'")
+        attr, est_count = self.schema[0].plan(where if where else [])
+        self._order_by(attr.name())
+
     cdef _add_colspec(self, ColSpec colspec):
         schema, attr = self.__decode_attr_name(colspec.name)
         if not schema:
@@ -5343,7 +6029,8 @@ cdef class Query:
         colspec.update(self, idx, attr)
         self.columns.append(colspec)
 
-    def select(self, columns, order_by=None, where=None, from_=None, unique=False):
+    def select(self, columns, order_by=None, where=None, from_=None, unique=False,
+               limit=None, parallel=None, ordered=True):
         """Set the attribute list returned in the result
 
         Positional Parmeters:
@@ -5384,6 +6071,11 @@ cdef class Query:
         where     -- An array of conditions to filter the data
         order_by  -- The attribute to use as the primary index
         unique    -- Return only a single result for each matching key
+        limit     -- The maximum number of rows returned, see Filter.limit()
+        parallel  -- The number of threads used to search the index,
+                     see Filter.parallel()
+        ordered   -- If False, a parallel query returns the rows in the
+                     order they are found rather than in index order
 
         FROM_
 
@@ -5406,6 +6098,14 @@ cdef class Query:
 
             where = [( 'timestamp', COND_GE, 1510597567.001617 )]
 
+          If the condition is the string 'in', the value is a list
+          and the attribute must equal one of its values, see
+          Filter.add_in().
+
+          Example:
+
+            where = [( 'component_id', 'in', [ 1, 5, 17 ] )]
+
         ORDER_BY
 
           Specifies the name of the primary key. This attribute must be
@@ -5416,6 +6116,10 @@ cdef class Query:
           list is used. If this attribute is not indexed, an exception
           will be raised.
 
+          If order_by is '*', the index is chosen by the query planner
+          based on the where conditions and the index statistics of
+          the first schema in the from_ list, see Schema.plan().
+
           Example:
 
             order_by = 'job_comp_time'
@@ -5436,13 +6140,16 @@ cdef class Query:
         self.schema = []
         self.unique = unique
 
-        if order_by:
+        if order_by and order_by != '*':
             # Must be before the Filter(s) are created
             self._order_by(order_by)
 
         if from_:
             self._from_(from_)
 
+        if order_by == '*':
+            self._plan_order_by(where)
+
         self.filter_idx = {}
         self.filters = []
         self.columns = []
@@ -5481,6 +6188,13 @@ cdef class Query:
             # Must be after the Filter(s) are created
             self._where(where)
 
+        if limit:
+            for f in self.filters:
+                f.limit(limit)
+
+        self.parallel = parallel if parallel else 0
+        self.parallel_ordered = 1 if ordered else 0
+
     def get_columns(self):
         """Return list of columns-specification (ColSpec)"""
         return self.columns
@@ -5505,7 +6219,10 @@ cdef class Query:
                 raise ValueError("Each condition is a list/tuple; "
                                  "[<attr-name>, <condition>, <value>]")
             for f in self.filters:
-                f.add_condition(f.get_attr().schema()[c[0]], c[1], c[2])
+                if c[1] == 'in':
+                    f.add_in(f.get_attr().schema()[c[0]], c[2])
+                else:
+                    f.add_condition(f.get_attr().schema()[c[0]], c[1], c[2])
 
     def to_timeseries(self, timestamp='timestamp', interval_ms=None,
                       max_array=QueryInputer.DEFAULT_ARRAY_LIMIT,
@@ -5514,6 +6231,38 @@ cdef class Query:
             return self.inputer.to_timeseries(self, timestamp, interval_ms, max_array, max_string)
         return None
 
+    def resample(self, interval_ms, ops=None, timestamp='timestamp',
+                 count=QUERY_RESULT_LIMIT, cont=False):
+        """Downsample the query result into fixed width time buckets
+
+        The buckets are reduced in the container library as described
+        in Filter.resample(); only one row per bucket is returned. The
+        query must select from a single schema and be ordered by the
+        timestamp or by a join index that begins with the timestamp.
+
+        Keyword Parameters:
+        ops       -- A dictionary mapping column names to one of 'first',
+                     'last', 'min', 'max', 'mean' or 'rate'. Columns
+                     not in the dictionary are reduced with 'mean'.
+        timestamp -- The name of the timestamp attribute
+        count     -- The maximum number of rows to return
+        cont      -- If True, continue after the last row returned
+
+        Returns a DataSet, or None if there are no more rows.
+        """
+        if len(self.filters) != 1:
+            raise ValueError("resample() requires a query on a single schema")
+        if ops is None:
+            ops = {}
+        columns = []
+        for col in self.columns:
+            if col.attr_name == timestamp:
+                continue
+            columns.append((col.attr_name, ops.get(col.col_name, 'mean'),
+                            col.col_name))
+        return self.filters[0].resample(interval_ms, columns, timestamp=timestamp,
+                                        count=count, cont=cont)
+
     def to_dataset(self, max_array=QueryInputer.DEFAULT_ARRAY_LIMIT,
                    max_string=QueryInputer.DEFAULT_ARRAY_LIMIT):
         if self.inputer:
@@ -425,6 +425,7 @@ int sos_container_new(const char *path, int o_mode)
 	}
 	SOS_PART_UDATA(udata)->signature = SOS_PART_SIGNATURE;
 	SOS_PART_UDATA(udata)->primary = 0;
+	SOS_PART_UDATA(udata)->primary_time = 0;
 	SOS_PART_UDATA(udata)->head = 0;
 	SOS_PART_UDATA(udata)->tail = 0;
 	SOS_PART_UDATA(udata)->lock = 0;
@@ -577,7 +578,8 @@ int sos_container_commit(sos_t sos, sos_commit_t flags)
 	/* Commit the object ods */
 	sos_part_t part;
 	TAILQ_FOREACH(part, &sos->part_list, entry)
-		if (SOS_PART(part->part_obj)->state & SOS_PART_STATE_ACTIVE)
+		if (part->obj_ods
+		    && (SOS_PART(part->part_obj)->state & SOS_PART_STATE_ACTIVE))
 			ods_commit(part->obj_ods, commit);
 
 	/* Commit all the attribute indices */
@@ -585,8 +587,8 @@ int sos_container_commit(sos_t sos, sos_commit_t flags)
 		if (schema->state != SOS_SCHEMA_OPEN)
 			continue;
 		TAILQ_FOREACH(attr, &schema->attr_list, entry) {
-			if (sos_attr_index(attr))
-				sos_index_commit(sos_attr_index(attr), commit);
+			if (__sos_attr_index(attr))
+				sos_index_commit(__sos_attr_index(attr), commit);
 		}
 	}
 	return 0;
@@ -612,8 +614,8 @@ int print_schema(struct rbn *n, void *fp_, int level)
 	sos_schema_print(schema, fp);
 
 	TAILQ_FOREACH(attr, &schema->attr_list, entry) {
-		if (sos_attr_index(attr))
-			sos_index_info(sos_attr_index(attr), fp);
+		if (__sos_attr_index(attr))
+			sos_index_info(__sos_attr_index(attr), fp);
 	}
 	return 0;
 }
@@ -789,11 +791,25 @@ static void free_sos(sos_t sos, sos_commit_t flags)
 		TAILQ_REMOVE(&sos->part_list, part, entry);
 		sos_part_put(part); /* the list reference */
 	}
+	while (!TAILQ_EMPTY(&sos->part_retired)) {
+		part = TAILQ_FIRST(&sos->part_retired);
+		TAILQ_REMOVE(&sos->part_retired, part, entry);
+		sos_part_put(part);
+	}
+	__sos_part_table_free(sos);
 	if (sos->part_udata)
 		ods_obj_put(sos->part_udata);
 	if (sos->part_ods)
 		ods_close(sos->part_ods, flags);
 	pthread_mutex_destroy(&sos->lock);
+	pthread_mutex_destroy(&sos->roll_lock);
+	pthread_cond_destroy(&sos->roll_cond);
+	pthread_mutex_destroy(&sos->build_lock);
+	pthread_cond_destroy(&sos->build_cond);
+	pthread_mutex_destroy(&sos->retain_lock);
+	pthread_cond_destroy(&sos->retain_cond);
+	pthread_mutex_destroy(&sos->part_open_lock);
+	pthread_rwlock_destroy(&sos->part_evict_lock);
 	free(sos);
 }
 
@@ -968,9 +984,18 @@ sos_t sos_container_open(const char *path_arg, sos_perm_t o_perm)
 		return NULL;
 	}
 	pthread_mutex_init(&sos->lock, NULL);
+	pthread_mutex_init(&sos->roll_lock, NULL);
+	pthread_cond_init(&sos->roll_cond, NULL);
+	pthread_mutex_init(&sos->build_lock, NULL);
+	pthread_cond_init(&sos->build_cond, NULL);
+	pthread_mutex_init(&sos->retain_lock, NULL);
+	pthread_cond_init(&sos->retain_cond, NULL);
+	pthread_mutex_init(&sos->part_open_lock, NULL);
+	pthread_rwlock_init(&sos->part_evict_lock, NULL);
 	LIST_INIT(&sos->obj_list);
 	LIST_INIT(&sos->obj_free_list);
 	TAILQ_INIT(&sos->part_list);
+	TAILQ_INIT(&sos->part_retired);
 
 	/* Stat the container path to get the file mode bits */
 	sos->path = path;
@@ -982,6 +1007,7 @@ sos_t sos_container_open(const char *path_arg, sos_perm_t o_perm)
 	rbt_init(&sos->schema_name_rbt, __sos_schema_name_cmp);
 	rbt_init(&sos->schema_id_rbt, schema_id_cmp);
 	sos->schema_count = 0;
+	sos->config.part_roll_extend = SOS_PART_ROLL_EXTEND_DEFAULT;
 
 	rc = __sos_config_init(sos);
 	if (rc) {
@@ -1084,6 +1110,30 @@ sos_t sos_container_open(const char *path_arg, sos_perm_t o_perm)
 		goto err;
 	}
 
+	rc = __sos_part_roll_start(sos);
+	if (rc) {
+		sos_error("Error %d starting the partition roll thread for %s\n",
+			  rc, path_arg);
+		errno = rc;
+		goto err;
+	}
+
+	rc = __sos_index_build_resume(sos);
+	if (rc) {
+		sos_error("Error %d starting the index build thread for %s\n",
+			  rc, path_arg);
+		errno = rc;
+		goto err;
+	}
+
+	rc = __sos_part_retain_start(sos);
+	if (rc) {
+		sos_error("Error %d starting the partition retention thread for %s\n",
+			  rc, path_arg);
+		errno = rc;
+		goto err;
+	}
+
 	ods_iter_delete(iter);
 	__pos_cleanup(sos);
 
@@ -1092,6 +1142,9 @@ sos_t sos_container_open(const char *path_arg, sos_perm_t o_perm)
 	pthread_mutex_unlock(&cont_list_lock);
 	return sos;
  err:
+	__sos_part_retain_stop(sos);
+	__sos_index_build_stop(sos);
+	__sos_part_roll_stop(sos);
 	if (iter)
 		ods_iter_delete(iter);
 	free_sos(sos, SOS_COMMIT_ASYNC);
@@ -1215,7 +1268,10 @@ int sos_container_move(const char *path_arg, const char *new_path)
 int sos_container_stat(sos_t sos, struct stat *sb)
 {
 	sos_part_t part = TAILQ_FIRST(&sos->part_list);
-	return ods_stat(part->obj_ods, sb);
+	ods_t ods = part ? __sos_part_ods(part) : NULL;
+	if (!ods)
+		return ENOENT;
+	return ods_stat(ods, sb);
 }
 
 /**
@@ -1232,6 +1288,9 @@ int sos_container_stat(sos_t sos, struct stat *sb)
  */
 void sos_container_close(sos_t sos, sos_commit_t flags)
 {
+	__sos_part_retain_stop(sos);
+	__sos_index_build_stop(sos);
+	__sos_part_roll_stop(sos);
 	__pos_cleanup(sos);
 
 	pthread_mutex_lock(&cont_list_lock);
@@ -1263,7 +1322,9 @@ sos_obj_t __sos_init_obj_no_lock(sos_t sos, sos_schema_t schema, ods_obj_t ods_o
 	if (!sos_obj)
 		return NULL;
 	LIST_INSERT_HEAD(&sos->obj_list, sos_obj, entry);
-	SOS_OBJ(ods_obj)->schema = schema->data->id;
+	/* Don't dirty the page of an object that is only read */
+	if (SOS_OBJ(ods_obj)->schema != schema->data->id)
+		SOS_OBJ(ods_obj)->schema = schema->data->id;
 	sos_obj->sos = sos;
 	sos_obj->obj = ods_obj;
 	sos_obj->obj_ref = obj_ref;
@@ -1325,7 +1386,9 @@ sos_obj_t sos_obj_new(sos_schema_t schema)
 		errno = ENOSPC;
 		return NULL;
 	}
-	ods_obj = __sos_obj_new(part->obj_ods, schema->data->obj_sz,
+	/* An index build must not scan the object before it is recorded */
+	__sos_index_build_lock(schema->sos);
+	ods_obj = __sos_obj_new(__sos_part_ods(part), schema->data->obj_sz,
 				&schema->sos->lock);
 	if (!ods_obj)
 		goto err_0;
@@ -1335,11 +1398,20 @@ sos_obj_t sos_obj_new(sos_schema_t schema)
 	sos_obj = __sos_init_obj(schema->sos, schema, ods_obj, obj_ref);
 	if (!sos_obj)
 		goto err_1;
+	if (__sos_index_build_obj_new(sos_obj))
+		goto err_2;
+	__sos_index_build_unlock(schema->sos);
 	return sos_obj;
+ err_2:
+	ods_obj_delete(ods_obj);
+	sos_obj_put(sos_obj);
+	errno = ENOMEM;
+	goto err_0;
  err_1:
 	ods_obj_delete(ods_obj);
 	ods_obj_put(ods_obj);
  err_0:
+	__sos_index_build_unlock(schema->sos);
 	return NULL;
 }
 
@@ -1418,14 +1490,10 @@ sos_obj_ref_t sos_obj_ref(sos_obj_t obj)
 
 ods_t __sos_ods_from_ref(sos_t sos, ods_ref_t ref)
 {
-	sos_part_t part;
-	TAILQ_FOREACH(part, &sos->part_list, entry) {
-		if (ref == SOS_PART(part->part_obj)->part_id)
-			goto found;
-	}
-	return NULL;
- found:
-	return part->obj_ods;
+	sos_part_t part = __sos_part_by_id(sos, ref);
+	if (!part)
+		return NULL;
+	return __sos_part_ods(part);
 }
 
 static int ref_is_null(sos_obj_ref_t ref)
@@ -1452,11 +1520,7 @@ sos_obj_t sos_ref_as_obj(sos_t sos, sos_obj_ref_t ref)
 	if (ref_is_null(ref))
 		return NULL;
 
-	ods_t ods = __sos_ods_from_ref(sos, ref.ref.ods);
-	if (!ods)
-		return NULL;
-
-	ods_obj = ods_ref_as_obj(ods, ref.ref.obj);
+	ods_obj = __sos_part_ref_as_obj(sos, ref);
 	if (!ods_obj)
 		return NULL;
 
@@ -1520,6 +1584,9 @@ sos_schema_t sos_obj_schema(sos_obj_t obj)
 void sos_obj_delete(sos_obj_t obj)
 {
 	sos_attr_t attr;
+	/* Keep an index build from adding the object while it is freed */
+	__sos_index_build_lock(obj->sos);
+	__sos_index_build_obj_delete(obj);
 	TAILQ_FOREACH(attr, &obj->schema->attr_list, entry) {
 		struct sos_value_s v_;
 		sos_value_t value;
@@ -1532,6 +1599,7 @@ void sos_obj_delete(sos_obj_t obj)
 		sos_value_put(value);
 	}
 	ods_obj_delete(obj->obj);
+	__sos_index_build_unlock(obj->sos);
 }
 
 /**
@@ -1610,34 +1678,67 @@ void __sos_obj_put_no_lock(sos_obj_t obj)
 int sos_obj_remove(sos_obj_t obj)
 {
 	sos_attr_t attr;
-	size_t key_sz;
 	int rc;
-	sos_key_t key;
+
 	TAILQ_FOREACH(attr, &obj->schema->attr_list, entry) {
-		sos_index_t index;
-		struct sos_value_s v_;
-		sos_value_t value;
-		index = sos_attr_index(attr);
-		if (!index)
-			continue;
-		value = sos_value_init(&v_, obj, attr);
-		key_sz = sos_value_size(value);
-		key = sos_key_new(key_sz);
-		if (!key) {
-			sos_value_put(value);
-			return ENOMEM;
-		}
-		ods_key_set(key, sos_value_as_key(value), key_sz);
-		rc = ods_idx_delete(index->idx, key, &obj->obj_ref.idx_data);
-		sos_key_put(key);
-		sos_value_put(value);
+		rc = __sos_obj_remove_attr(obj, attr);
 		if (rc)
 			return rc;
 	}
-
 	return 0;
 }
 
+/*
+ * Remove the object's key from an index. Returns 0 if the attribute
+ * is an array whose value has not been set.
+ */
+int __sos_obj_remove_key(sos_obj_t obj, sos_attr_t attr, sos_index_t index)
+{
+	struct sos_value_s v_;
+	sos_value_t value;
+	size_t key_sz;
+	sos_key_t key;
+	int rc;
+
+	value = sos_value_init(&v_, obj, attr);
+	if (!value)
+		return 0;
+	key_sz = sos_value_size(value);
+	key = sos_key_new(key_sz);
+	if (!key) {
+		sos_value_put(value);
+		return ENOMEM;
+	}
+	ods_key_set(key, sos_value_as_key(value), key_sz);
+	rc = sos_index_remove(index, key, obj);
+	sos_key_put(key);
+	sos_value_put(value);
+	return rc;
+}
+
+/*
+ * Remove the object's key from the index of the attribute. Returns 0
+ * if the attribute is not indexed.
+ */
+int __sos_obj_remove_attr(sos_obj_t obj, sos_attr_t attr)
+{
+	sos_index_t index;
+	int rc;
+
+	index = __sos_attr_index(attr);
+	if (!index)
+		return 0;
+	if (attr->data->building
+	    && !__sos_index_build_visited(obj, attr))
+		/* The index build has not added it yet */
+		return 0;
+	rc = __sos_obj_remove_key(obj, attr, index);
+	if (rc == ENOENT && attr->data->building)
+		/* The index build has not added it either */
+		rc = 0;
+	return rc;
+}
+
 /**
  * \brief Add an object to its indexes
  *
@@ -1651,43 +1752,78 @@ int sos_obj_remove(sos_obj_t obj)
  * \retval -1	An error occurred. Refer to errno for detail.
  */
 int sos_obj_index(sos_obj_t obj)
+{
+	sos_attr_t attr;
+	int rc;
+
+	TAILQ_FOREACH(attr, &obj->schema->idx_attr_list, idx_entry) {
+		rc = __sos_obj_index_attr(obj, attr);
+		if (rc)
+			return rc;
+	}
+	return 0;
+}
+
+/*
+ * Add the object's key to the index of the attribute. If replace is
+ * !0, an entry for the object that may already be in the index is
+ * removed first. Returns 0 if the attribute is an array whose value
+ * has not been set.
+ */
+int __sos_obj_index_key(sos_obj_t obj, sos_attr_t attr, sos_index_t index,
+			int replace)
 {
 	struct sos_value_s v_;
 	sos_value_t value;
-	sos_attr_t attr;
 	size_t key_sz;
 	sos_key_t the_key = NULL;
 	SOS_KEY(key);
 	int rc;
 
-	TAILQ_FOREACH(attr, &obj->schema->idx_attr_list, idx_entry) {
-		sos_index_t index = sos_attr_index(attr);
-		if (!index)
-			return errno;
-		value = sos_value_init(&v_, obj, attr);
-		if (!value) {
-			/* Array value not set, skip */
-			continue;
-		}
-		key_sz = sos_value_size(value);
-		if (key_sz < 254) {
-			the_key = key;
-		} else {
-			the_key = sos_key_new(key_sz);
-		}
-		sos_key_set(the_key, sos_value_as_key(value), key_sz);
-		rc = sos_index_insert(index, the_key, obj);
-		if (the_key != key)
-			sos_key_put(the_key);
-		sos_value_put(value);
-		if (rc)
-			goto err;
+	value = sos_value_init(&v_, obj, attr);
+	if (!value) {
+		/* Array value not set, skip */
+		return 0;
 	}
-	return 0;
- err:
+	key_sz = sos_value_size(value);
+	if (key_sz < 254) {
+		the_key = key;
+	} else {
+		the_key = sos_key_new(key_sz);
+	}
+	sos_key_set(the_key, sos_value_as_key(value), key_sz);
+	if (replace)
+		(void)sos_index_remove(index, the_key, obj);
+	rc = sos_index_insert(index, the_key, obj);
+	if (the_key != key)
+		sos_key_put(the_key);
+	sos_value_put(value);
 	return rc;
 }
 
+/*
+ * Add an object to the index of a single attribute. Returns 0 if the
+ * attribute is an array whose value has not been set.
+ */
+int __sos_obj_index_attr(sos_obj_t obj, sos_attr_t attr)
+{
+	int replace = 0;
+	sos_index_t index = __sos_attr_index(attr);
+	if (!index)
+		return errno;
+	if (attr->data->building) {
+		/*
+		 * The index build adds the objects it has not visited
+		 * yet. It may have added this one before it was
+		 * indexed here, so replace that entry.
+		 */
+		if (!__sos_index_build_visited(obj, attr))
+			return 0;
+		replace = 1;
+	}
+	return __sos_obj_index_key(obj, attr, index, replace);
+}
+
 /**
  * \brief Set an object attribute's value from a string
  *
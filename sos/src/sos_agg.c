@@ -0,0 +1,734 @@
+/*
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \page aggregation Aggregation
+ *
+ * sos_filter_aggregate() computes the count, sum, minimum and maximum
+ * of an attribute's values over the objects matching a filter,
+ * optionally grouped by the value of another attribute. The objects
+ * are fetched in batches with sos_filter_batch_begin() and
+ * sos_filter_batch_next() and the attribute values are gathered from
+ * each batch into a column before they are accumulated, so no object
+ * values are copied out of the container.
+ *
+ * The average is the sum divided by the count.
+ *
+ * sos_resample_new() and sos_resample_next() downsample the objects
+ * matching a timestamp ordered filter into fixed width time buckets.
+ * One row is produced for each bucket that contains at least one
+ * object and each column of the row is reduced from the bucket's
+ * values with one of the ::sos_resample_op_e operators. The rows are
+ * written into caller supplied column buffers so that an application
+ * can fill e.g. numpy arrays without an intermediate copy.
+ *
+ * sos_filter_top_k() returns the k matching objects with the smallest
+ * or largest values of an attribute. If the filter already iterates
+ * in that attribute's order, the scan stops after k matches.
+ * Otherwise the objects are kept in a bounded heap while the filter
+ * iterates, so at most k objects are held at any time.
+ */
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <sos/sos.h>
+#include <ods/rbt.h>
+#include "sos_priv.h"
+
+typedef void (*agg_gather_fn_t)(sos_obj_t *objs, int count, size_t offset,
+				double *col);
+
+#define AGG_GATHER(_name_, _type_)					\
+static void _name_(sos_obj_t *objs, int count, size_t offset, double *col) \
+{									\
+	_type_ v;							\
+	int i;								\
+	for (i = 0; i < count; i++) {					\
+		memcpy(&v, &objs[i]->obj->as.bytes[offset], sizeof(v));\
+		col[i] = (double)v;					\
+	}								\
+}
+
+AGG_GATHER(int16_gather, int16_t)
+AGG_GATHER(int32_gather, int32_t)
+AGG_GATHER(int64_gather, int64_t)
+AGG_GATHER(uint16_gather, uint16_t)
+AGG_GATHER(uint32_gather, uint32_t)
+AGG_GATHER(uint64_gather, uint64_t)
+AGG_GATHER(float_gather, float)
+AGG_GATHER(double_gather, double)
+AGG_GATHER(long_double_gather, long double)
+
+static void timestamp_gather(sos_obj_t *objs, int count, size_t offset,
+			     double *col)
+{
+	union sos_timestamp_u v;
+	int i;
+	for (i = 0; i < count; i++) {
+		memcpy(&v, &objs[i]->obj->as.bytes[offset], sizeof(v));
+		col[i] = (double)v.fine.secs + (double)v.fine.usecs / 1.0e6;
+	}
+}
+
+static agg_gather_fn_t gather_table[] = {
+	[SOS_TYPE_INT16] = int16_gather,
+	[SOS_TYPE_INT32] = int32_gather,
+	[SOS_TYPE_INT64] = int64_gather,
+	[SOS_TYPE_UINT16] = uint16_gather,
+	[SOS_TYPE_UINT32] = uint32_gather,
+	[SOS_TYPE_UINT64] = uint64_gather,
+	[SOS_TYPE_FLOAT] = float_gather,
+	[SOS_TYPE_DOUBLE] = double_gather,
+	[SOS_TYPE_LONG_DOUBLE] = long_double_gather,
+	[SOS_TYPE_TIMESTAMP] = timestamp_gather,
+};
+
+static void __agg_init(sos_agg_t agg)
+{
+	agg->count = 0;
+	agg->sum = 0.0;
+	agg->min = DBL_MAX;
+	agg->max = -DBL_MAX;
+}
+
+static void __agg_col(sos_agg_t agg, double *col, int count)
+{
+	double sum = 0.0, min = agg->min, max = agg->max;
+	int i;
+	for (i = 0; i < count; i++) {
+		sum += col[i];
+		if (col[i] < min)
+			min = col[i];
+		if (col[i] > max)
+			max = col[i];
+	}
+	agg->count += count;
+	agg->sum += sum;
+	agg->min = min;
+	agg->max = max;
+}
+
+static void __agg_one(sos_agg_t agg, double v)
+{
+	agg->count += 1;
+	agg->sum += v;
+	if (v < agg->min)
+		agg->min = v;
+	if (v > agg->max)
+		agg->max = v;
+}
+
+struct agg_group_s {
+	struct sos_value_s value_;
+	sos_value_t value;
+	struct sos_agg_s agg;
+	struct rbn rbn;
+};
+
+static int __group_cmp(void *tree_key, void *key)
+{
+	return sos_value_cmp((sos_value_t)tree_key, (sos_value_t)key);
+}
+
+static struct agg_group_s *__group_find(struct rbt *groups, sos_obj_t obj,
+					sos_attr_t group_attr)
+{
+	struct agg_group_s *group;
+	struct sos_value_s v_;
+	sos_value_t v;
+	struct rbn *rbn;
+
+	v = sos_value_init(&v_, obj, group_attr);
+	if (!v)
+		return NULL;
+	rbn = rbt_find(groups, v);
+	if (rbn) {
+		sos_value_put(v);
+		return container_of(rbn, struct agg_group_s, rbn);
+	}
+	group = calloc(1, sizeof(*group));
+	if (!group)
+		goto out;
+	group->value = sos_value_copy(&group->value_, v);
+	if (!group->value) {
+		free(group);
+		group = NULL;
+		goto out;
+	}
+	__agg_init(&group->agg);
+	rbn_init(&group->rbn, group->value);
+	rbt_ins(groups, &group->rbn);
+ out:
+	sos_value_put(v);
+	return group;
+}
+
+/**
+ * \brief Aggregate an attribute over the objects matching a filter
+ *
+ * Computes the count, sum, minimum and maximum of the values of attr
+ * in the objects matching the filter. If attr is NULL, only the count
+ * is computed. The attribute must be a numeric or timestamp type;
+ * timestamps are aggregated as seconds since the Epoch.
+ *
+ * If group_attr is NULL, fn is called once with a NULL group value.
+ * Otherwise the objects are grouped by the value of group_attr and fn
+ * is called for each group in group value order. If fn returns !0,
+ * no further groups are reported and that value is returned.
+ *
+ * The filter is positioned past the last matching object on return.
+ *
+ * \param filt The filter handle
+ * \param attr The attribute to aggregate or NULL
+ * \param group_attr The attribute to group by or NULL
+ * \param fn The function called with the result for each group
+ * \param arg Passed to fn
+ * \retval 0 Success
+ * \retval EINVAL The attribute type cannot be aggregated
+ * \retval ENOMEM Insufficient resources
+ * \retval !0 The value returned by fn
+ */
+int sos_filter_aggregate(sos_filter_t filt, sos_attr_t attr, sos_attr_t group_attr,
+			 sos_agg_fn_t fn, void *arg)
+{
+	sos_obj_t objs[SOS_FILTER_BATCH];
+	double col[SOS_FILTER_BATCH];
+	agg_gather_fn_t gather = NULL;
+	struct agg_group_s *group;
+	struct sos_agg_s agg;
+	struct rbt groups;
+	struct rbn *rbn;
+	size_t offset = 0;
+	int i, n, rc = 0;
+
+	if (attr) {
+		if (sos_attr_type(attr) > SOS_TYPE_TIMESTAMP)
+			return EINVAL;
+		gather = gather_table[sos_attr_type(attr)];
+		offset = attr->data->offset;
+	}
+	__agg_init(&agg);
+	rbt_init(&groups, __group_cmp);
+	for (n = sos_filter_batch_begin(filt, objs, SOS_FILTER_BATCH); n > 0;
+	     n = sos_filter_batch_next(filt, objs, SOS_FILTER_BATCH)) {
+		if (gather)
+			gather(objs, n, offset, col);
+		if (!group_attr) {
+			if (gather)
+				__agg_col(&agg, col, n);
+			else
+				agg.count += n;
+		}
+		for (i = 0; i < n; i++) {
+			if (group_attr && !rc) {
+				group = __group_find(&groups, objs[i], group_attr);
+				if (!group)
+					rc = ENOMEM;
+				else if (gather)
+					__agg_one(&group->agg, col[i]);
+				else
+					group->agg.count += 1;
+			}
+			sos_obj_put(objs[i]);
+		}
+		if (rc)
+			break;
+	}
+	if (!group_attr)
+		return fn(NULL, &agg, arg);
+	while ((rbn = rbt_min(&groups))) {
+		rbt_del(&groups, rbn);
+		group = container_of(rbn, struct agg_group_s, rbn);
+		if (!rc)
+			rc = fn(group->value, &group->agg, arg);
+		sos_value_put(group->value);
+		free(group);
+	}
+	return rc;
+}
+
+struct resample_col_s {
+	sos_attr_t attr;
+	enum sos_resample_op_e op;
+	agg_gather_fn_t gather;
+	size_t offset;
+	double *vals;		/* Gathered values of the current batch */
+	double first;
+	double last;
+	double min;
+	double max;
+	double sum;
+	double prev;		/* Last value of the previous bucket */
+};
+
+struct sos_resample_s {
+	sos_filter_t filt;
+	size_t ts_offset;
+	uint64_t interval;	/* Bucket width in microseconds */
+	int started;
+	int done;
+	int pos;		/* Next unconsumed sample in the batch */
+	int count;		/* Samples in the batch */
+	uint64_t ts[SOS_FILTER_BATCH];
+	uint64_t bucket;	/* Start of the current bucket */
+	uint64_t samples;	/* Samples in the current bucket */
+	uint64_t first_t;
+	uint64_t last_t;
+	uint64_t prev_t;	/* Time of the last sample of the previous bucket */
+	int has_prev;
+	int col_count;
+	struct resample_col_s cols[0];
+};
+
+static int __resample_ordered(sos_filter_t filt, sos_attr_t ts_attr)
+{
+	sos_attr_t attr = sos_iter_attr(filt->iter);
+	sos_array_t attr_ids;
+
+	if (attr == ts_attr)
+		return 1;
+	if (sos_attr_type(attr) != SOS_TYPE_JOIN)
+		return 0;
+	attr_ids = sos_attr_join_list(attr);
+	return (attr_ids->count > 0
+		&& attr_ids->data.uint32_[0] == sos_attr_id(ts_attr));
+}
+
+/**
+ * \brief Create a downsampling iterator
+ *
+ * The filter must iterate over ts_attr, or over a join index whose
+ * first component is ts_attr, so that the objects are visited in time
+ * order. Each bucket is interval microseconds wide and aligned on a
+ * multiple of interval since the Epoch.
+ *
+ * The columns are aggregated as follows:
+ * - SOS_RESAMPLE_FIRST The value of the first object in the bucket
+ * - SOS_RESAMPLE_LAST The value of the last object in the bucket
+ * - SOS_RESAMPLE_MIN The minimum value in the bucket
+ * - SOS_RESAMPLE_MAX The maximum value in the bucket
+ * - SOS_RESAMPLE_MEAN The average value in the bucket
+ * - SOS_RESAMPLE_RATE The change per second from the last value of the
+ *   previous bucket, or from the first value in the bucket if this is
+ *   the first bucket, to the last value in the bucket
+ *
+ * The iterator does not take a reference on the filter. The filter
+ * must not be freed or repositioned while the iterator is in use.
+ *
+ * \param filt The filter handle
+ * \param ts_attr The SOS_TYPE_TIMESTAMP attribute that orders the filter
+ * \param interval The bucket width in microseconds
+ * \param cols Array of column specifications
+ * \param col_count The number of entries in cols
+ * \retval !NULL The iterator handle
+ * \retval NULL errno is set to EINVAL if the filter is not ordered by
+ * ts_attr, interval is 0, or a column type cannot be aggregated, or
+ * ENOMEM if there are insufficient resources
+ */
+sos_resample_t sos_resample_new(sos_filter_t filt, sos_attr_t ts_attr,
+				uint64_t interval, sos_resample_col_t cols,
+				int col_count)
+{
+	sos_resample_t rs;
+	int i;
+
+	if (!interval || col_count < 0
+	    || sos_attr_type(ts_attr) != SOS_TYPE_TIMESTAMP
+	    || !__resample_ordered(filt, ts_attr))
+		goto einval;
+	for (i = 0; i < col_count; i++) {
+		if (sos_attr_type(cols[i].attr) > SOS_TYPE_TIMESTAMP
+		    || cols[i].op > SOS_RESAMPLE_RATE)
+			goto einval;
+	}
+	rs = calloc(1, sizeof(*rs) + col_count * sizeof(rs->cols[0]));
+	if (!rs)
+		return NULL;
+	rs->filt = filt;
+	rs->ts_offset = ts_attr->data->offset;
+	rs->interval = interval;
+	rs->col_count = col_count;
+	for (i = 0; i < col_count; i++) {
+		rs->cols[i].attr = cols[i].attr;
+		rs->cols[i].op = cols[i].op;
+		rs->cols[i].gather = gather_table[sos_attr_type(cols[i].attr)];
+		rs->cols[i].offset = cols[i].attr->data->offset;
+		rs->cols[i].vals = calloc(SOS_FILTER_BATCH, sizeof(double));
+		if (!rs->cols[i].vals)
+			goto enomem;
+	}
+	return rs;
+ enomem:
+	sos_resample_free(rs);
+	errno = ENOMEM;
+	return NULL;
+ einval:
+	errno = EINVAL;
+	return NULL;
+}
+
+/**
+ * \brief Free a downsampling iterator
+ *
+ * \param rs The iterator handle
+ */
+void sos_resample_free(sos_resample_t rs)
+{
+	int i;
+	for (i = 0; i < rs->col_count; i++)
+		free(rs->cols[i].vals);
+	free(rs);
+}
+
+static int __resample_fill(sos_resample_t rs)
+{
+	sos_obj_t objs[SOS_FILTER_BATCH];
+	union sos_timestamp_u t;
+	int i, c, n;
+
+	if (rs->started) {
+		n = sos_filter_batch_next(rs->filt, objs, SOS_FILTER_BATCH);
+	} else {
+		n = sos_filter_batch_begin(rs->filt, objs, SOS_FILTER_BATCH);
+		rs->started = 1;
+	}
+	if (n <= 0) {
+		rs->done = 1;
+		return 0;
+	}
+	for (c = 0; c < rs->col_count; c++)
+		rs->cols[c].gather(objs, n, rs->cols[c].offset, rs->cols[c].vals);
+	for (i = 0; i < n; i++) {
+		memcpy(&t, &objs[i]->obj->as.bytes[rs->ts_offset], sizeof(t));
+		rs->ts[i] = (uint64_t)t.fine.secs * 1000000 + t.fine.usecs;
+		sos_obj_put(objs[i]);
+	}
+	rs->pos = 0;
+	rs->count = n;
+	return n;
+}
+
+static void __resample_add(sos_resample_t rs, uint64_t t)
+{
+	struct resample_col_s *col;
+	double v;
+	int c;
+
+	for (c = 0; c < rs->col_count; c++) {
+		col = &rs->cols[c];
+		v = col->vals[rs->pos];
+		if (!rs->samples) {
+			col->first = col->min = col->max = v;
+			col->sum = 0.0;
+		} else if (v < col->min) {
+			col->min = v;
+		} else if (v > col->max) {
+			col->max = v;
+		}
+		col->last = v;
+		col->sum += v;
+	}
+	if (!rs->samples) {
+		rs->bucket = t - (t % rs->interval);
+		rs->first_t = t;
+	}
+	rs->last_t = t;
+	rs->samples += 1;
+	rs->pos += 1;
+}
+
+static void __resample_emit(sos_resample_t rs, size_t row,
+			    uint64_t *times, double **data)
+{
+	struct resample_col_s *col;
+	uint64_t base_t;
+	double base, dt, v;
+	int c;
+
+	if (times)
+		times[row] = rs->bucket;
+	base_t = (rs->has_prev ? rs->prev_t : rs->first_t);
+	dt = (double)(rs->last_t - base_t) / 1.0e6;
+	for (c = 0; c < rs->col_count; c++) {
+		col = &rs->cols[c];
+		switch (col->op) {
+		case SOS_RESAMPLE_FIRST:
+			v = col->first;
+			break;
+		case SOS_RESAMPLE_LAST:
+			v = col->last;
+			break;
+		case SOS_RESAMPLE_MIN:
+			v = col->min;
+			break;
+		case SOS_RESAMPLE_MAX:
+			v = col->max;
+			break;
+		case SOS_RESAMPLE_MEAN:
+			v = col->sum / (double)rs->samples;
+			break;
+		case SOS_RESAMPLE_RATE:
+		default:
+			base = (rs->has_prev ? col->prev : col->first);
+			v = (dt > 0.0 ? (col->last - base) / dt : 0.0);
+			break;
+		}
+		data[c][row] = v;
+		col->prev = col->last;
+	}
+	rs->prev_t = rs->last_t;
+	rs->has_prev = 1;
+	rs->samples = 0;
+}
+
+/**
+ * \brief Return the next downsampled rows
+ *
+ * Fills up to count rows. The start time of each row's bucket in
+ * microseconds since the Epoch is written to times[row] if times is not
+ * NULL, and the value of column i is written to data[i][row]. Rows are
+ * only produced for buckets that contain at least one object.
+ *
+ * The first call starts at the first object matching the filter; each
+ * subsequent call continues with the row following the last row
+ * returned.
+ *
+ * \param rs The iterator handle
+ * \param times Array of at least count bucket times or NULL
+ * \param data Array of col_count arrays of at least count values
+ * \param count The maximum number of rows to return
+ * \returns The number of rows written, 0 if there are no more rows
+ */
+size_t sos_resample_next(sos_resample_t rs, uint64_t *times, double **data,
+			 size_t count)
+{
+	size_t rows = 0;
+	uint64_t t;
+
+	while (rows < count) {
+		if (rs->pos == rs->count) {
+			if (rs->done || !__resample_fill(rs))
+				break;
+		}
+		t = rs->ts[rs->pos];
+		if (rs->samples && t - (t % rs->interval) != rs->bucket) {
+			__resample_emit(rs, rows++, times, data);
+			continue;
+		}
+		__resample_add(rs, t);
+	}
+	if (rs->done && rs->samples && rows < count)
+		__resample_emit(rs, rows++, times, data);
+	return rows;
+}
+
+struct topk_ent_s {
+	sos_obj_t obj;
+	struct sos_value_s v_;
+	sos_value_t v;
+};
+
+struct topk_s {
+	struct topk_ent_s **heap;
+	int count;
+	int desc;
+};
+
+/* < 0 if a is ordered before b in the result */
+static inline int __topk_cmp(struct topk_s *tk, struct topk_ent_s *a,
+			     struct topk_ent_s *b)
+{
+	int rc = sos_value_cmp(a->v, b->v);
+	return (tk->desc ? -rc : rc);
+}
+
+/* The heap root is the entry ordered last, i.e. the first to be dropped */
+static void __topk_sift_down(struct topk_s *tk, int i, int count)
+{
+	struct topk_ent_s *ent = tk->heap[i];
+	int c;
+
+	for (c = 2 * i + 1; c < count; i = c, c = 2 * i + 1) {
+		if (c + 1 < count && __topk_cmp(tk, tk->heap[c + 1], tk->heap[c]) > 0)
+			c += 1;
+		if (__topk_cmp(tk, tk->heap[c], ent) <= 0)
+			break;
+		tk->heap[i] = tk->heap[c];
+	}
+	tk->heap[i] = ent;
+}
+
+static void __topk_sift_up(struct topk_s *tk, int i)
+{
+	struct topk_ent_s *ent = tk->heap[i];
+	int p;
+
+	for (; i > 0; i = p) {
+		p = (i - 1) / 2;
+		if (__topk_cmp(tk, tk->heap[p], ent) >= 0)
+			break;
+		tk->heap[i] = tk->heap[p];
+	}
+	tk->heap[i] = ent;
+}
+
+static int __topk_index_order(sos_filter_t filt, sos_attr_t attr)
+{
+	sos_attr_t iter_attr = sos_iter_attr(filt->iter);
+	sos_array_t attr_ids;
+
+	if (iter_attr == attr)
+		return 1;
+	if (sos_attr_type(iter_attr) != SOS_TYPE_JOIN)
+		return 0;
+	attr_ids = sos_attr_join_list(iter_attr);
+	return (attr_ids->count > 0
+		&& attr_ids->data.uint32_[0] == sos_attr_id(attr));
+}
+
+/**
+ * \brief Return the k matching objects with the smallest or largest values
+ *
+ * The objects matching the filter with the k smallest values of attr,
+ * or the k largest if desc is !0, are returned in objs in that order.
+ * Each object returned must be released with sos_obj_put().
+ *
+ * If attr is NULL or the filter iterates over attr, or over a join
+ * index whose first component is attr, the first (or last) k matches
+ * in index order are returned and the scan stops there. Otherwise
+ * every match is visited and the best k are kept in a heap. Any limit
+ * set with sos_filter_limit_set() is ignored.
+ *
+ * \param filt The filter handle
+ * \param attr The attribute to order by or NULL for the index order
+ * \param desc !0 to return the largest values first
+ * \param objs An array of at least k object handles
+ * \param k The number of objects to return
+ * \returns The number of objects returned in objs, or -1 if there are
+ * insufficient resources
+ */
+int sos_filter_top_k(sos_filter_t filt, sos_attr_t attr, int desc,
+		     sos_obj_t *objs, int k)
+{
+	sos_obj_t batch[SOS_FILTER_BATCH];
+	struct topk_ent_s *ents, *ent, *spare;
+	struct topk_s tk;
+	size_t limit;
+	sos_obj_t obj;
+	int i, n, count;
+
+	if (k <= 0)
+		return 0;
+	limit = filt->limit;
+	filt->limit = 0;
+	if (!attr || __topk_index_order(filt, attr)) {
+		count = 0;
+		if (desc)
+			obj = sos_filter_end(filt);
+		else
+			obj = sos_filter_begin(filt);
+		while (obj) {
+			objs[count++] = obj;
+			if (count == k)
+				break;
+			if (desc)
+				obj = sos_filter_prev(filt);
+			else
+				obj = sos_filter_next(filt);
+		}
+		filt->limit = limit;
+		return count;
+	}
+
+	count = -1;
+	ents = calloc(k + 1, sizeof(*ents));
+	tk.heap = calloc(k, sizeof(*tk.heap));
+	if (!ents || !tk.heap)
+		goto out;
+	tk.count = 0;
+	tk.desc = desc;
+	spare = &ents[k];
+	for (n = sos_filter_batch_begin(filt, batch, SOS_FILTER_BATCH); n > 0;
+	     n = sos_filter_batch_next(filt, batch, SOS_FILTER_BATCH)) {
+		for (i = 0; i < n; i++) {
+			ent = (tk.count < k ? &ents[tk.count] : spare);
+			ent->v = sos_value_init(&ent->v_, batch[i], attr);
+			if (!ent->v) {
+				sos_obj_put(batch[i]);
+				continue;
+			}
+			ent->obj = batch[i];
+			if (tk.count < k) {
+				tk.heap[tk.count] = ent;
+				__topk_sift_up(&tk, tk.count++);
+				continue;
+			}
+			if (__topk_cmp(&tk, ent, tk.heap[0]) >= 0) {
+				sos_value_put(ent->v);
+				sos_obj_put(ent->obj);
+				continue;
+			}
+			/* Replace the root, its entry becomes the spare */
+			spare = tk.heap[0];
+			sos_value_put(spare->v);
+			sos_obj_put(spare->obj);
+			tk.heap[0] = ent;
+			__topk_sift_down(&tk, 0, tk.count);
+		}
+	}
+	/* Pop the root into the last free position to sort the result */
+	count = tk.count;
+	for (n = tk.count; n > 0; n--) {
+		ent = tk.heap[0];
+		objs[n - 1] = ent->obj;
+		sos_value_put(ent->v);
+		tk.heap[0] = tk.heap[n - 1];
+		__topk_sift_down(&tk, 0, n - 1);
+	}
+ out:
+	free(tk.heap);
+	free(ents);
+	filt->limit = limit;
+	return count;
+}
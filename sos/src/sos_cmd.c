@@ -65,8 +65,15 @@
 
 int add_filter(sos_schema_t schema, sos_filter_t filt, const char *str);
 char *strcasestr(const char *haystack, const char *needle);
+struct col_s;
+static size_t col_strlen(struct col_s *col, sos_attr_t attr, sos_obj_t obj, sos_key_t key);
+static const char *col_to_str(struct col_s *col, sos_attr_t attr, sos_obj_t obj,
+			      sos_key_t key, char *str, size_t len);
 
-const char *short_options = "f:I:M:m:C:K:O:S:X:V:F:T:tidcqlLRv";
+/* The covering join attribute if the columns are taken from the index keys */
+static sos_attr_t key_attr;
+
+const char *short_options = "f:I:M:m:C:K:O:S:X:V:F:T:N:B:P:tidcqlLRv";
 
 struct option long_options[] = {
 	{"format",      required_argument,  0,  'f'},
@@ -86,6 +93,9 @@ struct option long_options[] = {
 	{"csv",		required_argument,  0,  'I'},
 	{"map",         required_argument,  0,  'M'},
 	{"filter",	required_argument,  0,  'F'},
+	{"limit",	required_argument,  0,  'N'},
+	{"order_by",	required_argument,  0,  'B'},
+	{"parallel",	required_argument,  0,  'P'},
 	{"test",	no_argument,        0,  't'},
 	{"threads",	required_argument,  0,  'T'},
 	{"option",      optional_argument,  0,  'K'},
@@ -129,9 +139,16 @@ void usage(int argc, char *argv[])
 	printf("                   csv    - Comma separated file with a single header row defining columns\n");
 	printf("                   json   - JSON Objects.\n");
 	printf("       [-F <rule>] Add a filter rule to the index.\n");
+	printf("                   Use '<col>:in:<value>|<value>|...' to match any of the values.\n");
 	printf("       [-V <col>]  Add an object attribute (i.e. column) to the output.\n");
 	printf("                   If not specified, all attributes in the object are output.\n");
 	printf("                   Use '<col>[width]' to specify the desired column width\n");
+	printf("       [-N <count>] Output at most <count> objects.\n");
+	printf("       [-B <col>[:desc]] Output the -N objects with the smallest (or largest)\n");
+	printf("                   values of <col> in that order.\n");
+	printf("       [-P <threads>[:unordered]] Split the index into key ranges and scan\n");
+	printf("                   them on <threads> threads. The output is in index order\n");
+	printf("                   unless ':unordered' is given.\n");
 	exit(1);
 }
 
@@ -215,6 +232,7 @@ struct col_s {
 	const char *name;
 	int id;
 	int width;
+	int join_idx;	/* Position in the query's join key or -1 */
 	TAILQ_ENTRY(col_s) entry;
 };
 TAILQ_HEAD(col_list_s, col_s) col_list = TAILQ_HEAD_INITIALIZER(col_list);
@@ -344,7 +362,29 @@ void json_header(FILE *outp)
 	fprintf(outp, "{ \"data\" : [\n");
 }
 
-void table_row(FILE *outp, sos_schema_t schema, sos_obj_t obj)
+/*
+ * If the query is covered by a join index, obj is NULL and the
+ * column values are taken from the join key.
+ */
+static size_t col_strlen(struct col_s *col, sos_attr_t attr, sos_obj_t obj, sos_key_t key)
+{
+	struct sos_value_s v_;
+	if (obj)
+		return sos_obj_attr_strlen(obj, attr);
+	return sos_value_strlen(sos_key_join_value(&v_, key_attr, key, col->join_idx));
+}
+
+static const char *col_to_str(struct col_s *col, sos_attr_t attr, sos_obj_t obj,
+			      sos_key_t key, char *str, size_t len)
+{
+	struct sos_value_s v_;
+	if (obj)
+		return sos_obj_attr_to_str(obj, attr, str, len);
+	return sos_value_to_str(sos_key_join_value(&v_, key_attr, key, col->join_idx),
+				str, len);
+}
+
+void table_row(FILE *outp, sos_schema_t schema, sos_obj_t obj, sos_key_t key)
 {
 	struct col_s *col;
 	size_t col_len;
@@ -360,7 +400,7 @@ void table_row(FILE *outp, sos_schema_t schema, sos_obj_t obj)
 			if (col->width > 0)
 				col_len = col->width;
 			else
-				col_len = sos_obj_attr_strlen(obj, attr);
+				col_len = col_strlen(col, attr, obj, key);
 			if (col_len < sizeof(str))
 				col_str = str;
 			else
@@ -368,10 +408,10 @@ void table_row(FILE *outp, sos_schema_t schema, sos_obj_t obj)
 		}
 		if (col->width > 0) {
 			fprintf(outp, "%*s ", col->width,
-				sos_obj_attr_to_str(obj, attr, col_str, col_len));
+				col_to_str(col, attr, obj, key, col_str, col_len));
 		} else {
 			fprintf(outp, "%s ",
-				sos_obj_attr_to_str(obj, attr, col_str, col_len));
+				col_to_str(col, attr, obj, key, col_str, col_len));
 		}
 		if (col_str != str)
 			free(col_str);
@@ -379,7 +419,7 @@ void table_row(FILE *outp, sos_schema_t schema, sos_obj_t obj)
 	fprintf(outp, "\n");
 }
 
-void csv_row(FILE *outp, sos_schema_t schema, sos_obj_t obj)
+void csv_row(FILE *outp, sos_schema_t schema, sos_obj_t obj, sos_key_t key)
 {
 	struct col_s *col;
 	int first = 1;
@@ -391,14 +431,14 @@ void csv_row(FILE *outp, sos_schema_t schema, sos_obj_t obj)
 		attr = sos_schema_attr_by_id(schema, col->id);
 		if (!first)
 			fprintf(outp, ",");
-		col_len = sos_obj_attr_strlen(obj, attr);
+		col_len = col_strlen(col, attr, obj, key);
 		if (col_len < sizeof(str)) {
 			col_str = str;
 			col_len = sizeof(str);
 		} else {
 			col_str = malloc(col_len);
 		}
-		fprintf(outp, "%s", sos_obj_attr_to_str(obj, attr, col_str, col_len));
+		fprintf(outp, "%s", col_to_str(col, attr, obj, key, col_str, col_len));
 		if (col_str != str)
 			free(col_str);
 		first = 0;
@@ -406,7 +446,7 @@ void csv_row(FILE *outp, sos_schema_t schema, sos_obj_t obj)
 	fprintf(outp, "\n");
 }
 
-void json_row(FILE *outp, sos_schema_t schema, sos_obj_t obj)
+void json_row(FILE *outp, sos_schema_t schema, sos_obj_t obj, sos_key_t key)
 {
 	struct col_s *col;
 	static int first_row = 1;
@@ -423,7 +463,7 @@ void json_row(FILE *outp, sos_schema_t schema, sos_obj_t obj)
 		attr = sos_schema_attr_by_id(schema, col->id);
 		if (!first)
 			fprintf(outp, ",");
-		col_len = sos_obj_attr_strlen(obj, attr);
+		col_len = col_strlen(col, attr, obj, key);
 		if (col_len < sizeof(str)) {
 			col_str = str;
 			col_len = sizeof(str);
@@ -432,10 +472,10 @@ void json_row(FILE *outp, sos_schema_t schema, sos_obj_t obj)
 		}
 		if (sos_attr_is_array(attr) && sos_attr_type(attr) != SOS_TYPE_CHAR_ARRAY) {
 			fprintf(outp, "\"%s\" : [%s]", col->name,
-				sos_obj_attr_to_str(obj, attr, col_str, col_len));
+				col_to_str(col, attr, obj, key, col_str, col_len));
 		} else {
 			fprintf(outp, "\"%s\" : \"%s\"", col->name,
-				sos_obj_attr_to_str(obj, attr, col_str, col_len));
+				col_to_str(col, attr, obj, key, col_str, col_len));
 		}
 		if (col_str != str)
 			free(col_str);
@@ -470,13 +510,32 @@ void json_footer(FILE *outp, int rec_count, int iter_count)
 		"totalRecords", rec_count, "recordCount", iter_count);
 }
 
+#define QUERY_BATCH 256
+size_t query_limit;
+char *order_by;
+char *query_parallel;
+
+struct query_out_s {
+	void (*printer)(FILE *outp, sos_schema_t schema, sos_obj_t obj, sos_key_t key);
+	sos_schema_t schema;
+	int count;
+};
+
+static int query_out(sos_obj_t obj, void *arg)
+{
+	struct query_out_s *out = arg;
+	out->printer(stdout, out->schema, obj, NULL);
+	out->count += 1;
+	return 0;
+}
+
 int query(sos_t sos, const char *schema_name, const char *index_name)
 {
 	sos_schema_t schema;
 	sos_attr_t attr;
 	sos_iter_t iter;
 	size_t attr_count, attr_id;
-	int rc;
+	int rc, i;
 	struct col_s *col;
 	sos_filter_t filt;
 
@@ -526,6 +585,68 @@ int query(sos_t sos, const char *schema_name, const char *index_name)
 			return rc;
 	}
 
+	/* Resolve the -B attribute and direction */
+	sos_attr_t order_attr = NULL;
+	int order_desc = 0;
+	if (order_by) {
+		char *dir = strchr(order_by, ':');
+		if (dir) {
+			*dir++ = '\0';
+			order_desc = (0 == strcasecmp(dir, "desc"));
+		}
+		order_attr = sos_schema_attr_by_name(schema, order_by);
+		if (!order_attr) {
+			printf("The attribute '%s' does not exist in '%s'.\n",
+			       order_by, schema_name);
+			return ENOENT;
+		}
+		if (!query_limit) {
+			printf("The -B option requires a -N limit.\n");
+			return EINVAL;
+		}
+	}
+	sos_filter_limit_set(filt, query_limit);
+
+	/* Resolve the -P thread count and ordering */
+	int par_threads = 0;
+	int par_flags = 0;
+	if (query_parallel) {
+		char *mode = strchr(query_parallel, ':');
+		if (mode) {
+			*mode++ = '\0';
+			if (0 == strcasecmp(mode, "unordered"))
+				par_flags = SOS_FILTER_PARALLEL_UNORDERED;
+		}
+		par_threads = atoi(query_parallel);
+		if (par_threads < 1) {
+			printf("The -P thread count must be at least 1.\n");
+			return EINVAL;
+		}
+		if (order_attr) {
+			printf("The -P option cannot be used with -B.\n");
+			return EINVAL;
+		}
+	}
+
+	/* Use only the index keys if the join index covers the query */
+	key_attr = NULL;
+	if (!order_attr && !par_threads && sos_attr_type(sos_iter_attr(iter)) == SOS_TYPE_JOIN
+	    && sos_filter_is_covered(filt)) {
+		sos_array_t join_ids = sos_attr_join_list(sos_iter_attr(iter));
+		key_attr = sos_iter_attr(iter);
+		TAILQ_FOREACH(col, &col_list, entry) {
+			attr = sos_schema_attr_by_id(schema, col->id);
+			col->join_idx = -1;
+			for (i = 0; i < join_ids->count; i++) {
+				if (join_ids->data.uint32_[i] == col->id)
+					col->join_idx = i;
+			}
+			if (col->join_idx < 0 || sos_attr_is_array(attr)
+			    || sos_attr_type(attr) == SOS_TYPE_STRUCT)
+				key_attr = NULL;
+		}
+	}
+
 	switch (format) {
 	case JSON_FMT:
 		json_header(stdout);
@@ -540,8 +661,9 @@ int query(sos_t sos, const char *schema_name, const char *index_name)
 
 	int rec_count;
 	int iter_count;
-	sos_obj_t obj;
-	void (*printer)(FILE *outp, sos_schema_t schema, sos_obj_t obj);
+	sos_obj_t objs[QUERY_BATCH];
+	int count;
+	void (*printer)(FILE *outp, sos_schema_t schema, sos_obj_t obj, sos_key_t key);
 	switch (format) {
 	case JSON_FMT:
 		printer = json_row;
@@ -554,12 +676,51 @@ int query(sos_t sos, const char *schema_name, const char *index_name)
 		break;
 	}
 
-	for (rec_count = 0, iter_count = 0, obj = sos_filter_begin(filt);
-	     obj; obj = sos_filter_next(filt), iter_count++) {
-		printer(stdout, schema, obj);
-		rec_count++;
-		sos_obj_put(obj);
+	rec_count = iter_count = 0;
+	if (order_attr) {
+		sos_obj_t *top = calloc(query_limit, sizeof(*top));
+		if (!top)
+			return ENOMEM;
+		count = sos_filter_top_k(filt, order_attr, order_desc, top, query_limit);
+		for (i = 0; i < count; i++) {
+			printer(stdout, schema, top[i], NULL);
+			sos_obj_put(top[i]);
+		}
+		free(top);
+		if (count < 0)
+			return ENOMEM;
+		rec_count = iter_count = count;
+		goto footer;
+	}
+	if (par_threads) {
+		struct query_out_s out = { printer, schema, 0 };
+		rc = sos_filter_parallel(filt, par_threads, par_flags, query_out, &out);
+		if (rc)
+			return rc;
+		rec_count = iter_count = out.count;
+		goto footer;
+	}
+	if (key_attr) {
+		/* Every column and condition is in the join key */
+		sos_key_t key;
+		for (key = sos_filter_key_begin(filt); key; key = sos_filter_key_next(filt)) {
+			printer(stdout, schema, NULL, key);
+			sos_key_put(key);
+			rec_count += 1;
+			iter_count += 1;
+		}
+		goto footer;
 	}
+	for (count = sos_filter_batch_begin(filt, objs, QUERY_BATCH); count;
+	     count = sos_filter_batch_next(filt, objs, QUERY_BATCH)) {
+		for (i = 0; i < count; i++) {
+			printer(stdout, schema, objs[i], NULL);
+			sos_obj_put(objs[i]);
+		}
+		rec_count += count;
+		iter_count += count;
+	}
+ footer:
 	switch (format) {
 	case JSON_FMT:
 		json_footer(stdout, rec_count, iter_count);
@@ -862,7 +1023,8 @@ int add_filter(sos_schema_t schema, sos_filter_t filt, const char *str)
 	sos_value_t cond_value;
 	char attr_name[64];
 	char cond_str[16];
-	char value_str[64];
+	char value_str[1024];
+	char *in_str, *in_value;
 	int rc;
 
 	/*
@@ -875,7 +1037,7 @@ int add_filter(sos_schema_t schema, sos_filter_t filt, const char *str)
 		return rc;
 	}
 
-	rc = sscanf(str, "%64[^:]:%16[^:]:%64[^\t\n]", attr_name, cond_str, value_str);
+	rc = sscanf(str, "%63[^:]:%15[^:]:%1023[^\t\n]", attr_name, cond_str, value_str);
 	if (rc != 3) {
 		printf("Error %d parsing the filter clause '%s'.\n", rc, str);
 		return EINVAL;
@@ -884,13 +1046,16 @@ int add_filter(sos_schema_t schema, sos_filter_t filt, const char *str)
 	/*
 	 * Get the condition
 	 */
-	cond_key = bsearch(cond_str,
-			   cond_keys, sizeof(cond_keys)/sizeof(cond_keys[0]),
-			   sizeof(*cond_key),
-			   compare_key);
-	if (!cond_key) {
-		printf("Invalid comparason, '%s', specified.\n", cond_str);
-		return EINVAL;
+	cond_key = NULL;
+	if (strcmp(cond_str, "in")) {
+		cond_key = bsearch(cond_str,
+				   cond_keys, sizeof(cond_keys)/sizeof(cond_keys[0]),
+				   sizeof(*cond_key),
+				   compare_key);
+		if (!cond_key) {
+			printf("Invalid comparason, '%s', specified.\n", cond_str);
+			return EINVAL;
+		}
 	}
 
 	/*
@@ -902,6 +1067,28 @@ int add_filter(sos_schema_t schema, sos_filter_t filt, const char *str)
 		return EINVAL;
 	}
 
+	if (!cond_key) {
+		/* The values of an 'in' list are separated by '|' */
+		for (in_value = strtok_r(value_str, "|", &in_str); in_value;
+		     in_value = strtok_r(NULL, "|", &in_str)) {
+			cond_value = sos_value_init(sos_value_new(), NULL, attr);
+			rc = value_from_str(attr, cond_value, in_value, NULL);
+			if (rc) {
+				printf("The value '%s' specified for the attribute '%s' is invalid.\n",
+				       in_value, attr_name);
+				return EINVAL;
+			}
+			rc = sos_filter_in_add(filt, attr, &cond_value, 1);
+			sos_value_put(cond_value);
+			sos_value_free(cond_value);
+			if (rc) {
+				printf("The value could not be added, error %d.\n", rc);
+				return EINVAL;
+			}
+		}
+		return 0;
+	}
+
 	/*
 	 * Create a value and set it
 	 */
@@ -1004,6 +1191,15 @@ int main(int argc, char **argv)
 			if (add_clause(optarg))
 				exit(11);
 			break;
+		case 'N':
+			query_limit = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			order_by = strdup(optarg);
+			break;
+		case 'P':
+			query_parallel = strdup(optarg);
+			break;
 		case 'I':
 			action |= CSV;
 			csv_file = fopen(optarg, "r");
@@ -60,11 +60,24 @@
 #include "sos_priv.h"
 
 int handle_pos_keep_time(sos_t sos, sos_config_t config);
-
+int handle_part_roll_time(sos_t sos, sos_config_t config);
+int handle_part_roll_size(sos_t sos, sos_config_t config);
+int handle_part_roll_extend(sos_t sos, sos_config_t config);
+int handle_part_roll_standby(sos_t sos, sos_config_t config);
+int handle_part_open_max(sos_t sos, sos_config_t config);
+int handle_part_retention(sos_t sos, sos_config_t config);
+
+/* Sorted by name, see option_handler() */
 static struct config_opt {
 	const char *opt_name;
 	int (*opt_handler)(sos_t sos, sos_config_t config);
 } config_opts[] = {
+	{ SOS_PART_OPEN_MAX, handle_part_open_max },
+	{ SOS_PART_RETENTION, handle_part_retention },
+	{ SOS_PART_ROLL_EXTEND, handle_part_roll_extend },
+	{ SOS_PART_ROLL_SIZE, handle_part_roll_size },
+	{ SOS_PART_ROLL_STANDBY, handle_part_roll_standby },
+	{ SOS_PART_ROLL_TIME, handle_part_roll_time },
 	{ SOS_POS_KEEP_TIME, handle_pos_keep_time },
 };
 
@@ -119,6 +132,38 @@ static void normalize_option_name(char *name)
  *    Determines how long iterator positions are kept before being
  *    destroyed. The time is specified in seconds.
  *
+ * SOS_PART_ROLL_TIME
+ *    Make a new partition PRIMARY when the current PRIMARY partition
+ *    has been taking new objects for this long. The value is in
+ *    seconds or has an 'm', 'h' or 'd' suffix, e.g. "6h".
+ *
+ * SOS_PART_ROLL_SIZE
+ *    Make a new partition PRIMARY when the object store of the
+ *    current PRIMARY partition reaches this size. The value is in
+ *    bytes or has a 'k', 'm' or 'g' suffix, e.g. "64g".
+ *
+ * SOS_PART_ROLL_EXTEND
+ *    The number of bytes the standby partition's object store is
+ *    extended by when it is created. The default is 16m.
+ *
+ * SOS_PART_ROLL_STANDBY
+ *    Maintained by SOS. The name of the standby partition that is
+ *    made PRIMARY at the next roll.
+ *
+ * SOS_PART_OPEN_MAX
+ *    The maximum number of partition object stores that are kept
+ *    open. Partitions are opened when their objects are first
+ *    accessed; above this limit the least recently used partitions
+ *    with no objects in use are closed. The default, 0, is no limit.
+ *
+ * SOS_PART_RETENTION
+ *    Delete ACTIVE partitions whose object store has not been
+ *    modified for this long, e.g. "90d". The PRIMARY and standby
+ *    partitions are never deleted. The value is in seconds or has an
+ *    'm', 'h' or 'd' suffix. The default, 0, keeps all partitions.
+ *
+ * The PART options are read when the container is opened.
+ *
  * Sets the value of a SOS container option. Options include:
  */
 int sos_container_config_set(const char *path, const char *opt_name, const char *opt_value)
@@ -332,6 +377,56 @@ int handle_pos_keep_time(sos_t sos, sos_config_t config)
 	return 0;
 }
 
+int handle_part_roll_time(sos_t sos, sos_config_t config)
+{
+	long roll_time = convert_time_units(config->value);
+	if (!roll_time)
+		roll_time = strtol(config->value, NULL, 0);
+	sos->config.part_roll_time = roll_time > 0 ? roll_time : 0;
+	return 0;
+}
+
+int handle_part_roll_size(sos_t sos, sos_config_t config)
+{
+	long roll_size = convert_size_units(config->value);
+	if (!roll_size)
+		roll_size = strtol(config->value, NULL, 0);
+	sos->config.part_roll_size = roll_size > 0 ? roll_size : 0;
+	return 0;
+}
+
+int handle_part_roll_extend(sos_t sos, sos_config_t config)
+{
+	long extend = convert_size_units(config->value);
+	if (!extend)
+		extend = strtol(config->value, NULL, 0);
+	sos->config.part_roll_extend = extend > 0 ? extend : 0;
+	return 0;
+}
+
+int handle_part_roll_standby(sos_t sos, sos_config_t config)
+{
+	strncpy(sos->config.part_roll_standby, config->value,
+		sizeof(sos->config.part_roll_standby) - 1);
+	return 0;
+}
+
+int handle_part_open_max(sos_t sos, sos_config_t config)
+{
+	int open_max = atoi(config->value);
+	sos->config.part_open_max = open_max > 0 ? open_max : 0;
+	return 0;
+}
+
+int handle_part_retention(sos_t sos, sos_config_t config)
+{
+	long retention = convert_time_units(config->value);
+	if (!retention)
+		retention = strtol(config->value, NULL, 0);
+	sos->config.part_retention = retention > 0 ? retention : 0;
+	return 0;
+}
+
 sos_config_iter_t sos_config_iter_new(const char *path)
 {
 	char tmp_path[PATH_MAX];
@@ -115,6 +115,8 @@ static sos_index_t __sos_index_alloc(sos_t sos, const char *name)
 		return NULL;
 	index->sos = sos;
 	strcpy(index->name, name);
+	pthread_mutex_init(&index->plan_lock, NULL);
+	pthread_mutex_init(&index->parts_lock, NULL);
 
 	return index;
 }
@@ -205,56 +207,41 @@ int sos_index_new(sos_t sos, const char *name,
 	return rc;
 }
 
-/**
- * \brief Open an existing Index
- *
- * \param sos The container handle
- * \param name The unique index name
- * \retval 0 Success
- * \retval !0 A Unix error code
+/*
+ * Open the index file for the index \c name in the directory \c dir,
+ * creating it from the index definition if it does not exist.
  */
-sos_index_t sos_index_open(sos_t sos, const char *name)
+ods_idx_t __sos_index_idx_open(sos_t sos, const char *name, const char *dir)
 {
-	size_t name_len;
 	char tmp_path[PATH_MAX];
 	sos_obj_ref_t idx_ref;
 	ods_obj_t idx_obj = NULL;
+	ods_idx_t idx;
 	SOS_KEY(idx_key);
-	sos_index_t index;
 	int rc;
 
-	name_len = strlen(name);
-	if (name_len >= SOS_INDEX_NAME_LEN) {
-		errno = EINVAL;
-		goto err_0;
-	}
-
-	index = __sos_index_alloc(sos, name);
-	if (!index)
-		goto err_1;
-
 	ods_key_set(idx_key, name, strlen(name)+1);
 	ods_lock(sos->idx_ods, 0, NULL);
 	rc = ods_idx_find(sos->idx_idx, idx_key, &idx_ref.idx_data);
 	if (rc) {
 		errno = rc;
-		goto err_2;
+		goto err_0;
 	}
 
-	sprintf(tmp_path, "%s/%s_idx", sos->path, name);
+	sprintf(tmp_path, "%s/%s_idx", dir, name);
  retry:
-	index->idx = ods_idx_open(tmp_path, sos->o_perm);
-	if (!index->idx) {
+	idx = ods_idx_open(tmp_path, sos->o_perm);
+	if (!idx) {
 		if (idx_obj)
 			/* Already failed once, err out */
-			goto err_3;
+			goto err_1;
 		/* Attempt to create if it does not exist. */
 		if (errno != ENOENT)
-			goto err_2;
+			goto err_0;
 		idx_obj = ods_ref_as_obj(sos->idx_ods, idx_ref.ref.obj);
 		if (!idx_obj) {
 			errno = EINVAL;
-			goto err_2;
+			goto err_0;
 		}
 		rc = ods_idx_create(tmp_path,
 				    SOS_IDX(idx_obj)->mode,
@@ -264,21 +251,98 @@ sos_index_t sos_index_open(sos_t sos, const char *name)
 		if (!rc)
 			goto retry;
 		errno = rc;
-		goto err_3;
+		goto err_1;
 	}
 	ods_obj_put(idx_obj);
 	ods_unlock(sos->idx_ods, 0);
-	return index;
- err_3:
+	return idx;
+ err_1:
 	ods_obj_put(idx_obj);
- err_2:
+ err_0:
 	ods_unlock(sos->idx_ods, 0);
+	return NULL;
+}
+
+/**
+ * \brief Open an existing Index
+ *
+ * \param sos The container handle
+ * \param name The unique index name
+ * \retval 0 Success
+ * \retval !0 A Unix error code
+ */
+sos_index_t sos_index_open(sos_t sos, const char *name)
+{
+	size_t name_len;
+	sos_index_t index;
+
+	name_len = strlen(name);
+	if (name_len >= SOS_INDEX_NAME_LEN) {
+		errno = EINVAL;
+		goto err_0;
+	}
+
+	index = __sos_index_alloc(sos, name);
+	if (!index)
+		goto err_0;
+
+	index->idx = __sos_index_idx_open(sos, name, sos->path);
+	if (!index->idx)
+		goto err_1;
+	return index;
  err_1:
+	pthread_mutex_destroy(&index->plan_lock);
 	free(index);
  err_0:
 	return NULL;
 }
 
+/*
+ * Return the local indices of the ACTIVE and PRIMARY partitions. The
+ * list is rebuilt only when the partition generation changes. The
+ * caller must drop the reference with __sos_index_parts_put().
+ */
+static struct sos_index_parts_s *__sos_index_parts_get(sos_index_t index)
+{
+	struct sos_index_parts_s *parts;
+	int rc;
+
+	pthread_mutex_lock(&index->parts_lock);
+	parts = index->parts;
+	if (!parts
+	    || parts->part_gn != SOS_PART_UDATA(index->sos->part_udata)->gen) {
+		rc = __sos_part_idx_list(index, &parts);
+		if (rc) {
+			pthread_mutex_unlock(&index->parts_lock);
+			errno = rc;
+			return NULL;
+		}
+		__sos_index_parts_put(index->parts);
+		index->parts = parts;
+	}
+	ods_atomic_inc(&parts->ref_count);
+	pthread_mutex_unlock(&index->parts_lock);
+	return parts;
+}
+
+/*
+ * Return the index that contains the keys of the object. This is the
+ * local index of the object's partition if it was created with
+ * SOS_PART_F_LOCAL_INDEX, otherwise it is the container's index.
+ */
+static ods_idx_t __sos_index_obj_idx(sos_index_t index, sos_obj_t obj,
+				     sos_part_t *ppart)
+{
+	sos_part_t part = index->sos->primary_part;
+	if (!part || SOS_PART(part->part_obj)->part_id != obj->obj_ref.ref.ods)
+		part = __sos_part_by_id(index->sos, obj->obj_ref.ref.ods);
+	if (!part || !part->local_index) {
+		*ppart = NULL;
+		return index->idx;
+	}
+	*ppart = part;
+	return __sos_part_idx(part, index);
+}
 
 int sos_index_rt_opt_set(sos_index_t idx, sos_index_rt_opt_t opt, ...)
 {
@@ -297,7 +361,6 @@ static ods_visit_action_t visit_cb(ods_idx_t idx, ods_key_t key, ods_idx_data_t
 	int rc = (ods_visit_action_t)visit_arg->cb_fn(visit_arg->index,
 						      key, (sos_idx_data_t *)data,
 						      found, visit_arg->arg);
-	free(arg);
 	return rc;
 }
 /**
@@ -325,14 +388,49 @@ static ods_visit_action_t visit_cb(ods_idx_t idx, ods_key_t key, ods_idx_data_t
  *                   is false, this value is ignored and
  *                   sos_index_visit() will return EINVAL.
  * - SOS_VISIT_NOP - Do nothing
+ *
+ * If partitions have local indices, the key is visited in the index
+ * that contains it. A key that is not present is visited in the index
+ * that the primary partition inserts into.
  */
 int sos_index_visit(sos_index_t index, sos_key_t key, sos_visit_cb_fn_t cb_fn, void *arg)
 {
-	struct sos_visit_cb_ctxt_s *ctxt = malloc(sizeof(*ctxt));
-	ctxt->index = index;
-	ctxt->cb_fn = cb_fn;
-	ctxt->arg = arg;
-	return ods_idx_visit(index->idx, key, visit_cb, ctxt);
+	struct sos_visit_cb_ctxt_s ctxt;
+	struct sos_index_parts_s *parts;
+	sos_part_t part;
+	ods_idx_data_t data;
+	ods_idx_t idx = NULL;
+	int i, rc;
+
+	parts = __sos_index_parts_get(index);
+	if (!parts)
+		return errno;
+	for (i = 0; i < parts->count; i++) {
+		if (!ods_idx_find(parts->parts[i].idx, key, &data)) {
+			idx = parts->parts[i].idx;
+			break;
+		}
+	}
+	if (!idx && parts->count && ods_idx_find(index->idx, key, &data)) {
+		/* A new key goes where the primary partition inserts */
+		part = index->sos->primary_part;
+		if (part && part->local_index) {
+			idx = __sos_part_idx(part, index);
+			if (!idx) {
+				rc = errno;
+				goto out;
+			}
+		}
+	}
+	if (!idx)
+		idx = index->idx;
+	ctxt.index = index;
+	ctxt.cb_fn = cb_fn;
+	ctxt.arg = arg;
+	rc = ods_idx_visit(idx, key, visit_cb, &ctxt);
+ out:
+	__sos_index_parts_put(parts);
+	return rc;
 }
 
 /**
@@ -347,9 +445,17 @@ int sos_index_visit(sos_index_t index, sos_key_t key, sos_visit_cb_fn_t cb_fn, v
  */
 int sos_index_insert(sos_index_t index, sos_key_t key, sos_obj_t obj)
 {
-	if (ods_ref_valid(obj->obj->ods, obj->obj_ref.ref.obj))
-		return ods_idx_insert(index->idx, key, obj->obj_ref.idx_data);
-	return EINVAL;
+	sos_part_t part;
+	ods_idx_t idx;
+	if (!ods_ref_valid(obj->obj->ods, obj->obj_ref.ref.obj))
+		return EINVAL;
+	idx = __sos_index_obj_idx(index, obj, &part);
+	if (!idx)
+		return errno;
+	if (part)
+		/* Widen the zone map before the key becomes visible */
+		__sos_part_idx_zone_update(part, index, key);
+	return ods_idx_insert(idx, key, obj->obj_ref.idx_data);
 }
 
 /**
@@ -368,8 +474,143 @@ int sos_index_insert(sos_index_t index, sos_key_t key, sos_obj_t obj)
 int sos_index_remove(sos_index_t index, sos_key_t key, sos_obj_t obj)
 {
 	ods_idx_data_t data;
+	sos_part_t part;
+	ods_idx_t idx = __sos_index_obj_idx(index, obj, &part);
+	if (!idx)
+		return errno;
 	data = obj->obj_ref.idx_data;
-	return ods_idx_delete(index->idx, key, &data);
+	return ods_idx_delete(idx, key, &data);
+}
+
+enum local_find_e {
+	LOCAL_FIND,
+	LOCAL_SUP,
+	LOCAL_INF,
+	LOCAL_MIN,
+	LOCAL_MAX,
+};
+
+/*
+ * Position at the key in one index and return its key and data. The
+ * caller must put the returned key.
+ */
+static int __sos_index_idx_find(ods_idx_t idx, sos_key_t key,
+				enum local_find_e op, ods_key_t *pkey,
+				ods_idx_data_t *data)
+{
+	ods_iter_t iter;
+	int rc;
+
+	switch (op) {
+	case LOCAL_MIN:
+		return ods_idx_min(idx, pkey, data);
+	case LOCAL_MAX:
+		return ods_idx_max(idx, pkey, data);
+	default:
+		break;
+	}
+	iter = ods_iter_new(idx);
+	if (!iter)
+		return errno;
+	if (op == LOCAL_SUP)
+		rc = ods_iter_find_lub(iter, key);
+	else
+		rc = ods_iter_find_glb(iter, key);
+	if (!rc) {
+		*pkey = ods_iter_key(iter);
+		*data = ods_iter_data(iter);
+		if (!*pkey)
+			rc = ENOMEM;
+	}
+	ods_iter_delete(iter);
+	return rc;
+}
+
+/*
+ * Query the container's index and the partition local indices
+ * directly and return the reference of the best match. An exact
+ * match is returned from the first index that contains the key.
+ */
+static int __sos_index_local_find(sos_index_t index,
+				  struct sos_index_parts_s *parts,
+				  sos_key_t key, enum local_find_e op,
+				  sos_obj_ref_t *ref)
+{
+	ods_key_t best = NULL, k;
+	ods_idx_data_t data;
+	ods_idx_t idx;
+	int64_t res;
+	int i, rc = ENOENT;
+
+	for (i = -1; i < parts->count; i++) {
+		idx = i < 0 ? index->idx : parts->parts[i].idx;
+		if (op == LOCAL_FIND) {
+			if (!ods_idx_find(idx, key, &ref->idx_data))
+				return 0;
+			continue;
+		}
+		k = NULL;
+		rc = __sos_index_idx_find(idx, key, op, &k, &data);
+		if (rc) {
+			if (k)
+				ods_obj_put(k);
+			continue;
+		}
+		if (best) {
+			res = ods_key_cmp(index->idx, k, best);
+			/* Ties resolve as in the merged iterator order */
+			if (op == LOCAL_SUP || op == LOCAL_MIN ? res >= 0 : res < 0) {
+				ods_obj_put(k);
+				continue;
+			}
+			ods_obj_put(best);
+		}
+		best = k;
+		ref->idx_data = data;
+	}
+	if (!best)
+		return ENOENT;
+	ods_obj_put(best);
+	return 0;
+}
+
+static int __sos_index_find_op(sos_index_t index, sos_key_t key,
+			       enum local_find_e op, sos_obj_ref_t *ref)
+{
+	struct sos_index_parts_s *parts = __sos_index_parts_get(index);
+	ods_key_t k = NULL;
+	int rc;
+
+	if (!parts)
+		return errno;
+	if (parts->count) {
+		rc = __sos_index_local_find(index, parts, key, op, ref);
+		goto out;
+	}
+	switch (op) {
+	case LOCAL_FIND:
+		rc = ods_idx_find(index->idx, key, &ref->idx_data);
+		break;
+	case LOCAL_SUP:
+		rc = ods_idx_find_lub(index->idx, key, &ref->idx_data);
+		break;
+	case LOCAL_INF:
+		rc = ods_idx_find_glb(index->idx, key, &ref->idx_data);
+		break;
+	case LOCAL_MIN:
+		rc = ods_idx_min(index->idx, &k, &ref->idx_data);
+		break;
+	case LOCAL_MAX:
+		rc = ods_idx_max(index->idx, &k, &ref->idx_data);
+		break;
+	default:
+		rc = EINVAL;
+	}
+	if (k)
+		ods_obj_put(k);
+ out:
+	__sos_index_parts_put(parts);
+	return rc;
 }
 
 /**
@@ -384,7 +625,7 @@ sos_obj_t sos_index_find(sos_index_t index, sos_key_t key)
 {
 	sos_obj_ref_t idx_ref;
 	sos_obj_t obj;
-	int rc = ods_idx_find(index->idx, key, &idx_ref.idx_data);
+	int rc = sos_index_find_ref(index, key, &idx_ref);
 	if (rc) {
 		errno = ENOENT;
 		return NULL;
@@ -406,7 +647,7 @@ sos_obj_t sos_index_find(sos_index_t index, sos_key_t key)
  */
 int sos_index_find_ref(sos_index_t index, sos_key_t key, sos_obj_ref_t *ref)
 {
-	return ods_idx_find(index->idx, key, &ref->idx_data);
+	return __sos_index_find_op(index, key, LOCAL_FIND, ref);
 }
 
 /**
@@ -434,14 +675,11 @@ sos_obj_t sos_index_find_min(sos_index_t index)
 {
 	sos_obj_t obj;
 	sos_obj_ref_t idx_ref;
-	ods_key_t key = NULL;
-	int rc = ods_idx_min(index->idx, &key, &idx_ref.idx_data);
+	int rc = __sos_index_find_op(index, NULL, LOCAL_MIN, &idx_ref);
 	if (rc) {
 		errno = rc;
 		return NULL;
 	}
-	if (key)
-		ods_obj_put(key);
 	obj = sos_ref_as_obj(index->sos, idx_ref);
 	if (!obj)
 		errno = ENOMEM;
@@ -458,14 +696,11 @@ sos_obj_t sos_index_find_max(sos_index_t index)
 {
 	sos_obj_t obj;
 	sos_obj_ref_t idx_ref;
-	ods_key_t key = NULL;
-	int rc = ods_idx_max(index->idx, &key, &idx_ref.idx_data);
+	int rc = __sos_index_find_op(index, NULL, LOCAL_MAX, &idx_ref);
 	if (rc) {
 		errno = rc;
 		return NULL;
 	}
-	if (key)
-		ods_obj_put(key);
 	obj = sos_ref_as_obj(index->sos, idx_ref);
 	if (!obj)
 		errno = ENOMEM;
@@ -484,7 +719,7 @@ sos_obj_t sos_index_find_sup(sos_index_t index, sos_key_t key)
 {
 	sos_obj_ref_t idx_ref;
 	sos_obj_t obj;
-	int rc = ods_idx_find_lub(index->idx, key, &idx_ref.idx_data);
+	int rc = __sos_index_find_op(index, key, LOCAL_SUP, &idx_ref);
 	if (rc) {
 		errno = ENOENT;
 		return NULL;
@@ -507,7 +742,7 @@ sos_obj_t sos_index_find_inf(sos_index_t index, sos_key_t key)
 {
 	sos_obj_ref_t idx_ref;
 	sos_obj_t obj;
-	int rc = ods_idx_find_glb(index->idx, key, &idx_ref.idx_data);
+	int rc = __sos_index_find_op(index, key, LOCAL_INF, &idx_ref);
 	if (rc) {
 		errno = ENOENT;
 		return NULL;
@@ -531,6 +766,10 @@ int sos_index_close(sos_index_t index, sos_commit_t flags)
 	if (!index)
 		return EINVAL;
 	ods_idx_close(index->idx, ODS_COMMIT_ASYNC);
+	free(index->hist);
+	__sos_index_parts_put(index->parts);
+	pthread_mutex_destroy(&index->plan_lock);
+	pthread_mutex_destroy(&index->parts_lock);
 	free(index);
 	return 0;
 }
@@ -705,7 +944,16 @@ void sos_container_index_list(sos_t sos, FILE *fp)
  */
 int sos_index_commit(sos_index_t index, sos_commit_t flags)
 {
+	struct sos_index_parts_s *parts;
+	int i;
+
 	ods_idx_commit(index->idx, flags);
+	parts = __sos_index_parts_get(index);
+	if (!parts)
+		return errno;
+	for (i = 0; i < parts->count; i++)
+		ods_idx_commit(parts->parts[i].idx, flags);
+	__sos_index_parts_put(parts);
 	return 0;
 }
 
@@ -717,8 +965,9 @@ int sos_index_commit(sos_index_t index, sos_commit_t flags)
  */
 off_t sos_index_size(sos_index_t index)
 {
-	struct ods_idx_stat_s sb;
-	ods_idx_stat(index->idx, &sb);
+	struct sos_index_stat_s sb;
+	if (sos_index_stat(index, &sb))
+		return 0;
 	return sb.size;
 }
 
@@ -741,8 +990,25 @@ const char *sos_index_name(sos_index_t index)
  */
 int sos_index_stat(sos_index_t index, sos_index_stat_t sb)
 {
+	struct sos_index_parts_s *parts;
+	struct ods_idx_stat_s isb;
+	int i, rc;
+
 	if (!index || !sb)
 		return EINVAL;
-	return ods_idx_stat(index->idx, (ods_idx_stat_t)sb);
+	parts = __sos_index_parts_get(index);
+	if (!parts)
+		return errno;
+	rc = ods_idx_stat(index->idx, (ods_idx_stat_t)sb);
+	for (i = 0; !rc && i < parts->count; i++) {
+		rc = ods_idx_stat(parts->parts[i].idx, &isb);
+		if (rc)
+			break;
+		sb->cardinality += isb.cardinality;
+		sb->duplicates += isb.duplicates;
+		sb->size += isb.size;
+	}
+	__sos_index_parts_put(parts);
+	return rc;
 }
 
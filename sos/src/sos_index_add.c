@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \section sos_index_add sos_index_add command
+ *
+ * \b NAME
+ *
+ * sos_index_add - Add an index to an attribute of an existing schema
+ *
+ * \b SYNOPSIS
+ *
+ * sos_index_add -C <PATH> -S <SCHEMA> [-t <IDX-TYPE>] [-k <KEY-TYPE>] [-a <ARGS>] <ATTR-NAME>
+ *
+ * \b DESCRIPTION
+ *
+ * Creates the index of an attribute of a schema that is already in
+ * the container and adds the objects in the active partitions to
+ * it. The objects are added in the background at a limited rate so
+ * that ingest into the container is not disturbed. The command
+ * reports its progress and returns when the index is complete.
+ *
+ * If the command is interrupted, the index is built the next time
+ * the container is opened read-write.
+ *
+ * \b -C PATH
+ *
+ * Specify the PATH to the Container. This option is required.
+ *
+ * \b -S SCHEMA
+ *
+ * The name of the schema. This option is required.
+ *
+ * \b -t IDX-TYPE
+ *
+ * The index type. The default is BXTREE.
+ *
+ * \b -k KEY-TYPE
+ *
+ * The key type. The default depends on the attribute type.
+ *
+ * \b -a ARGS
+ *
+ * The index type specific arguments, e.g. ORDER=5
+ *
+ * \b ATTR-NAME
+ *
+ * The name of the attribute to index.
+ */
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <errno.h>
+#include <sos/sos.h>
+
+void usage(int argc, char *argv[])
+{
+	printf("sos_index_add -C <path> -S <schema> [-t <idx-type>] [-k <key-type>] [-a <args>] <attr-name>\n");
+	printf("    -C <path>      The path to the container.\n");
+	printf("    -S <schema>    The schema name.\n");
+	printf("    -t <idx-type>  The index type, the default is BXTREE.\n");
+	printf("    -k <key-type>  The key type.\n");
+	printf("    -a <args>      The index type arguments.\n");
+	printf("    <attr-name>    The name of the attribute to index.\n");
+	exit(1);
+}
+
+const char *short_options = "C:S:t:k:a:";
+
+struct option long_options[] = {
+	{"help",        no_argument,        0,  '?'},
+	{"path",        required_argument,  0,  'C'},
+	{"schema",      required_argument,  0,  'S'},
+	{"idx_type",    required_argument,  0,  't'},
+	{"key_type",    required_argument,  0,  'k'},
+	{"args",        required_argument,  0,  'a'},
+	{0,             0,                  0,  0}
+};
+
+int main(int argc, char **argv)
+{
+	struct sos_index_build_stat_s sb;
+	sos_schema_t schema;
+	sos_attr_t attr;
+	sos_t sos;
+	int opt, rc;
+	char *path = NULL;
+	char *schema_name = NULL;
+	char *attr_name = NULL;
+	char *idx_type = NULL;
+	char *key_type = NULL;
+	char *idx_args = NULL;
+	while (0 < (opt = getopt_long(argc, argv, short_options, long_options, NULL))) {
+		switch (opt) {
+		case 'C':
+			path = strdup(optarg);
+			break;
+		case 'S':
+			schema_name = strdup(optarg);
+			break;
+		case 't':
+			idx_type = strdup(optarg);
+			break;
+		case 'k':
+			key_type = strdup(optarg);
+			break;
+		case 'a':
+			idx_args = strdup(optarg);
+			break;
+		case '?':
+		default:
+			usage(argc, argv);
+		}
+	}
+
+	if (!path || !schema_name)
+		usage(argc, argv);
+
+	if (optind < argc)
+		attr_name = strdup(argv[optind]);
+	else
+		usage(argc, argv);
+
+	sos = sos_container_open(path, SOS_PERM_RW);
+	if (!sos) {
+		printf("Error %d opening the container %s.\n", errno, path);
+		exit(1);
+	}
+	schema = sos_schema_by_name(sos, schema_name);
+	if (!schema) {
+		printf("The schema named '%s' was not found.\n", schema_name);
+		exit(1);
+	}
+	attr = sos_schema_attr_by_name(schema, attr_name);
+	if (!attr) {
+		printf("The attribute named '%s' was not found.\n", attr_name);
+		exit(1);
+	}
+	if (idx_type || key_type || idx_args) {
+		rc = sos_schema_index_modify(schema, attr_name,
+					     idx_type ? idx_type : "BXTREE",
+					     key_type, idx_args);
+		if (rc) {
+			printf("Error %d setting the index type.\n", rc);
+			exit(1);
+		}
+	}
+	rc = sos_schema_index_add(schema, attr_name);
+	if (rc && rc != EEXIST) {
+		printf("Error %d adding the index.\n", rc);
+		exit(1);
+	}
+	do {
+		rc = sos_attr_index_build_stat(attr, &sb);
+		if (rc || !sb.building)
+			break;
+		if (sb.part_count)
+			printf("%u of %u partitions, %lu of %lu bytes, %lu objects\n",
+			       sb.part_done, sb.part_count,
+			       sb.part_pos, sb.part_size, sb.obj_count);
+		sleep(1);
+	} while (1);
+	sos_container_close(sos, SOS_COMMIT_SYNC);
+	if (rc) {
+		printf("Error %d building the index.\n", rc);
+		return 1;
+	}
+	return 0;
+}
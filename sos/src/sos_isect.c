@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \page isect Index Intersection
+ *
+ * A filter iterates a single index and tests every other condition
+ * by dereferencing each candidate object. When conditions on two or
+ * more indexed attributes are each selective, e.g. 'job_id == J' and
+ * 'comp_id == C', it is cheaper to scan the key range of each index,
+ * intersect the object references found, and only dereference the
+ * objects in the intersection.
+ *
+ * An intersection is created from a filter that holds the conditions.
+ * The objects are returned in reference order, i.e. grouped by
+ * partition and in storage order within a partition, and not in the
+ * order of any index.
+ *
+ *     sos_isect_t isect = sos_isect_new(filt, NULL, 0);
+ *     for (obj = sos_isect_begin(isect); obj; obj = sos_isect_next(isect)) {
+ *         ...
+ *         sos_obj_put(obj);
+ *     }
+ *     sos_isect_free(isect);
+ */
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sos/sos.h>
+#include "sos_priv.h"
+
+struct sos_isect_s {
+	sos_filter_t filt;	/* The conditions, owned by the caller */
+	int attr_count;
+	sos_attr_t *attrs;	/* The attributes whose indices are scanned */
+	sos_obj_ref_t *refs;	/* The intersection in reference order */
+	size_t ref_count;
+	size_t next;
+};
+
+static int __ref_cmp(const void *a, const void *b)
+{
+	const struct sos_idx_ref_s *ra = &((const sos_obj_ref_t *)a)->ref;
+	const struct sos_idx_ref_s *rb = &((const sos_obj_ref_t *)b)->ref;
+
+	if (ra->ods != rb->ods)
+		return (ra->ods < rb->ods ? -1 : 1);
+	if (ra->obj != rb->obj)
+		return (ra->obj < rb->obj ? -1 : 1);
+	return 0;
+}
+
+/*
+ * Sort the references and remove duplicates, which an index with
+ * multiple entries for an object may contain.
+ */
+static size_t __refs_sort(sos_obj_ref_t *refs, size_t count)
+{
+	size_t i, n;
+
+	if (!count)
+		return 0;
+	qsort(refs, count, sizeof(*refs), __ref_cmp);
+	for (i = n = 1; i < count; i++) {
+		if (__ref_cmp(&refs[i], &refs[n - 1]))
+			refs[n++] = refs[i];
+	}
+	return n;
+}
+
+/* Keep the references in a that are also in b, both sorted */
+static size_t __refs_intersect(sos_obj_ref_t *a, size_t a_count,
+			       sos_obj_ref_t *b, size_t b_count)
+{
+	size_t i = 0, j = 0, n = 0;
+	int rc;
+
+	while (i < a_count && j < b_count) {
+		rc = __ref_cmp(&a[i], &b[j]);
+		if (rc < 0) {
+			i++;
+		} else if (rc > 0) {
+			j++;
+		} else {
+			a[n++] = a[i];
+			i++;
+			j++;
+		}
+	}
+	return n;
+}
+
+static int __attr_has_bound(sos_filter_t filt, sos_attr_t attr)
+{
+	sos_filter_cond_t cond;
+	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+		if (cond->attr == attr && cond->cond != SOS_COND_NE)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Collect the sorted references of the entries in the attribute's
+ * index that satisfy the filter's conditions on the attribute.
+ */
+static int __attr_refs(sos_filter_t filt, sos_attr_t attr,
+		       sos_obj_ref_t **refs, size_t *count)
+{
+	sos_filter_cond_t cond;
+	sos_filter_t attr_filt;
+	sos_iter_t iter;
+	int rc;
+
+	iter = sos_attr_iter_new(attr);
+	if (!iter)
+		return errno;
+	attr_filt = sos_filter_new(iter);
+	if (!attr_filt) {
+		sos_iter_free(iter);
+		return errno;
+	}
+	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+		if (cond->attr != attr)
+			continue;
+		rc = sos_filter_cond_add(attr_filt, attr, cond->cond, cond->value);
+		if (rc)
+			goto out;
+	}
+	rc = __sos_filter_refs(attr_filt, refs, count);
+	if (!rc)
+		*count = __refs_sort(*refs, *count);
+ out:
+	sos_filter_free(attr_filt);
+	return rc;
+}
+
+/**
+ * \brief Create an index intersection
+ *
+ * The conditions are taken from the filter, see sos_filter_cond_add().
+ * The key range of each attribute in attrs is scanned using the
+ * conditions on that attribute; only the objects found in every range
+ * are dereferenced and tested against all of the filter's conditions.
+ *
+ * If attrs is NULL, the indices of every attribute with a condition
+ * other than SOS_COND_NE are scanned. Join attributes are not
+ * supported.
+ *
+ * The filter must not be freed before the intersection.
+ *
+ * \param filt The filter handle
+ * \param attrs An array of indexed attributes or NULL
+ * \param count The number of attributes in attrs
+ * \retval !NULL The intersection handle
+ * \retval NULL An error occurred, errno is set to one of:
+ *	EINVAL An attribute is a join or is not indexed
+ *	ENOENT No attribute in the filter has a bounding condition
+ *	ENOMEM Insufficient resources
+ */
+sos_isect_t sos_isect_new(sos_filter_t filt, sos_attr_t *attrs, int count)
+{
+	sos_isect_t isect;
+	sos_filter_cond_t cond;
+	int i, j;
+
+	isect = calloc(1, sizeof(*isect));
+	if (!isect)
+		goto enomem;
+	isect->filt = filt;
+	/* Bound the ranges by their lowest and highest values */
+	__sos_filter_ranges_prepare(filt, -1);
+	if (!attrs) {
+		count = 0;
+		TAILQ_FOREACH(cond, &filt->cond_list, entry)
+			count++;
+	}
+	isect->attrs = calloc(count + 1, sizeof(*isect->attrs));
+	if (!isect->attrs)
+		goto enomem;
+	if (attrs) {
+		for (i = 0; i < count; i++) {
+			if (!sos_attr_index(attrs[i])
+			    || sos_attr_type(attrs[i]) == SOS_TYPE_JOIN) {
+				errno = EINVAL;
+				goto err;
+			}
+			isect->attrs[i] = attrs[i];
+		}
+		isect->attr_count = count;
+	} else {
+		TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+			if (!sos_attr_index(cond->attr)
+			    || sos_attr_type(cond->attr) == SOS_TYPE_JOIN
+			    || !__attr_has_bound(filt, cond->attr))
+				continue;
+			for (j = 0; j < isect->attr_count; j++)
+				if (isect->attrs[j] == cond->attr)
+					break;
+			if (j == isect->attr_count)
+				isect->attrs[isect->attr_count++] = cond->attr;
+		}
+	}
+	if (!isect->attr_count) {
+		errno = ENOENT;
+		goto err;
+	}
+	return isect;
+ enomem:
+	errno = ENOMEM;
+ err:
+	if (isect)
+		free(isect->attrs);
+	free(isect);
+	return NULL;
+}
+
+/**
+ * \brief Free an index intersection
+ *
+ * \param isect The intersection handle
+ */
+void sos_isect_free(sos_isect_t isect)
+{
+	free(isect->refs);
+	free(isect->attrs);
+	free(isect);
+}
+
+/**
+ * \brief Return the number of candidate objects
+ *
+ * Returns the number of objects found in every index range by the
+ * last call to sos_isect_begin(). This is an upper bound on the
+ * number of objects returned since conditions on attributes that were
+ * not scanned are tested when the objects are dereferenced.
+ *
+ * \param isect The intersection handle
+ * \returns The number of candidate objects
+ */
+size_t sos_isect_card(sos_isect_t isect)
+{
+	return isect->ref_count;
+}
+
+static int __obj_eval(sos_filter_t filt, sos_obj_t obj)
+{
+	sos_filter_cond_t cond;
+	struct sos_value_s v_;
+	sos_value_t v;
+	int rc;
+
+	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+		v = sos_value_init(&v_, obj, cond->attr);
+		if (!v)
+			return 0;
+		rc = cond->cmp_fn(v, cond->value, &cond->ret);
+		sos_value_put(v);
+		if (!rc)
+			return 0;
+	}
+	if (filt->range_count > 1) {
+		v = sos_value_init(&v_, obj, filt->range_attr);
+		rc = (v && __sos_filter_in_ranges(filt, v));
+		sos_value_put(v);
+		return rc;
+	}
+	return 1;
+}
+
+/**
+ * \brief Return the next object in the intersection
+ *
+ * \param isect The intersection handle
+ * \retval !NULL The next object matching all of the conditions
+ * \retval NULL There are no more matching objects
+ */
+sos_obj_t sos_isect_next(sos_isect_t isect)
+{
+	sos_t sos = isect->filt->iter->index->sos;
+	sos_obj_t obj;
+
+	while (isect->next < isect->ref_count) {
+		obj = sos_ref_as_obj(sos, isect->refs[isect->next++]);
+		if (!obj)
+			continue;
+		if (__obj_eval(isect->filt, obj))
+			return obj;
+		sos_obj_put(obj);
+	}
+	return NULL;
+}
+
+/**
+ * \brief Return the first object in the intersection
+ *
+ * Scans the index ranges and computes the intersection of the object
+ * references found.
+ *
+ * \param isect The intersection handle
+ * \retval !NULL The first object matching all of the conditions
+ * \retval NULL There are no matching objects or an error occurred
+ */
+sos_obj_t sos_isect_begin(sos_isect_t isect)
+{
+	sos_obj_ref_t *refs;
+	size_t count;
+	int i, rc;
+
+	free(isect->refs);
+	isect->refs = NULL;
+	isect->ref_count = 0;
+	isect->next = 0;
+	for (i = 0; i < isect->attr_count; i++) {
+		rc = __attr_refs(isect->filt, isect->attrs[i], &refs, &count);
+		if (rc) {
+			errno = rc;
+			goto err;
+		}
+		if (!isect->refs) {
+			isect->refs = refs;
+			isect->ref_count = count;
+		} else {
+			isect->ref_count = __refs_intersect(isect->refs, isect->ref_count,
+							    refs, count);
+			free(refs);
+		}
+		if (!isect->ref_count)
+			break;
+	}
+	return sos_isect_next(isect);
+ err:
+	free(isect->refs);
+	isect->refs = NULL;
+	isect->ref_count = 0;
+	return NULL;
+}
@@ -83,6 +83,187 @@ static sos_filter_cond_t __sos_find_filter_condition(sos_filter_t filt,
 						     int attr_id);
 static sos_obj_t next_match(sos_filter_t filt);
 static sos_obj_t prev_match(sos_filter_t filt);
+static int __sos_filter_covered(sos_filter_t filt);
+static void __range_free(struct sos_filter_range_s *range);
+
+/*
+ * Partitions created with SOS_PART_F_LOCAL_INDEX keep the keys of
+ * their objects in their own indices. If any of these partitions is
+ * ACTIVE or PRIMARY, the iterator merges the container's index (slot
+ * 0) with the local index of each of these partitions. The merged
+ * order is the key, then the slot, then the position in the slot's
+ * index.
+ *
+ * The iterator position is the slot_cur slot. If slot_dir is 1, each
+ * other slot is at its first entry after the position, and if
+ * slot_dir is -1 at its last entry before it. Otherwise the other
+ * slots are repositioned before the next step.
+ */
+static ods_iter_t __sos_iter_base(sos_iter_t i)
+{
+	return i->slot_count ? i->slots[0].iter : i->iter;
+}
+
+static void __sos_iter_slot_key(struct sos_iter_slot_s *slot, int rc)
+{
+	slot->valid = !rc;
+}
+
+static void __sos_iter_slots_free(sos_iter_t i)
+{
+	int s;
+	if (!i->slot_count)
+		return;
+	i->iter = i->slots[0].iter;
+	__sos_iter_slot_key(&i->slots[0], ENOENT);
+	for (s = 1; s < i->slot_count; s++) {
+		__sos_iter_slot_key(&i->slots[s], ENOENT);
+		ods_iter_delete(i->slots[s].iter);
+		sos_part_put(i->slots[s].part);
+	}
+	free(i->slots);
+	i->slots = NULL;
+	i->slot_count = 0;
+}
+
+/*
+ * Rebuild the slots if the active partitions have changed since they
+ * were created.
+ */
+static int __sos_iter_slots_refresh(sos_iter_t i, int force)
+{
+	sos_t sos = i->index->sos;
+	struct sos_iter_slot_s *slots;
+	int s, count, rc;
+
+	if (!force && i->part_gn == SOS_PART_UDATA(sos->part_udata)->gen)
+		return 0;
+	__sos_iter_slots_free(i);
+	rc = __sos_part_idx_slots(i->index, &slots, &count, &i->part_gn);
+	if (rc || !count)
+		return rc;
+	slots[0].iter = i->iter;
+	for (s = 1; s < count; s++)
+		ods_iter_flags_set(slots[s].iter, i->flags);
+	i->slots = slots;
+	i->slot_count = count;
+	i->slot_cur = 0;
+	i->slot_dir = 0;
+	return 0;
+}
+
+/*
+ * Make the slot with the least (or greatest if max) key the iterator
+ * position. Equal keys resolve to the first slot, or to the last
+ * slot if last.
+ */
+static int __sos_iter_slot_pick(sos_iter_t i, int max, int last)
+{
+	int s, best = -1;
+	int64_t c;
+
+	for (s = 0; s < i->slot_count; s++) {
+		if (!i->slots[s].valid)
+			continue;
+		if (best < 0) {
+			best = s;
+			continue;
+		}
+		c = ods_iter_cmp(i->slots[s].iter, i->slots[best].iter);
+		if (max)
+			c = -c;
+		if (c < 0 || (c == 0 && last))
+			best = s;
+	}
+	if (best < 0)
+		return ENOENT;
+	i->slot_cur = best;
+	i->iter = i->slots[best].iter;
+	return 0;
+}
+
+/*
+ * Prune the partition slots whose zone map does not intersect [lo, hi]
+ */
+static void __sos_iter_slots_prune(sos_iter_t i, sos_key_t lo, sos_key_t hi)
+{
+	int s;
+	for (s = 1; s < i->slot_count; s++)
+		i->slots[s].pruned =
+			!__sos_part_idx_zone_test(i->slots[s].part, i->index, lo, hi);
+}
+
+/*
+ * Position the other slots relative to the iterator position for
+ * stepping in the direction dir.
+ */
+static void __sos_iter_slots_align(sos_iter_t i, int dir)
+{
+	struct sos_iter_slot_s *slot;
+	ods_key_t key;
+	int s, rc;
+
+	if (!i->slots[i->slot_cur].valid)
+		return;
+	key = ods_iter_key(i->slots[i->slot_cur].iter);
+	if (!key)
+		return;
+	for (s = 0; s < i->slot_count; s++) {
+		if (s == i->slot_cur)
+			continue;
+		slot = &i->slots[s];
+		if (slot->pruned) {
+			__sos_iter_slot_key(slot, ENOENT);
+			continue;
+		}
+		if (s < i->slot_cur) {
+			/* Entries with keys <= key precede the position */
+			ods_iter_flags_set(slot->iter, i->flags | ODS_ITER_F_GLB_LAST_DUP);
+			rc = ods_iter_find_glb(slot->iter, key);
+			if (dir > 0)
+				rc = rc ? ods_iter_begin(slot->iter) : ods_iter_next(slot->iter);
+		} else {
+			/* Entries with keys >= key follow the position */
+			ods_iter_flags_set(slot->iter, i->flags & ~ODS_ITER_F_LUB_LAST_DUP);
+			rc = ods_iter_find_lub(slot->iter, key);
+			if (dir < 0)
+				rc = rc ? ods_iter_end(slot->iter) : ods_iter_prev(slot->iter);
+		}
+		ods_iter_flags_set(slot->iter, i->flags);
+		__sos_iter_slot_key(slot, rc);
+	}
+	ods_obj_put(key);
+	i->slot_dir = dir;
+}
+
+static int __sos_iter_merged_step(sos_iter_t i, int dir)
+{
+	struct sos_iter_slot_s *slot = &i->slots[i->slot_cur];
+	ods_key_t key = NULL;
+	int rc;
+
+	if (!slot->valid)
+		return ENOENT;
+	if (i->slot_dir != dir)
+		__sos_iter_slots_align(i, dir);
+	if (i->flags & ODS_ITER_F_UNIQUE)
+		key = ods_iter_key(slot->iter);
+	do {
+		if (dir > 0)
+			rc = ods_iter_next(slot->iter);
+		else
+			rc = ods_iter_prev(slot->iter);
+		__sos_iter_slot_key(slot, rc);
+		rc = __sos_iter_slot_pick(i, dir < 0, dir < 0);
+		if (rc || !(i->flags & ODS_ITER_F_UNIQUE))
+			break;
+		/* Skip the key in the other slots */
+		slot = &i->slots[i->slot_cur];
+	} while (key && 0 == ods_iter_key_cmp(slot->iter, key));
+	if (key)
+		ods_obj_put(key);
+	return rc;
+}
 
 /**
  * \brief Create a SOS iterator from an index
@@ -98,7 +279,7 @@ sos_iter_t sos_index_iter_new(sos_index_t index)
 {
 	sos_iter_t i;
 
-	i = malloc(sizeof *i);
+	i = calloc(1, sizeof *i);
 	if (!i)
 		return NULL;
 	i->attr = NULL;
@@ -106,6 +287,12 @@ sos_iter_t sos_index_iter_new(sos_index_t index)
 	i->iter = ods_iter_new(index->idx);
 	if (!i->iter)
 		goto err;
+	i->flags = ods_iter_flags_get(i->iter);
+	errno = __sos_iter_slots_refresh(i, 1);
+	if (errno) {
+		ods_iter_delete(i->iter);
+		goto err;
+	}
 	return i;
  err:
 	if (i)
@@ -122,7 +309,8 @@ sos_iter_t sos_index_iter_new(sos_index_t index)
  * \param attr The schema attribute handle
  *
  * \retval sos_iter_t for the specified attribute
- * \retval NULL       The attribute is not indexed
+ * \retval NULL       The attribute is not indexed, errno is EBUSY if
+ *                    its index is still being built
  */
 sos_iter_t sos_attr_iter_new(sos_attr_t attr)
 {
@@ -130,7 +318,8 @@ sos_iter_t sos_attr_iter_new(sos_attr_t attr)
 	sos_index_t index = sos_attr_index(attr);
 
 	if (!index) {
-		errno = EINVAL;
+		if (!attr->data->building)
+			errno = EINVAL;
 		return NULL;
 	}
 
@@ -163,7 +352,14 @@ sos_attr_t sos_iter_attr(sos_iter_t iter)
  */
 int sos_iter_flags_set(sos_iter_t iter, sos_iter_flags_t flags)
 {
-	return ods_iter_flags_set(iter->iter, flags);
+	int s, rc;
+	rc = ods_iter_flags_set(__sos_iter_base(iter), flags);
+	if (rc)
+		return rc;
+	iter->flags = flags;
+	for (s = 1; s < iter->slot_count; s++)
+		ods_iter_flags_set(iter->slots[s].iter, flags);
+	return 0;
 }
 
 /**
@@ -174,7 +370,7 @@ int sos_iter_flags_set(sos_iter_t iter, sos_iter_flags_t flags)
  */
 sos_iter_flags_t sos_iter_flags_get(sos_iter_t iter)
 {
-	return (sos_iter_flags_t)ods_iter_flags_get(iter->iter);
+	return (sos_iter_flags_t)iter->flags;
 }
 
 /**
@@ -185,7 +381,7 @@ sos_iter_flags_t sos_iter_flags_get(sos_iter_t iter)
 uint64_t sos_iter_card(sos_iter_t iter)
 {
 	struct ods_idx_stat_s sb;
-	int rc = ods_idx_stat(ods_iter_idx(iter->iter), &sb);
+	int rc = __sos_iter_idx_stat(iter, &sb);
 	if (rc)
 		return 0;
 	return sb.cardinality;
@@ -198,12 +394,32 @@ uint64_t sos_iter_card(sos_iter_t iter)
 uint64_t sos_iter_dups(sos_iter_t iter)
 {
 	struct ods_idx_stat_s sb;
-	int rc = ods_idx_stat(ods_iter_idx(iter->iter), &sb);
+	int rc = __sos_iter_idx_stat(iter, &sb);
 	if (rc)
 		return 0;
 	return sb.duplicates;
 }
 
+/*
+ * Sum the statistics of the indices merged by the iterator
+ */
+int __sos_iter_idx_stat(sos_iter_t iter, ods_idx_stat_t sb)
+{
+	struct ods_idx_stat_s isb;
+	int s, rc;
+
+	rc = ods_idx_stat(ods_iter_idx(__sos_iter_base(iter)), sb);
+	for (s = 1; !rc && s < iter->slot_count; s++) {
+		rc = ods_idx_stat(ods_iter_idx(iter->slots[s].iter), &isb);
+		if (rc)
+			break;
+		sb->cardinality += isb.cardinality;
+		sb->duplicates += isb.duplicates;
+		sb->size += isb.size;
+	}
+	return rc;
+}
+
 #define FNV_32_PRIME 0x01000193
 static uint32_t fnv_hash_a1_32(const void *str, int len, uint32_t seed)
 {
@@ -221,9 +437,13 @@ static uint32_t fnv_hash_a1_32(const void *str, int len, uint32_t seed)
 /**
  * \brief Returns the current iterator position
  *
+ * Positions are not supported on an iterator that merges partition
+ * local indices, see sos_part_create_ex().
+ *
  * \param i The iterator handle
  * \param pos The sos_pos_t that will receive the position value.
- * \returns The current iterator position or 0 if position is invalid
+ * \retval 0 Success
+ * \retval ENOSYS The iterator merges partition local indices
  */
 int sos_iter_pos_get(sos_iter_t iter, sos_pos_t *pos)
 {
@@ -235,6 +455,8 @@ int sos_iter_pos_get(sos_iter_t iter, sos_pos_t *pos)
 	ods_idx_data_t pos_data;
 	SOS_KEY(pos_key);
 
+	if (iter->slot_count)
+		return ENOSYS;
 	rc = gettimeofday(&tv, NULL);
 	if (rc)
 		return rc;
@@ -342,6 +564,7 @@ void sos_pos_str_free(char *str)
  * \retval 0 Success
  * \retval ENOENT The position was not found, or has already been used
  * \retval EINVAL The position object is for a different index
+ * \retval ENOSYS The iterator merges partition local indices
  */
 int sos_iter_pos_set(sos_iter_t iter, const sos_pos_t pos)
 {
@@ -351,6 +574,9 @@ int sos_iter_pos_set(sos_iter_t iter, const sos_pos_t pos)
 	ods_idx_data_t pos_data;
 	SOS_KEY(pos_key);
 
+	if (iter->slot_count)
+		return ENOSYS;
+
 	ods_lock(sos->pos_ods, 0, NULL);
 
 	/* Look up the position */
@@ -417,7 +643,7 @@ int sos_iter_pos_put_no_lock(sos_iter_t iter, const sos_pos_t pos)
 	}
 
 	/* Put the iterator position */
-	rc = ods_iter_pos_put(iter->iter, &SOS_POS(pos_obj)->ods_pos);
+	rc = ods_iter_pos_put(__sos_iter_base(iter), &SOS_POS(pos_obj)->ods_pos);
 
  out_2:
 	ods_obj_delete(pos_obj);
@@ -452,6 +678,8 @@ int sos_iter_pos_put(sos_iter_t iter, const sos_pos_t pos)
  */
 void sos_iter_free(sos_iter_t iter)
 {
+	__sos_iter_slots_free(iter);
+	sos_iter_key_range_set(iter, NULL, NULL);
 	ods_iter_delete(iter->iter);
 	free(iter);
 }
@@ -501,8 +729,19 @@ sos_obj_ref_t sos_iter_ref(sos_iter_t i)
  */
 int sos_iter_entry_remove(sos_iter_t iter)
 {
+	struct sos_iter_slot_s *slot;
 	ods_idx_data_t data;
-	return ods_iter_entry_delete(iter->iter, &data);
+	int rc;
+
+	if (!iter->slot_count)
+		return ods_iter_entry_delete(iter->iter, &data);
+	if (iter->slot_dir != 1)
+		__sos_iter_slots_align(iter, 1);
+	slot = &iter->slots[iter->slot_cur];
+	rc = ods_iter_entry_delete(slot->iter, &data);
+	__sos_iter_slot_key(slot, 0);
+	__sos_iter_slot_pick(iter, 0, 0);
+	return rc;
 }
 
 /**
@@ -517,6 +756,8 @@ int sos_iter_entry_remove(sos_iter_t iter)
  */
 int sos_iter_next(sos_iter_t i)
 {
+	if (i->slot_count)
+		return __sos_iter_merged_step(i, 1);
 	return ods_iter_next(i->iter);
 }
 
@@ -532,6 +773,8 @@ int sos_iter_next(sos_iter_t i)
  */
 int sos_iter_prev(sos_iter_t i)
 {
+	if (i->slot_count)
+		return __sos_iter_merged_step(i, -1);
 	return ods_iter_prev(i->iter);
 }
 
@@ -545,10 +788,19 @@ int sos_iter_prev(sos_iter_t i)
  */
 int sos_iter_begin(sos_iter_t i)
 {
-	/* TODO clean if restarting */
+	int s, rc;
 
-	/* Get first partition */
-	return ods_iter_begin(i->iter);
+	rc = __sos_iter_slots_refresh(i, 0);
+	if (rc)
+		return rc;
+	if (!i->slot_count)
+		return ods_iter_begin(i->iter);
+	__sos_iter_slots_prune(i, i->range_lo, i->range_hi);
+	for (s = 0; s < i->slot_count; s++)
+		__sos_iter_slot_key(&i->slots[s], i->slots[s].pruned ? ENOENT
+				    : ods_iter_begin(i->slots[s].iter));
+	i->slot_dir = 1;
+	return __sos_iter_slot_pick(i, 0, 0);
 }
 
 /**
@@ -560,7 +812,19 @@ int sos_iter_begin(sos_iter_t i)
  */
 int sos_iter_end(sos_iter_t i)
 {
-	return ods_iter_end(i->iter);
+	int s, rc;
+
+	rc = __sos_iter_slots_refresh(i, 0);
+	if (rc)
+		return rc;
+	if (!i->slot_count)
+		return ods_iter_end(i->iter);
+	__sos_iter_slots_prune(i, i->range_lo, i->range_hi);
+	for (s = 0; s < i->slot_count; s++)
+		__sos_iter_slot_key(&i->slots[s], i->slots[s].pruned ? ENOENT
+				    : ods_iter_end(i->slots[s].iter));
+	i->slot_dir = -1;
+	return __sos_iter_slot_pick(i, 1, 1);
 }
 
 /**
@@ -586,7 +850,20 @@ int sos_iter_end(sos_iter_t i)
  */
 int sos_iter_sup(sos_iter_t i, sos_key_t key)
 {
-	return ods_iter_find_lub(i->iter, key);
+	int s, rc, last;
+
+	rc = __sos_iter_slots_refresh(i, 0);
+	if (rc)
+		return rc;
+	if (!i->slot_count)
+		return ods_iter_find_lub(i->iter, key);
+	__sos_iter_slots_prune(i, key, i->range_hi);
+	for (s = 0; s < i->slot_count; s++)
+		__sos_iter_slot_key(&i->slots[s], i->slots[s].pruned ? ENOENT
+				    : ods_iter_find_lub(i->slots[s].iter, key));
+	last = (0 != (i->flags & ODS_ITER_F_LUB_LAST_DUP));
+	i->slot_dir = last ? 0 : 1;
+	return __sos_iter_slot_pick(i, 0, last);
 }
 
 /**
@@ -612,7 +889,20 @@ int sos_iter_sup(sos_iter_t i, sos_key_t key)
  */
 int sos_iter_inf(sos_iter_t i, sos_key_t key)
 {
-	return ods_iter_find_glb(i->iter, key);
+	int s, rc, last;
+
+	rc = __sos_iter_slots_refresh(i, 0);
+	if (rc)
+		return rc;
+	if (!i->slot_count)
+		return ods_iter_find_glb(i->iter, key);
+	__sos_iter_slots_prune(i, i->range_lo, key);
+	for (s = 0; s < i->slot_count; s++)
+		__sos_iter_slot_key(&i->slots[s], i->slots[s].pruned ? ENOENT
+				    : ods_iter_find_glb(i->slots[s].iter, key));
+	last = (0 != (i->flags & ODS_ITER_F_GLB_LAST_DUP));
+	i->slot_dir = last ? -1 : 0;
+	return __sos_iter_slot_pick(i, 1, last);
 }
 
 /**
@@ -634,10 +924,33 @@ int sos_iter_inf(sos_iter_t i, sos_key_t key)
  */
 int64_t sos_iter_key_cmp(sos_iter_t iter, sos_key_t key)
 {
-	int64_t rc;
-	ods_key_t iter_key = ods_iter_key(iter->iter);
-	rc = ods_key_cmp(iter->index->idx, iter_key, key);
-	ods_obj_put(iter_key);
+	return ods_iter_key_cmp(iter->iter, key);
+}
+
+/*
+ * Position the iterator at the key in the first slot that contains
+ * it, or in the last slot if last.
+ */
+static int __sos_iter_merged_find(sos_iter_t i, sos_key_t key,
+				  int (*find_fn)(ods_iter_t, ods_key_t), int last)
+{
+	int s, n, rc = ENOENT;
+
+	for (n = 0; n < i->slot_count; n++)
+		__sos_iter_slot_key(&i->slots[n], ENOENT);
+	__sos_iter_slots_prune(i, key, key);
+	for (n = 0; rc && n < i->slot_count; n++) {
+		s = last ? i->slot_count - n - 1 : n;
+		if (i->slots[s].pruned)
+			continue;
+		rc = find_fn(i->slots[s].iter, key);
+		if (rc)
+			continue;
+		__sos_iter_slot_key(&i->slots[s], rc);
+		i->slot_cur = s;
+		i->iter = i->slots[s].iter;
+	}
+	i->slot_dir = 0;
 	return rc;
 }
 
@@ -656,7 +969,12 @@ int64_t sos_iter_key_cmp(sos_iter_t iter, sos_key_t key)
  */
 int sos_iter_find(sos_iter_t iter, sos_key_t key)
 {
-	return ods_iter_find(iter->iter, key);
+	int rc = __sos_iter_slots_refresh(iter, 0);
+	if (rc)
+		return rc;
+	if (!iter->slot_count)
+		return ods_iter_find(iter->iter, key);
+	return __sos_iter_merged_find(iter, key, ods_iter_find, 0);
 }
 
 /**
@@ -671,7 +989,12 @@ int sos_iter_find(sos_iter_t iter, sos_key_t key)
  */
 int sos_iter_find_first(sos_iter_t iter, sos_key_t key)
 {
-	return ods_iter_find_first(iter->iter, key);
+	int rc = __sos_iter_slots_refresh(iter, 0);
+	if (rc)
+		return rc;
+	if (!iter->slot_count)
+		return ods_iter_find_first(iter->iter, key);
+	return __sos_iter_merged_find(iter, key, ods_iter_find_first, 0);
 }
 
 /**
@@ -686,7 +1009,45 @@ int sos_iter_find_first(sos_iter_t iter, sos_key_t key)
  */
 int sos_iter_find_last(sos_iter_t iter, sos_key_t key)
 {
-	return ods_iter_find_last(iter->iter, key);
+	int rc = __sos_iter_slots_refresh(iter, 0);
+	if (rc)
+		return rc;
+	if (!iter->slot_count)
+		return ods_iter_find_last(iter->iter, key);
+	return __sos_iter_merged_find(iter, key, ods_iter_find_last, 1);
+}
+
+/**
+ * \brief Limit the partitions consulted by the iterator to a key range
+ *
+ * Partitions created with SOS_PART_F_LOCAL_INDEX keep a zone map,
+ * i.e. the range of the keys in each of their indices. After this
+ * call, the iterator skips the partitions whose zone map does not
+ * intersect [lo, hi]. This is a hint: keys outside the range may
+ * still be returned, but keys in partitions that cannot contain the
+ * range are not. The filter sets the range from its conditions.
+ *
+ * The range takes effect when the iterator is next positioned with
+ * sos_iter_begin(), sos_iter_end(), sos_iter_sup(), sos_iter_inf() or
+ * one of the find functions.
+ *
+ * \param iter The iterator handle
+ * \param lo The lowest key of interest or NULL for no lower bound
+ * \param hi The highest key of interest or NULL for no upper bound
+ * \retval 0 Success
+ * \retval ENOMEM Insufficient resources
+ */
+int sos_iter_key_range_set(sos_iter_t iter, sos_key_t lo, sos_key_t hi)
+{
+	if (iter->range_lo)
+		sos_key_put(iter->range_lo);
+	if (iter->range_hi)
+		sos_key_put(iter->range_hi);
+	iter->range_lo = lo ? __sos_key_dup(lo) : NULL;
+	iter->range_hi = hi ? __sos_key_dup(hi) : NULL;
+	if ((lo && !iter->range_lo) || (hi && !iter->range_hi))
+		return ENOMEM;
+	return 0;
 }
 
 /**
@@ -749,6 +1110,82 @@ sos_filter_fn_t fn_table[] = {
 	[SOS_COND_NE] = ne_fn,
 };
 
+/*
+ * Batch compare kernels. The attribute values are first gathered
+ * into a column and then compared against the condition value in a
+ * branch-free loop the compiler can vectorize.
+ */
+#define FILTER_KERN(_name_, _type_, _op_)				\
+static void _name_(sos_obj_t *objs, int count, size_t offset,		\
+		   sos_value_data_t value, uint8_t *sel)		\
+{									\
+	_type_ col[SOS_FILTER_BATCH];					\
+	_type_ v;							\
+	int i;								\
+	memcpy(&v, value, sizeof(v));					\
+	for (i = 0; i < count; i++)					\
+		memcpy(&col[i], &objs[i]->obj->as.bytes[offset],	\
+		       sizeof(col[i]));					\
+	for (i = 0; i < count; i++)					\
+		sel[i] &= (col[i] _op_ v);				\
+}
+
+#define FILTER_KERNS(_pfx_, _type_)					\
+FILTER_KERN(_pfx_ ## _lt_kern, _type_, <)				\
+FILTER_KERN(_pfx_ ## _le_kern, _type_, <=)				\
+FILTER_KERN(_pfx_ ## _eq_kern, _type_, ==)				\
+FILTER_KERN(_pfx_ ## _ge_kern, _type_, >=)				\
+FILTER_KERN(_pfx_ ## _gt_kern, _type_, >)				\
+FILTER_KERN(_pfx_ ## _ne_kern, _type_, !=)				\
+static sos_filter_kern_t _pfx_ ## _kern_table[] = {			\
+	[SOS_COND_LT] = _pfx_ ## _lt_kern,				\
+	[SOS_COND_LE] = _pfx_ ## _le_kern,				\
+	[SOS_COND_EQ] = _pfx_ ## _eq_kern,				\
+	[SOS_COND_GE] = _pfx_ ## _ge_kern,				\
+	[SOS_COND_GT] = _pfx_ ## _gt_kern,				\
+	[SOS_COND_NE] = _pfx_ ## _ne_kern,				\
+};
+
+FILTER_KERNS(INT16, int16_t)
+FILTER_KERNS(INT32, int32_t)
+FILTER_KERNS(INT64, int64_t)
+FILTER_KERNS(UINT16, uint16_t)
+FILTER_KERNS(UINT32, uint32_t)
+FILTER_KERNS(UINT64, uint64_t)
+FILTER_KERNS(FLOAT, float)
+FILTER_KERNS(DOUBLE, double)
+
+/*
+ * Types without a kernel are evaluated one object at a time with the
+ * cmp_fn. A timestamp is seconds in the high word and microseconds
+ * in the low word and so orders like a uint64_t.
+ */
+static sos_filter_kern_t *kern_table[] = {
+	[SOS_TYPE_INT16] = INT16_kern_table,
+	[SOS_TYPE_INT32] = INT32_kern_table,
+	[SOS_TYPE_INT64] = INT64_kern_table,
+	[SOS_TYPE_UINT16] = UINT16_kern_table,
+	[SOS_TYPE_UINT32] = UINT32_kern_table,
+	[SOS_TYPE_UINT64] = UINT64_kern_table,
+	[SOS_TYPE_FLOAT] = FLOAT_kern_table,
+	[SOS_TYPE_DOUBLE] = DOUBLE_kern_table,
+	[SOS_TYPE_LONG_DOUBLE] = NULL,
+	[SOS_TYPE_TIMESTAMP] = UINT64_kern_table,
+	[SOS_TYPE_OBJ] = NULL,
+	[SOS_TYPE_STRUCT] = NULL,
+	[SOS_TYPE_JOIN] = NULL,
+};
+
+static sos_filter_kern_t __sos_filter_kern(sos_attr_t attr, enum sos_cond_e cond_e)
+{
+	sos_type_t type = sos_attr_type(attr);
+	if (type >= sizeof(kern_table) / sizeof(kern_table[0]))
+		return NULL;
+	if (!kern_table[type])
+		return NULL;
+	return kern_table[type][cond_e];
+}
+
 /**
  * \brief allocate a Sos Filter
  *
@@ -773,11 +1210,18 @@ sos_filter_t sos_filter_new(sos_iter_t iter)
 void sos_filter_free(sos_filter_t f)
 {
 	sos_filter_cond_t cond;
+	int i;
+	/* Let the planner learn from scans that ran to completion */
+	if (f->empty)
+		__sos_plan_feedback(f);
 	while (!TAILQ_EMPTY(&f->cond_list)) {
 		cond = TAILQ_FIRST(&f->cond_list);
 		TAILQ_REMOVE(&f->cond_list, cond, entry);
 		free(cond);
 	}
+	for (i = 0; i < f->range_count; i++)
+		__range_free(f->ranges[i]);
+	free(f->ranges);
 	sos_iter_free(f->iter);
 	free(f);
 }
@@ -814,6 +1258,24 @@ static int __attr_join_idx(sos_attr_t filt_attr, sos_attr_t attr)
 	return -1;
 }
 
+/*
+ * A condition with the same attribute and comparator as another is
+ * only a duplicate if it also tests the same value, e.g. 'ts >= 10'
+ * and 'ts >= 20' are both kept.
+ */
+static void __insert_filter_cond_dup(struct sos_cond_list *head,
+				     struct sos_filter_cond_s *cond,
+				     struct sos_filter_cond_s *new_cond)
+{
+	if (sos_value_cmp(new_cond->value, cond->value)) {
+		TAILQ_INSERT_AFTER(head, cond, new_cond, entry);
+		return;
+	}
+	/* Found duplicate condition, remove it */
+	sos_value_put(new_cond->value);
+	free(new_cond);
+}
+
 static void
 __insert_filter_cond_fwd(sos_attr_t filt_attr, struct sos_cond_list *head,
 			 struct sos_filter_cond_s *new_cond)
@@ -855,9 +1317,7 @@ __insert_filter_cond_fwd(sos_attr_t filt_attr, struct sos_cond_list *head,
 				TAILQ_INSERT_AFTER(head, cond, new_cond, entry);
 				return;
 			} else {
-				/* Found duplicate condition, remove it */
-				sos_value_put(new_cond->value);
-				free(new_cond);
+				__insert_filter_cond_dup(head, cond, new_cond);
 				return;
 			}
 		} else if (filt_attr_id == new_attr_id) {
@@ -874,9 +1334,7 @@ __insert_filter_cond_fwd(sos_attr_t filt_attr, struct sos_cond_list *head,
 				TAILQ_INSERT_AFTER(head, cond, new_cond, entry);
 				return;
 			} else {
-				/* Found duplicate condition, remove it */
-				sos_value_put(new_cond->value);
-				free(new_cond);
+				__insert_filter_cond_dup(head, cond, new_cond);
 				return;
 			}
 		} else if (new_attr_id == sos_attr_id(cond->attr)) {
@@ -888,9 +1346,7 @@ __insert_filter_cond_fwd(sos_attr_t filt_attr, struct sos_cond_list *head,
 				TAILQ_INSERT_AFTER(head, cond, new_cond, entry);
 				return;
 			} else {
-				/* Found duplicate condition, remove it */
-				sos_value_put(new_cond->value);
-				free(new_cond);
+				__insert_filter_cond_dup(head, cond, new_cond);
 				return;
 			}
 		}
@@ -945,9 +1401,7 @@ __insert_filter_cond_bkwd(sos_attr_t filt_attr, struct sos_cond_list *head,
 				TAILQ_INSERT_AFTER(head, cond, new_cond, entry);
 				return;
 			} else {
-				/* Found duplicate condition, remove it */
-				sos_value_put(new_cond->value);
-				free(new_cond);
+				__insert_filter_cond_dup(head, cond, new_cond);
 				return;
 			}
 		} else if (filt_attr_id == new_attr_id) {
@@ -964,9 +1418,7 @@ __insert_filter_cond_bkwd(sos_attr_t filt_attr, struct sos_cond_list *head,
 				TAILQ_INSERT_AFTER(head, cond, new_cond, entry);
 				return;
 			} else {
-				/* Found duplicate condition, remove it */
-				sos_value_put(new_cond->value);
-				free(new_cond);
+				__insert_filter_cond_dup(head, cond, new_cond);
 				return;
 			}
 		} else if (new_attr_id == sos_attr_id(cond->attr)) {
@@ -978,9 +1430,7 @@ __insert_filter_cond_bkwd(sos_attr_t filt_attr, struct sos_cond_list *head,
 				TAILQ_INSERT_AFTER(head, cond, new_cond, entry);
 				return;
 			} else {
-				/* Found duplicate condition, remove it */
-				sos_value_put(new_cond->value);
-				free(new_cond);
+				__insert_filter_cond_dup(head, cond, new_cond);
 				return;
 			}
 		}
@@ -1056,45 +1506,443 @@ static void __sort_filter_conds_bkwd(sos_filter_t f)
  * \retval ENOMEM There was insufficient memory to allocate the filter condition
  */
 
-int sos_filter_cond_add(sos_filter_t filt,
-			sos_attr_t attr, enum sos_cond_e cond_e, sos_value_t value)
+static sos_filter_cond_t __sos_filter_cond_new(sos_filter_t filt, sos_attr_t attr,
+						enum sos_cond_e cond_e, sos_value_t value)
 {
 	sos_filter_cond_t cond = calloc(1, sizeof *cond);
 	if (!cond)
-		return ENOMEM;
+		return NULL;
 	cond->attr = attr;
 	cond->cmp_fn = fn_table[cond_e];
+	cond->kern_fn = __sos_filter_kern(attr, cond_e);
 	cond->value = sos_value_copy(&cond->value_, value);
 	cond->cond = cond_e;
+	cond->join_idx = -1;
+	if (filt->iter->attr)
+		cond->join_idx = __attr_join_idx(filt->iter->attr, attr);
 	TAILQ_INSERT_TAIL(&filt->cond_list, cond, entry);
+	filt->covered = __sos_filter_covered(filt);
+	return cond;
+}
+
+int sos_filter_cond_add(sos_filter_t filt,
+			sos_attr_t attr, enum sos_cond_e cond_e, sos_value_t value)
+{
+	if (!__sos_filter_cond_new(filt, attr, cond_e, value))
+		return ENOMEM;
 	return 0;
 }
 
-static sos_filter_cond_t sos_filter_eval(sos_obj_t obj, sos_filter_t filt)
+static void __sos_filter_cond_value_set(sos_filter_cond_t cond, sos_value_t value)
+{
+	if (cond->value == value)
+		return;
+	sos_value_put(cond->value);
+	cond->value = sos_value_copy(&cond->value_, value);
+}
+
+/**
+ * \brief Add a range of values to the filter
+ *
+ * The ranges added to a filter are OR'd together: an object matches
+ * if the value of attr is within any one of them and it also matches
+ * all of the conditions added with sos_filter_cond_add(). All ranges
+ * must be on the same attribute.
+ *
+ * If the filter iterates over attr, or over a join index in which
+ * attr follows components that have '==' conditions, the ranges are
+ * visited in index order, each one with a seek to its first key, so
+ * only the index entries within the ranges are examined. Overlapping
+ * ranges are merged and no object is returned twice. Otherwise the
+ * scan is bounded by the lowest and highest values and each object's
+ * value is looked up in the range set.
+ *
+ * \param filt The filter handle
+ * \param attr The attribute
+ * \param lo The low value of the range, inclusive
+ * \param hi The high value of the range, inclusive
+ * \retval 0 The range was added
+ * \retval EINVAL attr is not the attribute of the filter's other
+ * ranges or hi is less than lo
+ * \retval ENOMEM Insufficient resources
+ */
+int sos_filter_range_add(sos_filter_t filt, sos_attr_t attr,
+			 sos_value_t lo, sos_value_t hi)
+{
+	struct sos_filter_range_s *range, **ranges;
+
+	if (filt->range_attr && filt->range_attr != attr)
+		return EINVAL;
+	if (sos_value_cmp(lo, hi) > 0)
+		return EINVAL;
+	ranges = realloc(filt->ranges, (filt->range_count + 1) * sizeof(*ranges));
+	if (!ranges)
+		return ENOMEM;
+	filt->ranges = ranges;
+	range = calloc(1, sizeof(*range));
+	if (!range)
+		return ENOMEM;
+	range->lo = sos_value_copy(&range->lo_, lo);
+	range->hi = sos_value_copy(&range->hi_, hi);
+	if (!range->lo || !range->hi)
+		goto err;
+	if (!filt->range_attr) {
+		filt->range_lo = __sos_filter_cond_new(filt, attr, SOS_COND_GE, lo);
+		if (!filt->range_lo)
+			goto err;
+		filt->range_hi = __sos_filter_cond_new(filt, attr, SOS_COND_LE, hi);
+		if (!filt->range_hi)
+			goto err_lo;
+		filt->range_attr = attr;
+		filt->range_miss.attr = attr;
+		filt->range_miss.cond = SOS_COND_NE;
+		filt->range_miss.join_idx = -1;
+	} else {
+		if (sos_value_cmp(lo, filt->range_lo->value) < 0)
+			__sos_filter_cond_value_set(filt->range_lo, lo);
+		if (sos_value_cmp(hi, filt->range_hi->value) > 0)
+			__sos_filter_cond_value_set(filt->range_hi, hi);
+	}
+	ranges[filt->range_count++] = range;
+	filt->range_sorted = 0;
+	return 0;
+ err_lo:
+	TAILQ_REMOVE(&filt->cond_list, filt->range_lo, entry);
+	sos_value_put(filt->range_lo->value);
+	free(filt->range_lo);
+	filt->range_lo = NULL;
+	filt->covered = __sos_filter_covered(filt);
+ err:
+	sos_value_put(range->lo);
+	sos_value_put(range->hi);
+	free(range);
+	return ENOMEM;
+}
+
+/**
+ * \brief Add a list of values to the filter
+ *
+ * The filter matches objects whose attr value is equal to any of the
+ * values. This is the same as adding a range [value, value] with
+ * sos_filter_range_add() for each value.
+ *
+ * \param filt The filter handle
+ * \param attr The attribute
+ * \param values An array of values
+ * \param count The number of values
+ * \retval 0 The values were added
+ * \retval EINVAL attr is not the attribute of the filter's ranges
+ * \retval ENOMEM Insufficient resources
+ */
+int sos_filter_in_add(sos_filter_t filt, sos_attr_t attr,
+		      sos_value_t *values, int count)
+{
+	int i, rc;
+	for (i = 0; i < count; i++) {
+		rc = sos_filter_range_add(filt, attr, values[i], values[i]);
+		if (rc)
+			return rc;
+	}
+	return 0;
+}
+
+static int __range_cmp(const void *a, const void *b)
+{
+	struct sos_filter_range_s *ra = *(struct sos_filter_range_s **)a;
+	struct sos_filter_range_s *rb = *(struct sos_filter_range_s **)b;
+	return sos_value_cmp(ra->lo, rb->lo);
+}
+
+static void __range_free(struct sos_filter_range_s *range)
+{
+	sos_value_put(range->lo);
+	sos_value_put(range->hi);
+	free(range);
+}
+
+/*
+ * Sort the ranges and merge the ranges that overlap
+ */
+static void __sos_filter_ranges_sort(sos_filter_t filt)
+{
+	struct sos_filter_range_s *cur, *range;
+	int i, n;
+
+	qsort(filt->ranges, filt->range_count, sizeof(*filt->ranges), __range_cmp);
+	cur = filt->ranges[0];
+	for (i = n = 1; i < filt->range_count; i++) {
+		range = filt->ranges[i];
+		if (sos_value_cmp(range->lo, cur->hi) > 0) {
+			filt->ranges[n++] = cur = range;
+			continue;
+		}
+		if (sos_value_cmp(range->hi, cur->hi) > 0) {
+			sos_value_put(cur->hi);
+			cur->hi = sos_value_copy(&cur->hi_, range->hi);
+		}
+		__range_free(range);
+	}
+	filt->range_count = n;
+	filt->range_sorted = 1;
+}
+
+/*
+ * The ranges can be scanned one after the other in index order if
+ * the filter iterates over the range attribute or over a join whose
+ * components before the range attribute are fixed by '=='
+ * conditions.
+ */
+static int __sos_filter_ranges_ordered(sos_filter_t filt)
+{
+	sos_filter_cond_t cond;
+	int i, join_idx;
+
+	if (filt->range_attr == filt->iter->attr)
+		return 1;
+	join_idx = filt->range_lo->join_idx;
+	if (join_idx < 0)
+		return 0;
+	for (i = 0; i < join_idx; i++) {
+		TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+			if (cond->join_idx == i && cond->cond == SOS_COND_EQ)
+				break;
+		}
+		if (!cond)
+			return 0;
+	}
+	return 1;
+}
+
+static void __sos_filter_range_set(sos_filter_t filt, int idx)
+{
+	filt->range_idx = idx;
+	__sos_filter_cond_value_set(filt->range_lo, filt->ranges[idx]->lo);
+	__sos_filter_cond_value_set(filt->range_hi, filt->ranges[idx]->hi);
+}
+
+/*
+ * Set up the ranges for a scan. If dir is 1 (or 0) and the ranges can
+ * be scanned in index order, the bounds are set to the first (or
+ * last) range. Otherwise the bounds are set to the lowest and highest
+ * values and objects are looked up in the range set.
+ */
+void __sos_filter_ranges_prepare(sos_filter_t filt, int dir)
+{
+	if (!filt->range_count)
+		return;
+	if (!filt->range_sorted)
+		__sos_filter_ranges_sort(filt);
+	filt->range_scan = (dir >= 0 && filt->range_count > 1
+			    && __sos_filter_ranges_ordered(filt));
+	if (filt->range_scan) {
+		__sos_filter_range_set(filt, dir ? 0 : filt->range_count - 1);
+		return;
+	}
+	__sos_filter_cond_value_set(filt->range_lo, filt->ranges[0]->lo);
+	__sos_filter_cond_value_set(filt->range_hi,
+				    filt->ranges[filt->range_count - 1]->hi);
+}
+
+/*
+ * Return !0 if v is in one of the filter's ranges. The ranges must
+ * have been prepared.
+ */
+int __sos_filter_in_ranges(sos_filter_t filt, sos_value_t v)
+{
+	int lo = 0, hi = filt->range_count - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (sos_value_cmp(v, filt->ranges[mid]->lo) < 0)
+			hi = mid - 1;
+		else if (sos_value_cmp(v, filt->ranges[mid]->hi) > 0)
+			lo = mid + 1;
+		else
+			return 1;
+	}
+	return 0;
+}
+
+/* The range set is checked per object when the ranges are not scanned in turn */
+static inline int __sos_filter_range_check(sos_filter_t filt)
+{
+	return (filt->range_count > 1 && !filt->range_scan);
+}
+
+/*
+ * A filter on a join index is covered if every condition is on a
+ * scalar component of the join key, see sos_key_join_value(). Such a
+ * filter is evaluated on the keys and objects are only dereferenced
+ * when they match.
+ */
+static int __sos_filter_covered(sos_filter_t filt)
+{
+	sos_filter_cond_t cond;
+	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+		if (cond->join_idx < 0 || sos_attr_is_array(cond->attr)
+		    || sos_attr_type(cond->attr) == SOS_TYPE_STRUCT)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Evaluate the conditions of a covered filter on the key at the
+ * iterator position. Returns ENOENT if the iterator is not
+ * positioned, otherwise sets *pcond as sos_filter_eval() would.
+ */
+static int __sos_filter_eval_key(sos_filter_t filt, sos_filter_cond_t *pcond)
 {
 	sos_filter_cond_t cond;
 	struct sos_value_s v_;
-	sos_value_t obj_value;
+	sos_value_t v;
+	sos_key_t key;
 	int rc;
+
+	key = sos_iter_key(filt->iter);
+	if (!key)
+		return ENOENT;
 	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
-		obj_value = sos_value_init(&v_, obj, cond->attr);
-		rc = cond->cmp_fn(obj_value, cond->value, &cond->ret);
-		sos_value_put(obj_value);
+		v = sos_key_join_value(&v_, filt->iter->attr, key, cond->join_idx);
+		rc = cond->cmp_fn(v, cond->value, &cond->ret);
 		if (!rc)
-			return cond;
+			goto out;
+	}
+	if (__sos_filter_range_check(filt)) {
+		v = sos_key_join_value(&v_, filt->iter->attr, key,
+				       filt->range_lo->join_idx);
+		if (!v || !__sos_filter_in_ranges(filt, v)) {
+			cond = &filt->range_miss;
+			goto out;
+		}
 	}
-	sos_key_t key = sos_iter_key(filt->iter);
 	sos_key_copy(filt->last_match, key);
+ out:
 	sos_key_put(key);
-	return NULL;
+	*pcond = cond;
+	return 0;
 }
 
 /*
- * Searches for the next object that matches all of the conditions in
- * filt->cond_list. To avoid testing every object, conditions are sorted
- * and objects that can't match are skipped by building a key and searching
- * on the index.
- *
+ * Returned by next_match() and prev_match() in place of the matching
+ * object when the filter is only returning keys. It is consumed by
+ * the sos_filter_key_*() functions and is never returned by the
+ * public sos_filter_*() functions.
+ */
+static struct sos_obj_s __key_match_obj;
+
+/*
+ * Return the object at the iterator position of a covered filter
+ */
+static sos_obj_t __sos_filter_match_obj(sos_filter_t filt)
+{
+	if (filt->key_only)
+		return &__key_match_obj;
+	return sos_iter_obj(filt->iter);
+}
+
+static sos_filter_cond_t sos_filter_eval(sos_obj_t obj, sos_filter_t filt)
+{
+	sos_filter_cond_t cond;
+	struct sos_value_s v_;
+	sos_value_t obj_value;
+	int rc;
+	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+		obj_value = sos_value_init(&v_, obj, cond->attr);
+		rc = cond->cmp_fn(obj_value, cond->value, &cond->ret);
+		sos_value_put(obj_value);
+		if (!rc)
+			return cond;
+	}
+	if (__sos_filter_range_check(filt)) {
+		obj_value = sos_value_init(&v_, obj, filt->range_attr);
+		rc = (obj_value && __sos_filter_in_ranges(filt, obj_value));
+		sos_value_put(obj_value);
+		if (!rc)
+			return &filt->range_miss;
+	}
+	sos_key_t key = sos_iter_key(filt->iter);
+	sos_key_copy(filt->last_match, key);
+	sos_key_put(key);
+	return NULL;
+}
+
+/*
+ * Return the condition on the iterator attribute that sets the
+ * tightest lower (or upper) bound on the keys that can match, or
+ * NULL if there is none. Given equal values, the strict comparator
+ * is the tighter bound.
+ */
+static sos_filter_cond_t __sos_filter_bound(sos_filter_t filt, int lower)
+{
+	sos_filter_cond_t cond, bound = NULL;
+	int rc;
+
+	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+		if (cond->attr != filt->iter->attr || cond->cond == SOS_COND_NE)
+			continue;
+		if (lower ? cond->cond < SOS_COND_EQ : cond->cond > SOS_COND_EQ)
+			continue;
+		if (!bound) {
+			bound = cond;
+			continue;
+		}
+		rc = sos_value_cmp(cond->value, bound->value);
+		if (!lower)
+			rc = -rc;
+		if (rc > 0 || (rc == 0 && (cond->cond == SOS_COND_GT
+					   || cond->cond == SOS_COND_LT)))
+			bound = cond;
+	}
+	return bound;
+}
+
+/*
+ * Position the iterator at the first key that can satisfy the lower
+ * bound. Duplicates of a '>' value are stepped over by next_match().
+ */
+static int __sos_filter_seek_lower(sos_filter_t filt, sos_filter_cond_t bound)
+{
+	SOS_KEY(key);
+
+	sos_key_set(key, sos_value_as_key(bound->value), sos_value_size(bound->value));
+	return sos_iter_sup(filt->iter, key);
+}
+
+/*
+ * Position the iterator at the last duplicate of the greatest key
+ * less than or equal to key
+ */
+static int __sos_filter_inf_last(sos_filter_t filt, sos_key_t key)
+{
+	sos_iter_flags_t flags;
+	int rc;
+
+	flags = sos_iter_flags_get(filt->iter);
+	sos_iter_flags_set(filt->iter, flags | SOS_ITER_F_INF_LAST_DUP);
+	rc = sos_iter_inf(filt->iter, key);
+	sos_iter_flags_set(filt->iter, flags);
+	return rc;
+}
+
+/*
+ * Position the iterator at the last key that can satisfy the upper
+ * bound. Duplicates of a '<' value are stepped over by prev_match().
+ */
+static int __sos_filter_seek_upper(sos_filter_t filt, sos_filter_cond_t bound)
+{
+	SOS_KEY(key);
+
+	sos_key_set(key, sos_value_as_key(bound->value), sos_value_size(bound->value));
+	return __sos_filter_inf_last(filt, key);
+}
+
+/*
+ * Searches for the next object that matches all of the conditions in
+ * filt->cond_list. To avoid testing every object, conditions are sorted
+ * and objects that can't match are skipped by building a key and searching
+ * on the index.
+ *
  * This table specifies how the key is constructed given the 1st
  * failing condition on an object.
  *
@@ -1117,6 +1965,10 @@ static sos_filter_cond_t sos_filter_eval(sos_obj_t obj, sos_filter_t filt)
  * attribute.
  *
  * seek(cond->value) means set the key to the value tested in the condition.
+ *
+ * If the iterator attribute is not a join, the seek is to the tightest
+ * lower bound of all the conditions on the attribute and the seek(max)
+ * cases end the search.
  */
 static sos_obj_t next_match(sos_filter_t filt)
 {
@@ -1132,16 +1984,26 @@ static sos_obj_t next_match(sos_filter_t filt)
 	size_t comp_len;
 	sos_filter_cond_t join_cond;
 	ods_ref_t last_ref = 0;
+	ods_ref_t cur_ref;
 
 	filt->miss_cnt = 0;
 	do {
-		obj = sos_iter_obj(filt->iter);
-		if (!obj)
-			break;
-		cond = sos_filter_eval(obj, filt);
+		if (filt->covered) {
+			obj = NULL;
+			if (__sos_filter_eval_key(filt, &cond))
+				break;
+			cur_ref = sos_iter_ref(filt->iter).ref.obj;
+		} else {
+			obj = sos_iter_obj(filt->iter);
+			if (!obj)
+				break;
+			cond = sos_filter_eval(obj, filt);
+			cur_ref = obj->obj->ref;
+		}
+		filt->visit_cnt += 1;
 		if (!cond) {
 			filt->empty = 0;
-			return obj;
+			return (obj ? obj : __sos_filter_match_obj(filt));
 		}
 		filt->miss_cnt += 1;
 		/*
@@ -1166,19 +2028,22 @@ static sos_obj_t next_match(sos_filter_t filt)
 				 * assumed about the ordering
 				 */
 				goto next;
-			if (cond->cond < SOS_COND_GE)
+			if (cond->ret > 0 || (cond->ret == 0 && cond->cond == SOS_COND_LT))
 				/*
-				 * The condition requires <=, this
-				 * attribute is the key and the
-				 * comparison failed. There can be no
-				 * more matches
+				 * This attribute is the key and the
+				 * object is past the upper bound. There
+				 * can be no more matches
 				 */
 				break;
+			if (cond->ret == 0)
+				/* A duplicate of the '>' value */
+				goto next;
 			/*
-			 * Missing optimization to skip to 1st
-			 * possibly matching key
+			 * The object is below the lower bound, skip
+			 * to the 1st possibly matching key
 			 */
-			goto next;
+			rc = __sos_filter_seek_lower(filt, __sos_filter_bound(filt, 1));
+			goto seek;
 		}
 
 		if (sos_attr_is_array(cond->attr))
@@ -1223,7 +2088,16 @@ static sos_obj_t next_match(sos_filter_t filt)
 
 		for (i = 0; i < attr_ids->count; i++) {
 			int attr_id = attr_ids->data.uint32_[i];
-			obj_value = sos_value_by_id(&v_, obj, attr_id);
+			if (obj) {
+				obj_value = sos_value_by_id(&v_, obj, attr_id);
+			} else {
+				sos_key_t entry_key = sos_iter_key(filt->iter);
+				obj_value = sos_key_join_value(&v_, filt->iter->attr,
+								entry_key, i);
+				sos_key_put(entry_key);
+			}
+			if (!obj_value)
+				goto next;
 			join_cond = __sos_find_filter_condition(filt, attr_id);
 			if (i < join_idx) {
 				if (!join_cond)
@@ -1264,18 +2138,21 @@ static sos_obj_t next_match(sos_filter_t filt)
 				key_comp = __sos_set_key_comp_to_min(key_comp, obj_value->attr, &comp_len);
 			}
 			sos_value_put(obj_value);
+			obj_value = NULL;
 			comp_key->len += comp_len;
 		}
 		rc = sos_iter_sup(filt->iter, key);
+	seek:
 		if (rc)
 			break;
-		if (last_ref == obj->obj->ref)
+		if (last_ref == cur_ref)
 			goto out;
-		last_ref = obj->obj->ref;
+		last_ref = cur_ref;
 		sos_obj_put(obj);
 		continue;
 	next:
 		sos_value_put(obj_value);
+		obj_value = NULL;
 		rc = sos_iter_next(filt->iter);
 		if (!rc)
 			sos_obj_put(obj);
@@ -1340,6 +2217,10 @@ static sos_obj_t continue_next(sos_filter_t filt)
  * attribute.
  *
  * Seek(cond->value) means set the key to the value tested in the condition.
+ *
+ * If the iterator attribute is not a join, the seek is to the tightest
+ * upper bound of all the conditions on the attribute and the seek(min)
+ * cases end the search.
  */
 static sos_obj_t prev_match(sos_filter_t filt)
 {
@@ -1355,14 +2236,24 @@ static sos_obj_t prev_match(sos_filter_t filt)
 	size_t comp_len;
 	sos_filter_cond_t join_cond;
 	ods_ref_t last_ref = 0;
+	ods_ref_t cur_ref;
 	do {
-		obj = sos_iter_obj(filt->iter);
-		if (!obj)
-			break;
-		cond = sos_filter_eval(obj, filt);
+		if (filt->covered) {
+			obj = NULL;
+			if (__sos_filter_eval_key(filt, &cond))
+				break;
+			cur_ref = sos_iter_ref(filt->iter).ref.obj;
+		} else {
+			obj = sos_iter_obj(filt->iter);
+			if (!obj)
+				break;
+			cond = sos_filter_eval(obj, filt);
+			cur_ref = obj->obj->ref;
+		}
+		filt->visit_cnt += 1;
 		if (!cond) {
 			filt->empty = 0;
-			return obj;
+			return (obj ? obj : __sos_filter_match_obj(filt));
 		}
 		/*
 		 * One or more conditions failed, determine if there
@@ -1386,15 +2277,22 @@ static sos_obj_t prev_match(sos_filter_t filt)
 				 * assumed about the ordering
 				 */
 				goto prev;
-			if (cond->cond > SOS_COND_EQ)
+			if (cond->ret < 0 || (cond->ret == 0 && cond->cond == SOS_COND_GT))
 				/*
-				 * The condition requires >=, this
-				 * attribute is the key and the
-				 * comparison failed. There can be no
-				 * more matches
+				 * This attribute is the key and the
+				 * object is below the lower bound. There
+				 * can be no more matches
 				 */
 				break;
-			goto prev;
+			if (cond->ret == 0)
+				/* A duplicate of the '<' value */
+				goto prev;
+			/*
+			 * The object is above the upper bound, skip
+			 * to the last possibly matching key
+			 */
+			rc = __sos_filter_seek_upper(filt, __sos_filter_bound(filt, 0));
+			goto seek;
 		}
 
 		if (join_idx == 0 || cond == TAILQ_FIRST(&filt->cond_list)) {
@@ -1430,7 +2328,16 @@ static sos_obj_t prev_match(sos_filter_t filt)
 
 		for (i = 0; i < attr_ids->count; i++) {
 			int attr_id = attr_ids->data.uint32_[i];
-			obj_value = sos_value_by_id(&v_, obj, attr_id);
+			if (obj) {
+				obj_value = sos_value_by_id(&v_, obj, attr_id);
+			} else {
+				sos_key_t entry_key = sos_iter_key(filt->iter);
+				obj_value = sos_key_join_value(&v_, filt->iter->attr,
+								entry_key, i);
+				sos_key_put(entry_key);
+			}
+			if (!obj_value)
+				goto prev;
 			join_cond = __sos_find_filter_condition(filt, attr_id);
 			if (i < join_idx) {
 				if (!join_cond)
@@ -1446,7 +2353,7 @@ static sos_obj_t prev_match(sos_filter_t filt)
 						goto prev;
 					break;
 				case SOS_COND_EQ:
-					if (cond->ret < 0) {
+					if (cond->ret > 0) {
 						key_comp = __sos_set_key_comp(key_comp, cond->value, &comp_len);
 					} else {
 						if (__sos_value_is_min(obj_value))
@@ -1469,18 +2376,21 @@ static sos_obj_t prev_match(sos_filter_t filt)
 				key_comp = __sos_set_key_comp_to_max(key_comp, obj_value->attr, &comp_len);
 			}
 			sos_value_put(obj_value);
+			obj_value = NULL;
 			comp_key->len += comp_len;
 		}
 		rc = sos_iter_inf(filt->iter, key);
+	seek:
 		if (rc)
 			break;
-		if (last_ref == obj->obj->ref)
+		if (last_ref == cur_ref)
 			goto out;
-		last_ref = obj->obj->ref;
+		last_ref = cur_ref;
 		sos_obj_put(obj);
 		continue;
 	prev:
 		sos_value_put(obj_value);
+		obj_value = NULL;
 		rc = sos_iter_prev(filt->iter);
 		if (!rc)
 			sos_obj_put(obj);
@@ -1531,7 +2441,6 @@ static int __sos_filter_key_set(sos_filter_t filt, sos_key_t key, int min_not_ma
 	sos_filter_cond_t cond;
 	int join_idx;
 	sos_attr_t filt_attr = sos_iter_attr(filt->iter);
-	int filt_attr_id = sos_attr_id(filt_attr);
 	int search = 0;
 	sos_array_t attr_ids = sos_attr_join_list(filt_attr);
 
@@ -1541,17 +2450,16 @@ static int __sos_filter_key_set(sos_filter_t filt, sos_key_t key, int min_not_ma
 	}
 
 	if (sos_attr_type(filt_attr) != SOS_TYPE_JOIN) {
-		/* Find the first condition that matches the filter attr */
-		cond = __sos_find_filter_condition(filt, filt_attr_id);
+		/* Use the bound set by the conditions on the filter attr */
+		cond = __sos_filter_bound(filt, min_not_max);
 		if (!cond)
 			goto out;
 		sos_key_set(key, sos_value_as_key(cond->value),
 			    sos_value_size(cond->value));
-		if (cond->cond != SOS_COND_NE && (cond->cond >= SOS_COND_EQ))
-			search = ESRCH;
+		search = ESRCH;
 	} else {
 		ods_comp_key_t comp_key;
-		ods_key_comp_t key_comp;
+		ods_key_comp_t key_comp, last_comp = NULL;
 		comp_key = (ods_comp_key_t)ods_key_value(key);
 		key_comp = comp_key->value;
 		comp_key->len = 0;
@@ -1561,7 +2469,21 @@ static int __sos_filter_key_set(sos_filter_t filt, sos_key_t key, int min_not_ma
 			/* Search the condition list for this attribute */
 			cond = __sos_find_filter_condition(filt, join_attr_id);
 
+			if (cond && sos_attr_is_array(cond->attr)
+			    && (cond->cond == SOS_COND_NE
+				|| (min_not_max ? cond->cond < SOS_COND_EQ
+				    : cond->cond > SOS_COND_EQ))) {
+				/*
+				 * The array value does not bound the keys in
+				 * this direction; stop at the prefix as for an
+				 * array without a condition below.
+				 */
+				if (!min_not_max && last_comp)
+					(void)__sos_key_comp_incr(last_comp);
+				goto out;
+			}
 			if (cond) {
+				last_comp = key_comp;
 				if (sos_attr_is_array(cond->attr)) {
 					key_comp = __sos_set_key_comp(key_comp, cond->value, &comp_len);
 				} else if (min_not_max) {
@@ -1606,13 +2528,22 @@ static int __sos_filter_key_set(sos_filter_t filt, sos_key_t key, int min_not_ma
 					goto out;
 				attr = sos_schema_attr_by_id(sos_attr_schema(filt_attr),
 							     join_attr_id);
-				if (sos_attr_is_array(attr) || sos_attr_is_ref(attr)) {
+				if (sos_attr_is_array(attr)
+				    || (sos_attr_is_ref(attr)
+					&& sos_attr_type(attr) != SOS_TYPE_STRUCT)) {
 					/* There is no condition for this key component and the
 					 * attribute has a variable length. The key order after the
 					 * previous components will be determined by length.
+					 *
+					 * The key built so far sorts before the keys it is a
+					 * prefix of. For the upper bound, use the next value
+					 * of the previous component instead.
 					 */
+					if (!min_not_max && last_comp)
+						(void)__sos_key_comp_incr(last_comp);
 					goto out;
 				}
+				last_comp = key_comp;
 				if (min_not_max) {
 					key_comp = __sos_set_key_comp_to_min(key_comp, attr, &comp_len);
 				} else {
@@ -1627,6 +2558,150 @@ static int __sos_filter_key_set(sos_filter_t filt, sos_key_t key, int min_not_ma
 	return search;
 }
 
+/*
+ * Set key to a bound on the join keys that can match the filter. The
+ * key holds the leading join components that have an equality
+ * condition. A key with fewer components sorts before any key that it
+ * is a prefix of, so this is the lower bound. The upper bound adds
+ * the maximum of each remaining component.
+ *
+ * Returns 0 if there is no such bound: the first component has no
+ * equality condition, or a remaining component has a variable length
+ * and therefore no maximum.
+ */
+static int __sos_filter_join_bound(sos_filter_t filt, sos_key_t key, int upper)
+{
+	sos_attr_t filt_attr = sos_iter_attr(filt->iter);
+	sos_array_t attr_ids = sos_attr_join_list(filt_attr);
+	ods_comp_key_t comp_key = (ods_comp_key_t)ods_key_value(key);
+	ods_key_comp_t key_comp = comp_key->value;
+	sos_filter_cond_t cond;
+	sos_attr_t attr;
+	size_t comp_len;
+	int join_idx;
+
+	comp_key->len = 0;
+	for (join_idx = 0; join_idx < attr_ids->count; join_idx++) {
+		TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+			if (sos_attr_id(cond->attr) == attr_ids->data.uint32_[join_idx]
+			    && cond->cond == SOS_COND_EQ)
+				break;
+		}
+		if (!cond)
+			break;
+		key_comp = __sos_set_key_comp(key_comp, cond->value, &comp_len);
+		comp_key->len += comp_len;
+	}
+	if (!join_idx)
+		return 0;
+	if (!upper)
+		return 1;
+	for (; join_idx < attr_ids->count; join_idx++) {
+		attr = sos_schema_attr_by_id(sos_attr_schema(filt_attr),
+					     attr_ids->data.uint32_[join_idx]);
+		if (sos_attr_is_array(attr)
+		    || (sos_attr_is_ref(attr) && sos_attr_type(attr) != SOS_TYPE_STRUCT)
+		    || sos_attr_type(attr) == SOS_TYPE_LONG_DOUBLE)
+			return 0;
+		key_comp = __sos_set_key_comp_to_max(key_comp, attr, &comp_len);
+		comp_key->len += comp_len;
+	}
+	return 1;
+}
+
+/*
+ * Let the iterator skip the partitions whose zone map does not
+ * intersect the key range of the filter conditions. Only exact bounds
+ * are used; the keys that position the iterator may be prefixes that
+ * sort before matching keys.
+ */
+static void __sos_filter_key_range(sos_filter_t filt)
+{
+	sos_filter_cond_t cond;
+	SOS_KEY(lo);
+	SOS_KEY(hi);
+	int has_lo = 0, has_hi = 0;
+
+	if (__sos_iter_slots_refresh(filt->iter, 0) || !filt->iter->slot_count)
+		return;
+	if (sos_attr_type(sos_iter_attr(filt->iter)) != SOS_TYPE_JOIN) {
+		cond = __sos_filter_bound(filt, 1);
+		if (cond) {
+			sos_key_set(lo, sos_value_as_key(cond->value),
+				    sos_value_size(cond->value));
+			has_lo = 1;
+		}
+		cond = __sos_filter_bound(filt, 0);
+		if (cond) {
+			sos_key_set(hi, sos_value_as_key(cond->value),
+				    sos_value_size(cond->value));
+			has_hi = 1;
+		}
+	} else {
+		has_lo = __sos_filter_join_bound(filt, lo, 0);
+		has_hi = has_lo && __sos_filter_join_bound(filt, hi, 1);
+	}
+	sos_iter_key_range_set(filt->iter, has_lo ? lo : NULL, has_hi ? hi : NULL);
+}
+
+/*
+ * Position the iterator at the first key that can match the filter
+ */
+static int __sos_filter_seek_begin(sos_filter_t filt)
+{
+	sos_filter_cond_t bound;
+	int rc;
+	SOS_KEY(key);
+
+	__sort_filter_conds_fwd(filt);
+	__sos_filter_key_range(filt);
+	if (sos_attr_type(sos_iter_attr(filt->iter)) != SOS_TYPE_JOIN) {
+		bound = __sos_filter_bound(filt, 1);
+		if (bound)
+			return __sos_filter_seek_lower(filt, bound);
+		return sos_iter_begin(filt->iter);
+	}
+	rc = __sos_filter_key_set(filt, key, 1, 0);
+	switch (rc) {
+	case 0:
+		rc = sos_iter_begin(filt->iter);
+		break;
+	default:
+		rc = sos_iter_sup(filt->iter, key);
+		break;
+	}
+	return rc;
+}
+
+/*
+ * Position the iterator at the last key that can match the filter
+ */
+static int __sos_filter_seek_end(sos_filter_t filt)
+{
+	sos_filter_cond_t bound;
+	int rc;
+	SOS_KEY(key);
+
+	__sort_filter_conds_bkwd(filt);
+	__sos_filter_key_range(filt);
+	if (sos_attr_type(sos_iter_attr(filt->iter)) != SOS_TYPE_JOIN) {
+		bound = __sos_filter_bound(filt, 0);
+		if (bound)
+			return __sos_filter_seek_upper(filt, bound);
+		return sos_iter_end(filt->iter);
+	}
+	rc = __sos_filter_key_set(filt, key, 0, 0);
+	switch (rc) {
+	case 0:
+		rc = sos_iter_end(filt->iter);
+		break;
+	default:
+		rc = __sos_filter_inf_last(filt, key);
+		break;
+	}
+	return rc;
+}
+
 /**
  * \brief Return the miss-compare count
  *
@@ -1642,6 +2717,112 @@ int sos_filter_miss_count(sos_filter_t filt)
 }
 
 
+/*
+ * If the current range is exhausted, scan the following ranges until
+ * one of them has a match
+ */
+static sos_obj_t __sos_filter_next_range(sos_filter_t filt, sos_obj_t obj)
+{
+	while (!obj && filt->range_scan
+	       && filt->range_idx + 1 < filt->range_count) {
+		__sos_filter_range_set(filt, filt->range_idx + 1);
+		if (__sos_filter_seek_begin(filt))
+			break;
+		obj = next_match(filt);
+	}
+	return obj;
+}
+
+static sos_obj_t __sos_filter_prev_range(sos_filter_t filt, sos_obj_t obj)
+{
+	while (!obj && filt->range_scan && filt->range_idx > 0) {
+		__sos_filter_range_set(filt, filt->range_idx - 1);
+		if (__sos_filter_seek_end(filt))
+			break;
+		obj = prev_match(filt);
+	}
+	return obj;
+}
+
+/* Count a match against the limit set with sos_filter_limit_set() */
+static inline sos_obj_t __sos_filter_count(sos_filter_t filt, sos_obj_t obj)
+{
+	if (obj)
+		filt->match_cnt += 1;
+	return obj;
+}
+
+static inline int __sos_filter_limited(sos_filter_t filt)
+{
+	return (filt->limit && filt->match_cnt >= filt->limit);
+}
+
+/*
+ * The positioning functions behind sos_filter_begin() and friends.
+ * If filt->key_only is set they return __key_match_obj in place of
+ * the matching object; only the sos_filter_key_*() functions set it.
+ */
+static sos_obj_t __sos_filter_begin(sos_filter_t filt)
+{
+	sos_obj_t obj = NULL;
+
+	filt->batch_end = 0;
+	filt->visit_cnt = 0;
+	filt->match_cnt = 0;
+	__sos_filter_ranges_prepare(filt, 1);
+	if (!__sos_filter_seek_begin(filt))
+		obj = next_match(filt);
+	return __sos_filter_count(filt, __sos_filter_next_range(filt, obj));
+}
+
+static sos_obj_t __sos_filter_next(sos_filter_t filt)
+{
+	sos_obj_t obj = NULL;
+
+	if (filt->batch_end) {
+		filt->batch_end = 0;
+		filt->empty = 1;
+		return __sos_filter_count(filt, __sos_filter_next_range(filt, NULL));
+	}
+	if (__sos_filter_limited(filt))
+		return NULL;
+	if (filt->empty)
+		obj = continue_next(filt);
+	else if (0 == sos_iter_next(filt->iter))
+		obj = next_match(filt);
+	else
+		filt->empty = 1;
+	return __sos_filter_count(filt, __sos_filter_next_range(filt, obj));
+}
+
+static sos_obj_t __sos_filter_prev(sos_filter_t filt)
+{
+	sos_obj_t obj = NULL;
+
+	if (__sos_filter_limited(filt))
+		return NULL;
+	if (filt->empty)
+		obj = continue_prev(filt);
+	else if (0 == sos_iter_prev(filt->iter))
+		obj = prev_match(filt);
+	else
+		filt->empty = 1;
+	return __sos_filter_count(filt, __sos_filter_prev_range(filt, obj));
+}
+
+static sos_obj_t __sos_filter_end(sos_filter_t filt)
+{
+	sos_obj_t obj = NULL;
+
+	filt->batch_end = 0;
+	filt->visit_cnt = 0;
+	filt->match_cnt = 0;
+	__sos_filter_ranges_prepare(filt, 0);
+	if (!__sos_filter_seek_end(filt))
+		obj = prev_match(filt);
+	return __sos_filter_count(filt, __sos_filter_prev_range(filt, obj));
+}
+
 /**
  * \brief Return the first matching object.
  *
@@ -1651,22 +2832,7 @@ int sos_filter_miss_count(sos_filter_t filt)
  */
 sos_obj_t sos_filter_begin(sos_filter_t filt)
 {
-	int rc;
-	SOS_KEY(key);
-
-	__sort_filter_conds_fwd(filt);
-	rc = __sos_filter_key_set(filt, key, 1, 0);
-	switch (rc) {
-	case 0:
-		rc = sos_iter_begin(filt->iter);
-		break;
-	default:
-		rc = sos_iter_sup(filt->iter, key);
-		break;
-	}
-	if (!rc)
-		return next_match(filt);
-	return NULL;
+	return __sos_filter_begin(filt);
 }
 
 /**
@@ -1678,12 +2844,388 @@ sos_obj_t sos_filter_begin(sos_filter_t filt)
  */
 sos_obj_t sos_filter_next(sos_filter_t filt)
 {
-	if (filt->empty)
-		return continue_next(filt);
-	if (0 == sos_iter_next(filt->iter))
-		return next_match(filt);
-	filt->empty = 1;
-	return NULL;
+	return __sos_filter_next(filt);
+}
+
+/*
+ * Evaluate a condition over a batch one object at a time. This is
+ * used for attribute types that don't have a compare kernel.
+ */
+static void __sos_filter_eval_scalar(sos_obj_t *objs, int count,
+				     sos_attr_t attr, sos_filter_fn_t cmp_fn,
+				     sos_value_t cond_value, uint8_t *sel)
+{
+	struct sos_value_s v_;
+	sos_value_t obj_value;
+	int i, ret;
+
+	for (i = 0; i < count; i++) {
+		if (!sel[i])
+			continue;
+		obj_value = sos_value_init(&v_, objs[i], attr);
+		if (!obj_value) {
+			sel[i] = 0;
+			continue;
+		}
+		sel[i] = cmp_fn(obj_value, cond_value, &ret);
+		sos_value_put(obj_value);
+	}
+}
+
+/*
+ * Evaluate all conditions over the batch. On return, sel[i] is
+ * non-zero if objs[i] matches. The return value is the number of
+ * objects that precede the first object past the upper bound of a
+ * condition on the iterator attribute; no object at or after that
+ * position in the index can match.
+ */
+static int __sos_filter_eval_batch(sos_filter_t filt, sos_obj_t *objs,
+				   int count, uint8_t *sel)
+{
+	uint8_t within[SOS_FILTER_BATCH];
+	struct sos_value_s v_;
+	sos_value_t v;
+	sos_filter_cond_t cond;
+	sos_filter_kern_t bound_fn;
+	enum sos_cond_e bound;
+	size_t offset;
+	int i, bounded = 0;
+
+	memset(sel, 1, count);
+	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+		offset = cond->attr->data->offset;
+		if (cond->kern_fn)
+			cond->kern_fn(objs, count, offset, cond->value->data, sel);
+		else
+			__sos_filter_eval_scalar(objs, count, cond->attr,
+						 cond->cmp_fn, cond->value, sel);
+		if (cond->attr != filt->iter->attr || cond->cond > SOS_COND_EQ)
+			continue;
+		/*
+		 * The index is ordered on this attribute, the first
+		 * object above the bound ends the scan.
+		 */
+		if (!bounded) {
+			memset(within, 1, count);
+			bounded = 1;
+		}
+		bound = (cond->cond == SOS_COND_LT ? SOS_COND_LT : SOS_COND_LE);
+		bound_fn = __sos_filter_kern(cond->attr, bound);
+		if (bound_fn)
+			bound_fn(objs, count, offset, cond->value->data, within);
+		else
+			__sos_filter_eval_scalar(objs, count, cond->attr,
+						 fn_table[bound], cond->value, within);
+	}
+	if (__sos_filter_range_check(filt)) {
+		for (i = 0; i < count; i++) {
+			if (!sel[i])
+				continue;
+			v = sos_value_init(&v_, objs[i], filt->range_attr);
+			sel[i] = (v && __sos_filter_in_ranges(filt, v));
+			sos_value_put(v);
+		}
+	}
+	if (!bounded)
+		return count;
+	for (i = 0; i < count && within[i]; i++);
+	return i;
+}
+
+/*
+ * Fill objs with up to count matching objects starting at the
+ * current iterator position. The index entries are resolved in
+ * batches no larger than the space remaining in objs so that the
+ * iterator is never left past an object that was evaluated but not
+ * returned.
+ */
+static int __sos_filter_fill(sos_filter_t filt, sos_obj_t *objs, int count)
+{
+	sos_obj_t batch[SOS_FILTER_BATCH];
+	uint8_t sel[SOS_FILTER_BATCH];
+	struct sos_value_s v_;
+	sos_value_t v;
+	sos_obj_t last = NULL;
+	int i, m, max, valid, done = 0, n = 0;
+
+	filt->miss_cnt = 0;
+	while (n < count && !done) {
+		max = count - n;
+		if (max > SOS_FILTER_BATCH)
+			max = SOS_FILTER_BATCH;
+		for (m = 0; m < max; ) {
+			batch[m] = sos_iter_obj(filt->iter);
+			if (!batch[m]) {
+				done = 1;
+				break;
+			}
+			m++;
+			if (m == max)
+				break;
+			if (sos_iter_next(filt->iter)) {
+				done = 1;
+				break;
+			}
+		}
+		filt->visit_cnt += m;
+		valid = __sos_filter_eval_batch(filt, batch, m, sel);
+		if (valid < m)
+			done = 1;
+		for (i = 0; i < m; i++) {
+			if (i < valid && sel[i]) {
+				objs[n++] = last = batch[i];
+				continue;
+			}
+			if (i < valid)
+				filt->miss_cnt += 1;
+			sos_obj_put(batch[i]);
+		}
+		if (!done && n < count && sos_iter_next(filt->iter))
+			done = 1;
+	}
+	if (last) {
+		/* The iterator attribute is not a join, its value is the key */
+		v = sos_value_init(&v_, last, filt->iter->attr);
+		sos_key_set(filt->last_match, sos_value_as_key(v), sos_value_size(v));
+		sos_value_put(v);
+	}
+	/*
+	 * If objects were returned, the end is reported on the next
+	 * call as it would be by sos_filter_next()
+	 */
+	filt->batch_end = (done && n);
+	filt->empty = (done && !n);
+	return n;
+}
+
+/*
+ * Fill objs from the ranges following the current range once it is
+ * exhausted
+ */
+static int __sos_filter_fill_ranges(sos_filter_t filt, sos_obj_t *objs, int count)
+{
+	int n = 0;
+	while (!n && filt->range_scan
+	       && filt->range_idx + 1 < filt->range_count) {
+		__sos_filter_range_set(filt, filt->range_idx + 1);
+		filt->batch_end = 0;
+		if (__sos_filter_seek_begin(filt))
+			break;
+		n = __sos_filter_fill(filt, objs, count);
+	}
+	return n;
+}
+
+/*
+ * Indices on a join attribute are searched by next_match(), which
+ * can skip past ranges of the index that cannot match. The batch
+ * functions defer to it for these iterators.
+ */
+static int __sos_filter_fill_scalar(sos_filter_t filt, sos_obj_t obj,
+				    sos_obj_t *objs, int count)
+{
+	int n = 0;
+	while (obj) {
+		objs[n++] = obj;
+		if (n == count)
+			break;
+		obj = sos_filter_next(filt);
+	}
+	return n;
+}
+
+/**
+ * \brief Return a batch of matching objects starting at the first
+ *
+ * This is equivalent to calling sos_filter_begin() followed by
+ * sos_filter_next() until count objects have been returned, but the
+ * filter conditions are evaluated over a batch of index entries at a
+ * time. Each object returned in objs must be released with
+ * sos_obj_put().
+ *
+ * After this call, sos_filter_next() and sos_filter_batch_next()
+ * continue after the last object returned.
+ *
+ * \param filt  The filter handle.
+ * \param objs  An array of at least count object handles.
+ * \param count The maximum number of objects to return.
+ * \returns The number of objects returned in objs; 0 if no objects match.
+ */
+int sos_filter_batch_begin(sos_filter_t filt, sos_obj_t *objs, int count)
+{
+	int rc, n;
+
+	if (count <= 0)
+		return 0;
+	if (filt->limit && count > filt->limit)
+		count = filt->limit;
+	if (sos_attr_type(sos_iter_attr(filt->iter)) == SOS_TYPE_JOIN)
+		return __sos_filter_fill_scalar(filt, sos_filter_begin(filt),
+						objs, count);
+	__sos_filter_ranges_prepare(filt, 1);
+	rc = __sos_filter_seek_begin(filt);
+	filt->batch_end = 0;
+	filt->visit_cnt = 0;
+	filt->match_cnt = 0;
+	if (rc) {
+		filt->empty = 1;
+		return 0;
+	}
+	n = __sos_filter_fill(filt, objs, count);
+	if (!n)
+		n = __sos_filter_fill_ranges(filt, objs, count);
+	filt->match_cnt = n;
+	return n;
+}
+
+/**
+ * \brief Return the next batch of matching objects
+ *
+ * Returns up to count objects following the last object returned by
+ * the filter. See sos_filter_batch_begin().
+ *
+ * \param filt  The filter handle.
+ * \param objs  An array of at least count object handles.
+ * \param count The maximum number of objects to return.
+ * \returns The number of objects returned in objs; 0 if there are no more matches.
+ */
+int sos_filter_batch_next(sos_filter_t filt, sos_obj_t *objs, int count)
+{
+	int rc, n;
+	SOS_KEY(key);
+
+	if (count <= 0)
+		return 0;
+	if (filt->limit) {
+		if (filt->match_cnt >= filt->limit)
+			return 0;
+		if (count > filt->limit - filt->match_cnt)
+			count = filt->limit - filt->match_cnt;
+	}
+	if (sos_attr_type(sos_iter_attr(filt->iter)) == SOS_TYPE_JOIN)
+		return __sos_filter_fill_scalar(filt, sos_filter_next(filt),
+						objs, count);
+	if (filt->batch_end) {
+		filt->batch_end = 0;
+		filt->empty = 1;
+		n = __sos_filter_fill_ranges(filt, objs, count);
+		goto out;
+	}
+	if (filt->empty) {
+		__sort_filter_conds_fwd(filt);
+		__sos_filter_key_set(filt, key, 1, 1);
+		rc = sos_iter_sup(filt->iter, key);
+		if (rc)
+			return 0;
+	}
+	/* Skip the last object evaluated */
+	if (sos_iter_next(filt->iter)) {
+		filt->empty = 1;
+		return 0;
+	}
+	n = __sos_filter_fill(filt, objs, count);
+	if (!n)
+		n = __sos_filter_fill_ranges(filt, objs, count);
+ out:
+	filt->match_cnt += n;
+	return n;
+}
+
+/*
+ * Return the references of the index entries whose keys satisfy the
+ * conditions on the iterator attribute. Only the keys are compared;
+ * the objects are not dereferenced and conditions on other attributes
+ * are ignored. The references are returned in index order in an
+ * array that the caller must free.
+ */
+int __sos_filter_refs(sos_filter_t filt, sos_obj_ref_t **prefs, size_t *pcount)
+{
+	sos_filter_cond_t cond;
+	sos_obj_ref_t *refs = NULL, *new_refs;
+	size_t count = 0, size = 0;
+	sos_key_t *keys;
+	int i, ncond, rc, match;
+	int64_t c;
+
+	if (sos_attr_type(sos_iter_attr(filt->iter)) == SOS_TYPE_JOIN)
+		return EINVAL;
+	ncond = 0;
+	TAILQ_FOREACH(cond, &filt->cond_list, entry)
+		ncond++;
+	keys = calloc(ncond + 1, sizeof(*keys));
+	if (!keys)
+		return ENOMEM;
+	i = 0;
+	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+		if (cond->attr == filt->iter->attr) {
+			keys[i] = sos_key_new(sos_value_size(cond->value));
+			if (!keys[i]) {
+				rc = ENOMEM;
+				goto out;
+			}
+			sos_key_set(keys[i], sos_value_as_key(cond->value),
+				    sos_value_size(cond->value));
+		}
+		i++;
+	}
+	for (rc = __sos_filter_seek_begin(filt); !rc; rc = sos_iter_next(filt->iter)) {
+		match = 1;
+		i = 0;
+		TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+			if (!keys[i++])
+				continue;
+			c = sos_iter_key_cmp(filt->iter, keys[i - 1]);
+			switch (cond->cond) {
+			case SOS_COND_LT:
+				if (c >= 0)
+					goto done;
+				break;
+			case SOS_COND_LE:
+				if (c > 0)
+					goto done;
+				break;
+			case SOS_COND_EQ:
+				if (c > 0)
+					goto done;
+				match = match && (c == 0);
+				break;
+			case SOS_COND_NE:
+				match = match && (c != 0);
+				break;
+			case SOS_COND_GE:
+				match = match && (c >= 0);
+				break;
+			case SOS_COND_GT:
+				match = match && (c > 0);
+				break;
+			}
+		}
+		filt->visit_cnt += 1;
+		if (!match)
+			continue;
+		if (count == size) {
+			size = size ? size * 2 : 1024;
+			new_refs = realloc(refs, size * sizeof(*refs));
+			if (!new_refs) {
+				rc = ENOMEM;
+				goto out;
+			}
+			refs = new_refs;
+		}
+		refs[count++] = sos_iter_ref(filt->iter);
+	}
+ done:
+	rc = 0;
+	*prefs = refs;
+	*pcount = count;
+	refs = NULL;
+ out:
+	for (i = 0; i < ncond; i++)
+		if (keys[i])
+			sos_key_put(keys[i]);
+	free(keys);
+	free(refs);
+	return rc;
 }
 
 int sos_filter_pos_set(sos_filter_t filt, const sos_pos_t pos)
@@ -1703,32 +3245,147 @@ int sos_filter_pos_put(sos_filter_t filt, sos_pos_t pos)
 
 sos_obj_t sos_filter_prev(sos_filter_t filt)
 {
-	if (filt->empty)
-		return continue_prev(filt);
-	if (0 == sos_iter_prev(filt->iter));
-		return prev_match(filt);
-	filt->empty = 1;
-	return NULL;
+	return __sos_filter_prev(filt);
 }
 
 sos_obj_t sos_filter_end(sos_filter_t filt)
 {
-	int rc;
-	SOS_KEY(key);
+	return __sos_filter_end(filt);
+}
 
-	__sort_filter_conds_bkwd(filt);
-	rc = __sos_filter_key_set(filt, key, 0, 0);
-	switch (rc) {
-	case 0:
-		rc = sos_iter_end(filt->iter);
-		break;
-	default:
-		rc = sos_iter_inf(filt->iter, key);
-		break;
-	}
-	if (!rc)
-		return prev_match(filt);
-	return NULL;
+/**
+ * \brief Limit the number of matches returned by the filter
+ *
+ * After limit objects have been returned following sos_filter_begin(),
+ * sos_filter_end() or sos_filter_batch_begin(), sos_filter_next(),
+ * sos_filter_prev() and sos_filter_batch_next() return no more
+ * objects without visiting the index. A scan that only needs the
+ * first few entries in index order therefore stops as soon as they
+ * are found.
+ *
+ * \param filt The filter handle
+ * \param limit The maximum number of matches, 0 for no limit
+ */
+void sos_filter_limit_set(sos_filter_t filt, size_t limit)
+{
+	filt->limit = limit;
+}
+
+/**
+ * \brief Return the limit set with sos_filter_limit_set()
+ *
+ * \param filt The filter handle
+ * \returns The maximum number of matches, 0 if there is no limit
+ */
+size_t sos_filter_limit_get(sos_filter_t filt)
+{
+	return filt->limit;
+}
+
+/**
+ * \brief Test if the filter is evaluated on the index keys
+ *
+ * A filter on a join attribute is covered if all of its conditions
+ * are on components of the join key. The conditions of a covered
+ * filter are evaluated on the keys, and sos_filter_key_begin() and
+ * friends do not dereference any objects.
+ *
+ * \param filt The filter handle
+ * \retval !0 The filter is covered
+ * \retval 0 The filter is not covered
+ */
+int sos_filter_is_covered(sos_filter_t filt)
+{
+	return filt->covered;
+}
+
+static sos_key_t __sos_filter_match_key(sos_filter_t filt, sos_obj_t obj)
+{
+	if (!obj)
+		return NULL;
+	if (obj != &__key_match_obj)
+		sos_obj_put(obj);
+	return sos_iter_key(filt->iter);
+}
+
+/**
+ * \brief Return the index key of the first matching entry
+ *
+ * This is the same as sos_filter_begin() but returns the index key of
+ * the matching entry instead of the object. If the filter iterates a
+ * join index and all of the conditions are on components of the join
+ * key, the objects are not dereferenced at all. The component values
+ * can be retrieved with sos_key_split().
+ *
+ * \param filt The filter handle.
+ * \retval !NULL The key, release it with sos_key_put()
+ * \retval NULL  No entry matched all of the filter conditions.
+ */
+sos_key_t sos_filter_key_begin(sos_filter_t filt)
+{
+	sos_obj_t obj;
+
+	filt->key_only = 1;
+	obj = __sos_filter_begin(filt);
+	filt->key_only = 0;
+	return __sos_filter_match_key(filt, obj);
+}
+
+/**
+ * \brief Return the index key of the next matching entry
+ *
+ * See sos_filter_key_begin().
+ *
+ * \param filt The filter handle.
+ * \retval !NULL The key, release it with sos_key_put()
+ * \retval NULL  There are no more matching entries.
+ */
+sos_key_t sos_filter_key_next(sos_filter_t filt)
+{
+	sos_obj_t obj;
+
+	filt->key_only = 1;
+	obj = __sos_filter_next(filt);
+	filt->key_only = 0;
+	return __sos_filter_match_key(filt, obj);
+}
+
+/**
+ * \brief Return the index key of the previous matching entry
+ *
+ * See sos_filter_key_begin().
+ *
+ * \param filt The filter handle.
+ * \retval !NULL The key, release it with sos_key_put()
+ * \retval NULL  There are no more matching entries.
+ */
+sos_key_t sos_filter_key_prev(sos_filter_t filt)
+{
+	sos_obj_t obj;
+
+	filt->key_only = 1;
+	obj = __sos_filter_prev(filt);
+	filt->key_only = 0;
+	return __sos_filter_match_key(filt, obj);
+}
+
+/**
+ * \brief Return the index key of the last matching entry
+ *
+ * See sos_filter_key_begin().
+ *
+ * \param filt The filter handle.
+ * \retval !NULL The key, release it with sos_key_put()
+ * \retval NULL  No entry matched all of the filter conditions.
+ */
+sos_key_t sos_filter_key_end(sos_filter_t filt)
+{
+	sos_obj_t obj;
+
+	filt->key_only = 1;
+	obj = __sos_filter_end(filt);
+	filt->key_only = 0;
+	return __sos_filter_match_key(filt, obj);
 }
 
 sos_obj_t sos_filter_obj(sos_filter_t filt)
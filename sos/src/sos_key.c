@@ -107,6 +107,15 @@ int sos_key_copy(sos_key_t dst, sos_key_t src)
 	return sos_key_set(dst, sos_key_value(src), sos_key_len(src));
 }
 
+/* Return a memory key with the value of key */
+sos_key_t __sos_key_dup(sos_key_t key)
+{
+	sos_key_t dup = sos_key_new(sos_key_len(key));
+	if (dup)
+		sos_key_copy(dup, key);
+	return dup;
+}
+
 /**
  * \brief Create a memory key
  *
@@ -298,7 +307,7 @@ sos_key_t sos_key_for_attr(sos_key_t key, sos_attr_t attr, ...)
  */
 sos_key_t sos_attr_key_new(sos_attr_t attr, size_t size)
 {
-	sos_index_t index = sos_attr_index(attr);
+	sos_index_t index = __sos_attr_index(attr);
 	if (!index)
 		return NULL;
 	return sos_index_key_new(index, size);
@@ -316,7 +325,7 @@ sos_key_t sos_attr_key_new(sos_attr_t attr, size_t size)
  */
 int sos_attr_key_from_str(sos_attr_t attr, sos_key_t key, const char *str)
 {
-	sos_index_t index = sos_attr_index(attr);
+	sos_index_t index = __sos_attr_index(attr);
 	if (!index)
 		return -1;
 	return sos_index_key_from_str(index, key, str);
@@ -331,7 +340,7 @@ int sos_attr_key_from_str(sos_attr_t attr, sos_key_t key, const char *str)
  */
 const char *sos_attr_key_to_str(sos_attr_t attr, sos_key_t key)
 {
-	sos_index_t index = sos_attr_index(attr);
+	sos_index_t index = __sos_attr_index(attr);
 	if (!index)
 		return NULL;
 	return sos_index_key_to_str(index, key);
@@ -349,7 +358,7 @@ const char *sos_attr_key_to_str(sos_attr_t attr, sos_key_t key)
  */
 int sos_attr_key_cmp(sos_attr_t attr, sos_key_t a, sos_key_t b)
 {
-	sos_index_t index = sos_attr_index(attr);
+	sos_index_t index = __sos_attr_index(attr);
 	if (!index)
 		return 0;
 	return sos_index_key_cmp(index, a, b);
@@ -384,7 +393,7 @@ size_t sos_attr_key_size(sos_attr_t attr)
 		}
 		return size;
 	default:
-		index = sos_attr_index(attr);
+		index = __sos_attr_index(attr);
 		if (index)
 			return sos_index_key_size(index);
 		return sos_attr_size(attr);
@@ -540,6 +549,20 @@ ods_key_comp_t __sos_next_key_comp(ods_key_comp_t comp)
 	return (ods_key_comp_t)&((char *)comp)[koff];
 }
 
+/*
+ * Struct components compare as bytes, so the minimum and maximum are
+ * all 0x00 and all 0xff respectively
+ */
+static int __struct_is_all(sos_value_t v, unsigned char b)
+{
+	size_t i, sz = sos_value_size(v);
+	for (i = 0; i < sz; i++) {
+		if (v->data->prim.struc_[i] != b)
+			return 0;
+	}
+	return 1;
+}
+
 int __sos_value_is_min(sos_value_t v)
 {
 	switch (sos_value_type(v)) {
@@ -563,6 +586,8 @@ int __sos_value_is_min(sos_value_t v)
 		return (v->data->prim.int16_ == SHRT_MIN);
 	case SOS_TYPE_UINT16:
 		return (v->data->prim.uint16_ == 0);
+	case SOS_TYPE_STRUCT:
+		return __struct_is_all(v, 0);
 	case SOS_TYPE_LONG_DOUBLE:
 		sos_error("Unsupported type in sos_key_join\n");
 		break;
@@ -614,6 +639,11 @@ ods_key_comp_t __sos_set_key_comp_to_min(ods_key_comp_t comp, sos_attr_t a, size
 		comp->value.uint16_ = 0;
 		*comp_len = sizeof(uint16_t) + sizeof(uint16_t);
 		break;
+	case SOS_TYPE_STRUCT:
+		comp->value.str.len = sos_attr_size(a);
+		memset(comp->value.str.str, 0, comp->value.str.len);
+		*comp_len = comp->value.str.len + sizeof(comp->value.str.len) + sizeof(uint16_t);
+		break;
 	case SOS_TYPE_LONG_DOUBLE:
 		sos_error("Unsupported type in sos_key_join\n");
 		break;
@@ -647,6 +677,8 @@ int __sos_value_is_max(sos_value_t v)
 		return (v->data->prim.int16_ == SHRT_MAX);
 	case SOS_TYPE_UINT16:
 		return (v->data->prim.uint16_ == USHRT_MAX);
+	case SOS_TYPE_STRUCT:
+		return __struct_is_all(v, 0xff);
 	case SOS_TYPE_LONG_DOUBLE:
 		sos_error("Unsupported type in sos_key_join\n");
 		break;
@@ -698,6 +730,11 @@ ods_key_comp_t __sos_set_key_comp_to_max(ods_key_comp_t comp, sos_attr_t a, size
 		comp->value.uint16_ = USHRT_MAX;
 		*comp_len = sizeof(uint16_t) + sizeof(uint16_t);
 		break;
+	case SOS_TYPE_STRUCT:
+		comp->value.str.len = sos_attr_size(a);
+		memset(comp->value.str.str, 0xff, comp->value.str.len);
+		*comp_len = comp->value.str.len + sizeof(comp->value.str.len) + sizeof(uint16_t);
+		break;
 	case SOS_TYPE_LONG_DOUBLE:
 		sos_error("Unsupported type in sos_key_join\n");
 		break;
@@ -708,6 +745,59 @@ ods_key_comp_t __sos_set_key_comp_to_max(ods_key_comp_t comp, sos_attr_t a, size
 	return __sos_next_key_comp(comp);
 }
 
+/*
+ * Replace the value of comp with the next larger value of its type.
+ * Returns ERANGE if comp holds the maximum value, or if its type has
+ * no next value of the same size.
+ */
+int __sos_key_comp_incr(ods_key_comp_t comp)
+{
+	switch (comp->type) {
+	case SOS_TYPE_TIMESTAMP:
+		if (comp->value.tv_.tv_usec < UINT_MAX) {
+			comp->value.tv_.tv_usec++;
+			return 0;
+		}
+		if (comp->value.tv_.tv_sec == UINT_MAX)
+			return ERANGE;
+		comp->value.tv_.tv_sec++;
+		comp->value.tv_.tv_usec = 0;
+		return 0;
+	case SOS_TYPE_UINT64:
+		if (comp->value.uint64_ == ULONG_MAX)
+			return ERANGE;
+		comp->value.uint64_++;
+		return 0;
+	case SOS_TYPE_INT64:
+		if (comp->value.int64_ == LONG_MAX)
+			return ERANGE;
+		comp->value.int64_++;
+		return 0;
+	case SOS_TYPE_UINT32:
+		if (comp->value.uint32_ == UINT_MAX)
+			return ERANGE;
+		comp->value.uint32_++;
+		return 0;
+	case SOS_TYPE_INT32:
+		if (comp->value.int32_ == INT_MAX)
+			return ERANGE;
+		comp->value.int32_++;
+		return 0;
+	case SOS_TYPE_UINT16:
+		if (comp->value.uint16_ == USHRT_MAX)
+			return ERANGE;
+		comp->value.uint16_++;
+		return 0;
+	case SOS_TYPE_INT16:
+		if (comp->value.int16_ == SHRT_MAX)
+			return ERANGE;
+		comp->value.int16_++;
+		return 0;
+	default:
+		return ERANGE;
+	}
+}
+
 ods_key_comp_t __sos_set_key_comp(ods_key_comp_t comp, sos_value_t v, size_t *comp_len)
 {
 	size_t sz;
@@ -1011,6 +1101,50 @@ int sos_key_split(sos_key_t key, sos_attr_t join_attr, ...)
 	return 0;
 }
 
+/**
+ * \brief Get the value of a join key component
+ *
+ * Initializes a value with a component of a join attribute's key
+ * without accessing the object. The value does not need to be
+ * released with sos_value_put().
+ *
+ * \param v The value to initialize
+ * \param join_attr The SOS_TYPE_JOIN attribute whose index the key is from
+ * \param key The join key
+ * \param join_idx The position of the component in the join
+ * \retval v The component value
+ * \retval NULL join_idx is invalid or the component is an array or
+ *	a struct
+ */
+sos_value_t sos_key_join_value(sos_value_t v, sos_attr_t join_attr,
+			       sos_key_t key, int join_idx)
+{
+	sos_array_t attr_ids = sos_attr_join_list(join_attr);
+	ods_comp_key_t comp_key = (ods_comp_key_t)ods_key_value(key);
+	ods_key_comp_t comp = comp_key->value;
+	sos_attr_t attr;
+	int i;
+
+	if (!attr_ids || join_idx < 0 || join_idx >= attr_ids->count)
+		return NULL;
+	attr = sos_schema_attr_by_id(sos_attr_schema(join_attr),
+				     attr_ids->data.uint32_[join_idx]);
+	/*
+	 * Array and struct components are stored as a length and bytes,
+	 * and a struct may not fit in v->data_
+	 */
+	if (!attr || sos_attr_is_array(attr)
+	    || sos_attr_type(attr) == SOS_TYPE_STRUCT)
+		return NULL;
+	for (i = 0; i < join_idx; i++)
+		comp = __sos_next_key_comp(comp);
+	v->obj = NULL;
+	v->attr = attr;
+	v->data = &v->data_;
+	memcpy(&v->data_, &comp->value, sos_attr_size(attr));
+	return v;
+}
+
 /**
  * \brief Set the value of a compnent key
  *
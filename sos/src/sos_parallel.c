@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \page parallel Parallel Filters
+ *
+ * sos_filter_parallel() runs a filter on a pool of threads. The key
+ * space of the index the filter iterates is cut into ranges at keys
+ * taken from the index's internal nodes (see ods_idx_split()), so no
+ * entries are read to choose them. Each range is scanned by a copy of
+ * the filter with the range bounds added as conditions and the ranges
+ * are handed out to the threads in key order.
+ *
+ * The matching objects are passed to a callback on the calling
+ * thread. Because the ranges are disjoint and ordered, the ordered
+ * output is the concatenation of the outputs of the ranges and the
+ * objects are delivered in the same order as sos_filter_begin() and
+ * sos_filter_next() would return them. With
+ * SOS_FILTER_PARALLEL_UNORDERED the objects of any range are
+ * delivered as soon as they are found.
+ *
+ * If the index cannot be split, or its keys are not primitive
+ * values, the filter is run as a single range on one thread.
+ */
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sos/sos.h>
+#include "sos_priv.h"
+
+/* Ranges per thread, so that uneven ranges balance out */
+#define PAR_RANGES_PER_THREAD	4
+/* Batches of matches queued per range before its thread waits */
+#define PAR_QUEUE_DEPTH		8
+
+typedef struct par_batch_s {
+	int count;
+	TAILQ_ENTRY(par_batch_s) entry;
+	sos_obj_t objs[SOS_FILTER_BATCH];
+} *par_batch_t;
+
+typedef struct par_range_s {
+	sos_filter_t filt;
+	TAILQ_HEAD(par_batch_q, par_batch_s) queue;
+	int depth;
+	int done;
+	int rc;
+} *par_range_t;
+
+typedef struct par_exec_s {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;	/* A batch was queued or a range finished */
+	pthread_cond_t space;	/* A batch was consumed or the scan stopped */
+	struct par_range_s *ranges;
+	int range_count;
+	int next_range;
+	volatile int stop;
+} *par_exec_t;
+
+static void __par_batch_free(par_batch_t batch)
+{
+	int i;
+	for (i = 0; i < batch->count; i++)
+		sos_obj_put(batch->objs[i]);
+	free(batch);
+}
+
+/*
+ * Queue a batch on the range, waiting for the consumer if the queue
+ * is full. Returns ECANCELED and frees the batch if the scan was
+ * stopped.
+ */
+static int __par_push(par_exec_t px, par_range_t range, par_batch_t batch)
+{
+	pthread_mutex_lock(&px->lock);
+	while (range->depth >= PAR_QUEUE_DEPTH && !px->stop)
+		pthread_cond_wait(&px->space, &px->lock);
+	if (px->stop) {
+		pthread_mutex_unlock(&px->lock);
+		__par_batch_free(batch);
+		return ECANCELED;
+	}
+	TAILQ_INSERT_TAIL(&range->queue, batch, entry);
+	range->depth += 1;
+	pthread_cond_broadcast(&px->ready);
+	pthread_mutex_unlock(&px->lock);
+	return 0;
+}
+
+static void __par_scan(par_exec_t px, par_range_t range)
+{
+	par_batch_t batch = NULL;
+	sos_obj_t obj;
+	int rc = 0;
+
+	for (obj = sos_filter_begin(range->filt); obj && !px->stop;
+	     obj = sos_filter_next(range->filt)) {
+		if (!batch) {
+			batch = malloc(sizeof(*batch));
+			if (!batch) {
+				sos_obj_put(obj);
+				rc = ENOMEM;
+				break;
+			}
+			batch->count = 0;
+		}
+		batch->objs[batch->count++] = obj;
+		if (batch->count < SOS_FILTER_BATCH)
+			continue;
+		rc = __par_push(px, range, batch);
+		batch = NULL;
+		if (rc)
+			break;
+	}
+	if (obj && px->stop && !rc)
+		sos_obj_put(obj);
+	if (batch) {
+		if (!rc && batch->count)
+			rc = __par_push(px, range, batch);
+		else
+			__par_batch_free(batch);
+	}
+	pthread_mutex_lock(&px->lock);
+	range->done = 1;
+	if (rc != ECANCELED)
+		range->rc = rc;
+	pthread_cond_broadcast(&px->ready);
+	pthread_mutex_unlock(&px->lock);
+}
+
+static void *__par_worker(void *arg)
+{
+	par_exec_t px = arg;
+	int r;
+
+	pthread_mutex_lock(&px->lock);
+	while (!px->stop && px->next_range < px->range_count) {
+		r = px->next_range++;
+		pthread_mutex_unlock(&px->lock);
+		__par_scan(px, &px->ranges[r]);
+		pthread_mutex_lock(&px->lock);
+	}
+	pthread_mutex_unlock(&px->lock);
+	return NULL;
+}
+
+/*
+ * Return the next batch to deliver, or NULL when there are no more.
+ * In ordered mode, only the batches of the range at *pr are taken and
+ * *pr advances when that range is finished.
+ */
+static par_batch_t __par_pop(par_exec_t px, int ordered, int *pr, int *prc)
+{
+	par_batch_t batch = NULL;
+	par_range_t range;
+	int r, done;
+
+	pthread_mutex_lock(&px->lock);
+	while (*pr < px->range_count) {
+		done = 1;
+		for (r = *pr; r < px->range_count; r++) {
+			range = &px->ranges[r];
+			batch = TAILQ_FIRST(&range->queue);
+			if (batch) {
+				TAILQ_REMOVE(&range->queue, batch, entry);
+				range->depth -= 1;
+				pthread_cond_broadcast(&px->space);
+				goto out;
+			}
+			if (!range->done) {
+				done = 0;
+				if (ordered)
+					break;
+			} else if (range->rc && !*prc) {
+				*prc = range->rc;
+			}
+			if (done)
+				*pr = r + 1;
+		}
+		if (*pr >= px->range_count)
+			break;
+		pthread_cond_wait(&px->ready, &px->lock);
+	}
+ out:
+	pthread_mutex_unlock(&px->lock);
+	return batch;
+}
+
+/*
+ * Return the values that bound the ranges, taken from the split keys
+ * of the filter's index. For a join index, the ranges are bounded on
+ * the first component of the join.
+ */
+static int __par_bounds(sos_filter_t filt, int want, struct sos_value_s *bounds,
+			sos_attr_t *pattr)
+{
+	sos_attr_t attr = filt->iter->attr;
+	struct sos_value_s v_;
+	sos_value_t v;
+	sos_key_t *keys;
+	int i, n, count;
+
+	*pattr = NULL;
+	if (!attr || want <= 0)
+		return 0;
+	keys = calloc(want, sizeof(*keys));
+	if (!keys)
+		return 0;
+	count = want;
+	if (ods_idx_split(filt->iter->index->idx, keys, &count))
+		count = 0;
+	for (i = n = 0; i < count; i++) {
+		if (sos_attr_type(attr) == SOS_TYPE_JOIN) {
+			v = sos_key_join_value(&v_, attr, keys[i], 0);
+		} else if (sos_attr_is_array(attr)
+			   || sos_attr_type(attr) == SOS_TYPE_STRUCT
+			   || sos_key_len(keys[i]) != sos_attr_size(attr)) {
+			v = NULL;
+		} else {
+			v = &v_;
+			v->obj = NULL;
+			v->attr = attr;
+			v->data = &v->data_;
+			memcpy(&v->data_, sos_key_value(keys[i]), sos_attr_size(attr));
+		}
+		if (!v) {
+			n = 0;
+			break;
+		}
+		if (n && sos_value_cmp(v, &bounds[n - 1]) <= 0)
+			continue;
+		bounds[n] = *v;
+		bounds[n].data = &bounds[n].data_;
+		*pattr = v->attr;
+		n++;
+	}
+	for (i = 0; i < count; i++)
+		sos_key_put(keys[i]);
+	free(keys);
+	return n;
+}
+
+/*
+ * Copy the filter's conditions and ranges to a filter on a new
+ * iterator over the same index.
+ */
+static sos_filter_t __par_filter_copy(sos_filter_t filt)
+{
+	sos_filter_cond_t cond;
+	sos_filter_t f;
+	sos_iter_t iter;
+	int i, rc;
+
+	iter = sos_index_iter_new(filt->iter->index);
+	if (!iter)
+		return NULL;
+	iter->attr = filt->iter->attr;
+	sos_iter_flags_set(iter, sos_iter_flags_get(filt->iter));
+	f = sos_filter_new(iter);
+	if (!f) {
+		sos_iter_free(iter);
+		return NULL;
+	}
+	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+		if (cond == filt->range_lo || cond == filt->range_hi)
+			continue;
+		rc = sos_filter_cond_add(f, cond->attr, cond->cond, cond->value);
+		if (rc)
+			goto err;
+	}
+	for (i = 0; i < filt->range_count; i++) {
+		rc = sos_filter_range_add(f, filt->range_attr,
+					  filt->ranges[i]->lo, filt->ranges[i]->hi);
+		if (rc)
+			goto err;
+	}
+	return f;
+ err:
+	sos_filter_free(f);
+	return NULL;
+}
+
+static void __par_filter_free(sos_filter_t f)
+{
+	/* The range bounds would skew the planner's estimates */
+	f->empty = 0;
+	sos_filter_free(f);
+}
+
+/**
+ * \brief Run a filter on a pool of threads
+ *
+ * Splits the key space of the filter's index into ranges, scans the
+ * ranges with copies of the filter on thread_count threads and calls
+ * fn with each matching object on the calling thread. The filter
+ * itself is not positioned or modified. The object is released when
+ * fn returns; fn must take a reference with sos_obj_get() to keep it.
+ *
+ * Unless SOS_FILTER_PARALLEL_UNORDERED is set in flags, the objects
+ * are delivered in index order. A limit set with
+ * sos_filter_limit_set() caps the number of objects delivered.
+ *
+ * \param filt The filter handle
+ * \param thread_count The number of threads
+ * \param flags 0 or SOS_FILTER_PARALLEL_UNORDERED
+ * \param fn The function called with each matching object
+ * \param arg Passed to fn
+ * \retval 0 All matching objects were delivered
+ * \retval ENOMEM Insufficient resources
+ * \retval !0 The non-zero value returned by fn, which stopped the scan
+ */
+int sos_filter_parallel(sos_filter_t filt, int thread_count, int flags,
+			sos_filter_obj_fn_t fn, void *arg)
+{
+	struct par_exec_s px;
+	struct sos_value_s *bounds = NULL;
+	pthread_t *threads = NULL;
+	par_batch_t batch;
+	sos_attr_t attr;
+	size_t delivered = 0;
+	int i, r, want, nbounds, nthreads = 0;
+	int rc = 0, src = 0;
+
+	if (thread_count < 1)
+		thread_count = 1;
+	memset(&px, 0, sizeof(px));
+	pthread_mutex_init(&px.lock, NULL);
+	pthread_cond_init(&px.ready, NULL);
+	pthread_cond_init(&px.space, NULL);
+
+	want = thread_count > 1 ? thread_count * PAR_RANGES_PER_THREAD - 1 : 0;
+	if (want) {
+		bounds = calloc(want, sizeof(*bounds));
+		if (!bounds) {
+			rc = ENOMEM;
+			goto out;
+		}
+	}
+	nbounds = __par_bounds(filt, want, bounds, &attr);
+	px.range_count = nbounds + 1;
+	px.ranges = calloc(px.range_count, sizeof(*px.ranges));
+	if (!px.ranges) {
+		rc = ENOMEM;
+		goto out;
+	}
+	for (r = 0; r < px.range_count; r++) {
+		par_range_t range = &px.ranges[r];
+		TAILQ_INIT(&range->queue);
+		range->filt = __par_filter_copy(filt);
+		if (!range->filt) {
+			rc = ENOMEM;
+			goto out;
+		}
+		if (r)
+			rc = sos_filter_cond_add(range->filt, attr, SOS_COND_GE,
+						 &bounds[r - 1]);
+		if (!rc && r < nbounds)
+			rc = sos_filter_cond_add(range->filt, attr, SOS_COND_LT,
+						 &bounds[r]);
+		if (rc)
+			goto out;
+	}
+
+	if (thread_count > px.range_count)
+		thread_count = px.range_count;
+	threads = calloc(thread_count, sizeof(*threads));
+	if (!threads) {
+		rc = ENOMEM;
+		goto out;
+	}
+	for (nthreads = 0; nthreads < thread_count; nthreads++) {
+		if (pthread_create(&threads[nthreads], NULL, __par_worker, &px))
+			break;
+	}
+	if (!nthreads) {
+		rc = ENOMEM;
+		goto out;
+	}
+
+	r = 0;
+	while ((batch = __par_pop(&px, !(flags & SOS_FILTER_PARALLEL_UNORDERED),
+				  &r, &src))) {
+		for (i = 0; i < batch->count; i++) {
+			if (!rc && (!filt->limit || delivered < filt->limit)) {
+				rc = fn(batch->objs[i], arg);
+				delivered += 1;
+			}
+			sos_obj_put(batch->objs[i]);
+		}
+		free(batch);
+		if (rc || (filt->limit && delivered >= filt->limit))
+			break;
+	}
+	if (!rc)
+		rc = src;
+ out:
+	pthread_mutex_lock(&px.lock);
+	px.stop = 1;
+	pthread_cond_broadcast(&px.space);
+	pthread_mutex_unlock(&px.lock);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	for (r = 0; px.ranges && r < px.range_count; r++) {
+		par_range_t range = &px.ranges[r];
+		while ((batch = TAILQ_FIRST(&range->queue))) {
+			TAILQ_REMOVE(&range->queue, batch, entry);
+			__par_batch_free(batch);
+		}
+		if (range->filt)
+			__par_filter_free(range->filt);
+	}
+	free(px.ranges);
+	free(bounds);
+	pthread_cond_destroy(&px.space);
+	pthread_cond_destroy(&px.ready);
+	pthread_mutex_destroy(&px.lock);
+	return rc;
+}
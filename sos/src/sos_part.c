@@ -67,6 +67,7 @@
  * - \ref sos_part_modify Modify the state of a partition
  * - \ref sos_part_move Move a partition to another storage location
  * - \ref sos_part_delete Destroy a partition
+ * - \ref sos_part_retain Delete the partitions older than a retention period
  *
  * There must be at least one partition in the container in the
  * 'primary' state in order for objects to be allocated and stored in
@@ -125,6 +126,42 @@
  *      sos_part_modify -C theContainer -s offline today
  *      sos_part_delete -C theContainer today
  *
+ * Making a partition OFFLINE removes the keys of all of its objects
+ * from the container's indices, and making it ACTIVE again adds
+ * them back. A partition created with the -l option keeps these keys
+ * in index files in its own directory instead. Iterators merge these
+ * indices with the container's indices while the partition is ACTIVE
+ * or PRIMARY, so its state changes do not visit its objects:
+ *
+ *      sos_part_create -C theContainer -l -s primary "today"
+ *
+ * Instead of changing the PRIMARY partition from cron, the container
+ * can be configured to roll it when it gets old or large:
+ *
+ *      sos_cmd -C theContainer -K part_roll_time=1d -K part_roll_size=64g
+ *
+ * A container opened for writing with these options runs a thread
+ * that keeps an ACTIVE, pre-extended standby partition next to the
+ * PRIMARY partition. When the PRIMARY partition is due, the
+ * allocating thread signals this thread, which makes the standby
+ * PRIMARY; ingest continues into the old PRIMARY partition until the
+ * switch. The age is counted from the time the partition was made
+ * PRIMARY, which is kept in the container. Rolled partitions are named by
+ * their creation time and are placed and indexed like the PRIMARY
+ * partition they replace. Rotation should be configured in only one
+ * of the processes that write to a container.
+ *
+ * Old partitions can be deleted in the same way, instead of making
+ * them OFFLINE and deleting them from cron:
+ *
+ *      sos_cmd -C theContainer -K part_retention=90d
+ *
+ * A container opened for writing with this option deletes the ACTIVE
+ * partitions that have not been modified for 90 days and frees their
+ * storage. The sos_part_retain command does this once, for example:
+ *
+ *      sos_part_retain -C theContainer -k 90d
+ *
  * There are API for manipulating Partitions from a program. In
  * general, only management applications should call these
  * functions. It is possible to corrupt and otherwise destroy the
@@ -133,8 +170,11 @@
  * The Partition API include the following:
  *
  * - sos_part_create() Create a new partition
+ * - sos_part_create_ex() Create a new partition with its own indices
  * - sos_part_delete() Delete a partition
  * - sos_part_move() Move a parition to another storage location
+ * - sos_part_attach() Adopt a partition from another container
+ * - sos_part_retain() Delete the partitions older than a retention period
  * - sos_part_copy() Copy a partition to another storage location
  * - sos_part_iter_new() Create a partition iterator
  * - sos_part_iter_free() Free a partition iterator
@@ -152,6 +192,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/sendfile.h>
+#include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
@@ -171,6 +212,7 @@
 static sos_part_t __sos_part_first(sos_part_iter_t iter);
 static sos_part_t __sos_part_next(sos_part_iter_t iter);
 static int __refresh_part_list(sos_t sos);
+static int __sos_part_delete(sos_part_t part, uint64_t *bytes);
 
 /*
  * New partition objects show up in the address space through:
@@ -179,7 +221,8 @@ static int __refresh_part_list(sos_t sos);
  * on the object on behalf of the caller.
  */
 static ods_obj_t __sos_part_create(sos_t sos, char *tmp_path,
-				   const char *part_name, const char *part_path)
+				   const char *part_name, const char *part_path,
+				   uint64_t adopt_id)
 {
 	char real_path[PATH_MAX];
 	int rc;
@@ -202,7 +245,13 @@ static ods_obj_t __sos_part_create(sos_t sos, char *tmp_path,
 	}
 	sprintf(tmp_path, "%s/%s", part_path, part_name);
 	rc = stat(tmp_path, &sb);
-	if (rc == 0 || (rc && errno != ENOENT)) {
+	if (adopt_id) {
+		/* An adopted partition brings its directory with it */
+		if (rc || !S_ISDIR(sb.st_mode)) {
+			errno = ENOENT;
+			goto err_1;
+		}
+	} else if (rc == 0 || (rc && errno != ENOENT)) {
 		errno = EEXIST;
 		goto err_1;
 	}
@@ -232,8 +281,14 @@ static ods_obj_t __sos_part_create(sos_t sos, char *tmp_path,
 	/* Set up the new partition */
 	strcpy(SOS_PART(new_part)->name, part_name);
 	strcpy(SOS_PART(new_part)->path, part_path);
-	SOS_PART(new_part)->part_id =
-		ods_atomic_inc(&SOS_PART_UDATA(sos->part_udata)->next_part_id);
+	if (adopt_id > SOS_PART_UDATA(sos->part_udata)->next_part_id) {
+		/* This container has never issued the id, keep it */
+		SOS_PART_UDATA(sos->part_udata)->next_part_id = adopt_id;
+		SOS_PART(new_part)->part_id = adopt_id;
+	} else {
+		SOS_PART(new_part)->part_id =
+			ods_atomic_inc(&SOS_PART_UDATA(sos->part_udata)->next_part_id);
+	}
 	SOS_PART(new_part)->prev = tail_ref;
 	SOS_PART(new_part)->next = 0;
 	SOS_PART(new_part)->ref_count = 1 + 1; /* create reference + caller ref */
@@ -274,6 +329,8 @@ static int __sos_open_partition(sos_t sos, sos_part_t part)
 	int rc;
 	ods_t ods;
 
+	if (part->obj_ods)
+		return 0;
 	sprintf(tmp_path, "%s/%s", sos_part_path(part), sos_part_name(part));
 	assert(tmp_path[0] == '/');
 	rc = __sos_make_all_dir(tmp_path, sos->o_mode);
@@ -292,31 +349,75 @@ static int __sos_open_partition(sos_t sos, sos_part_t part)
 		goto retry;
 	}
 	part->obj_ods = ods;
+	part->lru_tick = ods_atomic_inc(&sos->part_lru_clock);
+	ods_atomic_inc(&sos->part_open_count);
 	return 0;
  err_0:
 	return rc;
 }
 
+static void __sos_close_partition(sos_part_t part)
+{
+	if (!part->obj_ods)
+		return;
+	ods_close(part->obj_ods, ODS_COMMIT_ASYNC);
+	part->obj_ods = NULL;
+	ods_atomic_dec(&part->sos->part_open_count);
+}
+
+/*
+ * The keys of a partition's objects in one global index. They are
+ * removed with range deletes unless per_obj is set, in which case
+ * they are removed one object at a time.
+ */
+struct unindex_range_s {
+	sos_attr_t attr;
+	sos_index_t index;
+	sos_key_t key;		/* Scratch key for the current object */
+	sos_key_t min_key;
+	sos_key_t max_key;
+	int per_obj;
+	LIST_ENTRY(unindex_range_s) entry;
+};
+LIST_HEAD(unindex_range_list, unindex_range_s);
+
 struct iter_args {
 	double start;
 	double timeout;
 	sos_part_t part;
 	uint64_t count;
+	struct unindex_range_list *ranges;
 };
 #define DUTY_CYCLE 250000
+/* The most values removed by a single range delete */
+#define UNINDEX_RANGE_CHUNK 16384
 
-static int __unindex_callback_fn(ods_t ods, ods_obj_t obj, void *arg)
+static struct unindex_range_s *
+__unindex_range_find(struct iter_args *uarg, sos_attr_t attr)
+{
+	struct unindex_range_s *range;
+	LIST_FOREACH(range, uarg->ranges, entry) {
+		if (range->attr == attr)
+			return range;
+	}
+	return NULL;
+}
+
+/*
+ * Return the object for an ODS object being unindexed, or NULL if it
+ * is to be skipped. Sets *stop when the duty cycle has been used up.
+ */
+static sos_obj_t __unindex_obj(struct iter_args *uarg, ods_obj_t obj, int *stop)
 {
 	sos_obj_ref_t ref;
-	sos_obj_t sos_obj;
-	struct iter_args *uarg = arg;
 	sos_part_t part = uarg->part;
 	sos_obj_data_t sos_obj_data = obj->as.ptr;
 	sos_schema_t schema = sos_schema_by_id(part->sos, sos_obj_data->schema);
+	*stop = 0;
 	if (!schema) {
 		sos_warn("Object at %p is missing a valid schema id.\n", ods_obj_ref(obj));
 		/* This is a garbage object that should not be here */
-		return 0;
+		return NULL;
 	}
 	struct timeval tv;
 	(void)gettimeofday(&tv, NULL);
@@ -325,25 +426,128 @@ static int __unindex_callback_fn(ods_t ods, ods_obj_t obj, void *arg)
 	uarg->count++;
 	if (now - uarg->start > uarg->timeout) {
 		sos_info("Processed %ld objects in %f microseconds\n", uarg->count, dur);
-		return 1;
+		*stop = 1;
+		return NULL;
 	}
 	ref.ref.ods = SOS_PART(part->part_obj)->part_id;
 	ref.ref.obj = ods_obj_ref(obj);
-	sos_obj = __sos_init_obj(part->sos, schema, obj, ref);
-	sos_obj_remove(sos_obj);
+	return __sos_init_obj(part->sos, schema, ods_obj_get(obj), ref);
+}
+
+static int __unindex_key_set(sos_key_t *pkey, sos_value_t value, size_t key_sz)
+{
+	sos_key_t key = *pkey;
+	if (!key || sos_key_size(key) < key_sz) {
+		key = sos_key_new(key_sz);
+		if (!key)
+			return ENOMEM;
+		if (*pkey)
+			sos_key_put(*pkey);
+		*pkey = key;
+	}
+	ods_key_set(key, sos_value_as_key(value), key_sz);
+	return 0;
+}
+
+/*
+ * Widen the key range of each of the object's indices to include the
+ * object's key.
+ */
+static int __unindex_scan_fn(ods_t ods, ods_obj_t obj, void *arg)
+{
+	struct iter_args *uarg = arg;
+	struct unindex_range_s *range;
+	struct sos_value_s v_;
+	sos_value_t value;
+	sos_obj_t sos_obj;
+	sos_attr_t attr;
+	size_t key_sz;
+	int stop, rc;
+
+	sos_obj = __unindex_obj(uarg, obj, &stop);
+	if (!sos_obj)
+		return stop;
+	TAILQ_FOREACH(attr, &sos_obj->schema->attr_list, entry) {
+		range = __unindex_range_find(uarg, attr);
+		if (!range || range->per_obj)
+			continue;
+		value = sos_value_init(&v_, sos_obj, attr);
+		key_sz = sos_value_size(value);
+		rc = __unindex_key_set(&range->key, value, key_sz);
+		if (!rc && (!range->min_key
+			    || sos_index_key_cmp(range->index, range->key,
+						 range->min_key) < 0))
+			rc = __unindex_key_set(&range->min_key, value, key_sz);
+		if (!rc && (!range->max_key
+			    || sos_index_key_cmp(range->index, range->key,
+						 range->max_key) > 0))
+			rc = __unindex_key_set(&range->max_key, value, key_sz);
+		sos_value_put(value);
+		if (rc)
+			range->per_obj = 1;
+	}
+	sos_obj_put(sos_obj);
+	return 0;
+}
+
+/*
+ * Remove the object's keys from the indices that are not removed
+ * with range deletes.
+ */
+static int __unindex_callback_fn(ods_t ods, ods_obj_t obj, void *arg)
+{
+	struct iter_args *uarg = arg;
+	struct unindex_range_s *range;
+	sos_obj_t sos_obj;
+	sos_attr_t attr;
+	int stop;
+
+	sos_obj = __unindex_obj(uarg, obj, &stop);
+	if (!sos_obj)
+		return stop;
+	TAILQ_FOREACH(attr, &sos_obj->schema->attr_list, entry) {
+		range = __unindex_range_find(uarg, attr);
+		if (range && !range->per_obj)
+			continue;
+		/* Keys already removed by a range delete are ENOENT */
+		(void)__sos_obj_remove_attr(sos_obj, attr);
+	}
 	sos_obj_put(sos_obj);
 	return 0;
 }
 
-void __unindex_part_objects(sos_t sos, sos_part_t part)
+/*
+ * Wait out the rest of the second. Returns EINTR if the retain thread
+ * is being stopped so that sos_container_close() does not wait for a
+ * partition to be made OFFLINE.
+ */
+static int __unindex_pause(sos_t sos)
+{
+	struct timespec ts;
+	int stop;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += (1000000 - DUTY_CYCLE) * 1000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec += 1;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_mutex_lock(&sos->retain_lock);
+	if (!sos->retain_stop)
+		pthread_cond_timedwait(&sos->retain_cond, &sos->retain_lock, &ts);
+	stop = sos->retain_stop;
+	pthread_mutex_unlock(&sos->retain_lock);
+	return stop ? EINTR : 0;
+}
+
+static int __unindex_iter(sos_t sos, sos_part_t part,
+			  struct unindex_range_list *ranges,
+			  ods_obj_iter_fn_t iter_fn)
 {
 	int rc;
 	struct iter_args uargs;
 	struct ods_obj_iter_pos_s pos;
 
-	/*
-	 * Remove all objects in this partition from the indices
-	 */
 	ods_obj_iter_pos_init(&pos);
 	do {
 		struct timeval tv;
@@ -352,11 +556,161 @@ void __unindex_part_objects(sos_t sos, sos_part_t part)
 		uargs.timeout = DUTY_CYCLE;
 		uargs.part = part;
 		uargs.count = 0;
-		rc = ods_obj_iter(part->obj_ods, &pos, __unindex_callback_fn, &uargs);
-		if (rc) {
-			usleep(1000000 - DUTY_CYCLE);
-		}
+		uargs.ranges = ranges;
+		rc = ods_obj_iter(part->obj_ods, &pos, iter_fn, &uargs);
+		if (rc && __unindex_pause(sos))
+			return EINTR;
 	} while (rc);
+	return 0;
+}
+
+struct unindex_check_s {
+	uint64_t part_id;
+	uint64_t budget;	/* The most values accepted per call */
+	uint64_t seen;
+	int foreign;		/* A value refers to another partition */
+};
+
+static int __unindex_range_check(ods_idx_t idx, ods_idx_data_t *data, void *arg)
+{
+	struct unindex_check_s *check = arg;
+	sos_obj_ref_t ref;
+
+	ref.idx_data = *data;
+	if (ref.ref.ods != check->part_id) {
+		check->foreign = 1;
+		return 1;
+	}
+	if (check->seen == check->budget)
+		return 1;
+	check->seen++;
+	return 0;
+}
+
+/*
+ * Delete the partition's key range from the index in chunks, yielding
+ * the index between chunks and sleeping when the duty cycle is used
+ * up. Returns EINTR if the retain thread is being stopped, or another
+ * !0 value if the range holds keys of other partitions and the
+ * remaining keys must be removed one object at a time.
+ */
+static int __unindex_range_delete(sos_part_t part, struct unindex_range_s *range)
+{
+	struct unindex_check_s check;
+	struct timeval tv;
+	double start, now;
+	uint64_t count;
+	int rc;
+
+	check.part_id = SOS_PART(part->part_obj)->part_id;
+	check.budget = UNINDEX_RANGE_CHUNK;
+	(void)gettimeofday(&tv, NULL);
+	start = (double)tv.tv_sec * 1.0e6 + (double)tv.tv_usec;
+	do {
+		check.seen = 0;
+		check.foreign = 0;
+		rc = ods_idx_delete_range(range->index->idx,
+					  range->min_key, range->max_key,
+					  __unindex_range_check, &check, &count);
+		if (rc != ECANCELED || check.foreign)
+			break;
+		/*
+		 * A key with more values than the budget is retried with
+		 * twice the budget until it has been deleted whole.
+		 */
+		check.budget = count ? UNINDEX_RANGE_CHUNK : check.budget * 2;
+		(void)gettimeofday(&tv, NULL);
+		now = (double)tv.tv_sec * 1.0e6 + (double)tv.tv_usec;
+		if (now - start > DUTY_CYCLE) {
+			if (__unindex_pause(part->sos))
+				return EINTR;
+			(void)gettimeofday(&tv, NULL);
+			start = (double)tv.tv_sec * 1.0e6 + (double)tv.tv_usec;
+		}
+	} while (1);
+	if (rc)
+		sos_info("Index %s: range delete stopped with %d, "
+			 "removing the remaining keys by object\n",
+			 range->index->name, rc);
+	return rc;
+}
+
+/*
+ * Returns EINTR if the retain thread is stopped before all of the
+ * keys have been removed.
+ */
+static int __unindex_part_objects(sos_t sos, sos_part_t part)
+{
+	struct unindex_range_list ranges;
+	struct unindex_range_s *range;
+	sos_schema_t schema;
+	sos_attr_t attr;
+	sos_index_t index;
+	int per_obj = 0;
+	int rc;
+
+	/*
+	 * Remove all objects in this partition from the indices
+	 */
+	if (__sos_open_partition(sos, part))
+		return 0;
+
+	/*
+	 * The partition's keys are usually a few dense ranges of each
+	 * index, e.g. a time span. Find the range of each index and
+	 * delete it in bulk; the deletes check that every key in the
+	 * range belongs to this partition. Indices where that is not the
+	 * case, or that are being built, fall back to removing the keys
+	 * one object at a time.
+	 */
+	LIST_INIT(&ranges);
+	for (schema = sos_schema_first(sos); schema;
+	     schema = sos_schema_next(schema)) {
+		TAILQ_FOREACH(attr, &schema->attr_list, entry) {
+			index = __sos_attr_index(attr);
+			if (!index)
+				continue;
+			range = calloc(1, sizeof *range);
+			if (!range) {
+				per_obj = 1;
+				continue;
+			}
+			range->attr = attr;
+			range->index = index;
+			range->per_obj = attr->data->building;
+			LIST_INSERT_HEAD(&ranges, range, entry);
+		}
+	}
+	rc = __unindex_iter(sos, part, &ranges, __unindex_scan_fn);
+	if (rc)
+		goto out;
+	LIST_FOREACH(range, &ranges, entry) {
+		if (range->per_obj || !range->min_key)
+			goto next;
+		rc = __unindex_range_delete(part, range);
+		if (rc == EINTR)
+			goto out;
+		if (rc)
+			range->per_obj = 1;
+	next:
+		per_obj |= range->per_obj;
+	}
+	rc = 0;
+	if (per_obj)
+		rc = __unindex_iter(sos, part, &ranges, __unindex_callback_fn);
+ out:
+	while (!LIST_EMPTY(&ranges)) {
+		range = LIST_FIRST(&ranges);
+		LIST_REMOVE(range, entry);
+		if (range->key)
+			sos_key_put(range->key);
+		if (range->min_key)
+			sos_key_put(range->min_key);
+		if (range->max_key)
+			sos_key_put(range->max_key);
+		free(range);
+	}
+	return rc;
 }
 
 void __make_part_offline(sos_t sos, sos_part_t part)
@@ -401,7 +755,7 @@ static int __reindex_callback_fn(ods_t ods, ods_obj_t obj, void *arg)
 	}
 	ref.ref.ods = SOS_PART(part->part_obj)->part_id;
 	ref.ref.obj = ods_obj_ref(obj);
-	sos_obj = __sos_init_obj(part->sos, schema, obj, ref);
+	sos_obj = __sos_init_obj(part->sos, schema, ods_obj_get(obj), ref);
 	rc = sos_obj_index(sos_obj);
 	if (rc) {
 		/* The object couldn't be indexed for some reason */
@@ -464,6 +818,7 @@ static void __make_part_primary(sos_t sos, sos_part_t part)
 	SOS_PART(part->part_obj)->state = SOS_PART_STATE_PRIMARY;
 	ods_atomic_inc(&SOS_PART_UDATA(sos->part_udata)->gen);
 	SOS_PART_UDATA(sos->part_udata)->primary = ods_obj_ref(part->part_obj);
+	SOS_PART_UDATA(sos->part_udata)->primary_time = time(NULL);
 	sos->primary_part = part;
 }
 
@@ -498,11 +853,18 @@ sos_part_t __sos_part_find_by_ref(sos_t sos, ods_ref_t ref)
  * OFFLINE, all Keys that refer to objects in that partition are
  * removed from all indices in the container.
  *
+ * A partition created with SOS_PART_F_LOCAL_INDEX keeps the keys of
+ * its objects in its own indices. These are simply no longer
+ * consulted when the partition is OFFLINE, so its state changes do
+ * not visit the objects in the partition.
+ *
  * \param part The partition handle
  * \param new_state The desired state of the partition
  * \retval 0 The state was successfully changed
  * \retval EINVAL The specified state is invalid given the current
  * state of the partition.
+ * \retval EINTR The container is being closed. The partition was
+ * being made OFFLINE by the retain thread and remains ACTIVE.
  */
 int sos_part_state_set(sos_part_t part, sos_part_state_t new_state)
 {
@@ -536,7 +898,8 @@ int sos_part_state_set(sos_part_t part, sos_part_state_t new_state)
 				pthread_mutex_unlock(&sos->lock);
 				return EINVAL;
 			}
-			__reindex_part_objects(sos, part);
+			if (!part->local_index)
+				__reindex_part_objects(sos, part);
 			break;
 		default:
 			break;
@@ -545,7 +908,8 @@ int sos_part_state_set(sos_part_t part, sos_part_state_t new_state)
 	case SOS_PART_STATE_ACTIVE:
 		switch (new_state) {
 		case SOS_PART_STATE_OFFLINE:
-			__unindex_part_objects(sos, part);
+			if (!part->local_index)
+				rc = __unindex_part_objects(sos, part);
 			break;
 		default:
 			break;
@@ -586,6 +950,9 @@ int sos_part_state_set(sos_part_t part, sos_part_state_t new_state)
 			rc = EINVAL;
 			break;
 		case SOS_PART_STATE_OFFLINE:
+			/* Interrupted, the partition stays ACTIVE */
+			if (rc)
+				break;
 			__make_part_offline(sos, part);
 			__refresh_part_list(sos);
 			break;
@@ -602,6 +969,11 @@ int sos_part_state_set(sos_part_t part, sos_part_state_t new_state)
 	default:
 		assert(0);
 	}
+	if (SOS_PART(part->part_obj)->state == SOS_PART_STATE_BUSY) {
+		/* The state is unchanged or the change is not valid */
+		SOS_PART(part->part_obj)->state = cur_state;
+		ods_atomic_inc(&SOS_PART_UDATA(sos->part_udata)->gen);
+	}
  out:
 	ods_unlock(sos->part_ods, 0);
 	pthread_mutex_unlock(&sos->lock);
@@ -610,122 +982,1928 @@ int sos_part_state_set(sos_part_t part, sos_part_state_t new_state)
 
 static sos_part_t __sos_part_new(sos_t sos, ods_obj_t part_obj)
 {
-	sos_part_t part = calloc(1, sizeof(*part));
+	char tmp_path[PATH_MAX];
+	struct stat sb;
+	sos_part_t part;
+	if (!part_obj) {
+		errno = EINVAL;
+		return NULL;
+	}
+	part = calloc(1, sizeof(*part));
 	if (!part)
 		return NULL;
 	part->ref_count = 1;
 	part->sos = sos;
 	part->part_obj = part_obj;
+	pthread_mutex_init(&part->idx_lock, NULL);
+	rbt_init(&part->idx_rbt, __sos_schema_name_cmp);
+	sprintf(tmp_path, "%s/%s/indices",
+		SOS_PART(part_obj)->path, SOS_PART(part_obj)->name);
+	if (!stat(tmp_path, &sb) && S_ISDIR(sb.st_mode))
+		part->local_index = 1;
 	return part;
 }
 
+/*
+ * Close the local indices of the partition. They are reopened on
+ * the next access.
+ */
+static void __sos_part_idx_close(sos_part_t part)
+{
+	struct rbn *rbn;
+	struct sos_part_idx_s *pidx;
+
+	pthread_mutex_lock(&part->idx_lock);
+	while (NULL != (rbn = rbt_min(&part->idx_rbt))) {
+		rbt_del(&part->idx_rbt, rbn);
+		pidx = container_of(rbn, struct sos_part_idx_s, rbn);
+		if (pidx->min_key)
+			sos_key_put(pidx->min_key);
+		if (pidx->max_key)
+			sos_key_put(pidx->max_key);
+		ods_idx_close(pidx->idx, ODS_COMMIT_ASYNC);
+		free(pidx);
+	}
+	pthread_mutex_unlock(&part->idx_lock);
+}
 
-static int __refresh_part_list(sos_t sos)
+/*
+ * Return the partition's local index for the container index,
+ * opening or creating the index file if necessary. The index is owned
+ * by the partition and is valid while the caller holds a reference on
+ * the partition.
+ */
+ods_idx_t __sos_part_idx(sos_part_t part, sos_index_t index)
 {
-	int rc = 0;
-	sos_part_t part;
-	ods_obj_t part_obj;
+	char tmp_path[PATH_MAX];
+	struct sos_part_idx_s *pidx;
+	struct rbn *rbn;
+	ods_idx_t idx = NULL;
+	ods_idx_data_t data;
+	sos_key_t key;
+
+	pthread_mutex_lock(&part->idx_lock);
+	rbn = rbt_find(&part->idx_rbt, (void *)index->name);
+	if (rbn) {
+		idx = container_of(rbn, struct sos_part_idx_s, rbn)->idx;
+		goto out;
+	}
+	pidx = calloc(1, sizeof(*pidx));
+	if (!pidx)
+		goto out;
+	sprintf(tmp_path, "%s/%s/indices", sos_part_path(part), sos_part_name(part));
+	pidx->idx = __sos_index_idx_open(part->sos, index->name, tmp_path);
+	if (!pidx->idx) {
+		free(pidx);
+		goto out;
+	}
+	/*
+	 * The zone map starts as the index's key range. The keys are
+	 * copied to memory so that they do not reference the index's ODS.
+	 */
+	if (!ods_idx_min(pidx->idx, &key, &data)) {
+		pidx->min_key = __sos_key_dup(key);
+		sos_key_put(key);
+	}
+	if (!ods_idx_max(pidx->idx, &key, &data)) {
+		pidx->max_key = __sos_key_dup(key);
+		sos_key_put(key);
+	}
+	strcpy(pidx->name, index->name);
+	rbn_init(&pidx->rbn, pidx->name);
+	rbt_ins(&part->idx_rbt, &pidx->rbn);
+	idx = pidx->idx;
+ out:
+	pthread_mutex_unlock(&part->idx_lock);
+	return idx;
+}
 
-	sos->primary_part = NULL;
-	while (!TAILQ_EMPTY(&sos->part_list)) {
-		part = TAILQ_FIRST(&sos->part_list);
-		sos_part_put(part);
-		TAILQ_REMOVE(&sos->part_list, part, entry);
+/*
+ * Widen the zone map of the partition's local index to include key
+ */
+void __sos_part_idx_zone_update(sos_part_t part, sos_index_t index, sos_key_t key)
+{
+	struct sos_part_idx_s *pidx;
+	struct rbn *rbn;
+	sos_key_t dup;
+
+	pthread_mutex_lock(&part->idx_lock);
+	rbn = rbt_find(&part->idx_rbt, (void *)index->name);
+	if (!rbn)
+		goto out;
+	pidx = container_of(rbn, struct sos_part_idx_s, rbn);
+	if (!pidx->min_key || ods_key_cmp(pidx->idx, key, pidx->min_key) < 0) {
+		dup = __sos_key_dup(key);
+		if (!dup)
+			goto out;
+		if (pidx->min_key)
+			sos_key_put(pidx->min_key);
+		pidx->min_key = dup;
 	}
-	sos->part_gn = SOS_PART_UDATA(sos->part_udata)->gen;
-	for (part_obj = __sos_part_data_first(sos);
-	     part_obj; part_obj = __sos_part_data_next(sos, part_obj)) {
-		part = __sos_part_new(sos, part_obj);
-		if (!part) {
-			rc = ENOMEM;
+	if (!pidx->max_key || ods_key_cmp(pidx->idx, key, pidx->max_key) > 0) {
+		dup = __sos_key_dup(key);
+		if (!dup)
 			goto out;
-		}
-		TAILQ_INSERT_TAIL(&sos->part_list, part, entry);
-		if (SOS_PART(part_obj)->state != SOS_PART_STATE_OFFLINE) {
-			rc = __sos_open_partition(sos, part);
-			if (rc)
-				goto out;
-		}
+		if (pidx->max_key)
+			sos_key_put(pidx->max_key);
+		pidx->max_key = dup;
 	}
  out:
-	return rc;
+	pthread_mutex_unlock(&part->idx_lock);
 }
 
-static int refresh_part_list(sos_t sos)
+/*
+ * Returns !0 if the partition's local index may contain keys in the
+ * range [lo, hi]. A NULL lo or hi leaves that end of the range open.
+ */
+int __sos_part_idx_zone_test(sos_part_t part, sos_index_t index,
+			     sos_key_t lo, sos_key_t hi)
 {
-	int rc;
-	ods_lock(sos->part_ods, 0, NULL);
-	rc = __refresh_part_list(sos);
-	ods_unlock(sos->part_ods, 0);
+	struct sos_part_idx_s *pidx;
+	struct rbn *rbn;
+	int rc = 1;
+
+	pthread_mutex_lock(&part->idx_lock);
+	rbn = rbt_find(&part->idx_rbt, (void *)index->name);
+	if (!rbn)
+		goto out;
+	pidx = container_of(rbn, struct sos_part_idx_s, rbn);
+	if (!pidx->min_key || !pidx->max_key)
+		rc = 0;
+	else if (hi && ods_key_cmp(pidx->idx, pidx->min_key, hi) > 0)
+		rc = 0;
+	else if (lo && ods_key_cmp(pidx->idx, pidx->max_key, lo) < 0)
+		rc = 0;
+ out:
+	pthread_mutex_unlock(&part->idx_lock);
 	return rc;
 }
 
-int __sos_open_partitions(sos_t sos, char *tmp_path)
+/*
+ * Return the partition with the specified id. No reference is taken,
+ * see __sos_ods_from_ref(). The sos_part_s stays valid until the
+ * container is closed, even if the partition is removed.
+ */
+sos_part_t __sos_part_by_id(sos_t sos, uint64_t part_id)
 {
-	int rc;
+	struct sos_part_table_s *table = sos->part_table;
+	if (table && part_id < table->count)
+		return table->parts[part_id];
+	return NULL;
+}
 
-	/* Open the partition ODS */
-	sprintf(tmp_path, "%s/.__part", sos->path);
-	sos->part_ods = ods_open(tmp_path, ODS_PERM_RW);
-	if (!sos->part_ods)
-		goto err_0;
-	sos->part_udata = ods_get_user_data(sos->part_ods);
-	if (!sos->part_udata)
-		goto err_1;
-	rc = refresh_part_list(sos);
-	return rc;
- err_1:
-	ods_close(sos->part_ods, ODS_COMMIT_ASYNC);
-	sos->part_ods = NULL;
- err_0:
-	return errno;
+/*
+ * Close the partition's object store unless it is pinned or has
+ * objects in use. Called with the container lock held.
+ */
+static void __sos_part_close_idle(sos_t sos, sos_part_t part)
+{
+	/* Wait for __sos_part_ref_as_obj() callers using the ODS */
+	pthread_rwlock_wrlock(&sos->part_evict_lock);
+	if (!part->ods_pin && !ods_obj_count(part->obj_ods))
+		__sos_close_partition(part);
+	pthread_rwlock_unlock(&sos->part_evict_lock);
 }
 
-sos_part_t __sos_primary_obj_part(sos_t sos)
+/*
+ * Close the least recently used partition object stores until fewer
+ * than config.part_open_max are open. Only ACTIVE partitions that are
+ * not pinned and have no objects in use are closed. Called with the
+ * part_open_lock and the container lock held.
+ */
+static void __sos_part_evict(sos_t sos)
 {
-	sos_part_t part = NULL;
+	sos_part_t part, victim;
+
+	while (sos->part_open_count >= sos->config.part_open_max) {
+		victim = NULL;
+		TAILQ_FOREACH(part, &sos->part_list, entry) {
+			if (!part->obj_ods || part->ods_pin)
+				continue;
+			if (SOS_PART(part->part_obj)->state != SOS_PART_STATE_ACTIVE)
+				continue;
+			if (ods_obj_count(part->obj_ods))
+				continue;
+			if (!victim || part->lru_tick < victim->lru_tick)
+				victim = part;
+		}
+		if (!victim)
+			break;
+		__sos_part_close_idle(sos, victim);
+		if (victim->obj_ods)
+			break;
+	}
+}
 
-	if ((NULL != sos->primary_part) &&
-	    (SOS_PART(sos->primary_part->part_obj)->state == SOS_PART_STATE_PRIMARY))
-		return sos->primary_part;
+static ods_t __sos_part_ods_open(sos_part_t part)
+{
+	sos_t sos = part->sos;
+	sos_part_state_t state;
+	ods_t ods = NULL;
 
+	pthread_mutex_lock(&sos->part_open_lock);
 	pthread_mutex_lock(&sos->lock);
-	ods_lock(sos->part_ods, 0, NULL);
-	if (sos->part_gn != SOS_PART_UDATA(sos->part_udata)->gen) {
-		int rc = __refresh_part_list(sos);
-		if (rc)
-			goto out;
+	if (part->obj_ods) {
+		ods = part->obj_ods;
+		goto out;
 	}
-	TAILQ_FOREACH(part, &sos->part_list, entry) {
-		if (SOS_PART(part->part_obj)->state == SOS_PART_STATE_PRIMARY) {
-			sos->primary_part = part;
-			goto out;
-		}
+	state = SOS_PART(part->part_obj)->state;
+	if (state != SOS_PART_STATE_ACTIVE && state != SOS_PART_STATE_PRIMARY) {
+		errno = EBUSY;
+		goto out;
 	}
+	if (sos->config.part_open_max)
+		__sos_part_evict(sos);
+	errno = __sos_open_partition(sos, part);
+	ods = part->obj_ods;
  out:
-	ods_unlock(sos->part_ods, 0);
 	pthread_mutex_unlock(&sos->lock);
-	return part;
+	pthread_mutex_unlock(&sos->part_open_lock);
+	return ods;
 }
 
-struct export_obj_iter_args_s {
-	sos_t src_sos;
-	sos_t dst_sos;
-	sos_part_t src_part;
-	ods_idx_t exp_idx;
-	int reindex;
-	int64_t export_count;
-};
-
-#pragma pack(4)
-union exp_obj_u {
-	struct ods_idx_data_s idx_data;
-	struct exp_obj_s {
-		uint64_t from_ref;
-		uint64_t to_ref;
-	} exp_data;
-};
-#pragma pack()
+/*
+ * Return the object store of an ACTIVE or PRIMARY partition, opening
+ * it if necessary. Returns NULL if the partition is OFFLINE or BUSY
+ * and not already open.
+ */
+ods_t __sos_part_ods(sos_part_t part)
+{
+	ods_t ods = part->obj_ods;
+	if (ods) {
+		if (part->sos->config.part_open_max)
+			part->lru_tick = ods_atomic_inc(&part->sos->part_lru_clock);
+		return ods;
+	}
+	return __sos_part_ods_open(part);
+}
+
+/*
+ * Return the ODS object referred to by ref. If open partitions may be
+ * evicted, the object is obtained under the part_evict_lock so that
+ * its partition is not closed before the object holds it open.
+ */
+ods_obj_t __sos_part_ref_as_obj(sos_t sos, sos_obj_ref_t ref)
+{
+	sos_part_t part;
+	ods_obj_t obj = NULL;
+	ods_t ods;
+
+	part = __sos_part_by_id(sos, ref.ref.ods);
+	if (!part)
+		return NULL;
+	ods = __sos_part_ods(part);
+	if (!ods)
+		return NULL;
+	if (!sos->config.part_open_max)
+		return ods_ref_as_obj(ods, ref.ref.obj);
+	do {
+		pthread_rwlock_rdlock(&sos->part_evict_lock);
+		ods = part->obj_ods;
+		if (ods)
+			obj = ods_ref_as_obj(ods, ref.ref.obj);
+		pthread_rwlock_unlock(&sos->part_evict_lock);
+	} while (!ods && __sos_part_ods(part));
+	return obj;
+}
+
+/*
+ * Return the object store of the partition and keep it open until
+ * __sos_part_ods_unpin() is called.
+ */
+static ods_t __sos_part_ods_pin(sos_part_t part)
+{
+	sos_t sos = part->sos;
+	ods_t ods;
+
+	do {
+		if (!__sos_part_ods(part))
+			return NULL;
+		pthread_rwlock_rdlock(&sos->part_evict_lock);
+		ods = part->obj_ods;
+		if (ods)
+			ods_atomic_inc(&part->ods_pin);
+		pthread_rwlock_unlock(&sos->part_evict_lock);
+	} while (!ods);
+	return ods;
+}
+
+static void __sos_part_ods_unpin(sos_part_t part)
+{
+	ods_atomic_dec(&part->ods_pin);
+}
+
+static int __part_is_local_active(sos_part_t part)
+{
+	sos_part_state_t state = SOS_PART(part->part_obj)->state;
+	return part->local_index
+		&& (state == SOS_PART_STATE_ACTIVE || state == SOS_PART_STATE_PRIMARY);
+}
+
+/*
+ * Build the list of local indices of the ACTIVE and PRIMARY
+ * partitions for the index. The list is returned even if no partition
+ * has a local index, in which case count is 0. Each entry holds a
+ * reference on its partition.
+ */
+int __sos_part_idx_list(sos_index_t index, struct sos_index_parts_s **pparts)
+{
+	sos_t sos = index->sos;
+	struct sos_index_parts_s *parts = NULL;
+	sos_part_t part;
+	ods_idx_t idx;
+	int count, rc = 0;
+
+	pthread_mutex_lock(&sos->lock);
+	ods_lock(sos->part_ods, 0, NULL);
+	if (sos->part_gn != SOS_PART_UDATA(sos->part_udata)->gen)
+		__refresh_part_list(sos);
+	count = 0;
+	TAILQ_FOREACH(part, &sos->part_list, entry) {
+		if (__part_is_local_active(part))
+			count++;
+	}
+	parts = calloc(1, sizeof(*parts) + count * sizeof(parts->parts[0]));
+	if (!parts) {
+		rc = ENOMEM;
+		goto out;
+	}
+	parts->ref_count = 1;
+	parts->part_gn = sos->part_gn;
+	TAILQ_FOREACH(part, &sos->part_list, entry) {
+		if (!__part_is_local_active(part))
+			continue;
+		idx = __sos_part_idx(part, index);
+		if (!idx) {
+			rc = errno;
+			goto err;
+		}
+		ods_atomic_inc(&part->ref_count);
+		parts->parts[parts->count].part = part;
+		parts->parts[parts->count].idx = idx;
+		parts->count++;
+	}
+ out:
+	ods_unlock(sos->part_ods, 0);
+	pthread_mutex_unlock(&sos->lock);
+	*pparts = parts;
+	return rc;
+ err:
+	__sos_index_parts_put(parts);
+	parts = NULL;
+	goto out;
+}
+
+void __sos_index_parts_put(struct sos_index_parts_s *parts)
+{
+	int i;
+	if (!parts || ods_atomic_dec(&parts->ref_count))
+		return;
+	for (i = 0; i < parts->count; i++)
+		sos_part_put(parts->parts[i].part);
+	free(parts);
+}
+
+/*
+ * Create the iterator slots for the local indices of the active
+ * partitions. Slot 0 is left for the caller's iterator on the
+ * container index. If no partition has a local index, *pslots is
+ * NULL and *pcount is 0. Each slot holds a reference on its
+ * partition.
+ */
+int __sos_part_idx_slots(sos_index_t index, struct sos_iter_slot_s **pslots,
+			 int *pcount, ods_atomic_t *pgen)
+{
+	sos_t sos = index->sos;
+	struct sos_iter_slot_s *slots = NULL;
+	sos_part_t part;
+	ods_idx_t idx;
+	int count, rc = 0;
+
+	pthread_mutex_lock(&sos->lock);
+	ods_lock(sos->part_ods, 0, NULL);
+	if (sos->part_gn != SOS_PART_UDATA(sos->part_udata)->gen)
+		__refresh_part_list(sos);
+	*pgen = sos->part_gn;
+	count = 0;
+	TAILQ_FOREACH(part, &sos->part_list, entry) {
+		if (__part_is_local_active(part))
+			count++;
+	}
+	if (!count)
+		goto out;
+	slots = calloc(count + 1, sizeof(*slots));
+	if (!slots) {
+		rc = ENOMEM;
+		goto out;
+	}
+	count = 1;
+	TAILQ_FOREACH(part, &sos->part_list, entry) {
+		if (!__part_is_local_active(part))
+			continue;
+		idx = __sos_part_idx(part, index);
+		if (!idx) {
+			rc = errno;
+			goto err;
+		}
+		slots[count].iter = ods_iter_new(idx);
+		if (!slots[count].iter) {
+			rc = errno;
+			goto err;
+		}
+		ods_atomic_inc(&part->ref_count);
+		slots[count].part = part;
+		count++;
+	}
+ out:
+	ods_unlock(sos->part_ods, 0);
+	pthread_mutex_unlock(&sos->lock);
+	*pslots = slots;
+	*pcount = slots ? count : 0;
+	return rc;
+ err:
+	while (--count > 0) {
+		ods_iter_delete(slots[count].iter);
+		sos_part_put(slots[count].part);
+	}
+	free(slots);
+	slots = NULL;
+	goto out;
+}
+
+
+/*
+ * Point the part_id table entry for part at part, growing the table
+ * if necessary. Called with the container lock held.
+ */
+static int __sos_part_table_set(sos_t sos, sos_part_t part)
+{
+	struct sos_part_table_s *table = sos->part_table;
+	struct sos_part_table_s *new_table;
+	uint64_t part_id = SOS_PART(part->part_obj)->part_id;
+	uint64_t count;
+
+	if (!table || part_id >= table->count) {
+		count = table ? table->count : 16;
+		while (count <= part_id)
+			count <<= 1;
+		new_table = calloc(1, sizeof(*new_table) + count * sizeof(sos_part_t));
+		if (!new_table)
+			return ENOMEM;
+		new_table->count = count;
+		if (table)
+			memcpy(new_table->parts, table->parts,
+			       table->count * sizeof(sos_part_t));
+		new_table->retired = table;
+		/* Readers must see the contents before the table */
+		__sync_synchronize();
+		sos->part_table = new_table;
+		table = new_table;
+	}
+	table->parts[part_id] = part;
+	return 0;
+}
+
+static void __sos_part_table_clear(sos_t sos, sos_part_t part)
+{
+	struct sos_part_table_s *table = sos->part_table;
+	uint64_t part_id = SOS_PART(part->part_obj)->part_id;
+
+	if (table && part_id < table->count && table->parts[part_id] == part)
+		table->parts[part_id] = NULL;
+}
+
+void __sos_part_table_free(sos_t sos)
+{
+	struct sos_part_table_s *table, *retired;
+
+	for (table = sos->part_table; table; table = retired) {
+		retired = table->retired;
+		free(table);
+	}
+	sos->part_table = NULL;
+}
+
+/*
+ * Take a partition that is no longer in the container out of the
+ * part_id table. The sos_part_s is kept until the container is
+ * closed, because __sos_part_by_id() callers may still be using it.
+ * Called with the container lock held.
+ */
+static void __sos_part_retire(sos_t sos, sos_part_t part)
+{
+	__sos_part_table_clear(sos, part);
+	if (part->obj_ods)
+		__sos_part_close_idle(sos, part);
+	/* Let the partition record be deleted now */
+	__sos_part_obj_put(sos, part->part_obj);
+	part->retired = 1;
+	TAILQ_INSERT_TAIL(&sos->part_retired, part, entry);
+}
+
+static int __refresh_part_list(sos_t sos)
+{
+	int rc = 0;
+	sos_part_t part;
+	ods_obj_t part_obj, next_obj;
+	struct sos_part_list old_list;
+	sos_part_state_t state;
+
+	/*
+	 * Partitions that are still in the list keep their sos_part_s,
+	 * so that their open object store and indices stay in use.
+	 * Removed partitions are retired rather than freed, because
+	 * __sos_part_by_id() callers do not take a reference.
+	 */
+	sos->primary_part = NULL;
+	TAILQ_INIT(&old_list);
+	TAILQ_CONCAT(&old_list, &sos->part_list, entry);
+	sos->part_gn = SOS_PART_UDATA(sos->part_udata)->gen;
+	part_obj = __sos_part_data_first(sos);
+	while (part_obj) {
+		next_obj = __sos_part_data_next(sos, part_obj);
+		part = __sos_part_by_id(sos, SOS_PART(part_obj)->part_id);
+		if (part && ods_obj_ref(part->part_obj) == ods_obj_ref(part_obj)) {
+			TAILQ_REMOVE(&old_list, part, entry);
+			__sos_part_obj_put(sos, part_obj);
+			ods_obj_put(part_obj);
+			state = SOS_PART(part->part_obj)->state;
+			if (part->obj_ods && state != SOS_PART_STATE_ACTIVE
+			    && state != SOS_PART_STATE_PRIMARY)
+				__sos_part_close_idle(sos, part);
+		} else {
+			part = __sos_part_new(sos, part_obj);
+			if (!part) {
+				rc = ENOMEM;
+				__sos_part_obj_put(sos, part_obj);
+				ods_obj_put(part_obj);
+				if (next_obj) {
+					__sos_part_obj_put(sos, next_obj);
+					ods_obj_put(next_obj);
+				}
+				goto out;
+			}
+			/* The partition is opened on first use, see __sos_part_ods() */
+		}
+		TAILQ_INSERT_TAIL(&sos->part_list, part, entry);
+		rc = __sos_part_table_set(sos, part);
+		if (rc) {
+			if (next_obj) {
+				__sos_part_obj_put(sos, next_obj);
+				ods_obj_put(next_obj);
+			}
+			goto out;
+		}
+		part_obj = next_obj;
+	}
+ out:
+	while (!TAILQ_EMPTY(&old_list)) {
+		part = TAILQ_FIRST(&old_list);
+		TAILQ_REMOVE(&old_list, part, entry);
+		__sos_part_retire(sos, part);
+	}
+	return rc;
+}
+
+static int refresh_part_list(sos_t sos)
+{
+	int rc;
+	ods_lock(sos->part_ods, 0, NULL);
+	rc = __refresh_part_list(sos);
+	ods_unlock(sos->part_ods, 0);
+	return rc;
+}
+
+int __sos_open_partitions(sos_t sos, char *tmp_path)
+{
+	int rc;
+
+	/* Open the partition ODS */
+	sprintf(tmp_path, "%s/.__part", sos->path);
+	sos->part_ods = ods_open(tmp_path, ODS_PERM_RW);
+	if (!sos->part_ods)
+		goto err_0;
+	sos->part_udata = ods_get_user_data(sos->part_ods);
+	if (!sos->part_udata)
+		goto err_1;
+	rc = refresh_part_list(sos);
+	return rc;
+ err_1:
+	ods_close(sos->part_ods, ODS_COMMIT_ASYNC);
+	sos->part_ods = NULL;
+ err_0:
+	return errno;
+}
+
+static int __sos_part_roll_due(sos_t sos, sos_part_t part)
+{
+	sos_part_udata_t udata = SOS_PART_UDATA(sos->part_udata);
+	time_t now;
+
+	if (sos->config.part_roll_size && part->obj_ods
+	    && ods_size(part->obj_ods) >= sos->config.part_roll_size)
+		return 1;
+	if (!sos->config.part_roll_time)
+		return 0;
+	now = time(NULL);
+	if (!udata->primary_time)
+		/* Made PRIMARY by a version that did not record the time */
+		udata->primary_time = now;
+	return now - (time_t)udata->primary_time >= sos->config.part_roll_time;
+}
+
+/*
+ * Ask the roll thread to make the standby partition PRIMARY if part
+ * is due to be rolled. This never waits for the roll thread; part
+ * remains PRIMARY until the roll thread has switched partitions.
+ */
+static void __sos_part_roll(sos_t sos, sos_part_t part)
+{
+	if (sos->roll_promote || !__sos_part_roll_due(sos, part))
+		return;
+	if (pthread_mutex_trylock(&sos->roll_lock))
+		return;
+	sos->roll_promote = 1;
+	pthread_cond_signal(&sos->roll_cond);
+	pthread_mutex_unlock(&sos->roll_lock);
+}
+
+/*
+ * Make the standby partition PRIMARY. Called by the roll thread. The
+ * list refresh done by sos_part_state_set() does not free the
+ * partition the application is allocating objects from, see
+ * __refresh_part_list().
+ */
+static int __sos_part_roll_promote(sos_t sos, uint64_t part_id)
+{
+	sos_part_t standby;
+	int rc;
+
+	/*
+	 * The partition list may have been refreshed since the standby
+	 * was created, look it up by id.
+	 */
+	pthread_mutex_lock(&sos->lock);
+	standby = __sos_part_by_id(sos, part_id);
+	if (standby)
+		ods_atomic_inc(&standby->ref_count);
+	pthread_mutex_unlock(&sos->lock);
+	if (!standby)
+		return ENOENT;
+	if (__sos_part_ods(standby))
+		rc = sos_part_state_set(standby, SOS_PART_STATE_PRIMARY);
+	else
+		rc = errno;
+	sos_part_put(standby);
+	return rc;
+}
+
+sos_part_t __sos_primary_obj_part(sos_t sos)
+{
+	sos_part_t part = NULL;
+
+	if ((NULL != sos->primary_part) &&
+	    (SOS_PART(sos->primary_part->part_obj)->state == SOS_PART_STATE_PRIMARY)) {
+		if (!sos->roll_running)
+			return sos->primary_part;
+		__sos_part_roll(sos, sos->primary_part);
+		return sos->primary_part;
+	}
+
+	pthread_mutex_lock(&sos->lock);
+	ods_lock(sos->part_ods, 0, NULL);
+	if (sos->part_gn != SOS_PART_UDATA(sos->part_udata)->gen) {
+		int rc = __refresh_part_list(sos);
+		if (rc)
+			goto out;
+	}
+	TAILQ_FOREACH(part, &sos->part_list, entry) {
+		if (SOS_PART(part->part_obj)->state == SOS_PART_STATE_PRIMARY) {
+			sos->primary_part = part;
+			goto out;
+		}
+	}
+ out:
+	ods_unlock(sos->part_ods, 0);
+	pthread_mutex_unlock(&sos->lock);
+	return part;
+}
+
+/*
+ * Returns !0 if part is the partition named by the PART_ROLL_STANDBY
+ * option and can still be used as the standby, i.e. it is ACTIVE
+ * and no partition has been created after it.
+ */
+static int __sos_part_is_standby(sos_t sos, sos_part_t part)
+{
+	if (strcmp(sos_part_name(part), sos->config.part_roll_standby))
+		return 0;
+	if (SOS_PART(part->part_obj)->state != SOS_PART_STATE_ACTIVE)
+		return 0;
+	return SOS_PART(part->part_obj)->part_id ==
+		SOS_PART_UDATA(sos->part_udata)->next_part_id;
+}
+
+static sos_part_t __sos_part_find_locked(sos_t sos, const char *name)
+{
+	sos_part_t part;
+
+	pthread_mutex_lock(&sos->lock);
+	TAILQ_FOREACH(part, &sos->part_list, entry) {
+		if (0 == strcmp(sos_part_name(part), name)) {
+			ods_atomic_inc(&part->ref_count);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sos->lock);
+	return part;
+}
+
+/*
+ * Create a new ACTIVE partition to become the next PRIMARY partition
+ * and return its part_id. The partition is created next to, and with
+ * the same flags as, the current PRIMARY partition.
+ *
+ * The partition is new and has no objects to reindex, so it is made
+ * ACTIVE by changing its state and bumping the list generation rather
+ * than with sos_part_state_set(). Either is safe beside the
+ * application's threads: a list refresh keeps the sos_part_s of every
+ * partition until the container is closed, which is also what lets
+ * __sos_part_roll_promote() use sos_part_state_set().
+ */
+static uint64_t __sos_part_roll_prepare(sos_t sos)
+{
+	char name[SOS_PART_NAME_LEN];
+	char path_buf[SOS_PART_PATH_LEN];
+	const char *path = NULL;
+	struct tm tm;
+	time_t now;
+	sos_part_t part;
+	uint64_t part_id = 0;
+	size_t extend;
+	int rc, flags = 0, seq = 0;
+
+	if (sos->config.part_roll_standby[0]) {
+		part = __sos_part_find_locked(sos, sos->config.part_roll_standby);
+		if (part) {
+			if (__sos_part_is_standby(sos, part))
+				part_id = SOS_PART(part->part_obj)->part_id;
+			sos_part_put(part);
+			if (part_id)
+				return part_id;
+		}
+	}
+	pthread_mutex_lock(&sos->lock);
+	TAILQ_FOREACH(part, &sos->part_list, entry) {
+		if (SOS_PART(part->part_obj)->state == SOS_PART_STATE_PRIMARY)
+			break;
+	}
+	if (part) {
+		if (strcmp(sos_part_path(part), sos->path))
+			path = strcpy(path_buf, sos_part_path(part));
+		if (part->local_index)
+			flags = SOS_PART_F_LOCAL_INDEX;
+	}
+	pthread_mutex_unlock(&sos->lock);
+	if (!part) {
+		rc = ENOENT;
+		goto err_0;
+	}
+
+	now = time(NULL);
+	localtime_r(&now, &tm);
+	strftime(name, sizeof(name), "%Y%m%d-%H%M%S", &tm);
+	while (EEXIST == (rc = sos_part_create_ex(sos, name, path, flags)))
+		snprintf(name + 15, sizeof(name) - 15, ".%d", ++seq);
+	if (rc)
+		goto err_0;
+	part = __sos_part_find_locked(sos, name);
+	if (!part) {
+		rc = ENOENT;
+		goto err_0;
+	}
+	if (!part->obj_ods) {
+		rc = __sos_open_partition(sos, part);
+		if (rc)
+			goto err_1;
+	}
+	extend = sos->config.part_roll_extend;
+	if (sos->config.part_roll_size && extend > sos->config.part_roll_size / 2)
+		extend = sos->config.part_roll_size / 2;
+	if (extend)
+		(void)ods_extend(part->obj_ods, extend);
+
+	pthread_mutex_lock(&sos->lock);
+	ods_lock(sos->part_ods, 0, NULL);
+	if (SOS_PART(part->part_obj)->state == SOS_PART_STATE_OFFLINE) {
+		SOS_PART(part->part_obj)->state = SOS_PART_STATE_ACTIVE;
+		ods_atomic_inc(&SOS_PART_UDATA(sos->part_udata)->gen);
+	}
+	ods_unlock(sos->part_ods, 0);
+	pthread_mutex_unlock(&sos->lock);
+	part_id = SOS_PART(part->part_obj)->part_id;
+	sos_part_put(part);
+
+	/* Remember the standby across opens of the container */
+	strcpy(sos->config.part_roll_standby, name);
+	(void)sos_container_config_set(sos->path, SOS_PART_ROLL_STANDBY, name);
+	return part_id;
+ err_1:
+	sos_part_put(part);
+ err_0:
+	sos_error("Error %d creating the standby partition '%s'\n", rc, name);
+	return 0;
+}
+
+static void *__sos_part_roll_proc(void *arg)
+{
+	sos_t sos = arg;
+	struct timespec ts;
+	uint64_t part_id;
+	int rc;
+
+	pthread_mutex_lock(&sos->roll_lock);
+	while (!sos->roll_stop) {
+		if (sos->roll_promote && sos->roll_standby) {
+			part_id = sos->roll_standby;
+			pthread_mutex_unlock(&sos->roll_lock);
+			rc = __sos_part_roll_promote(sos, part_id);
+			if (rc)
+				sos_error("Error %d making the standby "
+					  "partition PRIMARY\n", rc);
+			pthread_mutex_lock(&sos->roll_lock);
+			/* Prepare a new standby, even if this one failed */
+			sos->roll_standby = 0;
+			sos->roll_promote = 0;
+			continue;
+		}
+		if (sos->roll_standby) {
+			pthread_cond_wait(&sos->roll_cond, &sos->roll_lock);
+			continue;
+		}
+		pthread_mutex_unlock(&sos->roll_lock);
+		part_id = __sos_part_roll_prepare(sos);
+		pthread_mutex_lock(&sos->roll_lock);
+		if (part_id) {
+			sos->roll_standby = part_id;
+			continue;
+		}
+		/* Retry later */
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += 10;
+		pthread_cond_timedwait(&sos->roll_cond, &sos->roll_lock, &ts);
+	}
+	pthread_mutex_unlock(&sos->roll_lock);
+	return NULL;
+}
+
+/*
+ * Start the thread that rolls the PRIMARY partition if the container
+ * is configured to do so.
+ */
+int __sos_part_roll_start(sos_t sos)
+{
+	int rc;
+
+	if (sos->o_perm == ODS_PERM_RO)
+		return 0;
+	if (!sos->config.part_roll_time && !sos->config.part_roll_size)
+		return 0;
+	rc = pthread_create(&sos->roll_thread, NULL, __sos_part_roll_proc, sos);
+	if (rc)
+		return rc;
+	sos->roll_running = 1;
+	return 0;
+}
+
+void __sos_part_roll_stop(sos_t sos)
+{
+	if (!sos->roll_running)
+		return;
+	pthread_mutex_lock(&sos->roll_lock);
+	sos->roll_stop = 1;
+	pthread_cond_signal(&sos->roll_cond);
+	pthread_mutex_unlock(&sos->roll_lock);
+	pthread_join(sos->roll_thread, NULL);
+	sos->roll_running = 0;
+}
+
+/*
+ * Background index build
+ *
+ * sos_schema_index_add() on a schema that is already in a container
+ * creates the index, sets the attribute's building flag and starts
+ * the build thread. The thread builds one index at a time. It takes
+ * a snapshot of the ACTIVE and PRIMARY partitions, the PRIMARY last,
+ * and adds their objects to the index, running DUTY_CYCLE
+ * microseconds of each second.
+ *
+ * A partition is scanned in chunks of BUILD_CHUNK objects with the
+ * build_lock held. At the end of a chunk, build_cursor is set to the
+ * object the scan will resume at. __sos_obj_index_attr() consults
+ * __sos_index_build_visited() under the same lock, so an object is
+ * added either by the scan or by the caller, never by both.
+ *
+ * sos_obj_new() and sos_obj_delete() also hold the build_lock. An
+ * object allocated where the scan of a building index has not been
+ * yet is recorded in build_new with that index's attribute. The scan
+ * skips it, because it would otherwise add the object with whatever
+ * values it has when the scan gets there, and the caller's
+ * sos_obj_index() adds it instead.
+ */
+#define BUILD_CHUNK 256
+
+struct build_new_s {
+	sos_obj_ref_t ref;
+	sos_attr_t attr;
+	struct rbn rbn;
+};
+
+static int __build_new_cmp(void *a, void *b)
+{
+	struct sos_idx_ref_s *ra = a;
+	struct sos_idx_ref_s *rb = b;
+
+	if (ra->ods != rb->ods)
+		return (ra->ods < rb->ods ? -1 : 1);
+	if (ra->obj != rb->obj)
+		return (ra->obj < rb->obj ? -1 : 1);
+	return 0;
+}
+
+/* Called with the build_lock held */
+static struct build_new_s *__build_new_find(sos_t sos, uint64_t part_id,
+					    ods_ref_t obj_ref)
+{
+	struct sos_idx_ref_s ref = { part_id, obj_ref };
+	struct rbn *rbn;
+
+	if (rbt_empty(&sos->build_new))
+		return NULL;
+	rbn = rbt_find(&sos->build_new, &ref);
+	if (!rbn)
+		return NULL;
+	return container_of(rbn, struct build_new_s, rbn);
+}
+
+/* Called with the build_lock held */
+static void __build_new_del(sos_t sos, struct build_new_s *ent)
+{
+	rbt_del(&sos->build_new, &ent->rbn);
+	free(ent);
+}
+
+/* Called with the build_lock held */
+static void __build_new_clear(sos_t sos)
+{
+	while (!rbt_empty(&sos->build_new))
+		__build_new_del(sos, container_of(rbt_min(&sos->build_new),
+						  struct build_new_s, rbn));
+}
+
+struct build_args {
+	double start;
+	double timeout;
+	sos_t sos;
+	sos_attr_t attr;
+	uint64_t part_id;
+	ods_ref_t stop_ref;	/* The object the scan stopped at */
+	int count;
+	int stopped;
+	int slice_done;
+};
+
+static double __build_now(void)
+{
+	struct timeval tv;
+	(void)gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec * 1.0e6 + (double)tv.tv_usec;
+}
+
+static int __build_callback_fn(ods_t ods, ods_obj_t obj, void *arg)
+{
+	struct build_args *barg = arg;
+	sos_obj_data_t sos_obj_data = obj->as.ptr;
+	sos_schema_t schema = barg->attr->schema;
+	struct build_new_s *ent;
+	sos_obj_ref_t ref;
+	sos_obj_t sos_obj;
+	int rc;
+
+	if (barg->count >= BUILD_CHUNK) {
+		/* Let the application's threads in */
+		barg->stop_ref = ods_obj_ref(obj);
+		barg->stopped = 1;
+		return 1;
+	}
+	if (__build_now() - barg->start > barg->timeout) {
+		barg->stop_ref = ods_obj_ref(obj);
+		barg->stopped = 1;
+		barg->slice_done = 1;
+		return 1;
+	}
+	barg->count++;
+	if (sos_obj_data->schema != schema->data->id)
+		return 0;
+	ref.ref.ods = barg->part_id;
+	ref.ref.obj = ods_obj_ref(obj);
+	ent = __build_new_find(barg->sos, ref.ref.ods, ref.ref.obj);
+	if (ent && ent->attr == barg->attr) {
+		/* Allocated ahead of the scan, the caller indexes it */
+		__build_new_del(barg->sos, ent);
+		return 0;
+	}
+	sos_obj = __sos_init_obj(barg->sos, schema, ods_obj_get(obj), ref);
+	if (!sos_obj)
+		return 0;
+	rc = __sos_obj_index_key(sos_obj, barg->attr, barg->attr->index, 0);
+	if (rc)
+		sos_warn("The object of type '%s' at %p could not be indexed: "
+			 "errno %d\n", sos_schema_name(schema), ref.ref.obj, rc);
+	else
+		barg->sos->build_objs++;
+	sos_obj_put(sos_obj);
+	return 0;
+}
+
+/*
+ * Add the objects in the partition at build_parts[build_next] to the
+ * index. Returns EINTR if the thread was asked to stop.
+ */
+static int __build_part(sos_t sos, sos_attr_t attr)
+{
+	struct ods_obj_iter_pos_s pos;
+	struct build_args barg;
+	struct timespec ts;
+	sos_part_t part;
+	ods_t ods;
+	int rc;
+
+	pthread_mutex_lock(&sos->lock);
+	part = __sos_part_by_id(sos, sos->build_parts[sos->build_next]);
+	if (part && (SOS_PART(part->part_obj)->state == SOS_PART_STATE_ACTIVE
+		     || SOS_PART(part->part_obj)->state == SOS_PART_STATE_PRIMARY))
+		ods_atomic_inc(&part->ref_count);
+	else
+		/* Deleted or taken offline since the build started */
+		part = NULL;
+	pthread_mutex_unlock(&sos->lock);
+	ods = part ? __sos_part_ods_pin(part) : NULL;
+	if (!ods) {
+		if (part)
+			sos_part_put(part);
+		pthread_mutex_lock(&sos->build_lock);
+		sos->build_next++;
+		pthread_mutex_unlock(&sos->build_lock);
+		return 0;
+	}
+
+	memset(&barg, 0, sizeof(barg));
+	barg.sos = sos;
+	barg.attr = attr;
+	barg.part_id = SOS_PART(part->part_obj)->part_id;
+	barg.timeout = DUTY_CYCLE;
+	barg.start = __build_now();
+	ods_obj_iter_pos_init(&pos);
+	pthread_mutex_lock(&sos->build_lock);
+	sos->build_size = ods_size(ods);
+	do {
+		barg.count = 0;
+		barg.stopped = 0;
+		rc = ods_obj_iter(ods, &pos, __build_callback_fn, &barg);
+		if (!rc)
+			break;
+		if (!barg.stopped)
+			goto out;
+		sos->build_cursor = barg.stop_ref;
+		pthread_mutex_unlock(&sos->build_lock);
+		pthread_mutex_lock(&sos->build_lock);
+		if (sos->build_stop) {
+			rc = EINTR;
+			goto out;
+		}
+		if (!barg.slice_done)
+			continue;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += (1000000 - DUTY_CYCLE) * 1000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec += 1;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&sos->build_cond, &sos->build_lock, &ts);
+		if (sos->build_stop) {
+			rc = EINTR;
+			goto out;
+		}
+		sos->build_size = ods_size(ods);
+		barg.slice_done = 0;
+		barg.start = __build_now();
+	} while (1);
+	/* Objects allocated in the partition from now on are the caller's */
+	sos->build_next++;
+	sos->build_cursor = 0;
+ out:
+	pthread_mutex_unlock(&sos->build_lock);
+	__sos_part_ods_unpin(part);
+	sos_part_put(part);
+	return rc;
+}
+
+/*
+ * Return the first attribute whose index is waiting to be built
+ */
+static sos_attr_t __build_attr_next(sos_t sos)
+{
+	sos_schema_t schema;
+	sos_attr_t attr;
+
+	pthread_mutex_lock(&sos->lock);
+	LIST_FOREACH(schema, &sos->schema_list, entry) {
+		TAILQ_FOREACH(attr, &schema->idx_attr_list, idx_entry) {
+			if (attr->data->building)
+				goto out;
+		}
+	}
+	attr = NULL;
+ out:
+	pthread_mutex_unlock(&sos->lock);
+	return attr;
+}
+
+/*
+ * Take the snapshot of the partitions to scan. The PRIMARY partition
+ * is scanned last because it is the one being written to.
+ */
+static int __build_prepare(sos_t sos, sos_attr_t attr)
+{
+	uint64_t *parts, primary = 0;
+	sos_part_state_t state;
+	sos_part_t part;
+	int count = 0;
+
+	pthread_mutex_lock(&sos->lock);
+	TAILQ_FOREACH(part, &sos->part_list, entry)
+		count++;
+	parts = calloc(count + 1, sizeof(*parts));
+	if (!parts) {
+		pthread_mutex_unlock(&sos->lock);
+		return ENOMEM;
+	}
+	count = 0;
+	TAILQ_FOREACH(part, &sos->part_list, entry) {
+		state = SOS_PART(part->part_obj)->state;
+		if (state == SOS_PART_STATE_PRIMARY)
+			primary = SOS_PART(part->part_obj)->part_id;
+		else if (state == SOS_PART_STATE_ACTIVE)
+			parts[count++] = SOS_PART(part->part_obj)->part_id;
+	}
+	if (primary)
+		parts[count++] = primary;
+	pthread_mutex_unlock(&sos->lock);
+
+	pthread_mutex_lock(&sos->build_lock);
+	sos->build_parts = parts;
+	sos->build_count = count;
+	sos->build_next = 0;
+	sos->build_cursor = 0;
+	sos->build_size = 0;
+	sos->build_objs = 0;
+	sos->build_attr = attr;
+	pthread_mutex_unlock(&sos->build_lock);
+	return 0;
+}
+
+static void *__sos_index_build_proc(void *arg)
+{
+	sos_t sos = arg;
+	struct timespec ts;
+	sos_attr_t attr;
+	int rc;
+
+	pthread_mutex_lock(&sos->build_lock);
+	while (!sos->build_stop) {
+		pthread_mutex_unlock(&sos->build_lock);
+		attr = __build_attr_next(sos);
+		pthread_mutex_lock(&sos->build_lock);
+		if (!attr) {
+			__build_new_clear(sos);
+			pthread_cond_wait(&sos->build_cond, &sos->build_lock);
+			continue;
+		}
+		pthread_mutex_unlock(&sos->build_lock);
+		rc = __sos_schema_open(sos, attr->schema);
+		if (!rc)
+			rc = __build_prepare(sos, attr);
+		while (!rc && sos->build_next < sos->build_count)
+			rc = __build_part(sos, attr);
+		pthread_mutex_lock(&sos->build_lock);
+		if (!rc) {
+			sos_index_commit(attr->index, SOS_COMMIT_ASYNC);
+			sos_info("The index of %s.%s is built, %ld objects\n",
+				 sos_schema_name(attr->schema), sos_attr_name(attr),
+				 sos->build_objs);
+			/* The index can be used from now on */
+			attr->data->building = 0;
+		}
+		sos->build_attr = NULL;
+		free(sos->build_parts);
+		sos->build_parts = NULL;
+		sos->build_count = 0;
+		if (rc && !sos->build_stop) {
+			sos_error("Error %d building the index of %s.%s\n", rc,
+				  sos_schema_name(attr->schema), sos_attr_name(attr));
+			/* Retry later */
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += 10;
+			pthread_cond_timedwait(&sos->build_cond, &sos->build_lock, &ts);
+		}
+	}
+	__build_new_clear(sos);
+	pthread_mutex_unlock(&sos->build_lock);
+	return NULL;
+}
+
+/*
+ * Start the index build thread if it is not running and wake it up
+ */
+int __sos_index_build_start(sos_t sos)
+{
+	int rc = 0;
+
+	pthread_mutex_lock(&sos->build_lock);
+	if (!sos->build_running) {
+		rbt_init(&sos->build_new, __build_new_cmp);
+		rc = pthread_create(&sos->build_thread, NULL,
+				    __sos_index_build_proc, sos);
+		if (!rc)
+			sos->build_running = 1;
+	}
+	pthread_cond_signal(&sos->build_cond);
+	pthread_mutex_unlock(&sos->build_lock);
+	return rc;
+}
+
+/*
+ * Called when the container is opened. An index build that did not
+ * complete before the container was closed starts over; the index
+ * files are removed here, before any thread can open them, and are
+ * recreated empty when the index is next opened.
+ */
+int __sos_index_build_resume(sos_t sos)
+{
+	char idx_name[SOS_SCHEMA_NAME_LEN + SOS_ATTR_NAME_LEN + 2];
+	char tmp_path[PATH_MAX];
+	sos_schema_t schema;
+	sos_attr_t attr;
+	sos_part_t part;
+	int count = 0;
+
+	if (sos->o_perm == ODS_PERM_RO)
+		return 0;
+	LIST_FOREACH(schema, &sos->schema_list, entry) {
+		TAILQ_FOREACH(attr, &schema->idx_attr_list, idx_entry) {
+			if (!attr->data->building)
+				continue;
+			sprintf(idx_name, "%s_%s",
+				schema->data->name, attr->data->name);
+			sprintf(tmp_path, "%s/%s_idx", sos->path, idx_name);
+			(void)ods_idx_destroy(tmp_path);
+			TAILQ_FOREACH(part, &sos->part_list, entry) {
+				if (!part->local_index)
+					continue;
+				sprintf(tmp_path, "%s/%s/indices/%s_idx",
+					sos_part_path(part), sos_part_name(part),
+					idx_name);
+				(void)ods_idx_destroy(tmp_path);
+			}
+			count++;
+		}
+	}
+	if (!count)
+		return 0;
+	return __sos_index_build_start(sos);
+}
+
+void __sos_index_build_stop(sos_t sos)
+{
+	if (!sos->build_running)
+		return;
+	pthread_mutex_lock(&sos->build_lock);
+	sos->build_stop = 1;
+	pthread_cond_signal(&sos->build_cond);
+	pthread_mutex_unlock(&sos->build_lock);
+	pthread_join(sos->build_thread, NULL);
+	sos->build_running = 0;
+}
+
+/*
+ * Returns !0 if the object must be added to the attribute's index by
+ * the caller, i.e. the index build has already passed the object's
+ * place in its partition or is not going to scan the partition. The
+ * caller holds the build_lock.
+ */
+static int __build_visited(sos_t sos, sos_obj_t obj, sos_attr_t attr)
+{
+	uint64_t part_id = obj->obj_ref.ref.ods;
+	struct build_new_s *ent;
+	int i;
+
+	ent = __build_new_find(sos, part_id, obj->obj_ref.ref.obj);
+	if (ent && ent->attr == attr)
+		/* The scan will skip it */
+		return 1;
+	if (sos->build_attr != attr)
+		/* The build will visit every object if it hasn't started */
+		return !attr->data->building;
+	for (i = 0; i < sos->build_count; i++) {
+		if (sos->build_parts[i] == part_id)
+			break;
+	}
+	if (i == sos->build_count)
+		/* The partition was made active after the build started */
+		return 1;
+	if (i > sos->build_next)
+		return 0;
+	if (i == sos->build_next)
+		return obj->obj_ref.ref.obj < sos->build_cursor;
+	return 1;
+}
+
+int __sos_index_build_visited(sos_obj_t obj, sos_attr_t attr)
+{
+	sos_t sos = attr->schema->sos;
+	int visited;
+
+	pthread_mutex_lock(&sos->build_lock);
+	visited = __build_visited(sos, obj, attr);
+	pthread_mutex_unlock(&sos->build_lock);
+	return visited;
+}
+
+void __sos_index_build_lock(sos_t sos)
+{
+	pthread_mutex_lock(&sos->build_lock);
+}
+
+void __sos_index_build_unlock(sos_t sos)
+{
+	pthread_mutex_unlock(&sos->build_lock);
+}
+
+/*
+ * Called by sos_obj_new() with the build_lock held. If the scan of
+ * the first index of the schema that is building has not reached the
+ * new object, it is recorded so that the scan skips it and the
+ * caller's sos_obj_index() adds it. Indices after the first are
+ * scanned long after the caller has set the object's values. Returns
+ * ENOMEM if the object cannot be recorded.
+ */
+int __sos_index_build_obj_new(sos_obj_t obj)
+{
+	sos_t sos = obj->sos;
+	struct build_new_s *ent;
+	sos_attr_t attr;
+
+	if (!sos->build_running)
+		return 0;
+	pthread_mutex_lock(&sos->lock);
+	TAILQ_FOREACH(attr, &obj->schema->idx_attr_list, idx_entry) {
+		if (attr->data->building)
+			break;
+	}
+	pthread_mutex_unlock(&sos->lock);
+	if (!attr || __build_visited(sos, obj, attr))
+		return 0;
+	ent = malloc(sizeof(*ent));
+	if (!ent)
+		return ENOMEM;
+	ent->ref = obj->obj_ref;
+	ent->attr = attr;
+	rbn_init(&ent->rbn, &ent->ref.ref);
+	rbt_ins(&sos->build_new, &ent->rbn);
+	return 0;
+}
+
+/*
+ * Called by sos_obj_delete() with the build_lock held. The lock is
+ * kept until the object is freed so that the scan cannot reach it in
+ * between. An object that was removed from its indices before the
+ * scan reached it may have been added by the scan since; that entry
+ * is removed here.
+ */
+void __sos_index_build_obj_delete(sos_obj_t obj)
+{
+	sos_t sos = obj->sos;
+	sos_attr_t attr = sos->build_attr;
+	struct build_new_s *ent;
+	int skipped;
+
+	if (!sos->build_running)
+		return;
+	ent = __build_new_find(sos, obj->obj_ref.ref.ods, obj->obj_ref.ref.obj);
+	if (ent) {
+		/* The storage may be reused by another object */
+		skipped = (ent->attr == attr);
+		__build_new_del(sos, ent);
+		if (skipped)
+			return;
+	}
+	if (attr && attr->schema == obj->schema
+	    && __build_visited(sos, obj, attr))
+		(void)__sos_obj_remove_key(obj, attr, attr->index);
+}
+
+/**
+ * \brief Return the progress of an index build
+ *
+ * An index added with sos_schema_index_add() to a schema that is
+ * already in a container is built in the background. This function
+ * reports how far the build has progressed. Partitions are scanned
+ * one at a time; \c part_pos and \c part_size report the progress
+ * through the partition being scanned.
+ *
+ * \param attr	The attribute handle
+ * \param sb	Pointer to the sos_index_build_stat_s to fill in
+ * \retval 0	Success
+ * \retval ENOENT The attribute is not indexed
+ */
+int sos_attr_index_build_stat(sos_attr_t attr, sos_index_build_stat_t sb)
+{
+	sos_t sos = attr->schema->sos;
+
+	if (!attr->data->indexed)
+		return ENOENT;
+	memset(sb, 0, sizeof(*sb));
+	sb->building = attr->data->building;
+	if (!sos || !sb->building)
+		return 0;
+	pthread_mutex_lock(&sos->build_lock);
+	if (sos->build_attr == attr) {
+		sb->part_count = sos->build_count;
+		sb->part_done = sos->build_next;
+		if (sos->build_next < sos->build_count) {
+			sb->part_size = sos->build_size;
+			sb->part_pos = sos->build_cursor < sos->build_size ?
+				sos->build_cursor : sos->build_size;
+		}
+		sb->obj_count = sos->build_objs;
+	}
+	sb->building = attr->data->building;
+	pthread_mutex_unlock(&sos->build_lock);
+	return 0;
+}
+
+/*
+ * Partition retention
+ *
+ * If the PART_RETENTION option is set, the retain thread periodically
+ * deletes the ACTIVE partitions whose object store has not been
+ * modified for that long. A partition is deleted by making it
+ * OFFLINE, which removes the keys of its objects from the container's
+ * indices DUTY_CYCLE microseconds of each second, and then removing
+ * its files. The keys of a partition with local indices go with its
+ * index files. The PRIMARY partition and the roll standby are never
+ * deleted.
+ */
+#define RETAIN_INTERVAL 60
+
+/*
+ * Format a path into a PATH_MAX buffer. Returns ENAMETOOLONG rather
+ * than leave a truncated path in the buffer.
+ */
+static int __part_path_fmt(char *path, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(path, PATH_MAX, fmt, ap);
+	va_end(ap);
+	if (len < 0 || len >= PATH_MAX) {
+		path[0] = '\0';
+		return ENAMETOOLONG;
+	}
+	return 0;
+}
+
+/*
+ * Returns the last time an object was written to the partition, or 0
+ * if its object store has never been opened. The page file is not
+ * consulted, it is also written when objects are only read.
+ */
+static time_t __sos_part_mtime(sos_part_t part)
+{
+	char tmp_path[PATH_MAX];
+	struct stat sb;
+
+	if (__part_path_fmt(tmp_path, "%s/%s/objects.OBJ",
+			    sos_part_path(part), sos_part_name(part)))
+		return 0;
+	if (stat(tmp_path, &sb))
+		return 0;
+	return sb.st_mtime;
+}
+
+/*
+ * Returns the part_id of the partitions that may be deleted, i.e. the
+ * ACTIVE partitions other than the standby.
+ */
+static uint64_t *__retain_prepare(sos_t sos, int *pcount)
+{
+	uint64_t *part_ids = NULL;
+	sos_part_t part;
+	int count = 0;
+
+	pthread_mutex_lock(&sos->lock);
+	ods_lock(sos->part_ods, 0, NULL);
+	if (sos->part_gn != SOS_PART_UDATA(sos->part_udata)->gen
+	    && __refresh_part_list(sos))
+		goto out;
+	TAILQ_FOREACH(part, &sos->part_list, entry)
+		count++;
+	part_ids = calloc(count + 1, sizeof(*part_ids));
+	if (!part_ids)
+		goto out;
+	count = 0;
+	TAILQ_FOREACH(part, &sos->part_list, entry) {
+		if (SOS_PART(part->part_obj)->state != SOS_PART_STATE_ACTIVE)
+			continue;
+		if (__sos_part_is_standby(sos, part)
+		    || SOS_PART(part->part_obj)->part_id == sos->roll_standby)
+			continue;
+		part_ids[count++] = SOS_PART(part->part_obj)->part_id;
+	}
+ out:
+	ods_unlock(sos->part_ods, 0);
+	pthread_mutex_unlock(&sos->lock);
+	*pcount = count;
+	return part_ids;
+}
+
+/**
+ * \brief Delete the partitions older than the retention period
+ *
+ * Deletes the ACTIVE partitions whose object store has not been
+ * modified for \c keep seconds and frees their storage. The PRIMARY
+ * partition and the standby partition are never deleted. The keys
+ * of the deleted objects are removed from the container's indices
+ * DUTY_CYCLE microseconds of each second so that threads adding
+ * objects to the container are not stalled.
+ *
+ * This is what the container does periodically if the
+ * PART_RETENTION option is set, see sos_container_config_set().
+ *
+ * \param sos	The container handle
+ * \param keep	The retention period in seconds, 0 to use the
+ *		PART_RETENTION option
+ * \param stat	If not NULL, the partitions deleted and the bytes
+ *		reclaimed by this call are returned here
+ * \retval 0	Success
+ * \retval EPERM The container is open read-only
+ * \retval EINVAL \c keep is 0 and no retention period is configured
+ * \retval ENOMEM Insufficient resources
+ */
+int sos_part_retain(sos_t sos, time_t keep, sos_part_retain_stat_t stat)
+{
+	struct sos_part_retain_stat_s sb;
+	uint64_t *part_ids, bytes;
+	sos_part_t part;
+	time_t mtime, now;
+	int i, count, rc;
+
+	memset(&sb, 0, sizeof(sb));
+	if (stat)
+		memset(stat, 0, sizeof(*stat));
+	if (sos->o_perm == ODS_PERM_RO)
+		return EPERM;
+	if (!keep)
+		keep = sos->config.part_retention;
+	if (!keep)
+		return EINVAL;
+	part_ids = __retain_prepare(sos, &count);
+	if (!part_ids)
+		return ENOMEM;
+	now = time(NULL);
+	for (i = 0; i < count; i++) {
+		pthread_mutex_lock(&sos->lock);
+		part = __sos_part_by_id(sos, part_ids[i]);
+		if (part)
+			ods_atomic_inc(&part->ref_count);
+		pthread_mutex_unlock(&sos->lock);
+		if (!part)
+			continue;
+		mtime = __sos_part_mtime(part);
+		if (!mtime || now - mtime < keep) {
+			sos_part_put(part);
+			continue;
+		}
+		rc = sos_part_state_set(part, SOS_PART_STATE_OFFLINE);
+		if (rc == EINTR) {
+			sos_part_put(part);
+			break;
+		}
+		if (!rc)
+			rc = __sos_part_delete(part, &bytes);
+		if (rc) {
+			sos_part_put(part);
+			continue;
+		}
+		sb.part_count++;
+		sb.bytes += bytes;
+	}
+	free(part_ids);
+	pthread_mutex_lock(&sos->retain_lock);
+	sos->retain_stat.part_count += sb.part_count;
+	sos->retain_stat.bytes += sb.bytes;
+	pthread_mutex_unlock(&sos->retain_lock);
+	if (stat)
+		*stat = sb;
+	return 0;
+}
+
+/**
+ * \brief Return the partitions deleted by retention
+ *
+ * Returns the number of partitions deleted and the bytes of storage
+ * reclaimed by sos_part_retain() and the retain thread since the
+ * container was opened.
+ *
+ * \param sos	The container handle
+ * \param stat	The statistics are returned here
+ */
+void sos_part_retain_stat(sos_t sos, sos_part_retain_stat_t stat)
+{
+	pthread_mutex_lock(&sos->retain_lock);
+	*stat = sos->retain_stat;
+	pthread_mutex_unlock(&sos->retain_lock);
+}
+
+static void *__sos_part_retain_proc(void *arg)
+{
+	sos_t sos = arg;
+	struct timespec ts;
+	time_t interval;
+
+	interval = sos->config.part_retention;
+	if (interval > RETAIN_INTERVAL)
+		interval = RETAIN_INTERVAL;
+	pthread_mutex_lock(&sos->retain_lock);
+	while (!sos->retain_stop) {
+		pthread_mutex_unlock(&sos->retain_lock);
+		(void)sos_part_retain(sos, 0, NULL);
+		pthread_mutex_lock(&sos->retain_lock);
+		if (sos->retain_stop)
+			break;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += interval;
+		pthread_cond_timedwait(&sos->retain_cond, &sos->retain_lock, &ts);
+	}
+	pthread_mutex_unlock(&sos->retain_lock);
+	return NULL;
+}
+
+/*
+ * Start the thread that deletes old partitions if the container is
+ * configured to do so.
+ */
+int __sos_part_retain_start(sos_t sos)
+{
+	int rc;
+
+	if (sos->o_perm == ODS_PERM_RO)
+		return 0;
+	if (!sos->config.part_retention)
+		return 0;
+	rc = pthread_create(&sos->retain_thread, NULL, __sos_part_retain_proc, sos);
+	if (rc)
+		return rc;
+	sos->retain_running = 1;
+	return 0;
+}
+
+void __sos_part_retain_stop(sos_t sos)
+{
+	if (!sos->retain_running)
+		return;
+	pthread_mutex_lock(&sos->retain_lock);
+	sos->retain_stop = 1;
+	pthread_cond_broadcast(&sos->retain_cond);
+	pthread_mutex_unlock(&sos->retain_lock);
+	pthread_join(sos->retain_thread, NULL);
+	sos->retain_running = 0;
+}
+
+struct export_obj_iter_args_s {
+	sos_t src_sos;
+	sos_part_t src_part;
+	int64_t export_count;
+};
+
+/*
+ * Export pipeline
+ *
+ * Reader threads walk disjoint page ranges of the source partition
+ * and queue batches of objects. A single writer copies each object
+ * to the primary partition of the destination container and rewrites
+ * its reference attributes using an in-memory map from source to
+ * destination references. If requested, the indices are built once
+ * the copy is complete, one index per thread.
+ *
+ * Memory use is bounded for large partitions. Once the map holds
+ * EXP_MAP_MAX entries, further entries go to an index in the
+ * destination container directory. The indices are also updated each
+ * time EXP_REFS_MAX objects are waiting to be indexed.
+ */
+#define EXP_BATCH_SIZE		256
+#define EXP_RANGES_PER_THREAD	4
+#define EXP_MAP_MAX		(1 << 21)
+#define EXP_REFS_MAX		(1 << 22)
+
+struct exp_batch_s {
+	int count;
+	TAILQ_ENTRY(exp_batch_s) entry;
+	ods_obj_t objs[EXP_BATCH_SIZE];
+};
+
+struct exp_map_ent_s {
+	sos_obj_ref_t from;
+	sos_obj_ref_t to;
+};
+
+struct exp_schema_refs_s {
+	sos_schema_t schema;
+	size_t count;
+	size_t alloc;
+	sos_obj_ref_t *refs;
+};
+
+struct exp_reader_s {
+	struct export_s *exp;
+	struct exp_batch_s *batch;
+};
+
+struct export_s {
+	sos_t src_sos;
+	sos_t dst_sos;
+	sos_part_t src_part;
+	ods_t src_ods;
+	int reindex;
+	int64_t export_count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready_cond;
+	pthread_cond_t space_cond;
+	TAILQ_HEAD(exp_batch_q, exp_batch_s) batch_q;
+	int batch_depth;
+	int batch_max;
+	int readers;
+	int stop;
+	int rc;
+	struct ods_obj_iter_pos_s *ranges;
+	int range_count;
+	int range_next;
+
+	/* Only the writer touches the reference map and object lists */
+	struct exp_map_ent_s *map;
+	size_t map_count;
+	size_t map_size;
+	ods_idx_t map_idx;	/* Entries beyond EXP_MAP_MAX */
+	char map_path[PATH_MAX];
+	struct exp_schema_refs_s *refs;
+	int refs_count;
+	size_t refs_total;	/* Objects waiting to be indexed */
+
+	/* Index build work list */
+	struct exp_idx_work_s {
+		struct exp_schema_refs_s *refs;
+		sos_attr_t attr;
+	} *work;
+	int work_count;
+	int work_next;
+};
+
+static int __export_index(struct export_s *exp);
+
+static inline size_t __exp_map_slot(sos_obj_ref_t ref, size_t size)
+{
+	uint64_t h = (ref.ref.obj ^ (ref.ref.ods << 48)) * 0x9E3779B97F4A7C15UL;
+	return (h >> 16) & (size - 1);
+}
+
+static int __exp_map_find(struct export_s *exp, sos_obj_ref_t from, sos_obj_ref_t *to)
+{
+	size_t slot;
+	if (exp->map) {
+		for (slot = __exp_map_slot(from, exp->map_size);
+		     exp->map[slot].from.ref.obj;
+		     slot = (slot + 1) & (exp->map_size - 1)) {
+			if (exp->map[slot].from.ref.obj == from.ref.obj
+			    && exp->map[slot].from.ref.ods == from.ref.ods) {
+				*to = exp->map[slot].to;
+				return 0;
+			}
+		}
+	}
+	if (exp->map_idx) {
+		ODS_KEY(key);
+		ods_key_set(&key, &from, sizeof(from));
+		return ods_idx_find(exp->map_idx, &key, &to->idx_data);
+	}
+	return ENOENT;
+}
+
+static void __exp_map_put(struct exp_map_ent_s *map, size_t size,
+			  sos_obj_ref_t from, sos_obj_ref_t to)
+{
+	size_t slot;
+	for (slot = __exp_map_slot(from, size);
+	     map[slot].from.ref.obj;
+	     slot = (slot + 1) & (size - 1));
+	map[slot].from = from;
+	map[slot].to = to;
+}
+
+/*
+ * Once the map is full, the entries are kept in an index in the
+ * destination container directory that is removed by __export_free().
+ */
+static int __exp_map_spill(struct export_s *exp, sos_obj_ref_t from, sos_obj_ref_t to)
+{
+	ODS_KEY(key);
+	int rc;
+
+	if (!exp->map_idx) {
+		if (snprintf(exp->map_path, sizeof(exp->map_path), "%s/%s_export",
+			     exp->dst_sos->path, sos_part_name(exp->src_part))
+		    >= sizeof(exp->map_path))
+			return ENAMETOOLONG;
+		rc = ods_idx_create(exp->map_path, 0600, "BXTREE", "MEMCMP", NULL);
+		if (rc)
+			return rc;
+		exp->map_idx = ods_idx_open(exp->map_path, ODS_PERM_RW);
+		if (!exp->map_idx) {
+			rc = errno;
+			ods_destroy(exp->map_path);
+			return rc;
+		}
+	}
+	ods_key_set(&key, &from, sizeof(from));
+	return ods_idx_insert(exp->map_idx, &key, to.idx_data);
+}
+
+static int __exp_map_insert(struct export_s *exp, sos_obj_ref_t from, sos_obj_ref_t to)
+{
+	if (exp->map_count >= EXP_MAP_MAX)
+		return __exp_map_spill(exp, from, to);
+	if ((exp->map_count + 1) * 2 > exp->map_size) {
+		size_t i, size = (exp->map_size ? exp->map_size * 2 : 65536);
+		struct exp_map_ent_s *map = calloc(size, sizeof(*map));
+		if (!map)
+			return ENOMEM;
+		for (i = 0; i < exp->map_size; i++) {
+			if (exp->map[i].from.ref.obj)
+				__exp_map_put(map, size, exp->map[i].from, exp->map[i].to);
+		}
+		free(exp->map);
+		exp->map = map;
+		exp->map_size = size;
+	}
+	__exp_map_put(exp->map, exp->map_size, from, to);
+	exp->map_count ++;
+	return 0;
+}
+
+static int __exp_refs_add(struct export_s *exp, sos_schema_t schema, sos_obj_ref_t ref)
+{
+	struct exp_schema_refs_s *refs;
+	int i;
+	for (i = 0; i < exp->refs_count; i++) {
+		if (exp->refs[i].schema == schema)
+			break;
+	}
+	if (i == exp->refs_count) {
+		refs = realloc(exp->refs, (i + 1) * sizeof(*refs));
+		if (!refs)
+			return ENOMEM;
+		exp->refs = refs;
+		memset(&refs[i], 0, sizeof(*refs));
+		refs[i].schema = schema;
+		exp->refs_count ++;
+	}
+	refs = &exp->refs[i];
+	if (refs->count == refs->alloc) {
+		size_t alloc = (refs->alloc ? refs->alloc * 2 : 4096);
+		sos_obj_ref_t *r = realloc(refs->refs, alloc * sizeof(*r));
+		if (!r)
+			return ENOMEM;
+		refs->refs = r;
+		refs->alloc = alloc;
+	}
+	refs->refs[refs->count++] = ref;
+	if (++exp->refs_total < EXP_REFS_MAX)
+		return 0;
+	return __export_index(exp);
+}
 
 static sos_schema_t __export_schema(sos_t sos, sos_schema_t src, const char *name)
 {
@@ -746,21 +2924,21 @@ static sos_schema_t __export_schema(sos_t sos, sos_schema_t src, const char *nam
 	return schema;
 }
 
-static int __shallow_export(sos_t dst_sos, sos_t src_sos,
-			    ods_obj_t src_ods_obj, ods_idx_t exp_idx,
+static int __shallow_export(struct export_s *exp, sos_obj_ref_t from,
+			    ods_obj_t src_ods_obj,
 			    sos_schema_t *dst_schema, sos_schema_t *src_schema,
 			    sos_obj_ref_t *dst_ref, ods_obj_t *dst_ods_obj)
 {
+	sos_t dst_sos = exp->dst_sos;
 	ods_obj_t dobj;
 	sos_obj_data_t sos_obj_data = src_ods_obj->as.ptr;
 	const char *schema_name;
 	sos_schema_t dschema, sschema;
 	sos_part_t part;
+	sos_obj_ref_t to;
 	int rc;
-	ODS_KEY(exp_key);
-	union exp_obj_u exp;
 
-	sschema = sos_schema_by_id(src_sos, sos_obj_data->schema);
+	sschema = sos_schema_by_id(exp->src_sos, sos_obj_data->schema);
 	if (!sschema) {
 		sos_error("ODS object with ref %p has the invalid schema id %ld\n",
 			  (void *)ods_obj_ref(src_ods_obj), sos_obj_data->schema);
@@ -775,47 +2953,42 @@ static int __shallow_export(sos_t dst_sos, sos_t src_sos,
 		return errno;
 	}
 
-	part = __sos_primary_obj_part(dst_sos);
-	if (!part)
-		return ENOSPC;
-
 	/* Check to see if this object already exists in the
 	 * destination container. If it does, it was processed by
 	 * virtue of being referred to by a previously exported
 	 * object
 	 */
-	exp.exp_data.from_ref = ods_obj_ref(src_ods_obj);
-	ods_key_set(&exp_key, &exp.exp_data.from_ref, sizeof(exp.exp_data.from_ref));
-	rc = ods_idx_find(exp_idx, &exp_key, &exp.idx_data);
-	if (rc == 0) {
-		dobj = ods_ref_as_obj(part->obj_ods, exp.exp_data.to_ref);
+	if (0 == __exp_map_find(exp, from, &to)) {
+		dobj = __sos_part_ref_as_obj(dst_sos, to);
 		if (!dobj)
 			return ENOSPC;
 	} else {
-		dobj = __sos_obj_new(part->obj_ods, src_ods_obj->size, &dst_sos->lock);
+		part = __sos_primary_obj_part(dst_sos);
+		if (!part)
+			return ENOSPC;
+		dobj = __sos_obj_new(__sos_part_ods(part), src_ods_obj->size, &dst_sos->lock);
 		if (!dobj)
 			return ENOSPC;
 
 		memcpy(dobj->as.ptr, src_ods_obj->as.ptr, src_ods_obj->size);
 		SOS_OBJ(dobj)->schema = dschema->data->id;
 
-		/* Add this object to the index of objects that we've created */
-		exp.exp_data.from_ref = ods_obj_ref(src_ods_obj);
-		exp.exp_data.to_ref = ods_obj_ref(dobj);
-		sos_key_set(&exp_key, &exp.exp_data.from_ref, sizeof(exp.exp_data.from_ref));
-		rc = ods_idx_insert(exp_idx, &exp_key, exp.idx_data);
+		/* Remember the new object for later references to it */
+		to.ref.ods = SOS_PART(part->part_obj)->part_id;
+		to.ref.obj = ods_obj_ref(dobj);
+		rc = __exp_map_insert(exp, from, to);
 		if (rc) {
-			printf("Error indexing exported object.\n");
+			ods_obj_put(dobj);
 			return rc;
 		}
 	}
 
-	if (dst_ref) {
-		dst_ref->ref.ods = SOS_PART(part->part_obj)->part_id;
-		dst_ref->ref.obj = ods_obj_ref(dobj);
-	}
+	if (dst_ref)
+		*dst_ref = to;
 	if (dst_ods_obj)
 		*dst_ods_obj = dobj;
+	else
+		ods_obj_put(dobj);
 	if (dst_schema)
 		*dst_schema = dschema;
 	if (src_schema)
@@ -833,25 +3006,24 @@ static int __shallow_export(sos_t dst_sos, sos_t src_sos,
  *
  *     3. create a new object in the dest container
  *
- *     4. Add a tracking object to the obj_idx so we can find
- *        this new object later in 1. above, or 5. below
+ *     4. Add the source and new references to the reference map
+ *        so we can find this new object later in 1. above, or 5. below
  *
  *     5. Run through each attribute in the object and if it
  *        is a reference, look it up and/or create it.
  */
-static int __export_callback_fn(ods_t ods, ods_obj_t src_ods_obj, void *arg)
+static int __export_obj(struct export_s *exp, ods_obj_t src_ods_obj)
 {
-	struct export_obj_iter_args_s *uarg = arg;
-	sos_t src_sos = uarg->src_sos;
-	sos_t dst_sos = uarg->dst_sos;
-	sos_obj_t dst_sos_obj;
+	sos_t src_sos = exp->src_sos;
 	ods_obj_t dst_ods_obj;
 	sos_schema_t src_schema, dst_schema;
-	sos_obj_ref_t dst_ref;
+	sos_obj_ref_t src_ref, dst_ref, obj_ref;
 	int rc;
 
-	rc = __shallow_export(dst_sos, src_sos, src_ods_obj, uarg->exp_idx,
-			      &dst_schema, &src_schema, &dst_ref, &dst_ods_obj);
+	src_ref.ref.ods = SOS_PART(exp->src_part->part_obj)->part_id;
+	src_ref.ref.obj = ods_obj_ref(src_ods_obj);
+	rc = __shallow_export(exp, src_ref, src_ods_obj,
+			      &dst_schema, &src_schema, &obj_ref, &dst_ods_obj);
 	if (rc)
 		return rc;
 
@@ -861,11 +3033,6 @@ static int __export_callback_fn(ods_t ods, ods_obj_t src_ods_obj, void *arg)
 		return 0;
 	}
 
-	/* Instantiate a SOS version of the destination ODS object */
-	dst_sos_obj = __sos_init_obj(dst_sos, dst_schema, dst_ods_obj, dst_ref);
-	if (!dst_sos_obj)
-		return ENOMEM;
-
 	/* Run through the attributes of the object, instantiate any
 	 * reference objects, and fix-up the reference values in the
 	 * destination object.
@@ -877,6 +3044,7 @@ static int __export_callback_fn(ods_t ods, ods_obj_t src_ods_obj, void *arg)
 		if (!src_attr) {
 			printf("Error instantiating attribute id %d in schema %s\n",
 			       attr_id, sos_schema_name(src_schema));
+			ods_obj_put(dst_ods_obj);
 			return EINVAL;
 		}
 		sos_type_t type = sos_attr_type(src_attr);
@@ -885,34 +3053,317 @@ static int __export_callback_fn(ods_t ods, ods_obj_t src_ods_obj, void *arg)
 
 		ref_val = (sos_value_data_t)&src_ods_obj->as.bytes[src_attr->data->offset];
 
-		/* The reference might point to an object in another partition :-\ */
-		ods_t ods = __sos_ods_from_ref(src_sos, ref_val->prim.ref_.ref.ods);
-		if (!ods)
-			continue;
-
-		ods_obj_t src_attr_obj = ods_ref_as_obj(ods, ref_val->prim.ref_.ref.obj);
+		/*
+		 * The reference might point to an object in another
+		 * partition :-\ The source partition itself is BUSY, so
+		 * its objects are read from the ODS held by the export.
+		 */
+		ods_obj_t src_attr_obj;
+		if (ref_val->prim.ref_.ref.ods == src_ref.ref.ods)
+			src_attr_obj = ods_ref_as_obj(exp->src_ods, ref_val->prim.ref_.ref.obj);
+		else
+			src_attr_obj = __sos_part_ref_as_obj(src_sos, ref_val->prim.ref_);
 		if (!src_attr_obj)
 			continue;
 
-		ods_obj_t dst_attr_obj;
-		rc = __shallow_export(dst_sos, src_sos, src_attr_obj, uarg->exp_idx,
-				      NULL, NULL, &dst_ref, &dst_attr_obj);
+		rc = __shallow_export(exp, ref_val->prim.ref_, src_attr_obj,
+				      NULL, NULL, &dst_ref, NULL);
 		ods_obj_put(src_attr_obj);
 		if (0 == rc) {
 			ref_val = (sos_value_data_t)&dst_ods_obj->as.bytes[src_attr->data->offset];
 			ref_val->prim.ref_ = dst_ref;
-			ods_obj_put(dst_attr_obj);
 		} else {
 			printf("Error exporting internal reference attribute %s\n", sos_attr_name(src_attr));
 		}
 	}
-	if (uarg->reindex)
-		sos_obj_index(dst_sos_obj);
-	sos_obj_put(dst_sos_obj);
-	uarg->export_count ++;
+	ods_obj_put(dst_ods_obj);
+	if (exp->reindex) {
+		rc = __exp_refs_add(exp, dst_schema, obj_ref);
+		if (rc)
+			return rc;
+	}
+	exp->export_count ++;
+	return 0;
+}
+
+static void __exp_batch_free(struct exp_batch_s *batch)
+{
+	int i;
+	for (i = 0; i < batch->count; i++)
+		ods_obj_put(batch->objs[i]);
+	free(batch);
+}
+
+static void __exp_batch_queue(struct export_s *exp, struct exp_batch_s *batch)
+{
+	pthread_mutex_lock(&exp->lock);
+	while (exp->batch_depth >= exp->batch_max && !exp->stop)
+		pthread_cond_wait(&exp->space_cond, &exp->lock);
+	if (exp->stop) {
+		pthread_mutex_unlock(&exp->lock);
+		__exp_batch_free(batch);
+		return;
+	}
+	TAILQ_INSERT_TAIL(&exp->batch_q, batch, entry);
+	exp->batch_depth ++;
+	pthread_cond_signal(&exp->ready_cond);
+	pthread_mutex_unlock(&exp->lock);
+}
+
+static int __export_read_fn(ods_t ods, ods_obj_t obj, void *arg)
+{
+	struct exp_reader_s *rd = arg;
+	if (!rd->batch) {
+		rd->batch = malloc(sizeof(*rd->batch));
+		if (!rd->batch)
+			return ENOMEM;
+		rd->batch->count = 0;
+	}
+	rd->batch->objs[rd->batch->count++] = ods_obj_get(obj);
+	if (rd->batch->count == EXP_BATCH_SIZE) {
+		__exp_batch_queue(rd->exp, rd->batch);
+		rd->batch = NULL;
+	}
+	return rd->exp->stop;
+}
+
+static void *__export_read_proc(void *arg)
+{
+	struct export_s *exp = arg;
+	struct exp_reader_s rd = { .exp = exp, .batch = NULL };
+	struct ods_obj_iter_pos_s pos;
+	int range, rc = 0;
+
+	while (!rc) {
+		pthread_mutex_lock(&exp->lock);
+		if (exp->stop || exp->range_next == exp->range_count) {
+			pthread_mutex_unlock(&exp->lock);
+			break;
+		}
+		range = exp->range_next++;
+		pthread_mutex_unlock(&exp->lock);
+
+		pos = exp->ranges[range];
+		rc = ods_obj_iter_range(exp->src_ods, &pos, &exp->ranges[range + 1],
+					__export_read_fn, &rd);
+	}
+	if (rd.batch)
+		__exp_batch_queue(exp, rd.batch);
+
+	pthread_mutex_lock(&exp->lock);
+	if (rc && !exp->stop) {
+		exp->rc = rc;
+		exp->stop = 1;
+		pthread_cond_broadcast(&exp->space_cond);
+	}
+	exp->readers --;
+	pthread_cond_signal(&exp->ready_cond);
+	pthread_mutex_unlock(&exp->lock);
+	return NULL;
+}
+
+/*
+ * Copy the queued objects to the destination until the readers are
+ * done. On error, the remaining batches are drained and released.
+ */
+static void __export_write(struct export_s *exp)
+{
+	struct exp_batch_s *batch;
+	int i, rc;
+
+	pthread_mutex_lock(&exp->lock);
+	while (1) {
+		while (TAILQ_EMPTY(&exp->batch_q) && exp->readers)
+			pthread_cond_wait(&exp->ready_cond, &exp->lock);
+		batch = TAILQ_FIRST(&exp->batch_q);
+		if (!batch)
+			break;
+		TAILQ_REMOVE(&exp->batch_q, batch, entry);
+		exp->batch_depth --;
+		pthread_cond_signal(&exp->space_cond);
+		if (exp->stop) {
+			pthread_mutex_unlock(&exp->lock);
+			__exp_batch_free(batch);
+			pthread_mutex_lock(&exp->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&exp->lock);
+
+		for (rc = 0, i = 0; i < batch->count && !rc; i++)
+			rc = __export_obj(exp, batch->objs[i]);
+		__exp_batch_free(batch);
+
+		pthread_mutex_lock(&exp->lock);
+		if (rc && !exp->stop) {
+			exp->rc = rc;
+			exp->stop = 1;
+			pthread_cond_broadcast(&exp->space_cond);
+		}
+	}
+	pthread_mutex_unlock(&exp->lock);
+}
+
+static void *__export_index_proc(void *arg)
+{
+	struct export_s *exp = arg;
+	struct exp_idx_work_s *work;
+	sos_obj_t obj;
+	size_t i;
+	int rc = 0;
+
+	while (!rc) {
+		pthread_mutex_lock(&exp->lock);
+		if (exp->stop || exp->work_next == exp->work_count) {
+			pthread_mutex_unlock(&exp->lock);
+			break;
+		}
+		work = &exp->work[exp->work_next++];
+		pthread_mutex_unlock(&exp->lock);
+
+		for (i = 0; i < work->refs->count && !rc; i++) {
+			obj = sos_ref_as_obj(exp->dst_sos, work->refs->refs[i]);
+			if (!obj) {
+				rc = errno ? errno : ENOENT;
+				break;
+			}
+			rc = __sos_obj_index_attr(obj, work->attr);
+			sos_obj_put(obj);
+		}
+	}
+	if (rc) {
+		pthread_mutex_lock(&exp->lock);
+		if (!exp->stop) {
+			exp->rc = rc;
+			exp->stop = 1;
+		}
+		pthread_mutex_unlock(&exp->lock);
+	}
+	return NULL;
+}
+
+/*
+ * Add the exported objects to the destination indices. Each index is
+ * built by a single thread so that the keys of one index are inserted
+ * in the order in which the objects were copied. The object lists are
+ * emptied when the indices have been updated.
+ */
+static int __export_index(struct export_s *exp)
+{
+	pthread_t *threads;
+	sos_attr_t attr;
+	int i, count, thread_count;
+
+	free(exp->work);
+	exp->work = NULL;
+	exp->work_count = exp->work_next = 0;
+	count = 0;
+	for (i = 0; i < exp->refs_count; i++) {
+		TAILQ_FOREACH(attr, &exp->refs[i].schema->idx_attr_list, idx_entry)
+			count ++;
+	}
+	if (!count)
+		goto out;
+	exp->work = calloc(count, sizeof(*exp->work));
+	if (!exp->work)
+		return ENOMEM;
+	for (i = 0; i < exp->refs_count; i++) {
+		TAILQ_FOREACH(attr, &exp->refs[i].schema->idx_attr_list, idx_entry) {
+			/* Open the index before the threads share it */
+			if (!__sos_attr_index(attr))
+				return errno;
+			exp->work[exp->work_count].refs = &exp->refs[i];
+			exp->work[exp->work_count].attr = attr;
+			exp->work_count ++;
+		}
+	}
+	thread_count = SOS_PART_EXPORT_THREADS;
+	if (thread_count > count)
+		thread_count = count;
+	threads = calloc(thread_count, sizeof(*threads));
+	if (!threads)
+		return ENOMEM;
+	for (count = 0; count < thread_count; count++) {
+		if (pthread_create(&threads[count], NULL, __export_index_proc, exp))
+			break;
+	}
+	if (!count)
+		__export_index_proc(exp);
+	for (i = 0; i < count; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	if (exp->rc)
+		return exp->rc;
+ out:
+	for (i = 0; i < exp->refs_count; i++)
+		exp->refs[i].count = 0;
+	exp->refs_total = 0;
 	return 0;
 }
 
+static int __export_run(struct export_s *exp, int thread_count)
+{
+	pthread_t *threads;
+	sos_part_t part;
+	int i, count;
+
+	exp->ranges = calloc(thread_count * EXP_RANGES_PER_THREAD + 1,
+			     sizeof(*exp->ranges));
+	threads = calloc(thread_count, sizeof(*threads));
+	if (!exp->ranges || !threads) {
+		free(threads);
+		return ENOMEM;
+	}
+	exp->range_count = ods_obj_iter_split(exp->src_ods, exp->ranges,
+					      thread_count * EXP_RANGES_PER_THREAD);
+
+	/*
+	 * Grow the destination once by the size of the source rather
+	 * than in many small steps as the objects are allocated.
+	 */
+	part = __sos_primary_obj_part(exp->dst_sos);
+	if (part)
+		(void)ods_extend(__sos_part_ods(part), ods_size(exp->src_ods));
+
+	exp->batch_max = thread_count * 2;
+	pthread_mutex_lock(&exp->lock);
+	for (count = 0; count < thread_count; count++) {
+		if (pthread_create(&threads[count], NULL, __export_read_proc, exp))
+			break;
+		exp->readers ++;
+	}
+	pthread_mutex_unlock(&exp->lock);
+	if (!count) {
+		free(threads);
+		return EAGAIN;
+	}
+	__export_write(exp);
+	for (i = 0; i < count; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	if (!exp->rc && exp->reindex)
+		return __export_index(exp);
+	return exp->rc;
+}
+
+static void __export_free(struct export_s *exp)
+{
+	int i;
+	for (i = 0; i < exp->refs_count; i++)
+		free(exp->refs[i].refs);
+	free(exp->refs);
+	free(exp->work);
+	free(exp->map);
+	if (exp->map_idx) {
+		ods_idx_close(exp->map_idx, ODS_COMMIT_ASYNC);
+		ods_destroy(exp->map_path);
+	}
+	free(exp->ranges);
+	pthread_mutex_destroy(&exp->lock);
+	pthread_cond_destroy(&exp->ready_cond);
+	pthread_cond_destroy(&exp->space_cond);
+}
+
 /**
  * \brief Export the objects in a partition to another container
  *
@@ -926,6 +3377,11 @@ static int __export_callback_fn(ods_t ods, ods_obj_t src_ods_obj, void *arg)
  * The source container (the container in which src_part is located)
  * cannot be the same as the destination container.
  *
+ * The source partition is read by SOS_PART_EXPORT_THREADS threads
+ * while a single thread copies the objects to the destination. When
+ * reindex is set, the indices are built after all objects have been
+ * copied.
+ *
  * \param src_part	The source partition handle
  * \param dst_cont	The destination container
  * \param reindex	Set to 1 to add exported objects to their schema indices
@@ -936,16 +3392,15 @@ static int __export_callback_fn(ods_t ods, ods_obj_t src_ods_obj, void *arg)
 int64_t sos_part_export(sos_part_t src_part, sos_t dst_sos, int reindex)
 {
 	sos_t src_sos = src_part->sos;
-	uint64_t rc = 0;
+	int64_t rc = 0;
 	sos_part_state_t cur_state;
-	struct export_obj_iter_args_s uargs;
-	struct ods_obj_iter_pos_s pos;
+	struct export_s exp;
 
 	/* The source container cannot be the same as the destination
 	 * container */
 	if (src_sos == dst_sos) {
-		return -EINVAL;
 		errno = EINVAL;
+		return -EINVAL;
 	}
 
 	/* If the state is PRIMARY or BUSY, return EBUSY */
@@ -956,46 +3411,36 @@ int64_t sos_part_export(sos_part_t src_part, sos_t dst_sos, int reindex)
 	    || cur_state == SOS_PART_STATE_PRIMARY) {
 		errno = EBUSY;
 		rc = -errno;
-		ods_unlock(src_sos->part_ods, 0);
 		goto err;
 	}
 
-	/* Create an index to track objects that are created so that
-	 * we handle objects that are referenced by other objects,
-	 * e.g. arrays. The index name is 'partition_name' && '_export'
+	/* Make the source partition busy to prevent changes while the
+	 * data is being copied
 	 */
-	char idx_path[PATH_MAX];
-	snprintf(idx_path, sizeof(idx_path), "%s/%s_export",
-		 dst_sos->path, sos_part_name(src_part));
-	rc = ods_idx_create(idx_path, 0600, "BXTREE", "UINT64", NULL);
+	rc = __sos_open_partition(src_sos, src_part);
 	if (rc) {
 		errno = rc;
 		rc = -rc;
-		ods_unlock(src_sos->part_ods, 0);
 		goto err;
 	}
-	uargs.exp_idx = ods_idx_open(idx_path, ODS_PERM_RW);
-	if (!uargs.exp_idx) {
-		rc = -errno;
-		ods_unlock(src_sos->part_ods, 0);
-		goto err_1;
-	}
-	/* Make the source partition busy to prevent changes while the
-	 * data is being copied
-	 */
 	__make_part_busy(src_sos, src_part);
 	ods_unlock(src_sos->part_ods, 0);
 	pthread_mutex_unlock(&src_sos->lock);
 
-	uargs.src_sos = src_sos;
-	uargs.src_part = src_part;
-	uargs.dst_sos = dst_sos;
-	uargs.export_count = 0;
-	uargs.reindex = reindex;
+	memset(&exp, 0, sizeof(exp));
+	exp.src_sos = src_sos;
+	exp.src_part = src_part;
+	exp.src_ods = src_part->obj_ods;
+	exp.dst_sos = dst_sos;
+	exp.reindex = reindex;
+	pthread_mutex_init(&exp.lock, NULL);
+	pthread_cond_init(&exp.ready_cond, NULL);
+	pthread_cond_init(&exp.space_cond, NULL);
+	TAILQ_INIT(&exp.batch_q);
 
 	/* Export all objects in src_part to the destination container */
-	ods_obj_iter_pos_init(&pos);
-	rc = ods_obj_iter(src_part->obj_ods, &pos, __export_callback_fn, &uargs);
+	rc = __export_run(&exp, SOS_PART_EXPORT_THREADS);
+	__export_free(&exp);
 
 	/* Restore the source partition state */
 	pthread_mutex_lock(&src_sos->lock);
@@ -1004,15 +3449,13 @@ int64_t sos_part_export(sos_part_t src_part, sos_t dst_sos, int reindex)
 	ods_unlock(src_sos->part_ods, 0);
 	pthread_mutex_unlock(&src_sos->lock);
 
-	ods_destroy(idx_path);
 	if (rc) {
 		errno = rc;
 		return -rc;
 	}
-	return uargs.export_count;
- err_1:
-	ods_destroy(idx_path);
+	return exp.export_count;
  err:
+	ods_unlock(src_sos->part_ods, 0);
 	pthread_mutex_unlock(&src_sos->lock);
 	return rc;
 }
@@ -1042,7 +3485,7 @@ static int __index_callback_fn(ods_t ods, ods_obj_t ods_obj, void *arg)
 	/* Instantiate a SOS version of the ODS object */
 	ref.ref.ods = SOS_PART(part->part_obj)->part_id;
 	ref.ref.obj = ods_obj_ref(ods_obj);
-	sos_obj = __sos_init_obj(sos, schema, ods_obj, ref);
+	sos_obj = __sos_init_obj(sos, schema, ods_obj_get(ods_obj), ref);
 	if (!sos_obj)
 		return ENOMEM;
 
@@ -1078,6 +3521,11 @@ int64_t sos_part_index(sos_part_t part)
 	/* Make the source partition busy to prevent changes while the
 	 * data is being copied
 	 */
+	if (__sos_open_partition(sos, part)) {
+		rc = -errno;
+		ods_unlock(sos->part_ods, 0);
+		goto err;
+	}
 	__make_part_busy(sos, part);
 	ods_unlock(sos->part_ods, 0);
 	pthread_mutex_unlock(&sos->lock);
@@ -1118,9 +3566,12 @@ int64_t sos_part_index(sos_part_t part)
 void sos_part_put(sos_part_t part)
 {
 	if (0 == ods_atomic_dec(&part->ref_count)) {
-		__sos_part_obj_put(part->sos, part->part_obj);
+		__sos_part_idx_close(part);
+		if (!part->retired)
+			__sos_part_obj_put(part->sos, part->part_obj);
 		ods_obj_put(part->part_obj);
-		ods_close(part->obj_ods, ODS_COMMIT_ASYNC);
+		__sos_close_partition(part);
+		pthread_mutex_destroy(&part->idx_lock);
 		free(part);
 	}
 }
@@ -1156,7 +3607,7 @@ ods_obj_t __sos_part_obj_get(sos_t sos, ods_obj_t part_obj)
 void __sos_part_obj_put(sos_t sos, ods_obj_t part_obj)
 {
 	if (0 == ods_atomic_dec(&SOS_PART(part_obj)->ref_count)) {
-		if (SOS_PART(part_obj)->state == SOS_PART_STATE_OFFLINE) {
+		if (SOS_PART(part_obj)->state != SOS_PART_STATE_OFFLINE) {
 			sos_error("Reference count has gone to zero on "
 				  "parition %s with state %d\n",
 				  SOS_PART(part_obj)->name,
@@ -1222,10 +3673,41 @@ void sos_part_iter_free(sos_part_iter_t iter)
  * \retval ENOMEM Insufficient resources
  */
 int sos_part_create(sos_t sos, const char *part_name, const char *part_path)
+{
+	return sos_part_create_ex(sos, part_name, part_path, 0);
+}
+
+/**
+ * \brief Create a new partition with options
+ *
+ * If \c flags contains SOS_PART_F_LOCAL_INDEX, the keys of the
+ * objects in the partition are kept in index files in the partition
+ * directory instead of in the container's indices. Iterators merge
+ * the keys of all ACTIVE and PRIMARY partitions, and changing the
+ * state of the partition to or from OFFLINE does not have to remove
+ * or re-add the keys of its objects.
+ *
+ * \param sos The sos_t container handle
+ * \param part_name The name of the new partition.
+ * \param part_path An optional path to the partition. If null,
+ *                  the container path will be used.
+ * \param flags 0 or SOS_PART_F_LOCAL_INDEX
+ * \retval 0 Success
+ * \retval EEXIST The specified partition already exists
+ * \retval EINVAL The flags are invalid
+ * \retval EBADF Invalid container handle or other storage error
+ * \retval ENOMEM Insufficient resources
+ */
+int sos_part_create_ex(sos_t sos, const char *part_name, const char *part_path,
+		       int flags)
 {
 	char tmp_path[PATH_MAX];
 	ods_obj_t part_obj;
 	sos_part_t part;
+	int rc;
+
+	if (flags & ~SOS_PART_F_LOCAL_INDEX)
+		return EINVAL;
 
 	part = sos_part_find(sos, part_name);
 	if (part) {
@@ -1233,14 +3715,27 @@ int sos_part_create(sos_t sos, const char *part_name, const char *part_path)
 		return EEXIST;
 	}
 
-	part_obj = __sos_part_create(sos, tmp_path, part_name, part_path);
+	part_obj = __sos_part_create(sos, tmp_path, part_name, part_path, 0);
 	if (!part_obj)
 		return errno;
 
+	if (flags & SOS_PART_F_LOCAL_INDEX) {
+		sprintf(tmp_path, "%s/%s/indices",
+			SOS_PART(part_obj)->path, part_name);
+		rc = __sos_make_all_dir(tmp_path, sos->o_mode);
+		if (rc)
+			sos_error("Error %d creating the partition index directory "
+				  "'%s'\n", errno, tmp_path);
+	}
 	part = __sos_part_new(sos, part_obj);
+	if (!part)
+		return ENOMEM;
 	pthread_mutex_lock(&sos->lock);
 	TAILQ_INSERT_HEAD(&sos->part_list, part, entry);
+	rc = __sos_part_table_set(sos, part);
 	pthread_mutex_unlock(&sos->lock);
+	if (rc)
+		return rc;
 	return 0;
 }
 
@@ -1418,41 +3913,217 @@ uint32_t sos_part_refcount(sos_part_t part)
 	return SOS_PART(part->part_obj)->ref_count;
 }
 
+/*
+ * Remove the partition from the container. The partition storage is
+ * not touched. The handle may predate a refresh of the partition
+ * list, so the partition is removed through the list's own handle.
+ * On success the caller's reference has been dropped.
+ */
+static int __sos_part_remove(sos_part_t part)
+{
+	int rc = 0;
+	sos_t sos = part->sos;
+	sos_part_t cur;
+
+	pthread_mutex_lock(&sos->lock);
+	ods_lock(sos->part_ods, 0, NULL);
+	if (sos->part_gn != SOS_PART_UDATA(sos->part_udata)->gen) {
+		rc = __refresh_part_list(sos);
+		if (rc)
+			goto out;
+	}
+	cur = __sos_part_by_id(sos, SOS_PART(part->part_obj)->part_id);
+	if (!cur) {
+		rc = ENOENT;
+		goto out;
+	}
+	if (SOS_PART(cur->part_obj)->state != SOS_PART_STATE_OFFLINE) {
+		rc = EBUSY;
+		goto out;
+	}
+	/* Remove the partition from the container */
+	TAILQ_REMOVE(&sos->part_list, cur, entry);
+	/* Put the create reference */
+	__sos_part_obj_put(sos, cur->part_obj);
+	/* The container reference is put when the container is closed */
+	__sos_part_retire(sos, cur);
+	ods_atomic_inc(&SOS_PART_UDATA(sos->part_udata)->gen);
+	sos->part_gn = SOS_PART_UDATA(sos->part_udata)->gen;
+	/* Put the app reference */
+	sos_part_put(part);
+ out:
+	ods_unlock(sos->part_ods, 0);
+	pthread_mutex_unlock(&sos->lock);
+	return rc;
+}
+
+static uint64_t __sos_part_file_remove(const char *path)
+{
+	struct stat sb;
+
+	if (stat(path, &sb))
+		return 0;	/* The object store was never opened */
+	if (remove(path)) {
+		perror("Removing partition file");
+		return 0;
+	}
+	return (uint64_t)sb.st_blocks * 512;
+}
+
+/*
+ * Remove the object store and local index files of a deleted
+ * partition and its directory. Returns the number of bytes of
+ * storage the files occupied. The caller has checked that the
+ * object store paths fit in PATH_MAX.
+ */
+static uint64_t __sos_part_files_remove(const char *part_dir)
+{
+	char tmp_path[PATH_MAX];
+	char idx_dir[PATH_MAX];
+	struct dirent *dent;
+	uint64_t bytes = 0;
+	DIR *dir;
+
+	if (!__part_path_fmt(tmp_path, "%s/objects.PG", part_dir))
+		bytes += __sos_part_file_remove(tmp_path);
+	if (!__part_path_fmt(tmp_path, "%s/objects.OBJ", part_dir))
+		bytes += __sos_part_file_remove(tmp_path);
+	if (!__part_path_fmt(idx_dir, "%s/indices", part_dir))
+		dir = opendir(idx_dir);
+	else
+		dir = NULL;
+	if (dir) {
+		while (NULL != (dent = readdir(dir))) {
+			if (dent->d_name[0] == '.')
+				continue;
+			if (__part_path_fmt(tmp_path, "%s/%s", idx_dir, dent->d_name)) {
+				sos_error("The path of the index file %s in %s is too long\n",
+					  dent->d_name, idx_dir);
+				continue;
+			}
+			bytes += __sos_part_file_remove(tmp_path);
+		}
+		closedir(dir);
+		if (rmdir(idx_dir))
+			perror("Removing partition index directory");
+	}
+	if (rmdir(part_dir) && errno != ENOENT)
+		perror("Removing partition directory");
+	return bytes;
+}
+
+static int __sos_part_delete(sos_part_t part, uint64_t *bytes)
+{
+	char part_dir[PATH_MAX];
+	char tmp_path[PATH_MAX];
+	int rc;
+
+	/* The file paths must fit once the partition is gone */
+	rc = __part_path_fmt(tmp_path, "%s/%s/objects.OBJ",
+			     sos_part_path(part), sos_part_name(part));
+	if (!rc)
+		rc = __part_path_fmt(part_dir, "%s/%s",
+				     sos_part_path(part), sos_part_name(part));
+	if (rc)
+		return rc;
+	rc = __sos_part_remove(part);
+	if (rc)
+		return rc;
+	*bytes = __sos_part_files_remove(part_dir);
+	return 0;
+}
+
 /**
  * \brief Delete a partition
  *
  * Deletes the paritition specified by the handle. All object storage
  * associated with the parition will be freed. The parition must be in
- * the OFFLINE state to be deleted.
+ * the OFFLINE state to be deleted. On success, the caller's reference
+ * on the partition is dropped.
  *
  * \param part The partition handle
  * \retval 0 The parition was deleted
  * \retval EBUSY The partition is not offline
+ * \retval ENOENT The partition has already been deleted
  */
 int sos_part_delete(sos_part_t part)
 {
-	int rc = EBUSY;
-	sos_t sos = part->sos;
-	sos_part_state_t cur_state;
+	uint64_t bytes;
+	return __sos_part_delete(part, &bytes);
+}
 
-	pthread_mutex_unlock(&sos->lock);
-	ods_lock(sos->part_ods, 0, NULL);
-	cur_state = SOS_PART(part->part_obj)->state;
-	if (cur_state != SOS_PART_STATE_OFFLINE)
-		goto out;
+/*
+ * Copy the local index files of a partition to the partition
+ * directory at to_path, or if remove_from is !0, remove them from the
+ * partition directory at from_path.
+ */
+static int __sos_part_indices_copy(sos_part_t part, const char *from_path,
+				   const char *to_path, int remove_from)
+{
+	char from_dir[PATH_MAX];
+	char tmp_path[PATH_MAX];
+	struct dirent *dent;
+	struct stat sb;
+	off_t offset;
+	int in_fd, out_fd;
+	int rc = 0;
+	DIR *dir;
 
-	rc = 0;
-	/* Remove the partition from the container */
-	TAILQ_REMOVE(&sos->part_list, part, entry);
-	/* Put the create reference, we still hold the part reference */
-	__sos_part_obj_put(sos, part->part_obj);
-	/* Put the container reference */
-	sos_part_put(part);
-	/* Put the app reference reference */
-	sos_part_put(part);
- out:
-	ods_unlock(sos->part_ods, 0);
-	pthread_mutex_unlock(&sos->lock);
+	rc = __part_path_fmt(from_dir, "%s/%s/indices", from_path, sos_part_name(part));
+	if (rc)
+		return rc;
+	if (!remove_from) {
+		rc = __part_path_fmt(tmp_path, "%s/%s/indices", to_path, sos_part_name(part));
+		if (rc)
+			return rc;
+		if (__sos_make_all_dir(tmp_path, part->sos->o_mode))
+			return errno;
+	}
+	dir = opendir(from_dir);
+	if (!dir)
+		return errno;
+	while (!rc && NULL != (dent = readdir(dir))) {
+		if (dent->d_name[0] == '.')
+			continue;
+		rc = __part_path_fmt(tmp_path, "%s/%s", from_dir, dent->d_name);
+		if (rc)
+			break;
+		if (remove_from) {
+			if (remove(tmp_path))
+				perror("Removing partition index file");
+			continue;
+		}
+		in_fd = open(tmp_path, O_RDONLY);
+		if (in_fd < 0) {
+			rc = errno;
+			break;
+		}
+		if (fstat(in_fd, &sb)) {
+			rc = errno;
+			close(in_fd);
+			break;
+		}
+		rc = __part_path_fmt(tmp_path, "%s/%s/indices/%s", to_path,
+				     sos_part_name(part), dent->d_name);
+		if (rc) {
+			close(in_fd);
+			break;
+		}
+		out_fd = open(tmp_path, O_RDWR | O_CREAT, part->sos->o_mode);
+		if (out_fd < 0) {
+			rc = errno;
+			close(in_fd);
+			break;
+		}
+		offset = 0;
+		if (sendfile(out_fd, in_fd, &offset, sb.st_size) < 0)
+			rc = errno;
+		close(in_fd);
+		close(out_fd);
+	}
+	closedir(dir);
+	if (remove_from && rmdir(from_dir))
+		perror("Removing partition index directory");
 	return rc;
 }
 
@@ -1565,9 +4236,17 @@ int sos_part_move(sos_part_t part, const char *new_part_path)
 	}
 	close(in_fd);
 	close(out_fd);
+	if (part->local_index) {
+		/* The index files are reopened at the new path */
+		__sos_part_idx_close(part);
+		rc = __sos_part_indices_copy(part, old_part_path, new_part_path, 0);
+		if (rc) {
+			out_fd = -1;
+			goto out_3;
+		}
+	}
 	strcpy(SOS_PART(part->part_obj)->path, new_part_path);
-	if (part->obj_ods)
-		ods_close(part->obj_ods, SOS_COMMIT_ASYNC);
+	__sos_close_partition(part);
 	rc = __sos_open_partition(part->sos, part);
 
 	goto out;
@@ -1596,6 +4275,8 @@ int sos_part_move(sos_part_t part, const char *new_part_path)
 		rc = remove(tmp_path);
 		if (rc)
 			perror("Removing objects.OBJ file");
+		if (part->local_index)
+			__sos_part_indices_copy(part, old_part_path, NULL, 1);
 		sprintf(tmp_path, "%s/%s", old_part_path, sos_part_name(part));
 		rc = remove(tmp_path);
 		if (rc)
@@ -1608,6 +4289,308 @@ int sos_part_move(sos_part_t part, const char *new_part_path)
 	return rc;
 }
 
+struct attach_s {
+	struct export_s exp;	/* dst_sos and the index build lists */
+	uint64_t from_id;
+	uint64_t to_id;
+	uint32_t *schema_map;	/* source user schema id -> destination id */
+	uint32_t schema_count;
+	int collect;		/* Record the objects for the index build */
+};
+
+static int __attach_schema_check(sos_schema_t src, sos_schema_t dst)
+{
+	sos_attr_t src_attr, dst_attr;
+	int attr_id;
+
+	if (sos_schema_attr_count(src) != sos_schema_attr_count(dst))
+		return EINVAL;
+	for (attr_id = 0; attr_id < sos_schema_attr_count(src); attr_id++) {
+		src_attr = sos_schema_attr_by_id(src, attr_id);
+		dst_attr = sos_schema_attr_by_id(dst, attr_id);
+		if (!src_attr || !dst_attr
+		    || src_attr->data->type != dst_attr->data->type
+		    || src_attr->data->size != dst_attr->data->size
+		    || src_attr->data->offset != dst_attr->data->offset)
+			return EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Map the schema ids of the source container to the destination,
+ * adding the schemas that the destination does not have.
+ */
+static int __attach_schema_map(struct attach_s *att, sos_t src_sos, sos_t dst_sos)
+{
+	sos_schema_t src, dst;
+	uint32_t id;
+	int rc;
+
+	for (src = sos_schema_first(src_sos); src; src = sos_schema_next(src)) {
+		id = src->data->id;
+		if (id < SOS_SCHEMA_FIRST_USER)
+			continue;
+		id -= SOS_SCHEMA_FIRST_USER;
+		if (id >= att->schema_count) {
+			uint32_t *map = realloc(att->schema_map, (id + 1) * sizeof(*map));
+			if (!map)
+				return ENOMEM;
+			memset(&map[att->schema_count], 0,
+			       (id + 1 - att->schema_count) * sizeof(*map));
+			att->schema_map = map;
+			att->schema_count = id + 1;
+		}
+		dst = sos_schema_by_name(dst_sos, sos_schema_name(src));
+		if (dst) {
+			rc = __attach_schema_check(src, dst);
+			if (rc) {
+				sos_error("The schema '%s' in the destination "
+					  "container does not match the source.\n",
+					  sos_schema_name(src));
+				return rc;
+			}
+		} else {
+			dst = __export_schema(dst_sos, src, sos_schema_name(src));
+			if (!dst)
+				return errno;
+		}
+		att->schema_map[id] = dst->data->id;
+	}
+	return 0;
+}
+
+/*
+ * Rewrite the schema id and the intra-partition references of each
+ * object in place. References to objects in other partitions of the
+ * source container cannot be resolved in the destination and are
+ * cleared.
+ */
+static int __attach_fixup_fn(ods_t ods, ods_obj_t ods_obj, void *arg)
+{
+	struct attach_s *att = arg;
+	sos_obj_data_t obj_data = ods_obj->as.ptr;
+	sos_value_data_t ref_val;
+	sos_schema_t schema;
+	sos_obj_ref_t ref;
+	sos_attr_t attr;
+	uint32_t id;
+	int attr_id;
+
+	id = obj_data->schema;
+	if (id >= SOS_SCHEMA_FIRST_USER) {
+		id -= SOS_SCHEMA_FIRST_USER;
+		if (id >= att->schema_count || !att->schema_map[id]) {
+			sos_error("ODS object with ref %p has the invalid schema id %ld\n",
+				  (void *)ods_obj_ref(ods_obj), obj_data->schema);
+			return EINVAL;
+		}
+		if (obj_data->schema != att->schema_map[id])
+			obj_data->schema = att->schema_map[id];
+	}
+	schema = sos_schema_by_id(att->exp.dst_sos, obj_data->schema);
+	if (!schema)
+		return EINVAL;
+	if (schema->flags & SOS_SCHEMA_F_INTERNAL)
+		return 0;
+
+	for (attr_id = 0; attr_id < sos_schema_attr_count(schema); attr_id++) {
+		attr = sos_schema_attr_by_id(schema, attr_id);
+		if (sos_attr_type(attr) < SOS_TYPE_ARRAY
+		    && sos_attr_type(attr) != SOS_TYPE_OBJ)
+			continue;
+		ref_val = (sos_value_data_t)&ods_obj->as.bytes[attr->data->offset];
+		if (!ref_val->prim.ref_.ref.ods)
+			continue;
+		if (ref_val->prim.ref_.ref.ods == att->from_id) {
+			if (att->from_id != att->to_id)
+				ref_val->prim.ref_.ref.ods = att->to_id;
+		} else {
+			ref_val->prim.ref_.ref.ods = 0;
+			ref_val->prim.ref_.ref.obj = 0;
+		}
+	}
+	if (!att->collect)
+		return 0;
+	ref.ref.ods = att->to_id;
+	ref.ref.obj = ods_obj_ref(ods_obj);
+	return __exp_refs_add(&att->exp, schema, ref);
+}
+
+/**
+ * \brief Attach a partition from another container
+ *
+ * Moves an OFFLINE partition from its container to the destination
+ * container without copying its objects. The partition directory is
+ * renamed to \c part_path, or stays where it is if \c part_path is
+ * NULL, and the partition is removed from the source container.
+ *
+ * Schemas in the source container that are missing from the
+ * destination are added to it. A schema with the same name must have
+ * the same attributes in both containers. The partition keeps its
+ * partition id if the destination has not issued it, otherwise it is
+ * given a new one. The schema ids and the references between objects
+ * in the partition are then updated in place.
+ *
+ * If \c reindex is !0, the keys of the objects are added to the
+ * destination indices, one index per thread, and the partition is
+ * made ACTIVE. Otherwise the partition is OFFLINE in the
+ * destination. The local indices of a partition created with
+ * SOS_PART_F_LOCAL_INDEX are kept unless the partition id changes, in
+ * which case they are rebuilt.
+ *
+ * Like sos_part_move(), this function puts the \c src_part handle.
+ *
+ * \param src_part	The source partition handle
+ * \param dst_sos	The destination container
+ * \param part_path	The new location of the partition or NULL
+ * \param reindex	Set to !0 to index the objects and make the partition ACTIVE
+ * \retval 0		The partition was attached
+ * \retval EINVAL	The source and destination containers are the same, or
+ *			a schema does not match
+ * \retval EBUSY	The partition is not OFFLINE in the source container
+ * \retval EEXIST	A partition with the same name exists in the destination
+ * \retval EXDEV	The part_path is on a different filesystem
+ */
+int sos_part_attach(sos_part_t src_part, sos_t dst_sos, const char *part_path,
+		    int reindex)
+{
+	char part_name[SOS_PART_NAME_LEN];
+	char path[PATH_MAX];
+	char old_dir[PATH_MAX];
+	char tmp_path[PATH_MAX];
+	sos_t src_sos = src_part->sos;
+	struct attach_s att;
+	ods_obj_t part_obj;
+	sos_part_t part;
+	int rebuild, rc;
+
+	if (src_sos == dst_sos) {
+		rc = EINVAL;
+		goto err_0;
+	}
+	strcpy(part_name, sos_part_name(src_part));
+	part = sos_part_find(dst_sos, part_name);
+	if (part) {
+		sos_part_put(part);
+		rc = EEXIST;
+		goto err_0;
+	}
+
+	/* The partition files must not be in use by the source container */
+	pthread_mutex_lock(&src_sos->lock);
+	ods_lock(src_sos->part_ods, 0, NULL);
+	if (SOS_PART(src_part->part_obj)->state != SOS_PART_STATE_OFFLINE
+	    || src_part->ods_pin) {
+		ods_unlock(src_sos->part_ods, 0);
+		pthread_mutex_unlock(&src_sos->lock);
+		rc = EBUSY;
+		goto err_0;
+	}
+	__sos_part_idx_close(src_part);
+	__sos_close_partition(src_part);
+	ods_unlock(src_sos->part_ods, 0);
+	pthread_mutex_unlock(&src_sos->lock);
+
+	memset(&att, 0, sizeof(att));
+	att.exp.dst_sos = dst_sos;
+	pthread_mutex_init(&att.exp.lock, NULL);
+	pthread_cond_init(&att.exp.ready_cond, NULL);
+	pthread_cond_init(&att.exp.space_cond, NULL);
+	att.from_id = SOS_PART(src_part->part_obj)->part_id;
+	rc = __attach_schema_map(&att, src_sos, dst_sos);
+	if (rc)
+		goto err_1;
+
+	/* Rename the partition directory if it is moving */
+	sprintf(old_dir, "%s/%s", sos_part_path(src_part), part_name);
+	if (part_path) {
+		if (!realpath(part_path, path)) {
+			rc = errno;
+			goto err_1;
+		}
+	} else {
+		strcpy(path, sos_part_path(src_part));
+	}
+	sprintf(tmp_path, "%s/%s", path, part_name);
+	if (strcmp(old_dir, tmp_path) && rename(old_dir, tmp_path)) {
+		rc = errno;
+		goto err_1;
+	}
+
+	part_obj = __sos_part_create(dst_sos, tmp_path, part_name, path, att.from_id);
+	if (!part_obj) {
+		rc = errno;
+		sprintf(tmp_path, "%s/%s", path, part_name);
+		if (strcmp(old_dir, tmp_path))
+			(void)rename(tmp_path, old_dir);
+		goto err_1;
+	}
+	att.to_id = SOS_PART(part_obj)->part_id;
+
+	/*
+	 * The data now belongs to the destination, remove the partition
+	 * from the source without touching its files. This drops the
+	 * caller's reference.
+	 */
+	if (__sos_part_remove(src_part))
+		sos_part_put(src_part);
+
+	part = __sos_part_new(dst_sos, part_obj);
+	if (!part) {
+		rc = ENOMEM;
+		goto out;
+	}
+	ods_atomic_inc(&part->ref_count); /* our reference */
+	pthread_mutex_lock(&dst_sos->lock);
+	TAILQ_INSERT_HEAD(&dst_sos->part_list, part, entry);
+	rc = __sos_part_table_set(dst_sos, part);
+	pthread_mutex_unlock(&dst_sos->lock);
+	if (rc)
+		goto out_1;
+
+	/* Local index entries refer to objects by the old partition id */
+	rebuild = part->local_index && att.from_id != att.to_id;
+	if (rebuild) {
+		__sos_part_indices_copy(part, path, NULL, 1);
+		sprintf(tmp_path, "%s/%s/indices", path, part_name);
+		if (__sos_make_all_dir(tmp_path, dst_sos->o_mode)) {
+			rc = errno;
+			goto out_1;
+		}
+	}
+	att.collect = rebuild || (reindex && !part->local_index);
+
+	pthread_mutex_lock(&dst_sos->lock);
+	rc = __sos_open_partition(dst_sos, part);
+	pthread_mutex_unlock(&dst_sos->lock);
+	if (rc)
+		goto out_1;
+	rc = ods_obj_iter(part->obj_ods, NULL, __attach_fixup_fn, &att);
+	if (!rc && att.collect)
+		rc = __export_index(&att.exp);
+	if (!rc && reindex) {
+		pthread_mutex_lock(&dst_sos->lock);
+		ods_lock(dst_sos->part_ods, 0, NULL);
+		__make_part_active(dst_sos, part);
+		__refresh_part_list(dst_sos);
+		ods_unlock(dst_sos->part_ods, 0);
+		pthread_mutex_unlock(&dst_sos->lock);
+	}
+ out_1:
+	sos_part_put(part);
+ out:
+	free(att.schema_map);
+	__export_free(&att.exp);
+	return rc;
+ err_1:
+	free(att.schema_map);
+	__export_free(&att.exp);
+ err_0:
+	sos_part_put(src_part);
+	return rc;
+}
+
 /**
  * \brief Return size and access data for the partition
  *
@@ -1621,10 +4604,15 @@ int sos_part_stat(sos_part_t part, sos_part_stat_t stat)
 {
 	int rc = 0;
 	struct stat sb;
+	ods_t ods;
 
-	if (!part || !stat || !part->obj_ods)
+	if (!part || !stat)
 		return EINVAL;
-	rc = ods_stat(part->obj_ods, &sb);
+	ods = __sos_part_ods_pin(part);
+	if (!ods)
+		return EINVAL;
+	rc = ods_stat(ods, &sb);
+	__sos_part_ods_unpin(part);
 	if (rc)
 		goto out;
 
@@ -1657,7 +4645,7 @@ static int __part_obj_iter_cb(ods_t ods, ods_obj_t obj, void *arg)
 	}
 	ref.ref.ods = SOS_PART(part->part_obj)->part_id;
 	ref.ref.obj = ods_obj_ref(obj);
-	sos_obj = __sos_init_obj(part->sos, schema, obj, ref);
+	sos_obj = __sos_init_obj(part->sos, schema, ods_obj_get(obj), ref);
 	return oi_args->fn(oi_args->part, sos_obj, oi_args->arg);
 }
 
@@ -1695,10 +4683,12 @@ void sos_part_obj_iter_pos_init(sos_part_obj_iter_pos_t pos)
 int sos_part_obj_iter(sos_part_t part, sos_part_obj_iter_pos_t pos,
 		      sos_part_obj_iter_fn_t fn, void *arg)
 {
-	if (!part->obj_ods)
+	ods_t ods = __sos_part_ods_pin(part);
+	if (!ods)
 		return 0;
 	struct part_obj_iter_args_s args;
 	ods_obj_iter_pos_t ods_pos;
+	int rc;
 	if (pos)
 		ods_pos = &pos->pos;
 	else
@@ -1706,5 +4696,7 @@ int sos_part_obj_iter(sos_part_t part, sos_part_obj_iter_pos_t pos,
 	args.part = part;
 	args.fn = fn;
 	args.arg = arg;
-	return ods_obj_iter(part->obj_ods, ods_pos, __part_obj_iter_cb, &args);
+	rc = ods_obj_iter(ods, ods_pos, __part_obj_iter_cb, &args);
+	__sos_part_ods_unpin(part);
+	return rc;
 }
@@ -50,7 +50,7 @@
  *
  * \b SYNOPSIS
  *
- * sos_part_create -C <container> [-s <state>] [-p <path>] part_name
+ * sos_part_create -C <container> [-s <state>] [-p <path>] [-l] part_name
  *
  * \b DESCRIPTION
  *
@@ -70,6 +70,12 @@
  * Specify the path to the parition. This parameter is optional. The
  * default path is the container path.
  *
+ * \b -l
+ *
+ * The partition keeps the keys of its objects in its own index files
+ * in the partition directory. Changing the state of such a partition
+ * to or from OFFLINE does not update the container's indices.
+ *
  * \b part_name
  *
  * Specifies the name of the partition.
@@ -84,19 +90,20 @@
 #include <errno.h>
 #include <sos/sos.h>
 
-const char *short_options = "C:p:s:";
+const char *short_options = "C:p:s:l";
 
 struct option long_options[] = {
 	{"help",        no_argument,        0,  '?'},
 	{"container",   required_argument,  0,  'C'},
 	{"state",       no_argument,        0,  's'},
 	{"path",        required_argument,  0,  'p'},
+	{"local-index", no_argument,        0,  'l'},
 	{0,             0,                  0,  0}
 };
 
 void usage(int argc, char *argv[])
 {
-	printf("sos_part_create -C <path> [-p <path>] [-s <state>] <name>\n");
+	printf("sos_part_create -C <path> [-p <path>] [-s <state>] [-l] <name>\n");
 	printf("    -C <path>   The path to the container. Required for all options.\n");
 	printf("    -p <path>	Optional partition path. The container path is used by default.\n");
 	printf("    -s <state>  The initial state of a partition. Valid states are:\n"
@@ -104,14 +111,15 @@ void usage(int argc, char *argv[])
 	       "                active   - Objects are accessible, the partition does not grow\n"
 	       "                offline  - Object references are invalid; the partition\n"
 	       "                           may be moved or deleted.\n"
+	       "    -l          The partition keeps its own index files.\n"
 	       "    <name>      The partition name.\n"
 	       "     The default initial state is OFFLINE.\n");
 	exit(1);
 }
 
-int create_part(sos_t sos, const char *name, const char *path)
+int create_part(sos_t sos, const char *name, const char *path, int flags)
 {
-	int rc = sos_part_create(sos, name, path);
+	int rc = sos_part_create_ex(sos, name, path, flags);
 	if (rc)
 		perror("sos_part_create: ");
 	return rc;
@@ -170,6 +178,7 @@ int main(int argc, char **argv)
 	char *part_path = NULL;
 	char *name = NULL;
 	char *state = NULL;
+	int flags = 0;
 	int o, rc;
 	sos_t sos;
 	while (0 < (o = getopt_long(argc, argv, short_options, long_options, NULL))) {
@@ -183,6 +192,9 @@ int main(int argc, char **argv)
 		case 'p':
 			part_path = strdup(optarg);
 			break;
+		case 'l':
+			flags |= SOS_PART_F_LOCAL_INDEX;
+			break;
 		case '?':
 		default:
 			usage(argc, argv);
@@ -199,7 +211,7 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	rc = create_part(sos, name, part_path);
+	rc = create_part(sos, name, part_path, flags);
 	if (rc)
 		exit(1);
 	if (state) {
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \section sos_part_retain sos_part_retain command
+ *
+ * \b NAME
+ *
+ * sos_part_retain - Delete the partitions older than a retention period
+ *
+ * \b SYNOPSIS
+ *
+ * sos_part_retain -C <PATH> [-k <KEEP>]
+ *
+ * \b DESCRIPTION
+ *
+ * Deletes the active partitions in the Container whose objects have
+ * not been modified for KEEP and frees their storage. The primary
+ * partition is never deleted. The number of partitions deleted and
+ * the bytes of storage reclaimed are printed.
+ *
+ * \b -C PATH
+ *
+ * Specify the PATH to the Container. This option is required.
+ *
+ * \b -k KEEP
+ *
+ * The retention period in seconds, or with an 'm', 'h' or 'd' suffix,
+ * e.g. "90d". By default, the container's PART_RETENTION option is
+ * used.
+ */
+#include <sys/time.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sos/sos.h>
+
+void usage(int argc, char *argv[])
+{
+	printf("sos_part_retain -C <path> [-k <keep>]\n");
+	printf("    -C <path>   The path to the container.\n");
+	printf("    -k <keep>   Delete partitions not modified for this long, e.g. 90d.\n");
+	exit(1);
+}
+
+const char *short_options = "C:k:";
+
+struct option long_options[] = {
+	{"help",        no_argument,        0,  '?'},
+	{"path",        required_argument,  0,  'C'},
+	{"keep",        required_argument,  0,  'k'},
+	{0,             0,                  0,  0}
+};
+
+static time_t keep_time(const char *str)
+{
+	char *units;
+	long value;
+
+	value = strtol(str, &units, 0);
+	if (value <= 0)
+		return 0;
+	switch (*units) {
+	case 'm':
+	case 'M':
+		return value * 60;
+	case 'h':
+	case 'H':
+		return value * 60 * 60;
+	case 'd':
+	case 'D':
+		return value * 24 * 60 * 60;
+	}
+	return value;
+}
+
+int main(int argc, char **argv)
+{
+	struct sos_part_retain_stat_s sb;
+	char *path = NULL;
+	time_t keep = 0;
+	int opt, rc;
+	sos_t sos;
+
+	while (0 < (opt = getopt_long(argc, argv, short_options, long_options, NULL))) {
+		switch (opt) {
+		case 'C':
+			path = strdup(optarg);
+			break;
+		case 'k':
+			keep = keep_time(optarg);
+			if (!keep) {
+				printf("The retention period '%s' is invalid.\n", optarg);
+				exit(1);
+			}
+			break;
+		case '?':
+		default:
+			usage(argc, argv);
+		}
+	}
+	if (!path)
+		usage(argc, argv);
+
+	sos = sos_container_open(path, SOS_PERM_RW);
+	if (!sos) {
+		printf("Error %d opening the container %s.\n",
+		       errno, path);
+		exit(1);
+	}
+	rc = sos_part_retain(sos, keep, &sb);
+	sos_container_close(sos, SOS_COMMIT_SYNC);
+	if (rc == EINVAL) {
+		printf("Specify -k or set the container's PART_RETENTION option.\n");
+		return 1;
+	}
+	if (rc) {
+		printf("Error %d deleting the partitions.\n", rc);
+		return 1;
+	}
+	printf("Deleted %" PRIu64 " partitions, reclaimed %" PRIu64 " bytes.\n",
+	       sb.part_count, sb.bytes);
+	return 0;
+}
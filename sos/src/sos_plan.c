@@ -0,0 +1,523 @@
+/*
+ * Copyright (c) 2019 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \page planner Query Planning
+ *
+ * A filter is only as fast as the index it iterates. The planner
+ * estimates, for each indexed attribute of a schema, how many index
+ * entries a filter with a given set of conditions would visit if it
+ * iterated that attribute's index, and picks the attribute with the
+ * fewest.
+ *
+ * The estimates use the index cardinality and duplicate count, the
+ * minimum and maximum key, and, if the attribute has been analyzed
+ * with sos_attr_analyze(), an equi-depth histogram of the keys. The
+ * histogram and the correction below are kept with the open index;
+ * they are not persistent and are discarded when the container is
+ * closed.
+ *
+ * When a filter that ran to the end of its range is freed, the number
+ * of entries it actually visited is compared with the estimate and the
+ * ratio is used to correct subsequent estimates for that index.
+ */
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <sos/sos.h>
+#include <ods/ods_idx.h>
+#include "sos_priv.h"
+
+/* Selectivities used when there are no statistics for the attribute */
+#define SOS_PLAN_SEL_EQ		0.1
+#define SOS_PLAN_SEL_RANGE	(1.0 / 3.0)
+
+/* Scans shorter than this don't update the planner's correction */
+#define SOS_PLAN_FEEDBACK_MIN	1024
+#define SOS_PLAN_ADJ_MIN	0.01
+#define SOS_PLAN_ADJ_MAX	100.0
+
+struct plan_stats {
+	uint64_t card;		/* Entries in the index */
+	uint64_t distinct;	/* Distinct keys in the index */
+	int numeric;		/* min and max are valid */
+	double min;
+	double max;
+	struct sos_index_hist_s hist;	/* bin_count is 0 if not analyzed */
+};
+
+static int __type_is_numeric(sos_type_t type)
+{
+	return (type <= SOS_TYPE_TIMESTAMP && type != SOS_TYPE_LONG_DOUBLE);
+}
+
+static int __data_as_double(sos_type_t type, void *data, double *d)
+{
+	sos_value_data_t v = data;
+
+	switch (type) {
+	case SOS_TYPE_INT16:
+		*d = v->prim.int16_;
+		break;
+	case SOS_TYPE_INT32:
+		*d = v->prim.int32_;
+		break;
+	case SOS_TYPE_INT64:
+		*d = v->prim.int64_;
+		break;
+	case SOS_TYPE_UINT16:
+		*d = v->prim.uint16_;
+		break;
+	case SOS_TYPE_UINT32:
+		*d = v->prim.uint32_;
+		break;
+	case SOS_TYPE_UINT64:
+		*d = v->prim.uint64_;
+		break;
+	case SOS_TYPE_FLOAT:
+		*d = v->prim.float_;
+		break;
+	case SOS_TYPE_DOUBLE:
+		*d = v->prim.double_;
+		break;
+	case SOS_TYPE_TIMESTAMP:
+		*d = (double)v->prim.timestamp_.fine.secs
+			+ (double)v->prim.timestamp_.fine.usecs / 1.0e6;
+		break;
+	default:
+		return EINVAL;
+	}
+	return 0;
+}
+
+static int __obj_as_double(sos_obj_t obj, sos_attr_t attr, double *d)
+{
+	struct sos_value_s v_;
+	sos_value_t v;
+	int rc;
+
+	v = sos_value_init(&v_, obj, attr);
+	if (!v)
+		return EINVAL;
+	rc = __data_as_double(sos_attr_type(attr), v->data, d);
+	sos_value_put(v);
+	return rc;
+}
+
+static int __plan_stats(sos_attr_t attr, struct plan_stats *ps)
+{
+	struct sos_index_stat_s sb;
+	sos_index_t index = sos_attr_index(attr);
+	sos_obj_t obj;
+	int rc;
+
+	memset(ps, 0, sizeof(*ps));
+	if (!index)
+		return ENOENT;
+	rc = sos_index_stat(index, &sb);
+	if (rc)
+		return rc;
+	ps->card = sb.cardinality;
+	if (sb.cardinality > sb.duplicates)
+		ps->distinct = sb.cardinality - sb.duplicates;
+	else
+		ps->distinct = 1;
+	if (!__type_is_numeric(sos_attr_type(attr)))
+		return 0;
+	pthread_mutex_lock(&index->plan_lock);
+	if (index->hist)
+		ps->hist = *index->hist;
+	pthread_mutex_unlock(&index->plan_lock);
+	if (ps->hist.bin_count) {
+		ps->min = ps->hist.bins[0];
+		ps->max = ps->hist.bins[ps->hist.bin_count];
+		ps->numeric = 1;
+		return 0;
+	}
+	obj = sos_index_find_min(index);
+	if (!obj)
+		return 0;
+	rc = __obj_as_double(obj, attr, &ps->min);
+	sos_obj_put(obj);
+	if (rc)
+		return 0;
+	obj = sos_index_find_max(index);
+	if (!obj)
+		return 0;
+	rc = __obj_as_double(obj, attr, &ps->max);
+	sos_obj_put(obj);
+	if (!rc)
+		ps->numeric = 1;
+	return 0;
+}
+
+/*
+ * Return the fraction of the index entries with a key less than x
+ */
+static double __plan_cdf(struct plan_stats *ps, double x)
+{
+	sos_index_hist_t hist = &ps->hist;
+	double width;
+	int bin;
+
+	if (x <= ps->min)
+		return 0.0;
+	if (x >= ps->max)
+		return 1.0;
+	if (!hist->bin_count)
+		return (x - ps->min) / (ps->max - ps->min);
+	for (bin = 0; bin < hist->bin_count && x >= hist->bins[bin + 1]; bin++);
+	if (bin == hist->bin_count)
+		return 1.0;
+	width = hist->bins[bin + 1] - hist->bins[bin];
+	if (width <= 0.0)
+		return (double)bin / hist->bin_count;
+	return (bin + (x - hist->bins[bin]) / width) / hist->bin_count;
+}
+
+/*
+ * Return the fraction of the entries in the attribute's index that
+ * satisfy the conditions on attr. If range_only is set, only the
+ * conditions that bound the key range are considered, i.e. the result
+ * is the fraction of the index that a filter on attr visits.
+ */
+static double __plan_attr_sel(sos_attr_t attr, struct plan_stats *ps,
+			      sos_plan_cond_t conds, int count, int range_only)
+{
+	sos_type_t type = sos_attr_type(attr);
+	double lo = -HUGE_VAL, hi = HUGE_VAL, x = 0.0;
+	int i, eq = 0, bounded = 0, ne = 0, numeric = ps->numeric;
+	double sel = 1.0;
+
+	for (i = 0; i < count; i++) {
+		if (conds[i].attr != attr)
+			continue;
+		if (numeric && __data_as_double(type, conds[i].value->data, &x))
+			numeric = 0;
+		switch (conds[i].cond) {
+		case SOS_COND_EQ:
+			eq = 1;
+			break;
+		case SOS_COND_GE:
+		case SOS_COND_GT:
+			bounded = 1;
+			if (numeric && x > lo)
+				lo = x;
+			break;
+		case SOS_COND_LE:
+		case SOS_COND_LT:
+			bounded = 1;
+			if (numeric && x < hi)
+				hi = x;
+			break;
+		case SOS_COND_NE:
+			ne = 1;
+			break;
+		}
+	}
+	if (eq) {
+		sel = ps->card ? 1.0 / ps->distinct : SOS_PLAN_SEL_EQ;
+	} else if (bounded) {
+		if (numeric) {
+			sel = __plan_cdf(ps, hi) - __plan_cdf(ps, lo);
+			if (sel < 0.0)
+				sel = 0.0;
+		} else {
+			sel = SOS_PLAN_SEL_RANGE;
+		}
+	}
+	if (ne && !range_only && ps->distinct > 1)
+		sel *= 1.0 - 1.0 / ps->distinct;
+	return sel;
+}
+
+static int __plan_has_cond(sos_attr_t attr, sos_plan_cond_t conds, int count,
+			   int eq_only)
+{
+	int i;
+	for (i = 0; i < count; i++) {
+		if (conds[i].attr != attr)
+			continue;
+		if (!eq_only || conds[i].cond == SOS_COND_EQ)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Estimate the number of index entries a filter with these
+ * conditions visits when it iterates the attribute's index. Returns
+ * a negative value if the attribute is not indexed.
+ */
+static double __plan_visits(sos_attr_t attr, sos_plan_cond_t conds, int count)
+{
+	struct plan_stats ps, comp_ps;
+	sos_schema_t schema;
+	sos_array_t attr_ids;
+	sos_attr_t comp;
+	double sel = 1.0;
+	int i;
+
+	if (__plan_stats(attr, &ps))
+		return -1.0;
+	if (sos_attr_type(attr) != SOS_TYPE_JOIN)
+		return ps.card * __plan_attr_sel(attr, &ps, conds, count, 1);
+
+	/*
+	 * The key range of a join index is bounded by the leading
+	 * components that have conditions, up to and including the
+	 * first that is not tested for equality.
+	 */
+	schema = sos_attr_schema(attr);
+	attr_ids = sos_attr_join_list(attr);
+	for (i = 0; i < attr_ids->count; i++) {
+		comp = sos_schema_attr_by_id(schema, attr_ids->data.uint32_[i]);
+		if (!comp || !__plan_has_cond(comp, conds, count, 0))
+			break;
+		__plan_stats(comp, &comp_ps);
+		sel *= __plan_attr_sel(comp, &comp_ps, conds, count, 1);
+		if (!__plan_has_cond(comp, conds, count, 1))
+			break;
+	}
+	return ps.card * sel;
+}
+
+/**
+ * \brief Build the key distribution statistics for an attribute
+ *
+ * Scans the attribute's index and builds an equi-depth histogram of
+ * its keys that sos_plan_attr() uses to estimate the selectivity of
+ * range conditions. The histogram is kept with the open index and
+ * replaces any previous one; it is not updated as objects are added
+ * or removed. It is not persistent: the attribute must be analyzed
+ * again after the container is reopened.
+ *
+ * \param attr The attribute handle
+ * \retval 0 Success
+ * \retval ENOENT The attribute is not indexed
+ * \retval EINVAL The attribute is not a numeric or timestamp type
+ * \retval ENOMEM Insufficient resources
+ */
+int sos_attr_analyze(sos_attr_t attr)
+{
+	struct sos_index_stat_s sb;
+	sos_index_t index = sos_attr_index(attr);
+	sos_type_t type = sos_attr_type(attr);
+	sos_index_hist_t hist, swap;
+	sos_iter_t iter;
+	sos_key_t key;
+	uint64_t pos, next;
+	int rc, bins, bin;
+
+	if (!index)
+		return ENOENT;
+	if (!__type_is_numeric(type))
+		return EINVAL;
+	rc = sos_index_stat(index, &sb);
+	if (rc)
+		return rc;
+	hist = calloc(1, sizeof(*hist));
+	if (!hist)
+		return ENOMEM;
+	iter = sos_attr_iter_new(attr);
+	if (!iter) {
+		rc = errno;
+		goto err;
+	}
+	bins = SOS_INDEX_HIST_BINS;
+	if (sb.cardinality < bins)
+		bins = sb.cardinality;
+	bin = 0;
+	next = 0;
+	pos = 0;
+	for (rc = sos_iter_begin(iter); !rc && bin < bins;
+	     rc = sos_iter_next(iter), pos++) {
+		if (pos < next)
+			continue;
+		key = sos_iter_key(iter);
+		__data_as_double(type, sos_key_value(key), &hist->bins[bin]);
+		sos_key_put(key);
+		bin += 1;
+		next = bin * sb.cardinality / bins;
+	}
+	if (bin) {
+		/* The last bin ends at the largest key */
+		rc = sos_iter_end(iter);
+		if (!rc) {
+			key = sos_iter_key(iter);
+			__data_as_double(type, sos_key_value(key), &hist->bins[bin]);
+			sos_key_put(key);
+		} else {
+			hist->bins[bin] = hist->bins[bin - 1];
+		}
+	}
+	sos_iter_free(iter);
+	hist->bin_count = bin;
+	hist->cardinality = sb.cardinality;
+	pthread_mutex_lock(&index->plan_lock);
+	swap = index->hist;
+	index->hist = hist;
+	pthread_mutex_unlock(&index->plan_lock);
+	free(swap);
+	return 0;
+ err:
+	free(hist);
+	return rc;
+}
+
+/**
+ * \brief Choose the attribute index for a set of conditions
+ *
+ * Estimates, for each indexed attribute in the schema, the number of
+ * index entries a filter with the specified conditions would visit
+ * and returns the attribute with the fewest. The estimate is based on
+ * the index statistics, see sos_attr_analyze(), and is corrected by
+ * the number of entries previous filters on the index actually
+ * visited.
+ *
+ * The conditions are the same as those given to sos_filter_cond_add().
+ * If est_count is not NULL, it is set to the estimated number of
+ * objects that match all of the conditions.
+ *
+ * \param schema The schema handle
+ * \param conds An array of conditions
+ * \param count The number of conditions in conds
+ * \param est_count Pointer to the estimated result size or NULL
+ * \retval !NULL The attribute whose index should be iterated
+ * \retval NULL The schema has no indexed attributes, errno is ENOENT
+ */
+sos_attr_t sos_plan_attr(sos_schema_t schema, sos_plan_cond_t conds, int count,
+			 uint64_t *est_count)
+{
+	struct plan_stats ps;
+	sos_attr_t attr, best = NULL;
+	sos_index_t index;
+	double cost, best_cost = 0.0, sel;
+	uint64_t card;
+	int i, j;
+
+	for (attr = sos_schema_attr_first(schema); attr;
+	     attr = sos_schema_attr_next(attr)) {
+		cost = __plan_visits(attr, conds, count);
+		if (cost < 0.0)
+			continue;
+		index = sos_attr_index(attr);
+		pthread_mutex_lock(&index->plan_lock);
+		if (index->plan_adj > 0.0)
+			cost *= index->plan_adj;
+		pthread_mutex_unlock(&index->plan_lock);
+		if (!best || cost < best_cost) {
+			best = attr;
+			best_cost = cost;
+		}
+	}
+	if (!best) {
+		errno = ENOENT;
+		return NULL;
+	}
+	if (!est_count)
+		return best;
+
+	/* The conditions on different attributes are assumed independent */
+	__plan_stats(best, &ps);
+	card = ps.card;
+	sel = 1.0;
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < i; j++)
+			if (conds[j].attr == conds[i].attr)
+				break;
+		if (j < i)
+			continue;
+		__plan_stats(conds[i].attr, &ps);
+		sel *= __plan_attr_sel(conds[i].attr, &ps, conds, count, 0);
+	}
+	*est_count = (uint64_t)(card * sel + 0.5);
+	return best;
+}
+
+/*
+ * Called when a filter that ran to the end of its range is freed.
+ * Compare the number of entries visited with the estimate and adjust
+ * the correction applied to estimates for the index.
+ */
+void __sos_plan_feedback(sos_filter_t filt)
+{
+	struct sos_plan_cond_s *conds;
+	sos_filter_cond_t cond;
+	sos_attr_t attr = sos_iter_attr(filt->iter);
+	sos_index_t index;
+	double est, ratio;
+	int count;
+
+	if (!attr || filt->visit_cnt < SOS_PLAN_FEEDBACK_MIN)
+		return;
+	index = sos_attr_index(attr);
+	count = 0;
+	TAILQ_FOREACH(cond, &filt->cond_list, entry)
+		count++;
+	conds = calloc(count + 1, sizeof(*conds));
+	if (!conds)
+		return;
+	count = 0;
+	TAILQ_FOREACH(cond, &filt->cond_list, entry) {
+		conds[count].attr = cond->attr;
+		conds[count].cond = cond->cond;
+		conds[count].value = cond->value;
+		count++;
+	}
+	est = __plan_visits(attr, conds, count);
+	free(conds);
+	if (est < 1.0)
+		est = 1.0;
+	ratio = (double)filt->visit_cnt / est;
+	pthread_mutex_lock(&index->plan_lock);
+	if (index->plan_adj > 0.0)
+		ratio = (index->plan_adj + ratio) / 2.0;
+	if (ratio < SOS_PLAN_ADJ_MIN)
+		ratio = SOS_PLAN_ADJ_MIN;
+	if (ratio > SOS_PLAN_ADJ_MAX)
+		ratio = SOS_PLAN_ADJ_MAX;
+	index->plan_adj = ratio;
+	pthread_mutex_unlock(&index->plan_lock);
+}
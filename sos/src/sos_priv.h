@@ -121,6 +121,7 @@ typedef struct sos_part_udata_s {
 	ods_ref_t head;		/* Head of the partition list */
 	ods_ref_t tail;		/* Tail of the partition list */
 	ods_ref_t primary;	/* Current primary partition */
+	uint64_t primary_time;	/* When primary was made PRIMARY, 0 if unknown */
 } *sos_part_udata_t;
 #define SOS_PART_UDATA(_o_) ODS_PTR(sos_part_udata_t, _o_)
 
@@ -142,9 +143,43 @@ struct sos_part_s {
 	sos_t sos;
 	ods_obj_t part_obj;
 	ods_t obj_ods;
+	int local_index;	/* The partition keeps its own index files */
+	int retired;		/* Removed, see __sos_part_retire() */
+	ods_atomic_t lru_tick;	/* part_lru_clock at the last access */
+	ods_atomic_t ods_pin;	/* Users that keep obj_ods open */
+	pthread_mutex_t idx_lock;
+	struct rbt idx_rbt;	/* Open partition indices by name */
 	TAILQ_ENTRY(sos_part_s) entry;
 };
 
+/*
+ * An index of a partition created with SOS_PART_F_LOCAL_INDEX. The
+ * index files are kept in the partition's "indices" directory.
+ */
+struct sos_part_idx_s {
+	char name[SOS_INDEX_NAME_LEN];
+	ods_idx_t idx;
+	/*
+	 * Zone map: a key range that contains all keys in the index,
+	 * NULL if the index is empty. It is the index min/max when
+	 * opened and is widened by inserts.
+	 */
+	sos_key_t min_key;
+	sos_key_t max_key;
+	struct rbn rbn;
+};
+
+/*
+ * Maps a part_id to the partition in the partition list. The table
+ * is read without the container lock; when it grows, the old table is
+ * kept on the retired list until the container is closed.
+ */
+struct sos_part_table_s {
+	uint64_t count;
+	struct sos_part_table_s *retired;
+	sos_part_t parts[0];
+};
+
 struct sos_part_iter_s {
 	sos_t sos;
 	sos_part_t part;
@@ -173,6 +208,8 @@ typedef struct sos_pos_data_s {
 } *sos_pos_data_t;
 #define SOS_POS(_o_) ODS_PTR(sos_pos_data_t, _o_)
 #define SOS_POS_KEEP_TIME_DEFAULT 3600
+#define SOS_PART_ROLL_EXTEND_DEFAULT (16 * 1024 * 1024)
+#define SOS_PART_EXPORT_THREADS 4
 #define _stringify_(_x_) #_x_
 #define stringify(_x_) _stringify_(_x_)
 
@@ -214,6 +251,7 @@ typedef struct sos_attr_data_s {
 	uint32_t pad:23;
 	uint32_t size;		/* The size of the attribute in bytes */
 	uint32_t indexed:1;	/* !0 if there is an associated index */
+	uint32_t building:1;	/* !0 until the index is built, see sos_schema_index_add() */
 	uint64_t offset;	/* location of attribute in the object */
 	ods_ref_t ext_ref;	/* reference to extended data */
 } *sos_attr_data_t;
@@ -224,10 +262,41 @@ typedef char *(*sos_value_to_str_fn_t)(sos_value_t, char *, size_t);
 typedef int (*sos_value_from_str_fn_t)(sos_value_t, const char *, char **);
 typedef void *(*sos_value_key_value_fn_t)(sos_value_t);
 
+/*
+ * Equi-depth histogram of an index's numeric keys built by
+ * sos_attr_analyze(). Each bin holds the same number of entries;
+ * bins[i] and bins[i+1] are the smallest and largest key of bin i.
+ */
+#define SOS_INDEX_HIST_BINS	64
+typedef struct sos_index_hist_s {
+	uint64_t cardinality;	/* Index entries when the histogram was built */
+	int bin_count;
+	double bins[SOS_INDEX_HIST_BINS + 1];
+} *sos_index_hist_t;
+
+/*
+ * The local indices of the ACTIVE and PRIMARY partitions, cached by
+ * the index for the partition generation part_gn
+ */
+struct sos_index_parts_s {
+	ods_atomic_t ref_count;
+	ods_atomic_t part_gn;
+	int count;
+	struct sos_index_part_s {
+		sos_part_t part;
+		ods_idx_t idx;
+	} parts[0];
+};
+
 struct sos_index_s {
 	char name[SOS_INDEX_NAME_LEN];
 	sos_t sos;
 	ods_idx_t idx;
+	pthread_mutex_t parts_lock;	/* Protects parts */
+	struct sos_index_parts_s *parts;	/* NULL until first lookup */
+	pthread_mutex_t plan_lock;	/* Protects hist and plan_adj */
+	sos_index_hist_t hist;	/* Key distribution, NULL until analyzed */
+	double plan_adj;	/* Observed/estimated filter visits, 0 if unknown */
 };
 
 struct sos_attr_s {
@@ -302,6 +371,12 @@ typedef struct sos_idx_data_s {
 struct sos_container_config {
 	unsigned int options;
 	int pos_keep_time;
+	time_t part_roll_time;	/* Roll the primary after this many seconds */
+	size_t part_roll_size;	/* Roll the primary at this many bytes */
+	size_t part_roll_extend; /* Bytes to pre-extend the standby by */
+	char part_roll_standby[SOS_PART_NAME_LEN];
+	int part_open_max;	/* Max open partition object stores, 0 is no limit */
+	time_t part_retention;	/* Delete partitions unmodified this long, 0 is never */
 };
 
 /*
@@ -359,6 +434,63 @@ struct sos_container_s {
 	sos_part_t primary_part;
 	ods_t part_ods;
 	TAILQ_HEAD(sos_part_list, sos_part_s) part_list;
+	struct sos_part_list part_retired;	/* Removed, freed at close */
+	struct sos_part_table_s *part_table;	/* Partitions by part_id */
+
+	/*
+	 * Primary partition rotation. The roll thread keeps an ACTIVE
+	 * standby partition that becomes PRIMARY when the current
+	 * primary is too old or too large.
+	 */
+	int roll_running;
+	int roll_stop;
+	pthread_t roll_thread;
+	pthread_mutex_t roll_lock;
+	pthread_cond_t roll_cond;
+	uint64_t roll_standby;	/* part_id of the standby, 0 if none */
+	int roll_promote;	/* The PRIMARY is due to be rolled */
+
+	/*
+	 * Background index build. The build thread adds the objects
+	 * of the partitions in build_parts to the index of build_attr.
+	 * Partitions before build_next, and objects before build_cursor
+	 * in the partition at build_next, have been visited.
+	 */
+	int build_running;
+	int build_stop;
+	pthread_t build_thread;
+	pthread_mutex_t build_lock;
+	pthread_cond_t build_cond;
+	sos_attr_t build_attr;		/* NULL if idle */
+	uint64_t *build_parts;		/* part_id of the partitions to scan */
+	int build_count;
+	int build_next;
+	ods_ref_t build_cursor;
+	uint64_t build_size;		/* Size of the partition at build_next */
+	uint64_t build_objs;		/* Objects added to the index */
+	struct rbt build_new;		/* Objects allocated ahead of the scan */
+
+	/*
+	 * Partition retention. The retain thread deletes the ACTIVE
+	 * partitions that have not been modified for
+	 * config.part_retention seconds.
+	 */
+	int retain_running;
+	int retain_stop;
+	pthread_t retain_thread;
+	pthread_mutex_t retain_lock;
+	pthread_cond_t retain_cond;
+	struct sos_part_retain_stat_s retain_stat; /* Totals since open */
+
+	/*
+	 * Partition object stores are opened on first use, see
+	 * __sos_part_ods(). If config.part_open_max is set, the least
+	 * recently used idle stores are closed to stay under it.
+	 */
+	pthread_mutex_t part_open_lock;
+	pthread_rwlock_t part_evict_lock;
+	ods_atomic_t part_open_count;
+	ods_atomic_t part_lru_clock;
 
 	LIST_HEAD(obj_list_head, sos_obj_s) obj_list;
 	LIST_HEAD(obj_free_list_head, sos_obj_s) obj_free_list;
@@ -368,24 +500,65 @@ struct sos_container_s {
 };
 
 typedef int (*sos_filter_fn_t)(sos_value_t a, sos_value_t b, int *ret);
+
+/*
+ * The number of index entries evaluated together by
+ * sos_filter_batch_next()
+ */
+#define SOS_FILTER_BATCH 256
+
+/*
+ * A batch compare kernel clears sel[i] for each of the count objects
+ * whose attribute value at offset does not satisfy the condition.
+ */
+typedef void (*sos_filter_kern_t)(sos_obj_t *objs, int count, size_t offset,
+				  sos_value_data_t value, uint8_t *sel);
 struct sos_filter_cond_s {
 	sos_attr_t attr;
 	struct sos_value_s value_;
 	sos_value_t value;
 	sos_iter_t iter;
 	sos_filter_fn_t cmp_fn;
+	sos_filter_kern_t kern_fn;
 	enum sos_cond_e cond;
+	int join_idx;		/* Position of attr in the iterator's join key or -1 */
 	int ret;
 	TAILQ_ENTRY(sos_filter_cond_s) entry;
 };
 
+/*
+ * A range of values of the filter's range attribute. The filter
+ * matches objects whose value is in any one of its ranges.
+ */
+struct sos_filter_range_s {
+	struct sos_value_s lo_;
+	sos_value_t lo;
+	struct sos_value_s hi_;
+	sos_value_t hi;
+};
+
 struct sos_filter_s {
 	sos_iter_t iter;
 	SOS_KEY_VALUE(last_match_key);
 	struct ods_obj_s last_match_obj;
 	sos_key_t last_match;
 	int miss_cnt;
+	uint64_t visit_cnt;	/* Index entries examined since begin/end */
 	int empty;
+	int batch_end;	/* The last batch ended at the last match */
+	int covered;	/* All conditions can be evaluated on the join key */
+	int key_only;	/* Matching objects are not dereferenced */
+	size_t limit;	/* Maximum matches returned since begin/end, 0 is no limit */
+	size_t match_cnt;	/* Matches returned since begin/end */
+	sos_attr_t range_attr;	/* The attribute of the OR'd ranges or NULL */
+	struct sos_filter_range_s **ranges;
+	int range_count;
+	int range_sorted;	/* The ranges are sorted and disjoint */
+	int range_scan;		/* The ranges are scanned one at a time */
+	int range_idx;		/* The range being scanned */
+	sos_filter_cond_t range_lo;	/* '>=' the low value of the range(s) */
+	sos_filter_cond_t range_hi;	/* '<=' the high value of the range(s) */
+	struct sos_filter_cond_s range_miss;	/* The value is in no range */
 	TAILQ_HEAD(sos_cond_list, sos_filter_cond_s) cond_list;
 };
 
@@ -413,21 +586,50 @@ struct sos_config_iter_s {
 	ods_obj_t obj;
 };
 
+/*
+ * One of the index iterators merged by a sos_iter_t. Slot 0 iterates
+ * the container's index, the others the local index of an active
+ * partition.
+ */
+struct sos_iter_slot_s {
+	ods_iter_t iter;
+	int valid;		/* The iterator is positioned on an entry */
+	sos_part_t part;	/* The partition of a local index or NULL */
+	int pruned;		/* The zone map does not intersect the range */
+};
+
 struct sos_iter_s {
 	sos_attr_t attr;	/* !NULL if this iterator is associated with an attribute */
 	sos_index_t index;
-	ods_iter_t iter;
+	ods_iter_t iter;	/* The positioned index iterator */
+	ods_iter_flags_t flags;
+	ods_atomic_t part_gn;	/* Partition generation of the slots */
+	int slot_count;		/* 0 if no partition has a local index */
+	int slot_cur;		/* The slot of the iterator position */
+	int slot_dir;		/* 1 next, -1 prev, 0 the other slots must be repositioned */
+	struct sos_iter_slot_s *slots;
+	sos_key_t range_lo;	/* Key range hint for pruning partitions, see */
+	sos_key_t range_hi;	/* sos_iter_key_range_set() */
 };
 #ifndef SWIG
 /**
  * Internal routines
  */
 sos_schema_t __sos_get_ischema(sos_type_t type);
+void __sos_plan_feedback(sos_filter_t filt);
+void __sos_filter_ranges_prepare(sos_filter_t filt, int dir);
+int __sos_filter_in_ranges(sos_filter_t filt, sos_value_t v);
+int __sos_filter_refs(sos_filter_t filt, sos_obj_ref_t **prefs, size_t *pcount);
 sos_obj_t __sos_init_obj(sos_t sos, sos_schema_t schema,
 			 ods_obj_t ods_obj, sos_obj_ref_t obj_ref);
 sos_obj_t __sos_init_obj_no_lock(sos_t sos, sos_schema_t schema, ods_obj_t ods_obj,
 				 sos_obj_ref_t obj_ref);
 void __sos_obj_put_no_lock(sos_obj_t obj);
+int __sos_obj_index_attr(sos_obj_t obj, sos_attr_t attr);
+int __sos_obj_remove_attr(sos_obj_t obj, sos_attr_t attr);
+int __sos_obj_remove_key(sos_obj_t obj, sos_attr_t attr, sos_index_t index);
+int __sos_obj_index_key(sos_obj_t obj, sos_attr_t attr, sos_index_t index,
+			int replace);
 int sos_iter_pos_put_no_lock(sos_iter_t iter, const sos_pos_t pos);
 sos_value_size_fn_t __sos_attr_size_fn_for_type(sos_type_t type);
 sos_value_strlen_fn_t __sos_attr_strlen_fn_for_type(sos_type_t type);
@@ -441,6 +643,19 @@ ods_obj_t __sos_obj_new(ods_t ods, size_t size, pthread_mutex_t *lock);
 void __sos_schema_free(sos_schema_t schema);
 void __sos_part_primary_set(sos_t sos, ods_obj_t part_obj);
 sos_part_t __sos_primary_obj_part(sos_t sos);
+int __sos_part_roll_start(sos_t sos);
+void __sos_part_roll_stop(sos_t sos);
+int __sos_index_build_start(sos_t sos);
+int __sos_index_build_resume(sos_t sos);
+void __sos_index_build_stop(sos_t sos);
+int __sos_index_build_visited(sos_obj_t obj, sos_attr_t attr);
+void __sos_index_build_lock(sos_t sos);
+void __sos_index_build_unlock(sos_t sos);
+int __sos_index_build_obj_new(sos_obj_t obj);
+void __sos_index_build_obj_delete(sos_obj_t obj);
+int __sos_part_retain_start(sos_t sos);
+void __sos_part_retain_stop(sos_t sos);
+sos_index_t __sos_attr_index(sos_attr_t attr);
 sos_part_iter_t __sos_part_iter_new(sos_t sos);
 ods_obj_t __sos_part_obj_get(sos_t sos, ods_obj_t part_obj);
 void __sos_part_obj_put(sos_t sos, ods_obj_t part_obj);
@@ -454,11 +669,27 @@ int __sos_schema_name_cmp(void *a, void *b);
 int __sos_open_partitions(sos_t sos, char *tmp_path);
 int __sos_make_all_dir(const char *inp_path, mode_t omode);
 sos_part_t __sos_container_part_find(sos_t sos, const char *name);
+sos_part_t __sos_part_by_id(sos_t sos, uint64_t part_id);
+void __sos_part_table_free(sos_t sos);
+ods_t __sos_part_ods(sos_part_t part);
+ods_obj_t __sos_part_ref_as_obj(sos_t sos, sos_obj_ref_t ref);
+ods_idx_t __sos_part_idx(sos_part_t part, sos_index_t index);
+void __sos_part_idx_zone_update(sos_part_t part, sos_index_t index, sos_key_t key);
+int __sos_part_idx_zone_test(sos_part_t part, sos_index_t index,
+			     sos_key_t lo, sos_key_t hi);
+sos_key_t __sos_key_dup(sos_key_t key);
+int __sos_part_idx_slots(sos_index_t index, struct sos_iter_slot_s **pslots,
+			 int *pcount, ods_atomic_t *pgen);
+int __sos_part_idx_list(sos_index_t index, struct sos_index_parts_s **pparts);
+void __sos_index_parts_put(struct sos_index_parts_s *parts);
+ods_idx_t __sos_index_idx_open(sos_t sos, const char *name, const char *dir);
+int __sos_iter_idx_stat(sos_iter_t iter, ods_idx_stat_t sb);
 #define MAX_JOIN_ATTRS 8
 ods_key_comp_t __sos_next_key_comp(ods_key_comp_t comp);
 ods_key_comp_t __sos_set_key_comp(ods_key_comp_t comp, sos_value_t v, size_t *comp_len);
 ods_key_comp_t __sos_set_key_comp_to_min(ods_key_comp_t comp, sos_attr_t a, size_t *comp_len);
 ods_key_comp_t __sos_set_key_comp_to_max(ods_key_comp_t comp, sos_attr_t a, size_t *comp_len);
+int __sos_key_comp_incr(ods_key_comp_t comp);
 int __sos_value_is_max(sos_value_t v);
 int __sos_value_is_min(sos_value_t v);
 
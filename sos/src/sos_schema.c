@@ -117,6 +117,10 @@ static uint32_t type_sizes[] = {
  * returned by the sos_schema_attr_by_id() or sos_schema_attr_by_name()
  * functions.
  *
+ * An index added with sos_schema_index_add() to a schema that is
+ * already in a container is built in the background and used once
+ * it is complete.
+ *
  * - sos_schema_new()	     Create a schema
  * - sos_schema_attr_add()   Add an attribute to a schema
  * - sos_schema_index_add()  Add an index to an attribute
@@ -129,6 +133,7 @@ static uint32_t type_sizes[] = {
  * - sos_schema_attr_count() Returns the number of attributes in the schema.
  * - sos_schema_attr_by_id() Returns the attribute by ordinal id
  * - sos_schema_attr_by_name() Returns the attribute with the specified name
+ * - sos_attr_index_build_stat() Report the progress of an index build
  */
 
 /** \defgroup schema_funcs Schema Functions
@@ -516,38 +521,93 @@ int sos_schema_attr_add(sos_schema_t schema, const char *name, sos_type_t type,
 	return 0;
 }
 
+/*
+ * Create the index of an attribute of a schema that is already in a
+ * container and start the thread that adds the existing objects to it.
+ */
+static int __schema_index_build(sos_schema_t schema, sos_attr_t attr)
+{
+	char idx_name[SOS_SCHEMA_NAME_LEN + SOS_ATTR_NAME_LEN + 2];
+	sos_t sos = schema->sos;
+	sos_index_t index;
+	int rc;
+
+	if (sos->o_perm == ODS_PERM_RO)
+		return EPERM;
+	sprintf(idx_name, "%s_%s", schema->data->name, attr->data->name);
+	rc = sos_index_new(sos, idx_name,
+			   attr->idx_type, attr->key_type, attr->idx_args);
+	if (rc)
+		return rc;
+	index = sos_index_open(sos, idx_name);
+	if (!index)
+		return errno;
+
+	pthread_mutex_lock(&sos->lock);
+	if (schema->state == SOS_SCHEMA_OPEN)
+		attr->index = index;
+	else
+		/* __sos_schema_open() will open it with the others */
+		sos_index_close(index, SOS_COMMIT_ASYNC);
+	/* The index is not used until the build thread clears this */
+	attr->data->building = 1;
+	attr->data->indexed = 1;
+	TAILQ_INSERT_TAIL(&schema->idx_attr_list, attr, idx_entry);
+	pthread_mutex_unlock(&sos->lock);
+
+	return __sos_index_build_start(sos);
+}
+
 /**
  * \brief Add an index to an attribute
  *
- * Marks an attribute as having a key-value index. The index is not
- * actually created until the schema containing the attribute is added
- * to the container.
+ * Marks an attribute as having a key-value index. If the schema has
+ * not been added to a container, the index is created when the schema
+ * is added to the container.
+ *
+ * If the schema is already in a container, the index is created
+ * immediately and a background thread adds the objects in the ACTIVE
+ * and PRIMARY partitions to it. The thread is throttled so that it
+ * does not compete with ingest. Objects indexed with sos_obj_index()
+ * while the build is running are added to the new index as well.
+ * Until the build completes, sos_attr_index() returns NULL with
+ * errno set to EBUSY so that queries do not use a partial index. Use
+ * sos_attr_index_build_stat() to follow its progress. If the
+ * container is closed before the build completes, the build starts
+ * over the next time the container is opened read-write.
+ *
+ * Objects allocated while the index is building are left to
+ * sos_obj_index(). An object allocated before the index was added but
+ * not yet indexed when the build thread reaches it is added with the
+ * attribute value it has at that time.
  *
  * \param schema	The schema handle
  * \param attr_name	The attribute name
  * \retval 0		The index was succesfully added.
  * \retval ENOENT	The specified attribute does not exist.
+ * \retval EEXIST	The attribute is already indexed.
+ * \retval EPERM	The container was opened read-only.
  * \retval EINVAL	One or more parameters was invalid.
  */
 int sos_schema_index_add(sos_schema_t schema, const char *attr_name)
 {
 	sos_attr_t attr;
 
-	if (schema->schema_obj)
-		return EBUSY;
-
 	/* Find the attribute */
 	attr = _attr_by_name(schema, attr_name);
 	if (!attr)
 		return ENOENT;
 
 	/* Protect against adding it to the idx_list twice */
-	if (!attr->data->indexed) {
-		TAILQ_INSERT_TAIL(&schema->idx_attr_list, attr, idx_entry);
-		attr->data->indexed = 1;
-		return 0;
-	}
-	return EEXIST;
+	if (attr->data->indexed)
+		return EEXIST;
+
+	if (schema->schema_obj)
+		return __schema_index_build(schema, attr);
+
+	TAILQ_INSERT_TAIL(&schema->idx_attr_list, attr, idx_entry);
+	attr->data->indexed = 1;
+	return 0;
 }
 
 static void __toupper(char *s)
@@ -573,7 +633,20 @@ static void __toupper(char *s)
  * key types. These are useful for indexing complex data types that
  * are not understood as primitive types; for example a set of fields
  * that are represented as a UINT64.
-
+ *
+ * JOIN attributes default to the COMPOUND key type. The NCOMPOUND
+ * key type stores the same keys in an order preserving binary
+ * encoding that is compared with a single memcmp(); it is
+ * generally faster for searches but does not support LONG_DOUBLE
+ * or OBJ components.
+ *
+ * The PBXTREE index type stores keys in line in byte sized nodes
+ * with their common prefix removed. It is a good fit for long string
+ * and JOIN keys. The node size is specified as "NODE_SIZE=<bytes>".
+ *
+ * The index of a schema that is already in a container can only be
+ * modified before it is added with sos_schema_index_add().
+ *
  * \param schema	The schema handle.
  * \param name		The attribute name.
  * \param idx_type	The index type name. This parameter cannot be null.
@@ -584,6 +657,7 @@ static void __toupper(char *s)
  *			that specifies the number of entries in each BXTREE node.
  * \retval 0		The index was succesfully added.
  * \retval ENOENT	The specified attribute does not exist.
+ * \retval EBUSY	The index has already been created.
  * \retval EINVAL	One or more parameters was invalid.
  */
 int sos_schema_index_modify(sos_schema_t schema, const char *name,
@@ -592,14 +666,15 @@ int sos_schema_index_modify(sos_schema_t schema, const char *name,
 {
 	sos_attr_t attr;
 
-	if (schema->schema_obj)
-		return EBUSY;
-
 	/* Find the attribute */
 	attr = _attr_by_name(schema, name);
 	if (!attr)
 		return ENOENT;
 
+	/* The index of a schema in a container exists once it is added */
+	if (schema->schema_obj && attr->data->indexed)
+		return EBUSY;
+
 	if (idx_type) {
 		if (attr->idx_type)
 			free(attr->idx_type);
@@ -788,6 +863,8 @@ ods_obj_t __sos_obj_new(ods_t ods, size_t size, pthread_mutex_t *lock)
 {
 	ods_obj_t ods_obj;
 	size_t extend_size = (size < SOS_ODS_EXTEND_SZ ? SOS_ODS_EXTEND_SZ : size << 4);
+	if (!ods)
+		return NULL;
 	ods_obj = ods_obj_alloc(ods, size);
 	if (!ods_obj) {
 		int rc = ods_extend(ods, extend_size);
@@ -837,7 +914,8 @@ sos_value_t sos_array_new(sos_value_t val, sos_attr_t attr, sos_obj_t obj, size_
 	/* Free the old array contents if present */
 	if (val->data->prim.ref_.ref.obj) {
 		ods_t ods = __sos_ods_from_ref(obj->sos, val->data->prim.ref_.ref.ods);
-		ods_ref_delete(ods, val->data->prim.ref_.ref.obj);
+		if (ods)
+			ods_ref_delete(ods, val->data->prim.ref_.ref.obj);
 	}
 	/* Update the array reference in the containing object */
 	val->data->prim.ref_.ref.ods = obj->obj_ref.ref.ods;
@@ -869,7 +947,7 @@ sos_obj_t sos_array_obj_new(sos_t sos, sos_type_t type, size_t count)
 		+ (count * schema->data->el_sz); /* array elements */
 
 	part = __sos_primary_obj_part(sos);
-	array_obj = __sos_obj_new(part->obj_ods, size, &sos->lock);
+	array_obj = __sos_obj_new(__sos_part_ods(part), size, &sos->lock);
 	if (!array_obj)
 		return NULL;
 
@@ -884,13 +962,11 @@ sos_obj_t sos_array_obj_new(sos_t sos, sos_type_t type, size_t count)
 	return __sos_init_obj(sos, schema, array_obj, obj_ref);
 }
 
-/**
- * \brief Return the index for an attribute
- *
- * \param attr	The sos_attr_t handle
- * \returns The attribute index handle or NULL if the attribute is not indexed
+/*
+ * Return the index for an attribute whether or not it is still being
+ * built. This is used to maintain the index, not to query it.
  */
-sos_index_t sos_attr_index(sos_attr_t attr)
+sos_index_t __sos_attr_index(sos_attr_t attr)
 {
 	if (attr->data->indexed) {
 		int rc = __sos_schema_open(attr->schema->sos, attr->schema);
@@ -903,6 +979,26 @@ sos_index_t sos_attr_index(sos_attr_t attr)
 	return NULL;
 }
 
+/**
+ * \brief Return the index for an attribute
+ *
+ * An index that was added to the schema after it was added to the
+ * container is not returned until it has been built, see
+ * sos_schema_index_add().
+ *
+ * \param attr	The sos_attr_t handle
+ * \returns The attribute index handle or NULL if the attribute is not
+ * indexed. If the index is still being built, errno is set to EBUSY.
+ */
+sos_index_t sos_attr_index(sos_attr_t attr)
+{
+	if (attr->data->building) {
+		errno = EBUSY;
+		return NULL;
+	}
+	return __sos_attr_index(attr);
+}
+
 /**
  * \brief Return the size of an attribute's data
  *
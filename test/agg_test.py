@@ -0,0 +1,398 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import subprocess
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+TS_BASE = 1600000000 * 1000000 + 123457
+TS_COUNT = 2000
+TS_GAP = range(800, 900)
+RS_OPS = [ 'first', 'last', 'min', 'max', 'mean', 'rate' ]
+
+class AggTest(SosTestCase):
+    """Filter aggregation, resampling, limits and top-K selection"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("agg_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('agg_test',
+                                 [ { "name" : "key", "type" : "uint32",
+                                     "index" : {} },
+                                   { "name" : "comp", "type" : "uint32" },
+                                   { "name" : "val", "type" : "double" },
+                                   { "name" : "name", "type" : "char_array" }
+                               ])
+        cls.schema.add(cls.db)
+        cls.data = []
+        for k in range(0, 1000):
+            d = (k, k % 7, k * 0.5, "name-{0}".format(k % 3))
+            o = cls.schema.alloc()
+            o[:] = d
+            o.index_add()
+            cls.data.append(d)
+        del o
+
+        cls.rs_schema = Sos.Schema()
+        cls.rs_schema.from_template('agg_resample',
+                                    [ { "name" : "ts", "type" : "timestamp",
+                                        "index" : {} },
+                                      { "name" : "host", "type" : "uint32",
+                                        "index" : {} },
+                                      { "name" : "val", "type" : "double" },
+                                      { "name" : "cnt", "type" : "uint64" },
+                                      { "name" : "name", "type" : "char_array" },
+                                      { "name" : "ts_host", "type" : "join",
+                                        "join_attrs" : [ "ts", "host" ],
+                                        "index" : {} }
+                                  ])
+        cls.rs_schema.add(cls.db)
+        # Unevenly spaced samples that do not start on a bucket boundary,
+        # with a gap that leaves some buckets empty
+        cls.rs_data = []
+        for i in range(0, TS_COUNT):
+            if i in TS_GAP:
+                continue
+            t = TS_BASE + i * 137000 + (i % 7) * 3
+            d = (t, i % 4, float((i * 37) % 101 - 50), i * i)
+            o = cls.rs_schema.alloc()
+            o[:] = ( (t // 1000000, t % 1000000), d[1], d[2], d[3],
+                     "host-{0}".format(d[1]) )
+            o.index_add()
+            cls.rs_data.append(d)
+        del o
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __filter(self, lo):
+        attr = self.schema.attr_by_name('key')
+        f = attr.filter()
+        f.add_condition(attr, Sos.COND_GE, lo)
+        return f
+
+    def __stats(self, vals):
+        return { 'count' : len(vals), 'sum' : sum(vals),
+                 'min' : min(vals), 'max' : max(vals),
+                 'avg' : sum(vals) / len(vals) }
+
+    def test_00_all(self):
+        f = self.__filter(100)
+        self.assertEqual(f.aggregate('val'),
+                         self.__stats([ d[2] for d in self.data if d[0] >= 100 ]))
+        del f
+
+    def test_01_count(self):
+        f = self.__filter(990)
+        self.assertEqual(f.aggregate()['count'], 10)
+        del f
+
+    def test_02_empty(self):
+        f = self.__filter(5000)
+        res = f.aggregate('val')
+        self.assertEqual(res['count'], 0)
+        self.assertEqual(res['min'], None)
+        del f
+
+    def test_03_group(self):
+        f = self.__filter(500)
+        res = f.aggregate('val', group_by='comp')
+        self.assertEqual(sorted(res.keys()), list(range(0, 7)))
+        for c in range(0, 7):
+            self.assertEqual(res[c],
+                             self.__stats([ d[2] for d in self.data
+                                            if d[0] >= 500 and d[1] == c ]))
+        del f
+
+    def test_04_bad_attr(self):
+        f = self.__filter(0)
+        self.assertRaises(ValueError, f.aggregate, 'name')
+        del f
+
+    def __rs_filter(self, attr_name='ts', conds=[]):
+        f = self.rs_schema.attr_by_name(attr_name).filter()
+        for c in conds:
+            f.add_condition(self.rs_schema.attr_by_name(c[0]), c[1], c[2])
+        return f
+
+    def __rs_expect(self, interval_ms, data, col):
+        # One row per non-empty bucket: (start, first, last, min, max,
+        # mean, rate) computed from the samples in time order
+        interval = interval_ms * 1000
+        buckets = []
+        for d in data:
+            start = d[0] - d[0] % interval
+            if not buckets or buckets[-1][0] != start:
+                buckets.append((start, []))
+            buckets[-1][1].append((d[0], float(d[col])))
+        rows = []
+        prev = None
+        for start, samples in buckets:
+            vals = [ s[1] for s in samples ]
+            base = prev if prev else samples[0]
+            dt = (samples[-1][0] - base[0]) / 1.0e6
+            rate = (vals[-1] - base[1]) / dt if dt > 0 else 0.0
+            rows.append((start, vals[0], vals[-1], min(vals), max(vals),
+                         sum(vals) / len(vals), rate))
+            prev = samples[-1]
+        return rows
+
+    def __rs_rows(self, res, names, time_name='ts'):
+        times = res.array(time_name).astype('int64')
+        rows = []
+        for r in range(0, res.get_series_size()):
+            rows.append(tuple([ int(times[r]) ] +
+                              [ float(res.array(n)[r]) for n in names ]))
+        return rows
+
+    def __rs_check(self, rows, expect):
+        self.assertEqual(len(rows), len(expect))
+        for r in range(0, len(expect)):
+            self.assertEqual(rows[r][0], expect[r][0])
+            for c in range(1, len(expect[r])):
+                self.assertTrue(abs(rows[r][c] - expect[r][c])
+                                <= 1e-9 * max(1.0, abs(expect[r][c])))
+
+    def __rs_cols(self, name):
+        return [ (name, op) for op in RS_OPS ]
+
+    def __rs_names(self, name):
+        return [ '{0}_{1}'.format(name, op) for op in RS_OPS ]
+
+    def test_05_resample_align(self):
+        # Buckets start on a multiple of the interval and empty buckets
+        # produce no row
+        for interval_ms in [ 250, 1000, 60000 ]:
+            f = self.__rs_filter()
+            res = f.resample(interval_ms, [ 'val' ], timestamp='ts')
+            expect = self.__rs_expect(interval_ms, self.rs_data, 2)
+            times = [ int(t) for t in res.array('ts').astype('int64') ]
+            self.assertEqual(times, [ e[0] for e in expect ])
+            for t in times:
+                self.assertEqual(t % (interval_ms * 1000), 0)
+            self.assertTrue(times[0] < TS_BASE)
+            if interval_ms < 60000:
+                # The gap in the samples skips some buckets
+                steps = [ times[i + 1] - times[i] for i in range(0, len(times) - 1) ]
+                self.assertTrue(max(steps) > interval_ms * 1000)
+            self.assertTrue(f.resample(interval_ms, [ 'val' ], timestamp='ts',
+                                       cont=True) is None)
+            del f
+
+    def test_06_resample_ops(self):
+        # Every op over a double and an unsigned column. With a 250ms
+        # interval most buckets hold a single sample, so the rate is
+        # computed from the previous bucket.
+        for interval_ms in [ 100, 250, 1000, 60000 ]:
+            f = self.__rs_filter()
+            res = f.resample(interval_ms,
+                             self.__rs_cols('val') + self.__rs_cols('cnt'),
+                             timestamp='ts', count=TS_COUNT)
+            rows = self.__rs_rows(res, self.__rs_names('val') +
+                                  self.__rs_names('cnt'))
+            self.__rs_check([ r[0:7] for r in rows ],
+                            self.__rs_expect(interval_ms, self.rs_data, 2))
+            self.__rs_check([ r[0:1] + r[7:] for r in rows ],
+                            self.__rs_expect(interval_ms, self.rs_data, 3))
+            del f
+
+    def test_07_resample_rate(self):
+        # The rate of the first bucket is computed from its first
+        # sample and is 0 if the bucket holds only one sample
+        d = self.rs_data[10]
+        f = self.__rs_filter(conds=[ ('ts', Sos.COND_GE,
+                                      (d[0] // 1000000, d[0] % 1000000)) ])
+        res = f.resample(1000, [ ('cnt', 'rate', 'rate') ], timestamp='ts')
+        data = self.rs_data[10:]
+        expect = self.__rs_expect(1000, data, 3)
+        self.assertNotEqual(expect[0][6], 0.0)
+        self.__rs_check(self.__rs_rows(res, [ 'rate' ]),
+                        [ (e[0], e[6]) for e in expect ])
+        del f
+
+        d = self.rs_data[-1]
+        f = self.__rs_filter(conds=[ ('ts', Sos.COND_GE,
+                                      (d[0] // 1000000, d[0] % 1000000)) ])
+        res = f.resample(1000, [ ('cnt', 'rate', 'rate') ], timestamp='ts')
+        self.assertEqual(self.__rs_rows(res, [ 'rate' ]),
+                         [ (d[0] - d[0] % 1000000, 0.0) ])
+        del f
+
+    def test_08_resample_cont(self):
+        # Continuing with a small count returns the same rows, including
+        # buckets that span the internal object batches
+        cols = self.__rs_cols('val')
+        names = self.__rs_names('val')
+        for interval_ms in [ 100, 1000 ]:
+            expect = self.__rs_expect(interval_ms, self.rs_data, 2)
+            f = self.__rs_filter()
+            rows = []
+            res = f.resample(interval_ms, cols, timestamp='ts', count=3)
+            while res is not None:
+                self.assertTrue(res.get_series_size() <= 3)
+                rows += self.__rs_rows(res, names)
+                res = f.resample(interval_ms, cols, timestamp='ts', count=3,
+                                 cont=True)
+            self.__rs_check(rows, expect)
+            self.assertTrue(f.resample(interval_ms, cols, timestamp='ts',
+                                       count=3, cont=True) is None)
+            # Without cont the filter starts over
+            res = f.resample(interval_ms, cols, timestamp='ts', count=3)
+            self.__rs_check(self.__rs_rows(res, names), expect[0:3])
+            del f
+
+    def test_09_resample_join(self):
+        # A join index that begins with the timestamp orders the filter
+        f = self.__rs_filter('ts_host', [ ('host', Sos.COND_EQ, 2) ])
+        res = f.resample(1000, self.__rs_cols('val'), timestamp='ts')
+        self.__rs_check(self.__rs_rows(res, self.__rs_names('val')),
+                        self.__rs_expect(1000, [ d for d in self.rs_data
+                                                 if d[1] == 2 ], 2))
+        del f
+
+    def test_10_resample_query(self):
+        query = Sos.Query(self.db)
+        query.select([ 'ts', 'val', 'cnt' ], from_=[ 'agg_resample' ],
+                     order_by='ts')
+        res = query.resample(1000, ops={ 'cnt' : 'rate' }, timestamp='ts')
+        rows = self.__rs_rows(res, [ 'val', 'cnt' ])
+        self.__rs_check([ r[0:2] for r in rows ],
+                        [ (e[0], e[5]) for e in
+                          self.__rs_expect(1000, self.rs_data, 2) ])
+        self.__rs_check([ (r[0], r[2]) for r in rows ],
+                        [ (e[0], e[6]) for e in
+                          self.__rs_expect(1000, self.rs_data, 3) ])
+        del query
+
+    def test_11_resample_einval(self):
+        f = self.__rs_filter()
+        # A zero interval
+        self.assertRaises(ValueError, f.resample, 0, [ 'val' ], timestamp='ts')
+        # A column that is not numeric
+        self.assertRaises(ValueError, f.resample, 1000, [ 'name' ],
+                          timestamp='ts')
+        # A timestamp attribute that is not a timestamp
+        self.assertRaises(ValueError, f.resample, 1000, [ 'val' ],
+                          timestamp='cnt')
+        # An unknown op or attribute
+        self.assertRaises(ValueError, f.resample, 1000, [ ('val', 'median') ],
+                          timestamp='ts')
+        self.assertRaises(ValueError, f.resample, 1000, [ 'nope' ],
+                          timestamp='ts')
+        del f
+        # A filter that is not in time order
+        f = self.__rs_filter('host')
+        self.assertRaises(ValueError, f.resample, 1000, [ 'val' ],
+                          timestamp='ts')
+        del f
+
+    def __objs(self, f, first, step):
+        res = []
+        o = first()
+        while o:
+            res.append(o[0])
+            o = step()
+        del o
+        return res
+
+    def test_12_limit(self):
+        f = self.__filter(100)
+        f.limit(10)
+        self.assertEqual(self.__objs(f, f.begin, f.next), list(range(100, 110)))
+        self.assertTrue(f.next() is None)
+        # end() restarts the count
+        self.assertEqual(self.__objs(f, f.end, f.prev), list(range(999, 989, -1)))
+        # A limit of 0 removes the limit
+        f.limit(0)
+        self.assertEqual(self.__objs(f, f.begin, f.next), list(range(100, 1000)))
+        del f
+
+    def test_13_limit_batch(self):
+        f = self.__filter(100)
+        f.limit(25)
+        res = []
+        objs = f.batch_begin(10)
+        while objs:
+            res.append([ o[0] for o in objs ])
+            objs = f.batch_next(10)
+        self.assertEqual([ len(r) for r in res ], [ 10, 10, 5 ])
+        self.assertEqual(sum(res, []), list(range(100, 125)))
+        self.assertEqual(f.batch_next(10), [])
+        # next() after a batch counts against the same limit
+        res = [ o[0] for o in f.batch_begin(10) ]
+        res += self.__objs(f, f.next, f.next)
+        self.assertEqual(res, list(range(100, 125)))
+        del objs
+        del f
+
+    def test_14_top_k_index(self):
+        # Ordering by the filter attribute takes the first or last
+        # matches in index order
+        f = self.__filter(100)
+        f.add_condition(self.schema.attr_by_name('comp'), Sos.COND_EQ, 3)
+        match = [ d[0] for d in self.data if d[0] >= 100 and d[1] == 3 ]
+        f.limit(2)
+        for k in [ 1, 5, len(match), len(match) + 5 ]:
+            for attr in [ None, 'key' ]:
+                self.assertEqual([ o[0] for o in f.top_k(k, attr=attr) ],
+                                 match[0:k])
+                self.assertEqual([ o[0] for o in f.top_k(k, attr=attr, desc=True) ],
+                                 list(reversed(match))[0:k])
+        # The limit is ignored by top_k() but still applies afterwards
+        self.assertEqual(self.__objs(f, f.begin, f.next), match[0:2])
+        del f
+
+    def test_15_top_k_heap(self):
+        # Ordering by another attribute keeps the best k in a heap
+        f = self.__filter(100)
+        f.add_condition(self.schema.attr_by_name('key'), Sos.COND_LT, 900)
+        match = [ d for d in self.data if d[0] >= 100 and d[0] < 900 ]
+        for col, name in [ (2, 'val'), (1, 'comp') ]:
+            for desc in [ False, True ]:
+                ref = sorted([ d[col] for d in match ], reverse=desc)
+                for k in [ 1, 7, 100, len(match) + 5 ]:
+                    objs = f.top_k(k, attr=name, desc=desc)
+                    self.assertEqual([ o[col] for o in objs ], ref[0:k])
+                    keys = [ o[0] for o in objs ]
+                    self.assertEqual(len(set(keys)), len(keys))
+                    for key in keys:
+                        self.assertTrue(key >= 100 and key < 900)
+                    del objs
+        del f
+
+    def __sos_cmd(self, *args):
+        cmd = [ 'sos_cmd', '-C', self.path, '-q', '-S', 'agg_test', '-X', 'key',
+                '-f', 'csv' ] + list(args)
+        p = subprocess.run(cmd, stdout=subprocess.PIPE, universal_newlines=True)
+        rows = [ l.split(',') for l in p.stdout.splitlines()
+                 if l and not l.startswith('#') ]
+        return (p.returncode, rows)
+
+    @unittest.skipUnless(shutil.which('sos_cmd'), "sos_cmd is not installed")
+    def test_16_sos_cmd(self):
+        rc, rows = self.__sos_cmd('-V', 'key', '-N', '5', '-F', 'key:ge:100')
+        self.assertEqual(rc, 0)
+        self.assertEqual([ int(r[0]) for r in rows ], list(range(100, 105)))
+        rc, rows = self.__sos_cmd('-V', 'key', '-V', 'comp', '-N', '20',
+                                  '-B', 'comp:desc', '-F', 'key:ge:900')
+        self.assertEqual(rc, 0)
+        self.assertEqual([ int(r[1]) for r in rows ],
+                         sorted([ d[1] for d in self.data if d[0] >= 900 ],
+                                reverse=True)[0:20])
+        rc, rows = self.__sos_cmd('-V', 'key', '-N', '3', '-B', 'val',
+                                  '-F', 'key:ge:100')
+        self.assertEqual([ int(r[0]) for r in rows ], [ 100, 101, 102 ])
+        # -B requires -N
+        rc, rows = self.__sos_cmd('-V', 'key', '-B', 'val')
+        self.assertNotEqual(rc, 0)
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
@@ -0,0 +1,159 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import random
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+KEYS = 10
+DUPS = 600
+COUNT = 20000
+
+class BxtPostingTest(SosTestCase):
+    """BXTREE duplicate keys kept in posting-list pages"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("bxt_posting_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('bxt_posting_test',
+                                 [ { "name" : "key", "type" : "uint32",
+                                     "index" : { "type" : "BXTREE" } },
+                                   { "name" : "seq", "type" : "uint64" }
+                               ])
+        cls.schema.add(cls.db)
+        cls.objs = []
+        cls.live = {}
+
+    @classmethod
+    def tearDownClass(cls):
+        del cls.objs
+        cls.tearDownDb()
+
+    def __check(self):
+        attr = self.schema.attr_by_name('key')
+        expect = []
+        for k in sorted(self.live.keys()):
+            expect += [ (k, s) for s in self.live[k] ]
+        it = attr.attr_iter()
+        rows = []
+        b = it.begin()
+        while b:
+            o = it.item()
+            rows.append((o[0], o[1]))
+            b = it.next()
+        self.assertEqual(rows, expect)
+        rows = []
+        b = it.end()
+        while b:
+            o = it.item()
+            rows.append((o[0], o[1]))
+            b = it.prev()
+        rows.reverse()
+        self.assertEqual(rows, expect)
+        for k in self.live.keys():
+            f = attr.filter()
+            f.add_condition(attr, Sos.COND_EQ, k)
+            count = 0
+            o = f.begin()
+            while o:
+                self.assertEqual(o[0], k)
+                count += 1
+                o = f.next()
+            self.assertEqual(count, len(self.live[k]))
+            del f
+
+    def test_00_add(self):
+        # Interleave the keys so that each posting list grows across pages
+        seq = 0
+        for d in range(0, DUPS):
+            for k in range(0, KEYS):
+                o = self.schema.alloc()
+                o[:] = ( k * 10, seq )
+                o.index_add()
+                self.objs.append(o)
+                if k * 10 not in self.live:
+                    self.live[k * 10] = []
+                self.live[k * 10].append(seq)
+                seq += 1
+        self.__check()
+
+    def test_01_del_some(self):
+        for o in self.objs[::3]:
+            self.live[o[0]].remove(o[1])
+            self.assertEqual(o.index_del(), 0)
+        self.__check()
+
+    def test_02_del_key(self):
+        for o in self.objs:
+            if o[0] == 30 and o[1] in self.live[30]:
+                self.live[30].remove(o[1])
+                self.assertEqual(o.index_del(), 0)
+        del self.live[30]
+        self.__check()
+
+
+class BxtStatTest(SosTestCase):
+    """BXTREE node sizing and the depth and fill factor statistics"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("bxt_stat_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('bxt_stat_test',
+                                 [ { "name" : "small", "type" : "uint64",
+                                     "index" : { "type" : "BXTREE",
+                                                 "args" : "NODE_SIZE=512" } },
+                                   { "name" : "large", "type" : "uint64",
+                                     "index" : { "type" : "BXTREE",
+                                                 "args" : "NODE_SIZE=16K" } }
+                               ])
+        cls.schema.add(cls.db)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __stats(self, name):
+        return self.schema.attr_by_name(name).index().stats()
+
+    def test_00_empty(self):
+        for name in [ 'small', 'large' ]:
+            s = self.__stats(name)
+            self.assertEqual(s['cardinality'], 0)
+            self.assertEqual(s['depth'], 0)
+        self.assertTrue(self.__stats('small')['node_size'] <= 512)
+        self.assertTrue(self.__stats('large')['node_size'] <= 16384)
+        self.assertTrue(self.__stats('large')['node_size'] > 8192)
+
+    def test_01_add(self):
+        keys = list(range(0, COUNT))
+        random.shuffle(keys)
+        for k in keys:
+            o = self.schema.alloc()
+            o[:] = ( k, k )
+            o.index_add()
+        small = self.__stats('small')
+        large = self.__stats('large')
+        for s in [ small, large ]:
+            self.assertEqual(s['cardinality'], COUNT)
+            self.assertEqual(s['duplicates'], 0)
+            self.assertTrue(s['fill_factor'] > 0.25)
+            self.assertTrue(s['fill_factor'] <= 1.0)
+        self.assertTrue(small['depth'] > large['depth'])
+        self.assertTrue(large['depth'] >= 2)
+
+    def test_02_stat_repeat(self):
+        # Repeated calls report the same values
+        a = self.__stats('small')
+        b = self.__stats('small')
+        self.assertEqual(a['depth'], b['depth'])
+        self.assertEqual(a['fill_factor'], b['fill_factor'])
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
@@ -0,0 +1,162 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+COUNT = 1000
+TS_BASE = 1600000000
+BATCHES = [ 1, 7, 300 ]
+OPS = { Sos.COND_LT : lambda a, b : a < b,
+        Sos.COND_LE : lambda a, b : a <= b,
+        Sos.COND_EQ : lambda a, b : a == b,
+        Sos.COND_GE : lambda a, b : a >= b,
+        Sos.COND_GT : lambda a, b : a > b,
+        Sos.COND_NE : lambda a, b : a != b }
+COLS = [ 'seq', 'i16', 'i32', 'i64', 'u16', 'u32', 'u64',
+         'f32', 'f64', 'ts', 'name' ]
+
+class FilterBatchTest(SosTestCase):
+    """Filter.batch_begin() and batch_next() against begin() and next()"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("filter_batch_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('filter_batch_test',
+                                 [ { "name" : "seq", "type" : "uint64",
+                                     "index" : {} },
+                                   { "name" : "i16", "type" : "int16" },
+                                   { "name" : "i32", "type" : "int32" },
+                                   { "name" : "i64", "type" : "int64" },
+                                   { "name" : "u16", "type" : "uint16" },
+                                   { "name" : "u32", "type" : "uint32" },
+                                   { "name" : "u64", "type" : "uint64" },
+                                   { "name" : "f32", "type" : "float" },
+                                   { "name" : "f64", "type" : "double" },
+                                   { "name" : "ts", "type" : "timestamp",
+                                     "index" : {} },
+                                   { "name" : "name", "type" : "char_array" },
+                                   { "name" : "u32_seq", "type" : "join",
+                                     "join_attrs" : [ "u32", "seq" ],
+                                     "index" : {} }
+                               ])
+        cls.schema.add(cls.db)
+        cls.data = []
+        for i in range(0, COUNT):
+            d = ( i, (i * 7) % 200 - 100, (i * 13) % 1000 - 500,
+                  i * 1000003 - 1000000000, (i * 11) % 500, (i * 17) % 1000,
+                  (i * 19) % 5000, (i % 100) / 4.0, i * 0.25,
+                  (TS_BASE + i // 10, (i % 10) * 1000), "n-{0}".format(i % 13) )
+            o = cls.schema.alloc()
+            o[:] = d
+            o.index_add()
+            cls.data.append(d)
+        o = None
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __filter(self, attr_name, conds):
+        f = self.schema.attr_by_name(attr_name).filter()
+        for c in conds:
+            f.add_condition(self.schema.attr_by_name(c[0]), c[1], c[2])
+        return f
+
+    def __scalar(self, attr_name, conds):
+        f = self.__filter(attr_name, conds)
+        res = []
+        o = f.begin()
+        while o:
+            res.append(o[0])
+            o = f.next()
+        del o
+        del f
+        return res
+
+    def __batch(self, attr_name, conds, count):
+        f = self.__filter(attr_name, conds)
+        res = []
+        objs = f.batch_begin(count)
+        while objs:
+            self.assertTrue(len(objs) <= count)
+            res += [ o[0] for o in objs ]
+            objs = f.batch_next(count)
+        # The end is reported again by later calls
+        self.assertEqual(f.batch_next(count), [])
+        self.assertEqual(f.batch_next(count), [])
+        self.assertTrue(f.next() is None)
+        del objs
+        del f
+        return res
+
+    def __check(self, attr_name, conds, order=0):
+        expect = sorted(self.data, key=lambda d : (d[order], d[0]))
+        for c in conds:
+            col = COLS.index(c[0])
+            expect = [ d for d in expect if OPS[c[1]](d[col], c[2]) ]
+        expect = [ d[0] for d in expect ]
+        self.assertEqual(self.__scalar(attr_name, conds), expect)
+        for count in BATCHES:
+            self.assertEqual(self.__batch(attr_name, conds, count), expect)
+        return len(expect)
+
+    def test_00_kernels(self):
+        # Conditions on each type with a batch kernel
+        values = { 'i16' : -20, 'i32' : 100, 'i64' : -500000000,
+                   'u16' : 250, 'u32' : 600, 'u64' : 2500,
+                   'f32' : 12.5, 'f64' : 100.25 }
+        for col in values:
+            for op in OPS:
+                self.__check('seq', [ (col, op, values[col]) ])
+
+    def test_01_timestamp(self):
+        # A timestamp uses the UINT64 kernel
+        ts = (TS_BASE + 50, 5000)
+        for op in OPS:
+            self.__check('seq', [ ('ts', op, ts) ])
+
+    def test_02_scalar(self):
+        # A char_array has no kernel and is compared one object at a time
+        self.__check('seq', [ ('name', Sos.COND_EQ, "n-5") ])
+        self.__check('seq', [ ('name', Sos.COND_EQ, "n-5"),
+                              ('u32', Sos.COND_GT, 500) ])
+
+    def test_03_upper_bound(self):
+        # The first key past the bound ends the scan
+        self.assertEqual(self.__check('seq', [ ('seq', Sos.COND_LT, 400) ]), 400)
+        self.__check('seq', [ ('seq', Sos.COND_GE, 100),
+                              ('seq', Sos.COND_LE, 700),
+                              ('i16', Sos.COND_GT, 0) ])
+        self.__check('seq', [ ('seq', Sos.COND_EQ, 999) ])
+        self.__check('seq', [ ('seq', Sos.COND_GT, 999) ])
+        self.__check('ts', [ ('ts', Sos.COND_LE, (TS_BASE + 20, 0)) ], order=9)
+
+    def test_04_batch_then_next(self):
+        # next() continues after the last object of a batch
+        f = self.__filter('seq', [ ('u16', Sos.COND_LT, 100) ])
+        expect = [ d[0] for d in self.data if d[4] < 100 ]
+        res = [ o[0] for o in f.batch_begin(10) ]
+        o = f.next()
+        while o:
+            res.append(o[0])
+            o = f.next()
+        del o
+        del f
+        self.assertEqual(res, expect)
+
+    def test_05_join(self):
+        # Join iterators use next_match() for each object
+        self.__check('u32_seq', [ ('u32', Sos.COND_GE, 990) ], order=5)
+        self.__check('u32_seq', [ ('u32', Sos.COND_EQ, 17),
+                                  ('seq', Sos.COND_GT, 500) ], order=5)
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
@@ -0,0 +1,190 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import random
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+class FilterBoundsTest(SosTestCase):
+    """Filters whose conditions on the iterator attribute bound the key range"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("filter_bounds_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('filter_bounds_test',
+                                 [ { "name" : "key", "type" : "int64",
+                                     "index" : {} },
+                                   { "name" : "val", "type" : "int64" }
+                               ])
+        cls.schema.add(cls.db)
+        cls.data = []
+        for k in range(-500, 500, 5):
+            for d in range(0, 3):
+                cls.data.append((k, d))
+        for seq in cls.data:
+            o = cls.schema.alloc()
+            o[:] = seq
+            o.index_add()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __query(self, conds, expect):
+        attr = self.schema.attr_by_name('key')
+        f = attr.filter()
+        for c in conds:
+            f.add_condition(self.schema.attr_by_name(c[0]), c[1], c[2])
+        fwd = []
+        o = f.begin()
+        while o:
+            fwd.append(o[0])
+            o = f.next()
+        rev = []
+        o = f.end()
+        while o:
+            rev.append(o[0])
+            o = f.prev()
+        rev.reverse()
+        del f
+        self.assertEqual(fwd, expect)
+        self.assertEqual(rev, expect)
+
+    def __keys(self, fn):
+        return sorted([ d[0] for d in self.data if fn(d) ])
+
+    def test_00_ge_le(self):
+        self.__query([ ('key', Sos.COND_GE, -17), ('key', Sos.COND_LE, 42) ],
+                     self.__keys(lambda d: -17 <= d[0] <= 42))
+
+    def test_01_gt_lt(self):
+        self.__query([ ('key', Sos.COND_GT, -20), ('key', Sos.COND_LT, 20) ],
+                     self.__keys(lambda d: -20 < d[0] < 20))
+
+    def test_02_tightest(self):
+        self.__query([ ('key', Sos.COND_GE, -100), ('key', Sos.COND_GE, 0),
+                       ('key', Sos.COND_LE, 100), ('key', Sos.COND_LT, 50) ],
+                     self.__keys(lambda d: 0 <= d[0] < 50))
+
+    def test_03_eq(self):
+        self.__query([ ('key', Sos.COND_EQ, 35) ],
+                     self.__keys(lambda d: d[0] == 35))
+
+    def test_04_empty(self):
+        self.__query([ ('key', Sos.COND_GT, 10), ('key', Sos.COND_LT, 15) ], [])
+        self.__query([ ('key', Sos.COND_GT, 1000) ], [])
+
+    def test_05_other_attr(self):
+        self.__query([ ('key', Sos.COND_GE, 250), ('val', Sos.COND_EQ, 1) ],
+                     self.__keys(lambda d: d[0] >= 250 and d[1] == 1))
+
+
+class RangeTest(SosTestCase):
+    """Filters with several value ranges and IN lists"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("range_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('range_test',
+                                 [ { "name" : "job", "type" : "uint32" },
+                                   { "name" : "val", "type" : "int64",
+                                     "index" : {} },
+                                   { "name" : "other", "type" : "int64",
+                                     "index" : {} },
+                                   { "name" : "job_val", "type" : "join",
+                                     "join_attrs" : [ "job", "val" ],
+                                     "index" : {} }
+                               ])
+        cls.schema.add(cls.db)
+        cls.data = []
+        for job in range(0, 4):
+            for val in range(-100, 100, 3):
+                o = cls.schema.alloc()
+                o[:] = ( job, val, -val )
+                o.index_add()
+                cls.data.append((job, val, -val))
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __rows(self, f):
+        rows = []
+        o = f.begin()
+        while o:
+            rows.append((o[0], o[1], o[2]))
+            o = f.next()
+        rev = []
+        o = f.end()
+        while o:
+            rev.append((o[0], o[1], o[2]))
+            o = f.prev()
+        rev.reverse()
+        self.assertEqual(rows, rev)
+        return sorted(rows)
+
+    def __expect(self, fn):
+        return sorted([ d for d in self.data if fn(d) ])
+
+    def test_00_ranges(self):
+        val = self.schema.attr_by_name('val')
+        f = val.filter()
+        f.add_range(val, -50, -20)
+        f.add_range(val, 10, 30)
+        f.add_range(val, 25, 40)
+        self.assertEqual(self.__rows(f),
+                         self.__expect(lambda d: -50 <= d[1] <= -20
+                                       or 10 <= d[1] <= 40))
+        del f
+
+    def test_01_in(self):
+        val = self.schema.attr_by_name('val')
+        f = val.filter()
+        f.add_in(val, [ 2, -1, 50, 51, 2 ])
+        self.assertEqual(self.__rows(f),
+                         self.__expect(lambda d: d[1] in [ 2, -1, 50 ]))
+        del f
+
+    def test_02_other_index(self):
+        # The ranges bound the scan and each value is looked up
+        other = self.schema.attr_by_name('other')
+        val = self.schema.attr_by_name('val')
+        f = other.filter()
+        f.add_range(val, -10, 10)
+        f.add_in(val, [ 80 ])
+        self.assertEqual(self.__rows(f),
+                         self.__expect(lambda d: -10 <= d[1] <= 10 or d[1] == 80))
+        del f
+
+    def test_03_join(self):
+        job_val = self.schema.attr_by_name('job_val')
+        val = self.schema.attr_by_name('val')
+        f = job_val.filter()
+        f.add_condition(self.schema.attr_by_name('job'), Sos.COND_EQ, 2)
+        f.add_range(val, -30, -10)
+        f.add_range(val, 60, 70)
+        self.assertEqual(self.__rows(f),
+                         self.__expect(lambda d: d[0] == 2 and
+                                       (-30 <= d[1] <= -10 or 60 <= d[1] <= 70)))
+        del f
+
+    def test_04_invalid(self):
+        val = self.schema.attr_by_name('val')
+        f = val.filter()
+        self.assertRaises(ValueError, f.add_range, val, 10, 5)
+        f.add_range(val, 0, 10)
+        self.assertRaises(ValueError, f.add_range,
+                          self.schema.attr_by_name('other'), 0, 10)
+        self.assertEqual(self.__rows(f),
+                         self.__expect(lambda d: 0 <= d[1] <= 10))
+        del f
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
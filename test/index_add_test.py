@@ -0,0 +1,156 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import time
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+COUNT = 10000
+HELD = 50
+BUILD_TIMEOUT = 120
+
+class IndexAddTest(SosTestCase):
+    """Adding an index to a schema that already has objects"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("index_add_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('index_add_test',
+                                 [ { "name" : "seq", "type" : "uint64",
+                                     "index" : {} },
+                                   { "name" : "val", "type" : "uint64" },
+                                   { "name" : "val2", "type" : "uint64" }
+                               ])
+        cls.schema.add(cls.db)
+        cls.seqs = set()
+        cls.next_seq = 0
+        for name, local in [ ("P1", False), ("L1", True), ("P2", False) ]:
+            cls.db.part_create(name, local_index=local)
+            cls.db.part_by_name(name).state_set("PRIMARY")
+            for i in range(0, COUNT):
+                cls.add()
+            if name == "P1":
+                # Allocated but not indexed until the build has
+                # scanned them
+                cls.held = [ cls.add(index=False) for i in range(0, HELD) ]
+        cls.db.part_by_name("P1").state_set("ACTIVE")
+        cls.db.part_by_name("L1").state_set("ACTIVE")
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    @classmethod
+    def add(cls, index=True):
+        seq = cls.next_seq
+        cls.next_seq += 1
+        o = cls.schema.alloc()
+        o[:] = ( seq, seq * 3, seq * 5 )
+        cls.seqs.add(seq)
+        if not index:
+            return o
+        o.index_add()
+        del o
+
+    def __wait(self, attr):
+        start = time.time()
+        while attr.index_build_stat()['building']:
+            self.assertTrue(time.time() - start < BUILD_TIMEOUT)
+            time.sleep(0.1)
+
+    def __check(self, name, col, mult):
+        # Every object is in the new index exactly once
+        attr = self.schema.attr_by_name(name)
+        self.assertTrue(attr.is_indexed())
+        self.assertEqual(attr.index().stats()['cardinality'], len(self.seqs))
+        f = attr.filter()
+        vals = []
+        objs = f.batch_begin(4096)
+        while objs:
+            vals += [ o[col] for o in objs ]
+            objs = f.batch_next(4096)
+        del objs
+        del f
+        self.assertEqual(vals, sorted([ s * mult for s in self.seqs ]))
+
+    def __delete(self, seq):
+        attr = self.schema.attr_by_name('seq')
+        o = attr.find(attr.key(seq))
+        o.index_del()
+        o.delete()
+        del o
+        self.seqs.remove(seq)
+
+    def test_00_build_ingest(self):
+        attr = self.schema.attr_by_name('val')
+        held = set([ o[0] for o in self.held ])
+        deletes = [ seq for seq in range(1, 3 * COUNT, 97) if seq not in held ]
+        attr.index_add()
+        stat = attr.index_build_stat()
+        self.assertTrue(stat['building'])
+        # The index is not used until it is built
+        self.assertFalse(attr.is_indexed())
+        # Allocated ahead of the scan and set after the build, the
+        # scan must leave these to the caller
+        late = [ self.schema.alloc() for i in range(0, HELD) ]
+        added = 0
+        while True:
+            stat = attr.index_build_stat()
+            if not stat['building']:
+                break
+            if self.held and stat['part_done'] > 1:
+                # The build has scanned ROOT and P1 and added these,
+                # indexing them again replaces those entries
+                for o in self.held:
+                    o.index_add()
+                self.__class__.held = None
+                del o
+            self.add()
+            added += 1
+            if deletes:
+                self.__delete(deletes.pop(0))
+        self.assertTrue(added > 0)
+        self.assertTrue(self.held is None)
+        # Objects deleted after the build are removed from the index
+        for seq in deletes:
+            self.__delete(seq)
+        self.__wait(attr)
+        self.assertEqual(attr.index_build_stat()['part_count'], 0)
+        for o in late:
+            seq = self.next_seq
+            self.__class__.next_seq += 1
+            o[:] = ( seq, seq * 3, seq * 5 )
+            o.index_add()
+            self.seqs.add(seq)
+        del o
+        del late
+        self.__check('val', 1, 3)
+
+    def test_01_close_during_build(self):
+        attr = self.schema.attr_by_name('val2')
+        attr.index_add()
+        for i in range(0, 100):
+            self.add()
+        self.assertTrue(attr.index_build_stat()['building'])
+        # The partial index is removed when the container is reopened
+        # and the build starts over
+        self.db.close()
+        self.db.open(self.path)
+        self.__class__.schema = self.db.schema_by_name('index_add_test')
+        attr = self.schema.attr_by_name('val2')
+        self.assertTrue(attr.index_build_stat()['building'])
+        for i in range(0, 100):
+            self.add()
+        self.__wait(attr)
+        self.__check('val2', 2, 5)
+        self.__check('val', 1, 3)
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
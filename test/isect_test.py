@@ -0,0 +1,88 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+class IsectTest(SosTestCase):
+    """Filters evaluated by intersecting the indices of several attributes"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("isect_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('isect_test',
+                                 [ { "name" : "job", "type" : "uint32",
+                                     "index" : {} },
+                                   { "name" : "comp", "type" : "uint32",
+                                     "index" : {} },
+                                   { "name" : "seq", "type" : "uint64" },
+                                   { "name" : "vals", "type" : "int32_array" }
+                               ])
+        cls.schema.add(cls.db)
+        cls.data = []
+        seq = 0
+        for job in range(0, 20):
+            for comp in range(0, 50):
+                o = cls.schema.alloc()
+                o[0] = job
+                o[1] = comp
+                o[2] = seq
+                # Leave the array unset in every other object
+                if seq % 2:
+                    o[3] = [ job, comp ]
+                o.index_add()
+                cls.data.append((job, comp, seq))
+                seq += 1
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __filter(self, conds):
+        attr = self.schema.attr_by_name('job')
+        f = attr.filter()
+        for c in conds:
+            f.add_condition(self.schema.attr_by_name(c[0]), c[1], c[2])
+        return f
+
+    def __seqs(self, objs):
+        return sorted([ o[2] for o in objs ])
+
+    def test_00_eq(self):
+        f = self.__filter([ ('job', Sos.COND_EQ, 7), ('comp', Sos.COND_EQ, 13) ])
+        self.assertEqual(self.__seqs(f.intersect()),
+                         [ d[2] for d in self.data if d[0] == 7 and d[1] == 13 ])
+        del f
+
+    def test_01_range(self):
+        f = self.__filter([ ('job', Sos.COND_GE, 5), ('job', Sos.COND_LT, 9),
+                            ('comp', Sos.COND_GT, 40) ])
+        expect = [ d[2] for d in self.data if 5 <= d[0] < 9 and d[1] > 40 ]
+        self.assertEqual(self.__seqs(f.intersect()), expect)
+        self.assertEqual(self.__seqs(f.intersect([ 'job', 'comp' ])), expect)
+        self.assertEqual(self.__seqs(f.intersect([ 'comp' ])), expect)
+        del f
+
+    def test_02_empty(self):
+        f = self.__filter([ ('job', Sos.COND_EQ, 3), ('comp', Sos.COND_GE, 50) ])
+        self.assertEqual(f.intersect(), [])
+        del f
+
+    def test_03_unset_array(self):
+        # Objects without the array value do not match a condition on it
+        f = self.__filter([ ('job', Sos.COND_EQ, 2), ('comp', Sos.COND_LT, 10),
+                            ('vals', Sos.COND_GE, [ 0, 0 ]) ])
+        self.assertEqual(self.__seqs(f.intersect()),
+                         [ d[2] for d in self.data
+                           if d[0] == 2 and d[1] < 10 and d[2] % 2 ])
+        del f
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
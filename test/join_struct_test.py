@@ -0,0 +1,89 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+class JoinStructTest(SosTestCase):
+    """Filters on a join index with a struct component"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("join_struct_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('join_struct_test',
+                                 [ { "name" : "job", "type" : "uint32" },
+                                   { "name" : "tag", "type" : "struct",
+                                     "size" : 24 },
+                                   { "name" : "seq", "type" : "uint64" },
+                                   { "name" : "job_tag", "type" : "join",
+                                     "join_attrs" : [ "job", "tag" ],
+                                     "index" : {} }
+                               ])
+        cls.schema.add(cls.db)
+        cls.data = []
+        seq = 0
+        for job in range(0, 10):
+            for t in range(0, 20):
+                tag = cls.__tag(t)
+                o = cls.schema.alloc()
+                o[0] = job
+                o[1] = tag
+                o[2] = seq
+                o.index_add()
+                cls.data.append((job, t, seq))
+                seq += 1
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    @classmethod
+    def __tag(cls, t):
+        return bytearray("tag-{0:02d}".format(t).encode()).ljust(24, b'\0')
+
+    def __query(self, conds):
+        f = self.schema.attr_by_name('job_tag').filter()
+        for c in conds:
+            f.add_condition(self.schema.attr_by_name(c[0]), c[1], c[2])
+        seqs = []
+        o = f.begin()
+        while o:
+            seqs.append(o[2])
+            o = f.next()
+        rev = []
+        o = f.end()
+        while o:
+            rev.append(o[2])
+            o = f.prev()
+        del f
+        self.assertEqual(sorted(rev), sorted(seqs))
+        return sorted(seqs)
+
+    def test_00_job(self):
+        self.assertEqual(self.__query([ ('job', Sos.COND_EQ, 3) ]),
+                         [ d[2] for d in self.data if d[0] == 3 ])
+
+    def test_01_job_tag(self):
+        self.assertEqual(self.__query([ ('job', Sos.COND_EQ, 3),
+                                        ('tag', Sos.COND_EQ, self.__tag(7)) ]),
+                         [ d[2] for d in self.data if d[0] == 3 and d[1] == 7 ])
+
+    def test_02_tag_range(self):
+        self.assertEqual(self.__query([ ('job', Sos.COND_GE, 8),
+                                        ('tag', Sos.COND_GE, self.__tag(15)) ]),
+                         [ d[2] for d in self.data if d[0] >= 8 and d[1] >= 15 ])
+
+    def test_03_tag_lt(self):
+        self.assertEqual(self.__query([ ('job', Sos.COND_LE, 1),
+                                        ('tag', Sos.COND_LT, self.__tag(3)) ]),
+                         [ d[2] for d in self.data if d[0] <= 1 and d[1] < 3 ])
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
@@ -0,0 +1,235 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import random
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+PARTS = [ ('ROOT', False), ('L1', True), ('P2', False), ('L3', True) ]
+COUNT = 2000
+
+class LocalIndexTest(SosTestCase):
+    """Index lookups across partitions with local indices"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("local_index_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('local_index_test',
+                                 [ { "name" : "key", "type" : "int64",
+                                     "index" : {} },
+                                   { "name" : "part", "type" : "int32" }
+                               ])
+        cls.schema.add(cls.db)
+        # Even keys, spread across the partitions, leave gaps for sup/inf
+        cls.keys = {}
+        keys = list(range(0, 2 * COUNT, 2))
+        random.shuffle(keys)
+        for i in range(0, len(keys)):
+            cls.keys[keys[i]] = i % len(PARTS)
+        for p in range(0, len(PARTS)):
+            name, local = PARTS[p]
+            if name != 'ROOT':
+                cls.db.part_create(name, local_index=local)
+                cls.db.part_by_name(name).state_set("PRIMARY")
+            for k in keys:
+                if cls.keys[k] != p:
+                    continue
+                o = cls.schema.alloc()
+                o[:] = ( k, p )
+                o.index_add()
+            o = None
+        cls.online = set(range(0, len(PARTS)))
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __visible(self):
+        return sorted([ k for k in self.keys if self.keys[k] in self.online ])
+
+    def __check(self):
+        attr = self.schema.attr_by_name('key')
+        index = attr.index()
+        visible = self.__visible()
+        self.assertEqual(index.stats()['cardinality'], len(visible))
+        self.assertEqual(attr.min(), visible[0])
+        self.assertEqual(attr.max(), visible[-1])
+        vset = set(visible)
+        for k in range(-1, 2 * COUNT + 1):
+            key = attr.key(k)
+            o = attr.find(key)
+            if k in vset:
+                self.assertTrue(o is not None)
+                self.assertEqual(o[0], k)
+                self.assertEqual(o[1], self.keys[k])
+            else:
+                self.assertTrue(o is None)
+            sup = [ v for v in visible if v >= k ]
+            o = index.find_sup(key)
+            if sup:
+                self.assertEqual(o[0], sup[0])
+            else:
+                self.assertTrue(o is None)
+            inf = [ v for v in visible if v <= k ]
+            o = index.find_inf(key)
+            if inf:
+                self.assertEqual(o[0], inf[-1])
+            else:
+                self.assertTrue(o is None)
+
+    def test_00_all_active(self):
+        self.__check()
+
+    def test_01_offline(self):
+        # The state change must not be hidden by the cached index list
+        self.db.part_by_name('L1').state_set("OFFLINE")
+        self.online.discard(1)
+        self.__check()
+
+    def test_02_active_again(self):
+        self.db.part_by_name('L1').state_set("ACTIVE")
+        self.online.add(1)
+        self.__check()
+
+    def test_03_local_primary(self):
+        self.db.part_by_name('ROOT').state_set("PRIMARY")
+        self.db.part_by_name('L3').state_set("OFFLINE")
+        self.online.discard(3)
+        self.__check()
+
+    def __zone_add(self, seq, job, comp, name):
+        o = self.zone.alloc()
+        o[:] = ( seq, job, comp, name )
+        o.index_add()
+        del o
+        self.zone_data.append((seq, job, comp, name))
+
+    def __zone_query(self, attr_name, conds):
+        attr = self.zone.attr_by_name(attr_name)
+        f = attr.filter()
+        for c in conds:
+            f.add_condition(self.zone.attr_by_name(c[0]), c[1], c[2])
+        fwd = []
+        o = f.begin()
+        while o:
+            fwd.append(o[0])
+            o = f.next()
+        rev = []
+        o = f.end()
+        while o:
+            rev.append(o[0])
+            o = f.prev()
+        rev.reverse()
+        del o
+        del f
+        if attr_name == 'seq':
+            expect = sorted(self.zone_data)
+        else:
+            expect = sorted(self.zone_data, key=lambda d : d[1:])
+        ops = { Sos.COND_LT : lambda a, b : a < b,
+                Sos.COND_LE : lambda a, b : a <= b,
+                Sos.COND_EQ : lambda a, b : a == b,
+                Sos.COND_GE : lambda a, b : a >= b,
+                Sos.COND_GT : lambda a, b : a > b }
+        cols = { 'seq' : 0, 'job' : 1, 'comp' : 2, 'name' : 3 }
+        for c in conds:
+            expect = [ d for d in expect if ops[c[1]](d[cols[c[0]]], c[2]) ]
+        expect = [ d[0] for d in expect ]
+        self.assertEqual(fwd, expect)
+        self.assertEqual(rev, expect)
+        return len(expect)
+
+    def test_04_zone_data(self):
+        # Local partitions with disjoint key ranges; ROOT has a global index
+        self.__class__.zone = Sos.Schema()
+        self.zone.from_template('local_index_zone',
+                                [ { "name" : "seq", "type" : "int64",
+                                    "index" : {} },
+                                  { "name" : "job", "type" : "uint32" },
+                                  { "name" : "comp", "type" : "uint32" },
+                                  { "name" : "name", "type" : "char_array" },
+                                  { "name" : "jcn", "type" : "join",
+                                    "join_attrs" : [ "job", "comp", "name" ],
+                                    "index" : {} }
+                              ])
+        self.zone.add(self.db)
+        self.__class__.zone_data = []
+        for seq in range(500, 600):
+            self.__zone_add(seq, 4, seq % 5, "host-{0}".format(seq % 7))
+        self.db.part_create('Z1', local_index=True)
+        self.db.part_by_name('Z1').state_set("PRIMARY")
+        for seq in range(0, 100):
+            self.__zone_add(seq, 1, seq % 5, "host-{0}".format(seq))
+        # The only object in Z2 has a key longer than the (7, 3) prefix
+        self.db.part_create('Z2', local_index=True)
+        self.db.part_by_name('Z2').state_set("PRIMARY")
+        self.__zone_add(1000, 7, 3, "host-3")
+        self.db.part_create('Z3', local_index=True)
+        self.db.part_by_name('Z3').state_set("PRIMARY")
+        for seq in range(2000, 2100):
+            self.__zone_add(seq, 9, seq % 3, "host-{0}".format(seq % 10))
+        self.db.part_by_name('ROOT').state_set("PRIMARY")
+
+    def test_05_zone_attr(self):
+        self.assertEqual(self.__zone_query('seq', [ ('seq', Sos.COND_EQ, 1000) ]), 1)
+        self.assertEqual(self.__zone_query('seq', [ ('seq', Sos.COND_GE, 1000),
+                                                    ('seq', Sos.COND_LE, 1000) ]), 1)
+        self.__zone_query('seq', [ ('seq', Sos.COND_GE, 2050) ])
+        self.__zone_query('seq', [ ('seq', Sos.COND_LT, 50) ])
+        self.__zone_query('seq', [ ('seq', Sos.COND_GT, 99),
+                                   ('seq', Sos.COND_LT, 2000) ])
+        self.__zone_query('seq', [ ('seq', Sos.COND_GT, 2099) ])
+
+    def test_06_zone_join(self):
+        self.assertEqual(self.__zone_query('jcn', [ ('job', Sos.COND_EQ, 7),
+                                                    ('comp', Sos.COND_EQ, 3) ]), 1)
+        self.assertEqual(self.__zone_query('jcn', [ ('job', Sos.COND_EQ, 7) ]), 1)
+        self.assertEqual(self.__zone_query('jcn', [ ('job', Sos.COND_EQ, 7),
+                                                    ('comp', Sos.COND_EQ, 3),
+                                                    ('name', Sos.COND_EQ, "host-3") ]), 1)
+        self.assertEqual(self.__zone_query('jcn', [ ('job', Sos.COND_EQ, 1) ]), 100)
+        self.__zone_query('jcn', [ ('job', Sos.COND_EQ, 9),
+                                   ('comp', Sos.COND_LE, 1) ])
+        self.__zone_query('jcn', [ ('job', Sos.COND_EQ, 1),
+                                   ('comp', Sos.COND_EQ, 2),
+                                   ('name', Sos.COND_LT, "host-5") ])
+        self.__zone_query('jcn', [ ('job', Sos.COND_GE, 5) ])
+        self.__zone_query('jcn', [ ('job', Sos.COND_LE, 7),
+                                   ('comp', Sos.COND_EQ, 3) ])
+
+    def test_07_zone_key_range(self):
+        # Z1 and Z2 cannot hold [2000, 2099]; ROOT is not pruned
+        attr = self.zone.attr_by_name('seq')
+        it = attr.attr_iter()
+        it.key_range_set(attr.key(2000), attr.key(2099))
+        seqs = []
+        b = it.begin()
+        while b:
+            seqs.append(it.item()[0])
+            b = it.next()
+        self.assertEqual(seqs, list(range(500, 600)) + list(range(2000, 2100)))
+        it.key_range_set(None, attr.key(99))
+        seqs = []
+        b = it.end()
+        while b:
+            seqs.append(it.item()[0])
+            b = it.prev()
+        self.assertEqual(seqs, list(range(599, 499, -1)) + list(range(99, -1, -1)))
+        it.key_range_set()
+        seqs = []
+        b = it.begin()
+        while b:
+            seqs.append(it.item()[0])
+            b = it.next()
+        self.assertEqual(seqs, sorted([ d[0] for d in self.zone_data ]))
+        del it
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import random
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+class NCompoundTest(SosTestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("ncompound_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('ncompound_test',
+                                 [ { "name" : "a_1", "type" : "int64" },
+                                   { "name" : "a_2", "type" : "double" },
+                                   { "name" : "a_3", "type" : "int32_array" },
+                                   { "name" : "a_join", "type" : "join",
+                                     "join_attrs" : [ "a_1", "a_2", "a_3" ],
+                                     "index" : { "key" : "NCOMPOUND" } }
+                               ])
+        cls.schema.add(cls.db)
+        cls.data = []
+        for a_1 in [ -(1 << 40), -1, 0, 1, 1 << 40 ]:
+            for a_2 in [ -2.5, -1e-9, 0.0, 1e-9, 3.0 ]:
+                for a_3 in [ [ -9 ], [ -1, 5 ], [ 0 ], [ 0, 0, 1 ], [ 0, 1 ], [ 7 ] ]:
+                    cls.data.append((a_1, a_2, a_3))
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def test_00_add_data(self):
+        data = list(self.data)
+        random.shuffle(data)
+        for seq in data:
+            o = self.schema.alloc()
+            o[:] = seq
+            o.index_add()
+
+    def __row(self, o):
+        return (o[0], o[1], [ v for v in o[2] ])
+
+    def test_01_fwd_order(self):
+        it = self.schema.attr_by_name('a_join').attr_iter()
+        rows = []
+        b = it.begin()
+        while b:
+            rows.append(self.__row(it.item()))
+            b = it.next()
+        self.assertEqual(rows, sorted(self.data))
+
+    def test_02_rev_order(self):
+        it = self.schema.attr_by_name('a_join').attr_iter()
+        rows = []
+        b = it.end()
+        while b:
+            rows.append(self.__row(it.item()))
+            b = it.prev()
+        rows.reverse()
+        self.assertEqual(rows, sorted(self.data))
+
+    def test_03_filter_col(self):
+        a_join = self.schema.attr_by_name('a_join')
+        f = a_join.filter()
+        f.add_condition(self.schema.attr_by_name('a_1'), Sos.COND_EQ, -1)
+        f.add_condition(self.schema.attr_by_name('a_2'), Sos.COND_GE, 0.0)
+        count = 0
+        o = f.begin()
+        while o:
+            self.assertEqual(o[0], -1)
+            self.assertTrue(o[1] >= 0.0)
+            count += 1
+            o = f.next()
+        self.assertEqual(count, 3 * 6)
+        del f
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
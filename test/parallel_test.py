@@ -0,0 +1,88 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import random
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+COUNT = 20000
+
+class ParallelTest(SosTestCase):
+    """Filters scanned by several threads with Filter.parallel()"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("parallel_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('parallel_test',
+                                 [ { "name" : "key", "type" : "uint64",
+                                     "index" : { "type" : "BXTREE",
+                                                 "args" : "ORDER=16" } },
+                                   { "name" : "val", "type" : "uint32" }
+                               ])
+        cls.schema.add(cls.db)
+        keys = list(range(0, COUNT))
+        random.shuffle(keys)
+        for k in keys:
+            o = cls.schema.alloc()
+            o[:] = ( k, k % 11 )
+            o.index_add()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __filter(self, lo, val=None):
+        attr = self.schema.attr_by_name('key')
+        f = attr.filter()
+        f.add_condition(attr, Sos.COND_GE, lo)
+        if val is not None:
+            f.add_condition(self.schema.attr_by_name('val'), Sos.COND_EQ, val)
+        return f
+
+    def test_00_ordered(self):
+        f = self.__filter(1000)
+        res = [ o[0] for o in f.parallel(4) ]
+        self.assertEqual(res, list(range(1000, COUNT)))
+        del f
+
+    def test_01_unordered(self):
+        f = self.__filter(0, val=3)
+        res = [ o[0] for o in f.parallel(4, ordered=False) ]
+        self.assertEqual(sorted(res), [ k for k in range(0, COUNT) if k % 11 == 3 ])
+        del f
+
+    def test_02_limit(self):
+        f = self.__filter(100)
+        f.limit(250)
+        res = [ o[0] for o in f.parallel(3) ]
+        self.assertEqual(res, list(range(100, 350)))
+        del f
+
+    def test_03_threads(self):
+        f = self.__filter(0, val=7)
+        expect = [ k for k in range(0, COUNT) if k % 11 == 7 ]
+        for threads in [ 1, 2, 8 ]:
+            self.assertEqual([ o[0] for o in f.parallel(threads) ], expect)
+        del f
+
+    def test_04_delete_while_split(self):
+        # Remove entries between searches so that separators are freed
+        attr = self.schema.attr_by_name('key')
+        for k in range(0, COUNT, 2):
+            o = attr.find(attr.key(k))
+            o.index_del()
+            o.delete()
+        f = self.__filter(0)
+        self.assertEqual([ o[0] for o in f.parallel(4) ],
+                         list(range(1, COUNT, 2)))
+        del f
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
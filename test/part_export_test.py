@@ -0,0 +1,170 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+COUNT = 5000
+ATTACH_COUNT = 2000
+
+class PartExportTest(SosTestCase):
+    """Exporting a partition with array references to another container"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("part_export_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('part_export_test',
+                                 [ { "name" : "seq", "type" : "uint64",
+                                     "index" : {} },
+                                   { "name" : "vals", "type" : "int32_array" }
+                               ])
+        cls.schema.add(cls.db)
+        cls.db.part_create("P1")
+        cls.db.part_by_name("P1").state_set("PRIMARY")
+        for i in range(0, COUNT):
+            o = cls.schema.alloc()
+            o[:] = ( i, cls.vals(i) )
+            o.index_add()
+        o = None
+        cls.db.part_create("P2")
+        cls.db.part_by_name("P2").state_set("PRIMARY")
+        cls.dst_path = cls.path + "_dst"
+        shutil.rmtree(cls.dst_path, ignore_errors=True)
+        cls.dst = Sos.Container()
+        cls.dst.create(cls.dst_path)
+        cls.dst.open(cls.dst_path)
+        cls.dst.part_create("D")
+        cls.dst.part_by_name("D").state_set("PRIMARY")
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.dst.close()
+        del cls.dst
+        shutil.rmtree(cls.dst_path, ignore_errors=True)
+        cls.tearDownDb()
+
+    @classmethod
+    def vals(cls, i):
+        return [ i + j for j in range(0, 1 + i % 50) ]
+
+    def test_00_export(self):
+        count = self.db.part_by_name("P1").export(self.dst, reindex=True)
+        self.assertEqual(count, COUNT)
+
+    def test_01_find(self):
+        schema = self.dst.schema_by_name('part_export_test')
+        attr = schema.attr_by_name('seq')
+        self.assertEqual(attr.index().stats()['cardinality'], COUNT)
+        for i in range(0, COUNT):
+            o = attr.find(attr.key(i))
+            self.assertTrue(o is not None)
+            self.assertEqual(list(o[1]), self.vals(i))
+            del o
+
+    def test_02_no_map_index(self):
+        # The reference map does not leave files behind
+        for name in os.listdir(self.dst_path):
+            self.assertFalse(name.startswith("P1_export"))
+
+
+class PartAttachTest(SosTestCase):
+    """Attaching a partition from another container"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("part_attach_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('part_attach_test',
+                                 [ { "name" : "seq", "type" : "uint64",
+                                     "index" : {} },
+                                   { "name" : "vals", "type" : "int32_array" }
+                               ])
+        cls.schema.add(cls.db)
+        for name, local in [ ("P1", False), ("L1", True) ]:
+            cls.db.part_create(name, local_index=local)
+            cls.db.part_by_name(name).state_set("PRIMARY")
+            for i in cls.seqs(name):
+                o = cls.schema.alloc()
+                o[:] = ( i, cls.vals(i) )
+                o.index_add()
+            o = None
+        cls.db.part_by_name("ROOT").state_set("PRIMARY")
+        cls.db.part_by_name("P1").state_set("OFFLINE")
+        cls.db.part_by_name("L1").state_set("OFFLINE")
+
+        # A schema only in the destination gives the attached schema a new id
+        cls.dst_path = cls.path + "_dst"
+        shutil.rmtree(cls.dst_path, ignore_errors=True)
+        cls.dst = Sos.Container()
+        cls.dst.create(cls.dst_path)
+        cls.dst.open(cls.dst_path)
+        other = Sos.Schema()
+        other.from_template('part_attach_other',
+                            [ { "name" : "x", "type" : "uint64" } ])
+        other.add(cls.dst)
+        cls.dst.part_create("D")
+        cls.dst.part_by_name("D").state_set("PRIMARY")
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.dst.close()
+        del cls.dst
+        shutil.rmtree(cls.dst_path, ignore_errors=True)
+        cls.tearDownDb()
+
+    @classmethod
+    def seqs(cls, name):
+        if name == "P1":
+            return range(0, ATTACH_COUNT)
+        return range(ATTACH_COUNT, 2 * ATTACH_COUNT)
+
+    @classmethod
+    def vals(cls, i):
+        return [ i + j for j in range(0, 1 + i % 20) ]
+
+    def __check(self, seqs):
+        schema = self.dst.schema_by_name('part_attach_test')
+        attr = schema.attr_by_name('seq')
+        for i in seqs:
+            o = attr.find(attr.key(i))
+            self.assertTrue(o is not None)
+            self.assertEqual(o[0], i)
+            self.assertEqual(list(o[1]), self.vals(i))
+            del o
+
+    def test_00_attach_reindex(self):
+        self.db.part_by_name("P1").attach(self.dst, part_path=self.dst_path,
+                                          reindex=True)
+        self.assertTrue(self.db.part_by_name("P1") is None)
+        self.assertTrue(os.path.isdir(os.path.join(self.dst_path, "P1")))
+        p = self.dst.part_by_name("P1")
+        self.assertEqual(int(p.state()), Sos.PART_STATE_ACTIVE)
+        self.__check(self.seqs("P1"))
+
+    def test_01_attach_local_index(self):
+        self.db.part_by_name("L1").attach(self.dst)
+        self.assertTrue(self.db.part_by_name("L1") is None)
+        p = self.dst.part_by_name("L1")
+        self.assertEqual(int(p.state()), Sos.PART_STATE_OFFLINE)
+        p.state_set("ACTIVE")
+        self.__check(self.seqs("L1"))
+        self.__check(self.seqs("P1"))
+
+    def test_02_exists(self):
+        # A partition with the same name in the destination is refused
+        self.dst.part_create("ROOT")
+        self.db.part_create("X")
+        self.db.part_by_name("X").state_set("PRIMARY")
+        self.db.part_by_name("ROOT").state_set("OFFLINE")
+        with self.assertRaises(Exception):
+            self.db.part_by_name("ROOT").attach(self.dst)
+        self.assertTrue(self.db.part_by_name("ROOT") is not None)
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
@@ -0,0 +1,157 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+PARTS = 6
+COUNT = 200
+OPEN_MAX = 2
+REFRESH_COUNT = 100
+
+class PartOpenTest(SosTestCase):
+    """Partition object stores opened on first use, capped by PART_OPEN_MAX"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("part_open_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('part_open_test',
+                                 [ { "name" : "seq", "type" : "uint64",
+                                     "index" : {} },
+                                   { "name" : "part", "type" : "uint32" }
+                               ])
+        cls.schema.add(cls.db)
+        seq = 0
+        for p in range(0, PARTS):
+            name = "P{0}".format(p)
+            cls.db.part_create(name)
+            cls.db.part_by_name(name).state_set("PRIMARY")
+            for i in range(0, COUNT):
+                o = cls.schema.alloc()
+                o[:] = ( seq, p )
+                o.index_add()
+                seq += 1
+            o = None
+        cls.db.close()
+        Sos.container_config_set(cls.path, "PART_OPEN_MAX", OPEN_MAX)
+        cls.db.open(cls.path)
+        cls.schema = cls.db.schema_by_name('part_open_test')
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __open_parts(self):
+        # The partitions whose object store is open in this process
+        parts = set()
+        with open("/proc/self/maps") as f:
+            for line in f:
+                path = line.split()[-1]
+                if path.startswith(self.path) and path.endswith("objects.OBJ"):
+                    parts.add(os.path.basename(os.path.dirname(path)))
+        return parts
+
+    def test_00_lazy(self):
+        # Only the PRIMARY partition may have been opened so far
+        self.assertTrue(self.__open_parts() <= set([ "P{0}".format(PARTS - 1) ]))
+
+    def test_01_read_all(self):
+        attr = self.schema.attr_by_name('seq')
+        it = attr.attr_iter()
+        seq = 0
+        b = it.begin()
+        while b:
+            o = it.item()
+            self.assertEqual(o[0], seq)
+            self.assertEqual(o[1], seq // COUNT)
+            del o
+            seq += 1
+            b = it.next()
+        del it
+        self.assertEqual(seq, PARTS * COUNT)
+        self.assertTrue(len(self.__open_parts()) <= OPEN_MAX)
+
+    def test_02_find(self):
+        attr = self.schema.attr_by_name('seq')
+        for seq in range(0, PARTS * COUNT, COUNT // 4):
+            o = attr.find(attr.key(seq))
+            self.assertTrue(o is not None)
+            self.assertEqual(o[1], seq // COUNT)
+            del o
+        self.assertTrue(len(self.__open_parts()) <= OPEN_MAX)
+
+
+class PartRefreshTest(SosTestCase):
+    """Objects in use while the partition list changes"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("part_refresh_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('part_refresh_test',
+                                 [ { "name" : "seq", "type" : "uint64",
+                                     "index" : {} },
+                                   { "name" : "val", "type" : "uint64" }
+                               ])
+        cls.schema.add(cls.db)
+        cls.held = []
+        for i in range(0, REFRESH_COUNT):
+            o = cls.schema.alloc()
+            o[:] = ( i, i * 3 )
+            o.index_add()
+            cls.held.append(o)
+
+    @classmethod
+    def tearDownClass(cls):
+        del cls.held
+        cls.tearDownDb()
+
+    def __check(self):
+        for i in range(0, REFRESH_COUNT):
+            self.assertEqual(self.held[i][0], i)
+            self.assertEqual(self.held[i][1], i * 3)
+        attr = self.schema.attr_by_name('seq')
+        for i in range(0, REFRESH_COUNT, 7):
+            o = attr.find(attr.key(i))
+            self.assertTrue(o is not None)
+            self.assertEqual(o[1], i * 3)
+            del o
+
+    def test_00_new_primary(self):
+        self.db.part_create("P1")
+        self.db.part_by_name("P1").state_set("PRIMARY")
+        self.__check()
+
+    def test_01_offline_active(self):
+        self.db.part_create("P2")
+        self.db.part_by_name("P2").state_set("ACTIVE")
+        self.db.part_by_name("P2").state_set("OFFLINE")
+        self.__check()
+        self.db.part_by_name("ROOT").state_set("OFFLINE")
+        self.db.part_by_name("ROOT").state_set("ACTIVE")
+        self.__check()
+
+    def test_02_delete(self):
+        self.db.part_by_name("P2").delete()
+        self.assertTrue(self.db.part_by_name("P2") is None)
+        self.__check()
+
+    def test_03_update(self):
+        # The held objects are still backed by the open object store
+        for o in self.held:
+            o[1] = o[0] * 5
+        del self.held[:]
+        attr = self.schema.attr_by_name('seq')
+        for i in range(0, REFRESH_COUNT):
+            o = attr.find(attr.key(i))
+            self.assertEqual(o[1], i * 5)
+            del o
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
@@ -0,0 +1,225 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import time
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+COUNT = 60000
+OLD_BASE = 1 << 40
+DUPS = 20000            # More values than one range delete chunk
+UNINDEX_COUNT = 30000
+OTHER_BASE = 1 << 32
+CHAIN_COUNT = 3000
+
+class PartRetainTest(SosTestCase):
+    """Deleting partitions older than the retention period"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("part_retain_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('part_retain_test',
+                                 [ { "name" : "seq", "type" : "uint64",
+                                     "index" : {} },
+                                   { "name" : "val", "type" : "uint64",
+                                     "index" : {} }
+                               ])
+        cls.schema.add(cls.db)
+        # The NEW keys fall between the BIG keys, so that making BIG
+        # OFFLINE removes its keys one object at a time
+        cls.keys = { "OLD" : range(OLD_BASE, OLD_BASE + 100),
+                     "BIG" : range(0, 2 * COUNT, 2),
+                     "NEW" : range(1, 2 * COUNT, 2 * COUNT // 100) }
+        for name in [ "OLD", "BIG", "NEW" ]:
+            cls.db.part_create(name)
+            cls.db.part_by_name(name).state_set("PRIMARY")
+            for i in cls.keys[name]:
+                o = cls.schema.alloc()
+                o[:] = ( i, i )
+                o.index_add()
+            o = None
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __reopen(self, retention):
+        self.db.close()
+        Sos.container_config_set(self.path, "PART_RETENTION", retention)
+        self.db.open(self.path)
+        self.__class__.schema = self.db.schema_by_name('part_retain_test')
+
+    def __age(self, name):
+        old = time.time() - 7200
+        os.utime(os.path.join(self.path, name, "objects.OBJ"), (old, old))
+
+    def __found(self, keys):
+        attr = self.schema.attr_by_name('seq')
+        found = 0
+        for i in keys:
+            o = attr.find(attr.key(i))
+            if o is not None:
+                found += 1
+            del o
+        return found
+
+    def test_00_retain(self):
+        self.__age("OLD")
+        stat = self.db.part_retain(3600)
+        self.assertEqual(stat['part_count'], 1)
+        self.assertTrue(stat['bytes'] > 0)
+        self.assertTrue(self.db.part_by_name("OLD") is None)
+        self.assertFalse(os.path.exists(os.path.join(self.path, "OLD")))
+        self.assertEqual(self.__found(self.keys["OLD"]), 0)
+        self.assertEqual(self.__found(self.keys["BIG"][::100]), COUNT // 100)
+
+    def test_01_close(self):
+        # Closing the container does not wait for BIG to be made OFFLINE
+        self.__age("BIG")
+        self.__reopen("1h")
+        time.sleep(0.5)
+        start = time.time()
+        self.db.close()
+        self.assertTrue(time.time() - start < 1.0)
+        Sos.container_config_set(self.path, "PART_RETENTION", "0")
+        self.db.open(self.path)
+        self.__class__.schema = self.db.schema_by_name('part_retain_test')
+        p = self.db.part_by_name("BIG")
+        self.assertTrue(p is not None)
+        self.assertEqual(int(p.state()), Sos.PART_STATE_ACTIVE)
+
+    def test_02_retain_again(self):
+        # The interrupted partition is deleted by the next pass
+        stat = self.db.part_retain(3600)
+        self.assertEqual(stat['part_count'], 1)
+        self.assertTrue(self.db.part_by_name("BIG") is None)
+        self.assertEqual(self.__found(self.keys["BIG"][::100]), 0)
+        self.assertEqual(self.__found(self.keys["NEW"]), len(self.keys["NEW"]))
+
+
+class PartUnindexTest(SosTestCase):
+    """Removing the keys of a partition made OFFLINE by range deletes"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("part_unindex_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('part_unindex_test',
+                                 [ { "name" : "seq", "type" : "uint64",
+                                     "index" : {} }
+                               ])
+        cls.schema.add(cls.db)
+        # P1 has a key with many duplicates below a dense run of keys
+        cls.db.part_create("P1")
+        cls.db.part_by_name("P1").state_set("PRIMARY")
+        for i in range(0, DUPS):
+            cls.__add(5)
+        for i in range(0, UNINDEX_COUNT):
+            cls.__add(100 + i)
+        cls.db.part_create("P2")
+        cls.db.part_by_name("P2").state_set("PRIMARY")
+        for i in range(0, 100):
+            cls.__add(OTHER_BASE + i)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    @classmethod
+    def __add(cls, seq):
+        o = cls.schema.alloc()
+        o[:] = ( seq, )
+        o.index_add()
+        del o
+
+    def __cardinality(self):
+        attr = self.schema.attr_by_name('seq')
+        return attr.index().stats()['cardinality']
+
+    def __found(self, keys):
+        attr = self.schema.attr_by_name('seq')
+        found = 0
+        for i in keys:
+            o = attr.find(attr.key(i))
+            if o is not None:
+                found += 1
+            del o
+        return found
+
+    def test_00_online(self):
+        self.assertEqual(self.__cardinality(), DUPS + UNINDEX_COUNT + 100)
+
+    def test_01_offline(self):
+        self.db.part_by_name("P1").state_set("OFFLINE")
+        self.assertEqual(self.__cardinality(), 100)
+        self.assertEqual(self.__found([ 5 ]), 0)
+        self.assertEqual(self.__found(range(100, 100 + UNINDEX_COUNT, 97)), 0)
+        self.assertEqual(self.__found(range(OTHER_BASE, OTHER_BASE + 100)), 100)
+
+    def test_02_active(self):
+        self.db.part_by_name("P1").state_set("ACTIVE")
+        self.assertEqual(self.__cardinality(), DUPS + UNINDEX_COUNT + 100)
+        self.assertEqual(self.__found([ 5 ]), 1)
+        self.assertEqual(self.__found(range(100, 100 + UNINDEX_COUNT, 97)),
+                         len(range(100, 100 + UNINDEX_COUNT, 97)))
+
+    def __chain_name(self, i):
+        return "key-{0:048d}".format(i)
+
+    def __chain_found(self, attr, keys):
+        found = 0
+        for i in keys:
+            o = attr.find(attr.key(self.__chain_name(i).encode()))
+            if o is not None:
+                found += 1
+            del o
+        return found
+
+    def test_03_record_chain(self):
+        # An index in the format without posting lists, whose records
+        # reuse the slots of deleted keys
+        schema = Sos.Schema()
+        schema.from_template('part_unindex_chain',
+                             [ { "name" : "name", "type" : "char_array",
+                                 "index" : { "type" : "BXTREE",
+                                             "args" : "POSTING=0" } }
+                           ])
+        schema.add(self.db)
+        attr = schema.attr_by_name('name')
+        self.db.part_create("P3")
+        self.db.part_by_name("P3").state_set("PRIMARY")
+        for i in range(0, CHAIN_COUNT):
+            o = schema.alloc()
+            o[:] = ( self.__chain_name(i), )
+            o.index_add()
+            del o
+        for i in range(0, CHAIN_COUNT):
+            o = attr.find(attr.key(self.__chain_name(i).encode()))
+            o.index_del()
+            o.delete()
+        for i in range(CHAIN_COUNT, 2 * CHAIN_COUNT):
+            o = schema.alloc()
+            o[:] = ( self.__chain_name(i), )
+            o.index_add()
+            del o
+        self.db.part_create("P4")
+        self.db.part_by_name("P4").state_set("PRIMARY")
+
+        self.db.part_by_name("P3").state_set("OFFLINE")
+        self.assertEqual(attr.index().stats()['cardinality'], 0)
+        self.assertEqual(self.__chain_found(attr, range(0, 2 * CHAIN_COUNT, 7)), 0)
+
+        self.db.part_by_name("P3").state_set("ACTIVE")
+        self.assertEqual(attr.index().stats()['cardinality'], CHAIN_COUNT)
+        self.assertEqual(self.__chain_found(attr, range(0, CHAIN_COUNT)), 0)
+        self.assertEqual(self.__chain_found(attr, range(CHAIN_COUNT, 2 * CHAIN_COUNT)),
+                         CHAIN_COUNT)
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
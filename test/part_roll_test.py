@@ -0,0 +1,82 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import time
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+class PartRollTest(SosTestCase):
+    """Rolling the PRIMARY partition by age"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("part_roll_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('part_roll_test',
+                                 [ { "name" : "seq", "type" : "uint64",
+                                     "index" : {} }
+                               ])
+        cls.schema.add(cls.db)
+        cls.count = 0
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __reopen(self, roll_time):
+        self.db.close()
+        Sos.container_config_set(self.path, "PART_ROLL_TIME", roll_time)
+        self.db.open(self.path)
+        self.__class__.schema = self.db.schema_by_name('part_roll_test')
+
+    def __primary(self):
+        for p in self.db.part_iter():
+            if int(p.state()) == Sos.PART_STATE_PRIMARY:
+                return p.name()
+        return None
+
+    def __add(self):
+        o = self.schema.alloc()
+        o[:] = ( self.count, )
+        o.index_add()
+        del o
+        self.__class__.count += 1
+
+    def __check(self):
+        attr = self.schema.attr_by_name('seq')
+        for i in range(0, self.count):
+            o = attr.find(attr.key(i))
+            self.assertTrue(o is not None)
+            del o
+
+    def test_00_dir_mtime(self):
+        # The partition age does not come from its directory
+        primary = self.__primary()
+        old = time.time() - 7200
+        os.utime(os.path.join(self.path, "ROOT"), (old, old))
+        self.__reopen("1h")
+        for i in range(0, 30):
+            self.__add()
+            time.sleep(0.1)
+        self.assertEqual(self.__primary(), primary)
+        self.__check()
+
+    def test_01_roll_time(self):
+        primary = self.__primary()
+        self.__reopen("2")
+        start = time.time()
+        while self.__primary() == primary and time.time() - start < 30:
+            self.__add()
+            time.sleep(0.1)
+        self.assertNotEqual(self.__primary(), primary)
+        self.__add()
+        self.__check()
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
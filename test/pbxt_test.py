@@ -0,0 +1,109 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import random
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+class PbxtTest(SosTestCase):
+    """PBXTREE iteration and find across node splits and merges"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("pbxt_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('pbxt_test',
+                                 [ { "name" : "id", "type" : "uint64",
+                                     "index" : { "type" : "PBXTREE",
+                                                 "key" : "UINT64",
+                                                 "args" : "NODE_SIZE=512" } },
+                                   { "name" : "name", "type" : "char_array",
+                                     "index" : { "type" : "PBXTREE",
+                                                 "key" : "MEMCMP",
+                                                 "args" : "NODE_SIZE=512" } }
+                               ])
+        cls.schema.add(cls.db)
+        cls.ids = list(range(0, 2000))
+        random.shuffle(cls.ids)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __name(self, i):
+        return "node-{0:04d}.rack-{1:02d}.cluster.example.com".format(i, i % 17)
+
+    def __check(self, ids):
+        attr = self.schema.attr_by_name('id')
+        it = attr.attr_iter()
+        rows = []
+        b = it.begin()
+        while b:
+            rows.append(it.item()[0])
+            b = it.next()
+        self.assertEqual(rows, sorted(ids))
+        rows = []
+        b = it.end()
+        while b:
+            rows.append(it.item()[0])
+            b = it.prev()
+        rows.reverse()
+        self.assertEqual(rows, sorted(ids))
+
+        attr = self.schema.attr_by_name('name')
+        it = attr.attr_iter()
+        rows = []
+        b = it.begin()
+        while b:
+            rows.append(it.item()[1])
+            b = it.next()
+        self.assertEqual(rows, sorted([ self.__name(i) for i in ids ]))
+
+    def __delete(self, ids):
+        attr = self.schema.attr_by_name('id')
+        for i in ids:
+            o = attr.find(attr.key(i))
+            self.assertTrue(o is not None)
+            self.assertEqual(o.index_del(), 0)
+            o.delete()
+
+    def test_00_add(self):
+        for i in self.ids:
+            o = self.schema.alloc()
+            o[:] = ( i, self.__name(i) )
+            o.index_add()
+        self.__check(self.ids)
+
+    def test_01_find(self):
+        attr = self.schema.attr_by_name('name')
+        for i in self.ids[::7]:
+            o = attr.find(attr.key(self.__name(i).encode()))
+            self.assertTrue(o is not None)
+            self.assertEqual(o[0], i)
+
+    def test_02_del_most(self):
+        # Leave the nodes sparse so that they are merged
+        self.__delete([ i for i in self.ids if i % 8 ])
+        self.__check([ i for i in self.ids if i % 8 == 0 ])
+
+    def test_03_add_again(self):
+        for i in self.ids:
+            if i % 8 == 0:
+                continue
+            o = self.schema.alloc()
+            o[:] = ( i, self.__name(i) )
+            o.index_add()
+        self.__check(self.ids)
+
+    def test_04_del_all(self):
+        self.__delete(self.ids)
+        self.__check([])
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
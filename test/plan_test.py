@@ -0,0 +1,109 @@
+#!/usr/bin/env python
+import unittest
+import shutil
+import logging
+import os
+import random
+from sosdb import Sos
+from sosunittest import SosTestCase
+
+logger = logging.getLogger(__name__)
+
+COUNT = 10000
+
+class PlanTest(SosTestCase):
+    """Index choice and estimates from Schema.plan() and Attr.analyze()"""
+    @classmethod
+    def setUpClass(cls):
+        cls.setUpDb("plan_test_cont")
+        cls.schema = Sos.Schema()
+        cls.schema.from_template('plan_test',
+                                 [ { "name" : "uniform", "type" : "int64",
+                                     "index" : {} },
+                                   { "name" : "skewed", "type" : "int64",
+                                     "index" : {} }
+                               ])
+        cls.schema.add(cls.db)
+        for i in range(0, COUNT):
+            o = cls.schema.alloc()
+            # 90% of the skewed keys are below 100, the rest spread to 100000
+            if i % 10:
+                s = i % 100
+            else:
+                s = i * 10
+            o[:] = ( i, s )
+            o.index_add()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tearDownDb()
+
+    def __count(self, name, lo):
+        return len([ 1 for i in range(0, COUNT)
+                     if (i if name == 'uniform' else
+                         (i % 100 if i % 10 else i * 10)) >= lo ])
+
+    def __reopen(self):
+        self.db.close()
+        self.db.open(self.path)
+        self.__class__.schema = self.db.schema_by_name('plan_test')
+
+    def test_00_choice(self):
+        attr, est = self.schema.plan([ ('uniform', Sos.COND_GE, COUNT - 10),
+                                       ('skewed', Sos.COND_GE, 0) ])
+        self.assertEqual(attr.name(), 'uniform')
+        self.assertTrue(est < COUNT / 10)
+
+    def test_01_estimate_repeat(self):
+        where = [ ('uniform', Sos.COND_GE, COUNT / 2) ]
+        a = self.schema.plan(where)
+        b = self.schema.plan(where)
+        self.assertEqual(a[0].name(), b[0].name())
+        self.assertEqual(a[1], b[1])
+
+    def test_02_analyze(self):
+        # Without a histogram the skewed range is estimated as uniform
+        where = [ ('skewed', Sos.COND_GE, 1000) ]
+        real = self.__count('skewed', 1000)
+        attr, before = self.schema.plan(where)
+        self.schema.attr_by_name('skewed').analyze()
+        attr, after = self.schema.plan(where)
+        self.assertEqual(attr.name(), 'skewed')
+        self.assertTrue(abs(after - real) < abs(before - real))
+
+    def test_03_reopen(self):
+        # The histogram is not persistent; analyze again after reopening
+        where = [ ('skewed', Sos.COND_GE, 1000) ]
+        real = self.__count('skewed', 1000)
+        self.schema.attr_by_name('skewed').analyze()
+        attr, analyzed = self.schema.plan(where)
+        self.__reopen()
+        attr, reopened = self.schema.plan(where)
+        self.assertTrue(abs(analyzed - real) < abs(reopened - real))
+        self.schema.attr_by_name('skewed').analyze()
+        attr, again = self.schema.plan(where)
+        self.assertEqual(again, analyzed)
+
+    def test_04_filter_feedback(self):
+        # Running filters to the end updates the estimates, which must
+        # stay stable and usable
+        attr = self.schema.attr_by_name('uniform')
+        for i in range(0, 4):
+            f = attr.filter()
+            f.add_condition(attr, Sos.COND_GE, COUNT / 2)
+            count = 0
+            o = f.begin()
+            while o:
+                count += 1
+                o = f.next()
+            del f
+            self.assertEqual(count, COUNT / 2)
+        attr, est = self.schema.plan([ ('uniform', Sos.COND_GE, COUNT / 2) ])
+        self.assertEqual(attr.name(), 'uniform')
+        self.assertTrue(est > 0)
+
+if __name__ == "__main__":
+    LOGFMT = '%(asctime)s %(name)s %(levelname)s: %(message)s'
+    logging.basicConfig(format=LOGFMT)
+    logger.setLevel(logging.INFO)
+    unittest.main()
@@ -35,6 +35,22 @@ from key_test import KeyTest
 from timestamp_test import TimestampTest
 from array_test import ArrayTest
 from version_test import VersionTest
+from ncompound_test import NCompoundTest
+from pbxt_test import PbxtTest
+from bxt_test import BxtPostingTest, BxtStatTest
+from filter_batch_test import FilterBatchTest
+from filter_bounds_test import FilterBoundsTest, RangeTest
+from plan_test import PlanTest
+from isect_test import IsectTest
+from agg_test import AggTest
+from join_struct_test import JoinStructTest
+from parallel_test import ParallelTest
+from local_index_test import LocalIndexTest
+from part_roll_test import PartRollTest
+from part_open_test import PartOpenTest, PartRefreshTest
+from part_export_test import PartExportTest, PartAttachTest
+from index_add_test import IndexAddTest
+from part_retain_test import PartRetainTest, PartUnindexTest
 
 tests = [ SchemaTest,
           ObjTestSetGet,
@@ -62,6 +78,27 @@ tests = [ SchemaTest,
           TimestampTest,
           ArrayTest,
           VersionTest,
+          NCompoundTest,
+          PbxtTest,
+          BxtPostingTest,
+          BxtStatTest,
+          FilterBatchTest,
+          FilterBoundsTest,
+          PlanTest,
+          IsectTest,
+          AggTest,
+          JoinStructTest,
+          RangeTest,
+          ParallelTest,
+          LocalIndexTest,
+          PartRollTest,
+          PartOpenTest,
+          PartRefreshTest,
+          PartExportTest,
+          PartAttachTest,
+          IndexAddTest,
+          PartRetainTest,
+          PartUnindexTest,
           QueryTest,
           QueryTest2,
           ]